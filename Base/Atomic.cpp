@@ -17,8 +17,8 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
-#include "Atomic.h"
+#include "Atomic.hpp"
 
-namespace Ziqe {
+ZQ_BEGIN_NAMESPACE
 
-} // namespace Ziqe
+ZQ_END_NAMESPACE
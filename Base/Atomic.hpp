@@ -1,5 +1,5 @@
 /**
- * @file Atomic.h
+ * @file Atomic.hpp
  * @author shrek0 (shrek0.tk@gmail.com)
  *
  * Ziqe: copyright (C) 2016 shrek0
@@ -20,75 +20,117 @@
 #ifndef ZIQE_ATOMIC_H
 #define ZIQE_ATOMIC_H
 
-#include "Mutex.h"
+#include "Base/Macros.hpp"
+#include "Base/Types.hpp"
 
-#include <utility>
+ZQ_BEGIN_NAMESPACE
+namespace Base {
 
-namespace Ziqe {
+/// The orderings of the __atomic builtins.
+enum class MemoryOrder : int {
+    Relaxed                 = __ATOMIC_RELAXED,
+    Acquire                 = __ATOMIC_ACQUIRE,
+    Release                 = __ATOMIC_RELEASE,
+    AcquireRelease          = __ATOMIC_ACQ_REL,
+    SequentiallyConsistent  = __ATOMIC_SEQ_CST,
+};
 
+/**
+ * @brief A value of up to 8 bytes that is read and written atomically.
+ *
+ * A thin wrapper of the __atomic builtins: no locks, so it can be used
+ * from any context. fetchAdd() and the other arithmetic members are
+ * for integers only.
+ */
 template<class T>
 class Atomic
 {
 public:
-    template<class ...Args>
-    Atomic(Args&&... args)
-        : mValue{std::forward<Args>(args)...}
+    static_assert (__is_trivially_copyable (T) && sizeof (T) <= sizeof (uint64_t),
+                   "Atomic values must be trivially copyable and up to 8 bytes");
+
+    Atomic()
+        : mValue{}
     {
     }
 
-    struct GenericAtomicType {
-        GenericAtomicType(T &value, Mutex &mutex)
-            : mValue{value}, mLock{Mutex::Lock{mutex}}
-        {
-        }
-
-        T &get ()
-        {
-            return mValue;
-        }
+    Atomic(T value)
+        : mValue{value}
+    {
+    }
 
-    private:
-        T &mValue;
+    // The value of an atomic can't be copied atomically with its address.
+    ZQ_DISALLOW_COPY_AND_MOVE (Atomic)
 
-        mutable Mutex::Lock mLock;
-    };
+    T load (MemoryOrder order = MemoryOrder::SequentiallyConsistent) const
+    {
+        return __atomic_load_n (&mValue, static_cast<int>(order));
+    }
 
-    struct GenericConstAtomicType {
-        GenericConstAtomicType(const T &value, Mutex &mutex)
-            : mValue{value}, mLock{Mutex::Lock{mutex}}
-        {
-        }
+    void store (T value, MemoryOrder order = MemoryOrder::SequentiallyConsistent)
+    {
+        __atomic_store_n (&mValue, value, static_cast<int>(order));
+    }
 
-        const T &get ()
-        {
-            return mValue;
-        }
+    /// @return The previous value.
+    T exchange (T value, MemoryOrder order = MemoryOrder::SequentiallyConsistent)
+    {
+        return __atomic_exchange_n (&mValue, value, static_cast<int>(order));
+    }
 
-    private:
-        const T &mValue;
+    /**
+     * @brief Replace the value with @a desired if it is @a expected.
+     * @return Whether it was replaced, @a expected is set to the value otherwise.
+     */
+    bool compareExchange (T &expected, T desired,
+                          MemoryOrder order = MemoryOrder::SequentiallyConsistent)
+    {
+        return __atomic_compare_exchange_n (&mValue, &expected, desired, false,
+                                            static_cast<int>(order), FailureOrder (order));
+    }
 
-        mutable Mutex::Lock mLock;
-    };
+    /// @return The previous value.
+    T fetchAdd (T value, MemoryOrder order = MemoryOrder::SequentiallyConsistent)
+    {
+        return __atomic_fetch_add (&mValue, value, static_cast<int>(order));
+    }
 
+    /// @return The previous value.
+    T fetchSub (T value, MemoryOrder order = MemoryOrder::SequentiallyConsistent)
+    {
+        return __atomic_fetch_sub (&mValue, value, static_cast<int>(order));
+    }
 
-    // Undefined beheviour if the return value of lock is get used after
-    // *this gets destroyed.
-    GenericAtomicType lock ()
+    /// @return The previous value.
+    T fetchOr (T value, MemoryOrder order = MemoryOrder::SequentiallyConsistent)
     {
-        return GenericAtomicType{mValue, mMutex};
+        return __atomic_fetch_or (&mValue, value, static_cast<int>(order));
     }
 
-    GenericConstAtomicType lock () const
+    /// @return The previous value.
+    T fetchAnd (T value, MemoryOrder order = MemoryOrder::SequentiallyConsistent)
     {
-        return GenericConstAtomicType{mValue, mMutex};
+        return __atomic_fetch_and (&mValue, value, static_cast<int>(order));
     }
 
 private:
-    T mValue;
+    /// A failed compare and swap doesn't store: no release ordering.
+    static int FailureOrder (MemoryOrder order)
+    {
+        switch (order) {
+        case MemoryOrder::Release:
+            return __ATOMIC_RELAXED;
+        case MemoryOrder::AcquireRelease:
+            return __ATOMIC_ACQUIRE;
+        default:
+            return static_cast<int>(order);
+        }
+    }
 
-    mutable Mutex mMutex;
+    T mValue;
 };
 
-} // namespace Ziqe
+} // namespace Base
+ZQ_END_NAMESPACE
 
 #endif // ZIQE_ATOMIC_H
@@ -0,0 +1,878 @@
+/**
+ * @file BTreeMap.hpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2017 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ZIQE_BTREEMAP_H
+#define ZIQE_BTREEMAP_H
+
+#include "Base/Macros.hpp"
+#include "Base/Types.hpp"
+#include "Base/Checks.hpp"
+#include "Base/Constructor.hpp"
+#include "Base/NodePool.hpp"
+#include "Base/Vector.hpp"
+
+ZQ_BEGIN_NAMESPACE
+namespace Base {
+
+/**
+ * @brief An ordered map, as a B+ tree with nodes sized by cache lines.
+ *
+ * A node starts with its keys: the keys and the node's header fill
+ * kNodeKeysCacheLines cache lines, so a lookup reads a few lines per
+ * level (and there are log(n) / log(kMaxKeys) levels) instead of a random
+ * node per comparison like a binary tree. The values are only in the
+ * leaves, and the leaves are linked for ordered iteration.
+ *
+ * Nodes are never merged: a leaf is freed when its last entry is erased,
+ * and an inner node when its last child is.
+ *
+ * An iterator's operator* is the value and getKey() is the key. Every
+ * insert and erase invalidates the iterators.
+ *
+ * @tparam KeyType Must be default constructible and copyable (an address, an ID).
+ *
+ * @note Not thread safe.
+ */
+template<class KeyType, class T, class IsLess=IsLessThan<KeyType>>
+class BTreeMap
+{
+    struct Node;
+    struct InnerNode;
+    struct LeafNode;
+
+public:
+    static constexpr SizeType kCacheLineSize = 64;
+    static constexpr SizeType kNodeKeysCacheLines = 2;
+
+    /// The keys in a node, an inner node has one more child.
+    static constexpr SizeType kMaxKeys = ((kNodeKeysCacheLines * kCacheLineSize - sizeof (uint32_t)) / sizeof (KeyType) > 8)
+                                         ? (kNodeKeysCacheLines * kCacheLineSize - sizeof (uint32_t)) / sizeof (KeyType)
+                                         : 8;
+
+    static_assert (kMaxKeys <= 0xffff, "A node's count is 16 bits");
+
+    template<class LeafType, class ValueType>
+    struct _Iterator
+    {
+        _Iterator() = default;
+
+        _Iterator(LeafType *leaf, SizeType index)
+            : mLeaf{leaf}, mIndex{index}
+        {
+        }
+
+        // Iterator to ConstIterator.
+        template<class OtherLeafType, class OtherValueType>
+        _Iterator(const _Iterator<OtherLeafType, OtherValueType> &other)
+            : mLeaf{other.mLeaf}, mIndex{other.mIndex}
+        {
+        }
+
+        const KeyType &getKey () const
+        {
+            return mLeaf->keys[mIndex];
+        }
+
+        ValueType &operator * () const
+        {
+            return mLeaf->getValues ()[mIndex];
+        }
+
+        ValueType *operator -> () const
+        {
+            return &**this;
+        }
+
+        _Iterator &operator ++ () {
+            if (++mIndex == mLeaf->count) {
+                mLeaf = mLeaf->next;
+                mIndex = 0;
+            }
+
+            return *this;
+        }
+
+        _Iterator operator ++ (int) {
+            _Iterator copy{*this};
+
+            ++(*this);
+            return copy;
+        }
+
+        bool operator == (const _Iterator &other) const
+        {
+            return mLeaf == other.mLeaf && mIndex == other.mIndex;
+        }
+
+        bool operator != (const _Iterator &other) const
+        {
+            return ! (*this == other);
+        }
+
+    private:
+        friend class BTreeMap;
+
+        template<class, class>
+        friend struct _Iterator;
+
+        LeafType *mLeaf = nullptr;
+        SizeType mIndex = 0;
+    };
+
+    typedef _Iterator<LeafNode, T> Iterator;
+    typedef _Iterator<const LeafNode, const T> ConstIterator;
+
+    BTreeMap() = default;
+
+    ~BTreeMap()
+    {
+        clear ();
+    }
+
+    BTreeMap(const BTreeMap &other)
+    {
+        buildFromSorted (other.begin (), other.size (),
+                         [] (const ConstIterator &iterator) -> const KeyType & { return iterator.getKey (); },
+                         [] (const ConstIterator &iterator) -> const T & { return *iterator; });
+    }
+
+    BTreeMap &operator = (const BTreeMap &other) {
+        if (this != &other) {
+            BTreeMap copy{other};
+
+            swap (copy);
+        }
+
+        return *this;
+    }
+
+    BTreeMap(BTreeMap &&other)
+    {
+        swap (other);
+    }
+
+    BTreeMap &operator = (BTreeMap &&other) {
+        swap (other);
+
+        return *this;
+    }
+
+    /**
+     * @brief Build a map from [@a begin, @a end): Pairs of a key and a value,
+     *        sorted by their keys and without duplicates.
+     *
+     * The leaves are filled one after the other and the inner nodes are
+     * built above them, in O(n) instead of n inserts.
+     */
+    template<class InputIterator>
+    static BTreeMap BuildFromSorted (InputIterator begin, InputIterator end)
+    {
+        BTreeMap map;
+        SizeType count = 0;
+
+        for (auto iterator = begin; iterator != end; ++iterator)
+            ++count;
+
+        map.buildFromSorted (begin, count,
+                             [] (const InputIterator &iterator) -> decltype ((iterator->first)) { return iterator->first; },
+                             [] (const InputIterator &iterator) -> decltype ((iterator->second)) { return iterator->second; });
+
+        return map;
+    }
+
+    ZQ_DEFINE_CONST_AND_NON_CONST (ConstIterator, Iterator, begin, (), {
+        if (mRoot == nullptr)
+            return {};
+
+        return {getFirstLeaf (), 0};
+    })
+
+    ZQ_DEFINE_CONST_AND_NON_CONST (ConstIterator, Iterator, end, (), { return {}; })
+
+    /**
+     * @return The first entry whose key is not less than @a key, or end().
+     */
+    ZQ_DEFINE_CONST_AND_NON_CONST (ConstIterator, Iterator, lowerBound, (const KeyType &key), {
+        if (mRoot == nullptr)
+            return {};
+
+        LeafNode *leaf = findLeaf (key, nullptr);
+        SizeType index = lowerBoundInNode (leaf, key);
+
+        // Every key in the next leaf is not less than the separator that led us here.
+        if (index == leaf->count)
+            return {leaf->next, 0};
+
+        return {leaf, index};
+    })
+
+    ZQ_DEFINE_CONST_AND_NON_CONST (ConstIterator, Iterator, find, (const KeyType &key), {
+        auto iterator = lowerBound (key);
+
+        if (iterator != end () && ! isLess (key, iterator.getKey ()))
+            return iterator;
+
+        return end ();
+    })
+
+    bool isExist (const KeyType &key) const
+    {
+        return find (key) != end ();
+    }
+
+    /**
+     * @brief Try to insert a new entry.
+     * @param args Arguments for @tparam T's constructor.
+     * @return On success, .first=true and .second=the new entry's iterator.
+     *         On failure, .first=false and .second=the iterator of the entry with
+     *         the same key (and @a args are left untouched).
+     */
+    template<class... Args>
+    Pair<bool, Iterator> insert (const KeyType &key,
+                                 Args&&... args)
+    {
+        if (mRoot == nullptr)
+            mRoot = createLeaf ();
+
+        Path path;
+        LeafNode *leaf = findLeaf (key, &path);
+        SizeType index = lowerBoundInNode (leaf, key);
+
+        if (index < leaf->count && ! isLess (key, leaf->keys[index]))
+            return {false, Iterator{leaf, index}};
+
+        LeafNode *right = nullptr;
+
+        if (leaf->count == kMaxKeys) {
+            // An ascending fill (an append to the last leaf) leaves the full leaf as is.
+            SizeType splitIndex = (leaf->next == nullptr && index == leaf->count) ? leaf->count
+                                                                                   : leaf->count / 2;
+
+            right = splitLeaf (leaf, splitIndex);
+            if (index >= splitIndex) {
+                leaf = right;
+                index -= splitIndex;
+            }
+        }
+
+        insertToLeaf (leaf, index, key, Base::forward<Args>(args)...);
+
+        if (right != nullptr)
+            insertToParent (path, right->previous, right->keys[0], right);
+
+        return {true, Iterator{leaf, index}};
+    }
+
+    /**
+     * @brief Insert a new entry or replace the value of the existing one.
+     * @return The entry's iterator.
+     */
+    template<class... Args>
+    Iterator insertOrAssign (const KeyType &key,
+                             Args&&... args)
+    {
+        auto result = insert (key, Base::forward<Args>(args)...);
+
+        if (! result.first)
+            *result.second = T{Base::forward<Args>(args)...};
+
+        return result.second;
+    }
+
+    /**
+     * @brief Erase the entry with @a key.
+     * @return The iterator of the entry after it, or end() if there's
+     *         no such entry.
+     */
+    Iterator erase (const KeyType &key) {
+        if (mRoot == nullptr)
+            return end ();
+
+        Path path;
+        LeafNode *leaf = findLeaf (key, &path);
+        SizeType index = lowerBoundInNode (leaf, key);
+
+        if (index == leaf->count || isLess (key, leaf->keys[index]))
+            return end ();
+
+        return eraseFromLeaf (path, leaf, index, index + 1);
+    }
+
+    /**
+     * @return (++ @a iterator)
+     */
+    Iterator erase (const Iterator &iterator)
+    {
+        return erase (KeyType{iterator.getKey ()});
+    }
+
+    /**
+     * @brief Erase the entries with keys in [@a first, @a last).
+     * @return The first entry whose key is not less than @a last, or end().
+     */
+    Iterator erase (const KeyType &first, const KeyType &last)
+    {
+        return eraseRange (first, &last);
+    }
+
+    /**
+     * @brief Erase [@a begin, @a end).
+     * @return @a end
+     */
+    Iterator erase (const Iterator &begin, const Iterator &end)
+    {
+        if (begin == end)
+            return end;
+
+        if (end == this->end ())
+            return eraseRange (KeyType{begin.getKey ()}, nullptr);
+
+        KeyType last{end.getKey ()};
+        return eraseRange (KeyType{begin.getKey ()}, &last);
+    }
+
+    void clear () {
+        if (mRoot != nullptr)
+            destroySubtree (mRoot);
+
+        mRoot = nullptr;
+        mSize = 0;
+    }
+
+    SizeType size () const
+    {
+        return mSize;
+    }
+
+    SizeType getSize () const
+    {
+        return size ();
+    }
+
+    bool isEmpty () const
+    {
+        return size () == 0;
+    }
+
+    void swap (BTreeMap &other) {
+        Base::swap (mRoot, other.mRoot);
+        Base::swap (mSize, other.mSize);
+        Base::swap (mLeavesPool, other.mLeavesPool);
+        Base::swap (mInnerNodesPool, other.mInnerNodesPool);
+    }
+
+private:
+    // Without merges, a level is added after kMaxKeys / 2 times more inserts at the least.
+    static constexpr SizeType kMaxDepth = 24;
+
+    struct Node
+    {
+        // First: a search reads only the node's first cache lines.
+        KeyType keys[kMaxKeys];
+
+        uint16_t count;
+        bool isLeaf;
+    };
+
+    // The keys of children[i] are in [keys[i-1], keys[i]).
+    struct InnerNode : Node
+    {
+        Node *children[kMaxKeys + 1];
+    };
+
+    struct LeafNode : Node
+    {
+        T *getValues ()
+        {
+            return static_cast<T*>(static_cast<void*>(valuesStorage));
+        }
+
+        const T *getValues () const
+        {
+            return static_cast<const T*>(static_cast<const void*>(valuesStorage));
+        }
+
+        LeafNode *previous;
+        LeafNode *next;
+
+        alignas(T) char valuesStorage[kMaxKeys * sizeof (T)];
+    };
+
+    // The inner nodes from the root to a leaf, and the index of the next node in each.
+    struct Path
+    {
+        void push (InnerNode *node, SizeType index) {
+            ZQ_ASSERT (depth < kMaxDepth);
+
+            steps[depth++] = {node, index};
+        }
+
+        Pair<InnerNode *, SizeType> steps[kMaxDepth];
+        SizeType depth = 0;
+    };
+
+    bool isLess (const KeyType &one, const KeyType &other) const
+    {
+        return IsLess{} (one, other);
+    }
+
+    SizeType lowerBoundInNode (const Node *node, const KeyType &key) const
+    {
+        SizeType first = 0, last = node->count;
+
+        while (first < last) {
+            SizeType middle = first + (last - first) / 2;
+
+            if (isLess (node->keys[middle], key))
+                first = middle + 1;
+            else
+                last = middle;
+        }
+
+        return first;
+    }
+
+    SizeType upperBoundInNode (const Node *node, const KeyType &key) const
+    {
+        SizeType first = 0, last = node->count;
+
+        while (first < last) {
+            SizeType middle = first + (last - first) / 2;
+
+            if (isLess (key, node->keys[middle]))
+                last = middle;
+            else
+                first = middle + 1;
+        }
+
+        return first;
+    }
+
+    /// The leaf @a key belongs to, and the way there in @a path (if not nullptr).
+    LeafNode *findLeaf (const KeyType &key, Path *path) const
+    {
+        Node *node = mRoot;
+
+        if (path != nullptr)
+            path->depth = 0;
+
+        while (! node->isLeaf) {
+            InnerNode *inner = static_cast<InnerNode *>(node);
+            SizeType index = upperBoundInNode (inner, key);
+
+            if (path != nullptr)
+                path->push (inner, index);
+
+            node = inner->children[index];
+        }
+
+        return static_cast<LeafNode *>(node);
+    }
+
+    LeafNode *getFirstLeaf () const
+    {
+        Node *node = mRoot;
+
+        while (! node->isLeaf)
+            node = static_cast<InnerNode *>(node)->children[0];
+
+        return static_cast<LeafNode *>(node);
+    }
+
+    LeafNode *createLeaf () {
+        LeafNode *leaf = ::new(static_cast<void*>(mLeavesPool.allocate ())) LeafNode;
+
+        leaf->count = 0;
+        leaf->isLeaf = true;
+        leaf->previous = nullptr;
+        leaf->next = nullptr;
+
+        return leaf;
+    }
+
+    InnerNode *createInnerNode () {
+        InnerNode *node = ::new(static_cast<void*>(mInnerNodesPool.allocate ())) InnerNode;
+
+        node->count = 0;
+        node->isLeaf = false;
+
+        return node;
+    }
+
+    void destroyLeaf (LeafNode *leaf) {
+        leaf->~LeafNode ();
+        mLeavesPool.deallocate (leaf);
+    }
+
+    void destroyInnerNode (InnerNode *node) {
+        node->~InnerNode ();
+        mInnerNodesPool.deallocate (node);
+    }
+
+    void destroySubtree (Node *node) {
+        if (node->isLeaf) {
+            LeafNode *leaf = static_cast<LeafNode *>(node);
+
+            Constructor<T>{}.destruct (leaf->getValues (), leaf->count);
+            destroyLeaf (leaf);
+            return;
+        }
+
+        InnerNode *inner = static_cast<InnerNode *>(node);
+        for (SizeType i = 0; i <= inner->count; ++i)
+            destroySubtree (inner->children[i]);
+
+        destroyInnerNode (inner);
+    }
+
+    /// Move @a n values from @a source to @a destination, the ranges may overlap.
+    static void moveValues (T *destination, T *source, SizeType n) {
+        if (n == 0 || destination == source)
+            return;
+
+        if (IsTriviallyRelocatable<T>::value) {
+            __builtin_memmove (static_cast<void *>(destination),
+                               static_cast<const void *>(source),
+                               n * sizeof (T));
+            return;
+        }
+
+        Constructor<T> constructor;
+
+        if (destination < source) {
+            for (SizeType i = 0; i < n; ++i) {
+                constructor.construct (&destination[i], Base::move (source[i]));
+                constructor.destruct (&source[i]);
+            }
+        } else {
+            for (SizeType i = n; i > 0; --i) {
+                constructor.construct (&destination[i - 1], Base::move (source[i - 1]));
+                constructor.destruct (&source[i - 1]);
+            }
+        }
+    }
+
+    template<class... Args>
+    void insertToLeaf (LeafNode *leaf, SizeType index, const KeyType &key, Args&&... args) {
+        ZQ_ASSERT (leaf->count < kMaxKeys);
+
+        for (SizeType i = leaf->count; i > index; --i)
+            leaf->keys[i] = leaf->keys[i - 1];
+
+        moveValues (leaf->getValues () + index + 1, leaf->getValues () + index, leaf->count - index);
+
+        leaf->keys[index] = key;
+        Constructor<T>{}.construct (leaf->getValues () + index, Base::forward<Args>(args)...);
+
+        ++leaf->count;
+        ++mSize;
+    }
+
+    /// Move the entries from @a splitIndex to a new leaf after @a leaf.
+    LeafNode *splitLeaf (LeafNode *leaf, SizeType splitIndex) {
+        LeafNode *right = createLeaf ();
+        SizeType movedCount = leaf->count - splitIndex;
+
+        for (SizeType i = 0; i < movedCount; ++i)
+            right->keys[i] = leaf->keys[splitIndex + i];
+
+        Constructor<T>{}.relocate (right->getValues (), leaf->getValues () + splitIndex, movedCount);
+
+        right->count = static_cast<uint16_t>(movedCount);
+        leaf->count = static_cast<uint16_t>(splitIndex);
+
+        right->previous = leaf;
+        right->next = leaf->next;
+        if (leaf->next != nullptr)
+            leaf->next->previous = right;
+        leaf->next = right;
+
+        return right;
+    }
+
+    /// Add @a right after its sibling children[@a index] with @a key as their separator.
+    static void insertToInnerNode (InnerNode *node, SizeType index, const KeyType &key, Node *right) {
+        ZQ_ASSERT (node->count < kMaxKeys);
+
+        for (SizeType i = node->count; i > index; --i) {
+            node->keys[i] = node->keys[i - 1];
+            node->children[i + 1] = node->children[i];
+        }
+
+        node->keys[index] = key;
+        node->children[index + 1] = right;
+        ++node->count;
+    }
+
+    /**
+     * @brief Add @a right, that was split from @a left, to @a left 's parent
+     *        (the last node in @a path), and split the parents up to the
+     *        root as needed.
+     */
+    void insertToParent (Path &path, Node *left, KeyType key, Node *right) {
+        while (path.depth > 0) {
+            auto step = path.steps[--path.depth];
+            InnerNode *parent = step.first;
+            SizeType index = step.second;
+
+            if (parent->count < kMaxKeys) {
+                insertToInnerNode (parent, index, key, right);
+                return;
+            }
+
+            // The middle key moves up, the keys and children after it to a new sibling.
+            SizeType middle = parent->count / 2;
+            InnerNode *sibling = createInnerNode ();
+            KeyType separator{parent->keys[middle]};
+
+            sibling->count = static_cast<uint16_t>(parent->count - middle - 1);
+            for (SizeType i = 0; i < sibling->count; ++i)
+                sibling->keys[i] = parent->keys[middle + 1 + i];
+
+            for (SizeType i = 0; i <= sibling->count; ++i)
+                sibling->children[i] = parent->children[middle + 1 + i];
+
+            parent->count = static_cast<uint16_t>(middle);
+
+            if (index <= middle)
+                insertToInnerNode (parent, index, key, right);
+            else
+                insertToInnerNode (sibling, index - middle - 1, key, right);
+
+            left = parent;
+            right = sibling;
+            key = separator;
+        }
+
+        // The root has been split.
+        InnerNode *root = createInnerNode ();
+
+        root->keys[0] = key;
+        root->children[0] = left;
+        root->children[1] = right;
+        root->count = 1;
+
+        mRoot = root;
+    }
+
+    /// Erase [@a begin, @a end) from @a leaf (that @a path leads to).
+    Iterator eraseFromLeaf (Path &path, LeafNode *leaf, SizeType begin, SizeType end) {
+        SizeType erasedCount = end - begin;
+
+        Constructor<T>{}.destruct (leaf->getValues () + begin, erasedCount);
+
+        for (SizeType i = end; i < leaf->count; ++i)
+            leaf->keys[i - erasedCount] = leaf->keys[i];
+
+        moveValues (leaf->getValues () + begin, leaf->getValues () + end, leaf->count - end);
+
+        leaf->count = static_cast<uint16_t>(leaf->count - erasedCount);
+        mSize -= erasedCount;
+
+        if (begin < leaf->count)
+            return {leaf, begin};
+
+        LeafNode *next = leaf->next;
+
+        if (leaf->count == 0)
+            removeEmptyLeaf (path, leaf);
+
+        return {next, 0};
+    }
+
+    void removeEmptyLeaf (Path &path, LeafNode *leaf) {
+        if (leaf->previous != nullptr)
+            leaf->previous->next = leaf->next;
+        if (leaf->next != nullptr)
+            leaf->next->previous = leaf->previous;
+
+        destroyLeaf (leaf);
+
+        while (path.depth > 0) {
+            auto step = path.steps[--path.depth];
+            InnerNode *parent = step.first;
+            SizeType index = step.second;
+
+            // That was its only child.
+            if (parent->count == 0) {
+                destroyInnerNode (parent);
+                continue;
+            }
+
+            // children[index] 's keys join its left sibling, or its right one if it's the first.
+            SizeType keyIndex = (index > 0) ? index - 1 : 0;
+
+            for (SizeType i = keyIndex + 1; i < parent->count; ++i)
+                parent->keys[i - 1] = parent->keys[i];
+
+            for (SizeType i = index + 1; i <= parent->count; ++i)
+                parent->children[i - 1] = parent->children[i];
+
+            --parent->count;
+
+            // Remove roots with a single child.
+            while (! mRoot->isLeaf && mRoot->count == 0) {
+                InnerNode *root = static_cast<InnerNode *>(mRoot);
+
+                mRoot = root->children[0];
+                destroyInnerNode (root);
+            }
+
+            return;
+        }
+
+        mRoot = nullptr;
+    }
+
+    /// Erase the keys from @a first up to @a last, or to the end if @a last is nullptr.
+    Iterator eraseRange (const KeyType &first, const KeyType *last) {
+        if (mRoot == nullptr)
+            return end ();
+
+        Path path;
+        LeafNode *leaf = findLeaf (first, &path);
+        SizeType index = lowerBoundInNode (leaf, first);
+
+        if (index == leaf->count) {
+            leaf = leaf->next;
+            index = 0;
+
+            if (leaf != nullptr)
+                findLeaf (leaf->keys[0], &path);
+        }
+
+        while (leaf != nullptr) {
+            SizeType end = (last == nullptr) ? leaf->count : lowerBoundInNode (leaf, *last);
+
+            if (end <= index)
+                return {leaf, index};
+
+            bool isLastLeaf = (end < leaf->count);
+            LeafNode *next = leaf->next;
+            Iterator afterErased = eraseFromLeaf (path, leaf, index, end);
+
+            if (isLastLeaf || next == nullptr)
+                return afterErased;
+
+            leaf = next;
+            index = 0;
+            findLeaf (leaf->keys[0], &path);
+        }
+
+        return end ();
+    }
+
+    /**
+     * @brief Replace this map's entries with @a count entries from @a iterator,
+     *        sorted by their keys.
+     *
+     * Fills every leaf and inner node evenly, from the bottom up.
+     */
+    template<class InputIterator, class KeyFunction, class ValueFunction>
+    void buildFromSorted (InputIterator iterator, SizeType count, KeyFunction getKey, ValueFunction getValue) {
+        clear ();
+
+        if (count == 0)
+            return;
+
+        Vector<Node *> level;
+        Vector<KeyType> firstKeys;
+
+        level.resize ((count + kMaxKeys - 1) / kMaxKeys);
+        firstKeys.resize (level.size ());
+        LeafNode *previous = nullptr;
+
+        for (SizeType i = 0; i < level.size (); ++i) {
+            LeafNode *leaf = createLeaf ();
+            SizeType leafCount = count / level.size () + (i < count % level.size () ? 1 : 0);
+
+            for (SizeType j = 0; j < leafCount; ++j, ++iterator) {
+                leaf->keys[j] = getKey (iterator);
+                ZQ_ASSERT ((i == 0 && j == 0) || isLess ((j == 0 ? previous->keys[previous->count - 1] : leaf->keys[j - 1]),
+                                                         leaf->keys[j]));
+
+                Constructor<T>{}.construct (leaf->getValues () + j, getValue (iterator));
+                leaf->count = static_cast<uint16_t>(j + 1);
+            }
+
+            leaf->previous = previous;
+            if (previous != nullptr)
+                previous->next = leaf;
+
+            level[i] = leaf;
+            firstKeys[i] = leaf->keys[0];
+            previous = leaf;
+        }
+
+        while (level.size () > 1) {
+            SizeType parentsCount = (level.size () + kMaxKeys) / (kMaxKeys + 1);
+            Vector<Node *> parents;
+            Vector<KeyType> parentsFirstKeys;
+
+            parents.resize (parentsCount);
+            parentsFirstKeys.resize (parentsCount);
+            SizeType child = 0;
+
+            for (SizeType i = 0; i < parentsCount; ++i) {
+                InnerNode *parent = createInnerNode ();
+                SizeType childrenCount = level.size () / parentsCount + (i < level.size () % parentsCount ? 1 : 0);
+
+                parentsFirstKeys[i] = firstKeys[child];
+                parent->children[0] = level[child++];
+
+                for (SizeType j = 1; j < childrenCount; ++j) {
+                    parent->keys[j - 1] = firstKeys[child];
+                    parent->children[j] = level[child++];
+                }
+
+                parent->count = static_cast<uint16_t>(childrenCount - 1);
+                parents[i] = parent;
+            }
+
+            level = Base::move (parents);
+            firstKeys = Base::move (parentsFirstKeys);
+        }
+
+        mRoot = level[0];
+        mSize = count;
+    }
+
+    Node *mRoot = nullptr;
+    SizeType mSize = 0;
+
+    NodePool<LeafNode> mLeavesPool;
+    NodePool<InnerNode> mInnerNodesPool;
+};
+
+template<class KeyType, class T, class IsLess>
+constexpr SizeType BTreeMap<KeyType, T, IsLess>::kCacheLineSize;
+
+template<class KeyType, class T, class IsLess>
+constexpr SizeType BTreeMap<KeyType, T, IsLess>::kNodeKeysCacheLines;
+
+template<class KeyType, class T, class IsLess>
+constexpr SizeType BTreeMap<KeyType, T, IsLess>::kMaxKeys;
+
+template<class KeyType, class T, class IsLess>
+constexpr SizeType BTreeMap<KeyType, T, IsLess>::kMaxDepth;
+
+} // namespace Base
+ZQ_END_NAMESPACE
+
+#endif // ZIQE_BTREEMAP_H
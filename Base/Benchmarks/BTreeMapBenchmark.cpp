@@ -0,0 +1,141 @@
+/**
+ * @file BTreeMapBenchmark
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2016 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Base/BTreeMap.hpp"
+#include "Base/Vector.hpp"
+#include "Base/Logger.hpp"
+#include "CppCore/Metrics.h"
+#include "PerDriver/EntryPoints.hpp"
+
+/*
+ * BTreeMap against a sorted Vector with a binary search, the index that
+ * MemoryRevision used (RedBlackTree isn't complete enough to compare).
+ * Keys are shuffled page addresses, the results are logged in nanoseconds
+ * per operation.
+ */
+
+namespace {
+
+typedef uint64_t Address;
+
+constexpr Address kPageSize = 4096;
+
+// A full period LCG over [0, n) for a power of 2 n: every page once, shuffled.
+Address shuffledPage (Address index, Address n)
+{
+    return ((index * 6364136223846793005ULL + 1442695040888963407ULL) & (n - 1)) * kPageSize;
+}
+
+Ziqe::SizeType binarySearchLowerBound (const Ziqe::Base::Vector<Address> &sorted, Address key)
+{
+    Ziqe::SizeType first = 0, last = sorted.size ();
+
+    while (first < last) {
+        Ziqe::SizeType middle = first + (last - first) / 2;
+
+        if (sorted[middle] < key)
+            first = middle + 1;
+        else
+            last = middle;
+    }
+
+    return first;
+}
+
+void benchmark (Address n)
+{
+    using Ziqe::Base::BTreeMap;
+    using Ziqe::Base::Vector;
+
+    BTreeMap<Address, Address> map;
+    Vector<Address> sorted;
+    uint64_t start, mapNs, sortedNs;
+    Address found = 0;
+
+    start = ZQ_SYMBOL(ZqMetricsTimestamp) ();
+    for (Address i = 0; i < n; ++i)
+        map.insert (shuffledPage (i, n), i);
+    mapNs = ZQ_SYMBOL(ZqMetricsTimestamp) () - start;
+
+    ZQ_LOG_INFO ("%llu keys, insert: BTreeMap %llu ns", n, mapNs / n);
+
+    sorted.resize (n);
+    for (Address i = 0; i < n; ++i)
+        sorted[i] = i * kPageSize;
+
+    // Look the keys up in another order.
+    start = ZQ_SYMBOL(ZqMetricsTimestamp) ();
+    for (Address i = 0; i < n; ++i)
+        found += *map.find (shuffledPage (n - 1 - i, n));
+    mapNs = ZQ_SYMBOL(ZqMetricsTimestamp) () - start;
+
+    start = ZQ_SYMBOL(ZqMetricsTimestamp) ();
+    for (Address i = 0; i < n; ++i)
+        found += binarySearchLowerBound (sorted, shuffledPage (n - 1 - i, n));
+    sortedNs = ZQ_SYMBOL(ZqMetricsTimestamp) () - start;
+
+    ZQ_LOG_INFO ("%llu keys, find: BTreeMap %llu ns, sorted Vector %llu ns",
+                 n, mapNs / n, sortedNs / n);
+
+    // An address inside a page finds the next page.
+    start = ZQ_SYMBOL(ZqMetricsTimestamp) ();
+    for (Address i = 0; i < n; ++i) {
+        auto iterator = map.lowerBound (shuffledPage (i, n) + 1);
+
+        if (iterator != map.end ())
+            found += iterator.getKey ();
+    }
+    mapNs = ZQ_SYMBOL(ZqMetricsTimestamp) () - start;
+
+    start = ZQ_SYMBOL(ZqMetricsTimestamp) ();
+    for (Address i = 0; i < n; ++i)
+        found += binarySearchLowerBound (sorted, shuffledPage (i, n) + 1);
+    sortedNs = ZQ_SYMBOL(ZqMetricsTimestamp) () - start;
+
+    ZQ_LOG_INFO ("%llu keys, lower bound: BTreeMap %llu ns, sorted Vector %llu ns",
+                 n, mapNs / n, sortedNs / n);
+
+    Vector<Ziqe::Base::Pair<Address, Address>> pairs;
+    pairs.resize (n);
+    for (Address i = 0; i < n; ++i)
+        pairs[i] = {sorted[i], i};
+
+    start = ZQ_SYMBOL(ZqMetricsTimestamp) ();
+    auto built = BTreeMap<Address, Address>::BuildFromSorted (pairs.begin (), pairs.end ());
+    mapNs = ZQ_SYMBOL(ZqMetricsTimestamp) () - start;
+
+    ZQ_LOG_INFO ("%llu keys, build from sorted: %llu ns (%llu)",
+                 n, mapNs / n, found + built.size ());
+}
+
+} // namespace
+
+ZQ_BEGIN_C_DECL void ZQ_PER_DRIVER_UNIQUE_SYMBOL(ZqOnLoad) (Ziqe::Base::RawPointer<Ziqe::OS::DriverContext>)
+{
+    // 10^4 to 10^7 keys, as powers of 2.
+    for (Address n = 1 << 13; n <= (1 << 23); n <<= 2)
+        benchmark (n);
+}
+
+void ZQ_PER_DRIVER_UNIQUE_SYMBOL(ZqOnUnload) (Ziqe::Base::RawPointer<Ziqe::OS::DriverContext>)
+{
+}
+
+ZQ_END_C_DECL
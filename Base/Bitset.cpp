@@ -0,0 +1,194 @@
+/**
+ * @file Bitset.cpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2017 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "Bitset.hpp"
+
+ZQ_BEGIN_NAMESPACE
+namespace Base {
+namespace Bits {
+
+namespace {
+
+constexpr Word kAllSet = ~Word{0};
+
+/// The bits from @a index (of its word) and up.
+inline Word MaskFrom (SizeType index)
+{
+    return kAllSet << (index % kBitsPerWord);
+}
+
+/// The bits below @a index (of its word), all of them if it starts a word.
+inline Word MaskBelow (SizeType index)
+{
+    return (index % kBitsPerWord == 0) ? kAllSet : (Word{1} << (index % kBitsPerWord)) - 1;
+}
+
+/**
+ * @brief Find the first bit in [@a first, @a last) whose value is not
+ *        (@a skipped & 1): @a skipped is 0 to find a set bit, kAllSet to
+ *        find a clear one.
+ */
+SizeType FindNext (const Word *words, SizeType first, SizeType last, Word skipped)
+{
+    if (first >= last)
+        return last;
+
+    auto index = first / kBitsPerWord;
+    auto wordsEnd = GetWordsCount (last);
+    auto word = (words[index] ^ skipped) & MaskFrom (first);
+
+    while (word == 0) {
+        ++index;
+
+        // Skip kWordsPerStep words at a time while there is nothing to find.
+        while (index + kWordsPerStep <= wordsEnd
+               && ((words[index] ^ skipped) | (words[index + 1] ^ skipped)
+                   | (words[index + 2] ^ skipped) | (words[index + 3] ^ skipped)) == 0)
+            index += kWordsPerStep;
+
+        if (index >= wordsEnd)
+            return last;
+
+        word = words[index] ^ skipped;
+    }
+
+    auto found = index * kBitsPerWord + static_cast<SizeType>(__builtin_ctzll (word));
+
+    return (found < last) ? found : last;
+}
+
+} // namespace
+
+SizeType FindNextSet(const Word *words, SizeType first, SizeType last)
+{
+    return FindNext (words, first, last, 0);
+}
+
+SizeType FindNextClear(const Word *words, SizeType first, SizeType last)
+{
+    return FindNext (words, first, last, kAllSet);
+}
+
+SizeType CountRange(const Word *words, SizeType first, SizeType last)
+{
+    if (first >= last)
+        return 0;
+
+    auto firstWord = first / kBitsPerWord;
+    auto lastWord = (last - 1) / kBitsPerWord;
+
+    if (firstWord == lastWord)
+        return static_cast<SizeType>(__builtin_popcountll (words[firstWord] & MaskFrom (first) & MaskBelow (last)));
+
+    SizeType count = static_cast<SizeType>(__builtin_popcountll (words[firstWord] & MaskFrom (first)))
+                     + static_cast<SizeType>(__builtin_popcountll (words[lastWord] & MaskBelow (last)));
+
+    // Independent sums, so the popcounts don't wait for each other.
+    SizeType counts[kWordsPerStep] = {};
+    auto index = firstWord + 1;
+
+    for (; index + kWordsPerStep <= lastWord; index += kWordsPerStep) {
+        for (SizeType i = 0; i < kWordsPerStep; ++i)
+            counts[i] += static_cast<SizeType>(__builtin_popcountll (words[index + i]));
+    }
+
+    for (; index < lastWord; ++index)
+        count += static_cast<SizeType>(__builtin_popcountll (words[index]));
+
+    for (auto stepCount : counts)
+        count += stepCount;
+
+    return count;
+}
+
+void SetRange(Word *words, SizeType first, SizeType last)
+{
+    if (first >= last)
+        return;
+
+    auto firstWord = first / kBitsPerWord;
+    auto lastWord = (last - 1) / kBitsPerWord;
+
+    if (firstWord == lastWord) {
+        words[firstWord] |= MaskFrom (first) & MaskBelow (last);
+        return;
+    }
+
+    words[firstWord] |= MaskFrom (first);
+
+    for (auto index = firstWord + 1; index < lastWord; ++index)
+        words[index] = kAllSet;
+
+    words[lastWord] |= MaskBelow (last);
+}
+
+void ResetRange(Word *words, SizeType first, SizeType last)
+{
+    if (first >= last)
+        return;
+
+    auto firstWord = first / kBitsPerWord;
+    auto lastWord = (last - 1) / kBitsPerWord;
+
+    if (firstWord == lastWord) {
+        words[firstWord] &= ~(MaskFrom (first) & MaskBelow (last));
+        return;
+    }
+
+    words[firstWord] &= ~MaskFrom (first);
+
+    for (auto index = firstWord + 1; index < lastWord; ++index)
+        words[index] = 0;
+
+    words[lastWord] &= ~MaskBelow (last);
+}
+
+} // namespace Bits
+
+BitVector::BitVector(SizeType size)
+    : mWords{}, mSize{0}
+{
+    resize (size);
+}
+
+void BitVector::resize(SizeType newSize)
+{
+    // The bits after mSize are clear already.
+    mWords.resize (Bits::GetWordsCount (newSize), Word{0});
+
+    if (newSize < mSize && newSize % Bits::kBitsPerWord != 0)
+        mWords[newSize / Bits::kBitsPerWord] &= (Word{1} << (newSize % Bits::kBitsPerWord)) - 1;
+
+    mSize = newSize;
+}
+
+void BitVector::clear()
+{
+    for (auto &word : mWords)
+        word = 0;
+}
+
+void BitVector::swap(BitVector &other)
+{
+    mWords.swap (other.mWords);
+    Base::swap (mSize, other.mSize);
+}
+
+} // namespace Base
+ZQ_END_NAMESPACE
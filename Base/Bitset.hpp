@@ -0,0 +1,397 @@
+/**
+ * @file Bitset.hpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2017 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ZIQE_BITSET_H
+#define ZIQE_BITSET_H
+
+#include "Base/Macros.hpp"
+#include "Base/Types.hpp"
+#include "Base/Checks.hpp"
+#include "Base/Vector.hpp"
+
+ZQ_BEGIN_NAMESPACE
+namespace Base {
+
+/**
+ * @brief Operations on bitmaps of words, bit i is (words[i / kBitsPerWord] >> (i % kBitsPerWord)) & 1.
+ *
+ * Ranges are [@a first, @a last). The scans skip kWordsPerStep words at
+ * a time while they are all zero, so finding the next set bit in a sparse
+ * bitmap costs about a load per word (a 1 GiB region's dirty bitmap is
+ * 4096 words).
+ */
+namespace Bits {
+
+typedef uint64_t Word;
+
+static constexpr SizeType kBitsPerWord = sizeof (Word) * 8;
+static constexpr SizeType kWordsPerStep = 4;
+
+constexpr SizeType GetWordsCount (SizeType bitsCount)
+{
+    return (bitsCount + kBitsPerWord - 1) / kBitsPerWord;
+}
+
+inline bool Test (const Word *words, SizeType index)
+{
+    return (words[index / kBitsPerWord] >> (index % kBitsPerWord)) & 1;
+}
+
+inline void Set (Word *words, SizeType index)
+{
+    words[index / kBitsPerWord] |= Word{1} << (index % kBitsPerWord);
+}
+
+inline void Reset (Word *words, SizeType index)
+{
+    words[index / kBitsPerWord] &= ~(Word{1} << (index % kBitsPerWord));
+}
+
+/// @return The first set bit in [@a first, @a last), or @a last if there is none.
+SizeType FindNextSet (const Word *words, SizeType first, SizeType last);
+
+/// @return The first clear bit in [@a first, @a last), or @a last if there is none.
+SizeType FindNextClear (const Word *words, SizeType first, SizeType last);
+
+/// @return The number of set bits in [@a first, @a last).
+SizeType CountRange (const Word *words, SizeType first, SizeType last);
+
+void SetRange (Word *words, SizeType first, SizeType last);
+void ResetRange (Word *words, SizeType first, SizeType last);
+
+/**
+ * @brief Set a bit atomically (other bits of its word may be changed concurrently).
+ * @return Whether it was set before.
+ */
+inline bool AtomicTestAndSet (Word *words, SizeType index)
+{
+    Word bit = Word{1} << (index % kBitsPerWord);
+
+    return (__atomic_fetch_or (&words[index / kBitsPerWord], bit, __ATOMIC_ACQ_REL) & bit) != 0;
+}
+
+/**
+ * @brief Clear a bit atomically.
+ * @return Whether it was set.
+ */
+inline bool AtomicTestAndClear (Word *words, SizeType index)
+{
+    Word bit = Word{1} << (index % kBitsPerWord);
+
+    return (__atomic_fetch_and (&words[index / kBitsPerWord], ~bit, __ATOMIC_ACQ_REL) & bit) != 0;
+}
+
+inline bool AtomicTest (const Word *words, SizeType index)
+{
+    return (__atomic_load_n (&words[index / kBitsPerWord], __ATOMIC_ACQUIRE) >> (index % kBitsPerWord)) & 1;
+}
+
+} // namespace Bits
+
+/**
+ * @brief A fixed size set of @a kBits bits.
+ *
+ * The bits are stored in place, in Bits::Word words (getWords() can be
+ * sent or stored as is). The atomic members may run concurrently with each
+ * other, the rest are not thread safe.
+ */
+template<SizeType kBits>
+class Bitset
+{
+public:
+    typedef Bits::Word Word;
+
+    static_assert (kBits > 0, "An empty Bitset");
+
+    static constexpr SizeType kWords = Bits::GetWordsCount (kBits);
+
+    Bitset()
+        : mWords{}
+    {
+    }
+
+    ZQ_ALLOW_COPY_AND_MOVE (Bitset)
+
+    SizeType size () const
+    {
+        return kBits;
+    }
+
+    bool test (SizeType index) const
+    {
+        ZQ_ASSERT (index < kBits);
+        return Bits::Test (mWords, index);
+    }
+
+    void set (SizeType index)
+    {
+        ZQ_ASSERT (index < kBits);
+        Bits::Set (mWords, index);
+    }
+
+    void reset (SizeType index)
+    {
+        ZQ_ASSERT (index < kBits);
+        Bits::Reset (mWords, index);
+    }
+
+    void setRange (SizeType first, SizeType last)
+    {
+        ZQ_ASSERT (first <= last && last <= kBits);
+        Bits::SetRange (mWords, first, last);
+    }
+
+    void resetRange (SizeType first, SizeType last)
+    {
+        ZQ_ASSERT (first <= last && last <= kBits);
+        Bits::ResetRange (mWords, first, last);
+    }
+
+    /// Clear all the bits.
+    void clear ()
+    {
+        for (auto &word : mWords)
+            word = 0;
+    }
+
+    bool atomicTestAndSet (SizeType index)
+    {
+        ZQ_ASSERT (index < kBits);
+        return Bits::AtomicTestAndSet (mWords, index);
+    }
+
+    bool atomicTestAndClear (SizeType index)
+    {
+        ZQ_ASSERT (index < kBits);
+        return Bits::AtomicTestAndClear (mWords, index);
+    }
+
+    bool atomicTest (SizeType index) const
+    {
+        ZQ_ASSERT (index < kBits);
+        return Bits::AtomicTest (mWords, index);
+    }
+
+    /// @return The first set bit from @a first, or size() if there is none.
+    SizeType findNextSet (SizeType first = 0) const
+    {
+        return (first < kBits) ? Bits::FindNextSet (mWords, first, kBits) : kBits;
+    }
+
+    /// @return The first clear bit from @a first, or size() if there is none.
+    SizeType findNextClear (SizeType first = 0) const
+    {
+        return (first < kBits) ? Bits::FindNextClear (mWords, first, kBits) : kBits;
+    }
+
+    SizeType count () const
+    {
+        return Bits::CountRange (mWords, 0, kBits);
+    }
+
+    SizeType countRange (SizeType first, SizeType last) const
+    {
+        ZQ_ASSERT (first <= last && last <= kBits);
+        return Bits::CountRange (mWords, first, last);
+    }
+
+    bool isEmpty () const
+    {
+        return findNextSet () == kBits;
+    }
+
+    /// Call @a function (index) for every set bit, in ascending order.
+    template<class Function>
+    void forEachSet (Function function) const {
+        for (auto i = findNextSet (); i < kBits; i = findNextSet (i + 1))
+            function (i);
+    }
+
+    Bitset &operator |= (const Bitset &other) {
+        for (SizeType i = 0; i < kWords; ++i)
+            mWords[i] |= other.mWords[i];
+
+        return *this;
+    }
+
+    Bitset &operator &= (const Bitset &other) {
+        for (SizeType i = 0; i < kWords; ++i)
+            mWords[i] &= other.mWords[i];
+
+        return *this;
+    }
+
+    bool operator == (const Bitset &other) const
+    {
+        for (SizeType i = 0; i < kWords; ++i) {
+            if (mWords[i] != other.mWords[i])
+                return false;
+        }
+
+        return true;
+    }
+
+    bool operator != (const Bitset &other) const
+    {
+        return ! (*this == other);
+    }
+
+    /// The bits after size() in the last word are always clear.
+    ZQ_DEFINE_CONST_AND_NON_CONST (const Word *, Word *, getWords, (), {
+        return mWords;
+    })
+
+private:
+    Word mWords[kWords];
+};
+
+template<SizeType kBits>
+constexpr SizeType Bitset<kBits>::kWords;
+
+/**
+ * @brief A set of bits sized at runtime, e.g. a bit per page of a region.
+ *
+ * Like Bitset, except that it is stored in a Vector and can be resized.
+ * resize() is not thread safe.
+ */
+class BitVector
+{
+public:
+    typedef Bits::Word Word;
+
+    /// @a size clear bits.
+    explicit BitVector(SizeType size = 0);
+
+    ZQ_ALLOW_COPY_AND_MOVE (BitVector)
+
+    SizeType size () const
+    {
+        return mSize;
+    }
+
+    /// The new bits are clear.
+    void resize (SizeType newSize);
+
+    bool test (SizeType index) const
+    {
+        ZQ_ASSERT (index < mSize);
+        return Bits::Test (mWords.data (), index);
+    }
+
+    void set (SizeType index)
+    {
+        ZQ_ASSERT (index < mSize);
+        Bits::Set (mWords.data (), index);
+    }
+
+    void reset (SizeType index)
+    {
+        ZQ_ASSERT (index < mSize);
+        Bits::Reset (mWords.data (), index);
+    }
+
+    void setRange (SizeType first, SizeType last)
+    {
+        ZQ_ASSERT (first <= last && last <= mSize);
+        Bits::SetRange (mWords.data (), first, last);
+    }
+
+    void resetRange (SizeType first, SizeType last)
+    {
+        ZQ_ASSERT (first <= last && last <= mSize);
+        Bits::ResetRange (mWords.data (), first, last);
+    }
+
+    /// Clear all the bits (the size is kept).
+    void clear ();
+
+    bool atomicTestAndSet (SizeType index)
+    {
+        ZQ_ASSERT (index < mSize);
+        return Bits::AtomicTestAndSet (mWords.data (), index);
+    }
+
+    bool atomicTestAndClear (SizeType index)
+    {
+        ZQ_ASSERT (index < mSize);
+        return Bits::AtomicTestAndClear (mWords.data (), index);
+    }
+
+    bool atomicTest (SizeType index) const
+    {
+        ZQ_ASSERT (index < mSize);
+        return Bits::AtomicTest (mWords.data (), index);
+    }
+
+    /// @return The first set bit from @a first, or size() if there is none.
+    SizeType findNextSet (SizeType first = 0) const
+    {
+        return (first < mSize) ? Bits::FindNextSet (mWords.data (), first, mSize) : mSize;
+    }
+
+    /// @return The first clear bit from @a first, or size() if there is none.
+    SizeType findNextClear (SizeType first = 0) const
+    {
+        return (first < mSize) ? Bits::FindNextClear (mWords.data (), first, mSize) : mSize;
+    }
+
+    SizeType count () const
+    {
+        return Bits::CountRange (mWords.data (), 0, mSize);
+    }
+
+    SizeType countRange (SizeType first, SizeType last) const
+    {
+        ZQ_ASSERT (first <= last && last <= mSize);
+        return Bits::CountRange (mWords.data (), first, last);
+    }
+
+    bool isEmpty () const
+    {
+        return findNextSet () == mSize;
+    }
+
+    /// Call @a function (index) for every set bit, in ascending order.
+    template<class Function>
+    void forEachSet (Function function) const {
+        for (auto i = findNextSet (); i < mSize; i = findNextSet (i + 1))
+            function (i);
+    }
+
+    /// The bits after size() in the last word are always clear.
+    ZQ_DEFINE_CONST_AND_NON_CONST (const Word *, Word *, getWords, (), {
+        return mWords.data ();
+    })
+
+    SizeType getWordsCount () const
+    {
+        return mWords.size ();
+    }
+
+    void swap (BitVector &other);
+
+private:
+    Vector<Word> mWords;
+    SizeType mSize;
+};
+
+} // namespace Base
+ZQ_END_NAMESPACE
+
+#endif // ZIQE_BITSET_H
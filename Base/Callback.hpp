@@ -23,191 +23,384 @@
 #include "Macros.hpp"
 #include "Checks.hpp"
 
+#include "Base/Constructor.hpp"
 #include "Base/SharedPointer.hpp"
 #include "Base/UniquePointer.hpp"
 
 ZQ_BEGIN_NAMESPACE
 namespace Base {
+namespace Internal {
 
-template <typename F>
-class Callback;
+/// Targets up to this size are stored inside the callback, larger ones are allocated.
+constexpr SizeType kCallbackInlineSize = 3 * sizeof (void*);
 
-template <typename ReturnType_, typename... ArgsTypes>
-class Callback<ReturnType_(ArgsTypes...)>
+template<class Target>
+inline_hint constexpr bool IsCallbackTargetInline ()
 {
-public:
-    typedef ReturnType_ ReturnType;
-    typedef ReturnType FunctionType(ArgsTypes...);
+    return sizeof (Target) <= kCallbackInlineSize && alignof (Target) <= alignof (void*);
+}
 
-private:
-    /// @brief Get a pointer to member function type for ClassName.
-    template<typename ClassType>
-    using ClassMemeberFunctionType=ReturnType (ClassType::*)(ArgsTypes...);
+/// A target is valid unless it has an overload of its own (found by ADL).
+template<class Target>
+inline_hint bool IsCallbackTargetValid (const Target &)
+{
+    return true;
+}
 
-    struct ObjectManagerInterface
-    {
-        virtual ReturnType invoke(ArgsTypes&&... args) = 0;
+/**
+ * @brief What a callback does with its target, besides invoking it.
+ */
+struct CallbackOperations
+{
+    /// Move the target from @a from to the uninitialized @a to, and destruct @a from.
+    void (*move) (void *to, void *from);
 
-        virtual bool isValid() const{ return true; }
+    /// Copy the target to the uninitialized @a to. nullptr for a move only target.
+    void (*copy) (void *to, const void *from);
 
-        virtual ~ObjectManagerInterface() = 0;
-    };
+    void (*destruct) (void *storage);
 
-    template<FunctionType *sFunction>
-    struct RegularFunctionObjectManager final : public ObjectManagerInterface
+    bool (*isValid) (const void *storage);
+};
+
+template<class Target, bool sIsInline=IsCallbackTargetInline<Target> ()>
+struct CallbackTargetStorage;
+
+/// The target lives in the callback's storage.
+template<class Target>
+struct CallbackTargetStorage<Target, true>
+{
+    static Target *Get (void *storage)
     {
-        RegularFunctionObjectManager() = default;
+        return static_cast<Target*>(storage);
+    }
 
-        ZQ_ALLOW_MOVE (RegularFunctionObjectManager)
-        ZQ_DISALLOW_COPY (RegularFunctionObjectManager)
+    static const Target *Get (const void *storage)
+    {
+        return static_cast<const Target*>(storage);
+    }
 
-        virtual ReturnType invoke(ArgsTypes&&... args) override
-        {
-            return sFunction (Base::forward<ArgsTypes> (args)...);
-        }
+    template<class ...Args>
+    static void Construct (void *storage, Args&&...args)
+    {
+        CustomStorageConstructor<Target, char>{}.construct (static_cast<char*>(storage),
+                                                            Base::forward<Args>(args)...);
+    }
 
-        virtual ~RegularFunctionObjectManager() override = default;
-    };
+    static void Move (void *to, void *from) {
+        Construct (to, Base::move (*Get (from)));
+        Destruct (from);
+    }
 
-    template<typename ClassType, ClassMemeberFunctionType<ClassType> sClassFunction>
-    struct RegularObjectManager final : public ObjectManagerInterface
+    static void Copy (void *to, const void *from)
     {
-        RegularObjectManager(ClassType *classPointer)
-            : mClassPointer{classPointer}
-        {
-        }
+        Construct (to, *Get (from));
+    }
 
-        ZQ_ALLOW_MOVE (RegularObjectManager)
-        ZQ_DISALLOW_COPY (RegularObjectManager)
+    static void Destruct (void *storage)
+    {
+        CustomStorageConstructor<Target, char>{}.destruct (Get (storage));
+    }
+};
 
-        virtual ReturnType invoke(ArgsTypes&&... args) override
-        {
-            return (mClassPointer->*sClassFunction)(Base::forward<ArgsTypes>(args)...);
-        }
+/// The target is allocated, the callback's storage holds a pointer to it.
+template<class Target>
+struct CallbackTargetStorage<Target, false>
+{
+    static Target *Get (void *storage)
+    {
+        return *static_cast<Target**>(storage);
+    }
 
-        virtual bool isValid() const override
-        {
-            return !!mClassPointer;
-        }
+    static const Target *Get (const void *storage)
+    {
+        return *static_cast<Target *const *>(storage);
+    }
 
-        virtual ~RegularObjectManager() override = default;
+    template<class ...Args>
+    static void Construct (void *storage, Args&&...args)
+    {
+        *static_cast<Target**>(storage) = new Target{Base::forward<Args>(args)...};
+    }
 
-    private:
-       /// The object's pointer.
-       ClassType *mClassPointer;
-    };
+    static void Move (void *to, void *from)
+    {
+        *static_cast<Target**>(to) = Get (from);
+    }
 
-    template<typename ClassType, ClassMemeberFunctionType<ClassType> sClassFunction>
-    struct UniqueObjectManager final : public ObjectManagerInterface
+    static void Copy (void *to, const void *from)
     {
-        UniqueObjectManager(UniquePointer<ClassType> &&uniquePointer)
-            : mClassPointer{Base::move(uniquePointer)}
-        {
-        }
+        Construct (to, *Get (from));
+    }
 
-        ZQ_ALLOW_MOVE (UniqueObjectManager)
-        ZQ_DISALLOW_COPY (UniqueObjectManager)
+    static void Destruct (void *storage)
+    {
+        delete Get (storage);
+    }
+};
 
-        virtual ReturnType invoke(ArgsTypes&&... args) override
-        {
-            return (mClassPointer.get()->*sClassFunction)(Base::forward<ArgsTypes>(args)...);
-        }
+template<class Storage, bool sIsCopyable>
+struct CallbackCopyOperation
+{
+    static constexpr void (*kCopy) (void *, const void *) = &Storage::Copy;
+};
 
-        virtual bool isValid() const override
-        {
-            return !!mClassPointer;
-        }
+template<class Storage>
+struct CallbackCopyOperation<Storage, false>
+{
+    static constexpr void (*kCopy) (void *, const void *) = nullptr;
+};
 
-        virtual ~UniqueObjectManager() override = default;
+template<class Target, bool sIsCopyable>
+struct CallbackTargetOperations
+{
+    typedef CallbackTargetStorage<Target> Storage;
 
-    private:
-       /// The object's pointer.
-       UniquePointer<ClassType> mClassPointer;
+    static bool IsValid (const void *storage)
+    {
+        return IsCallbackTargetValid (*Storage::Get (storage));
+    }
+
+    static constexpr CallbackOperations kOperations{
+        &Storage::Move,
+        CallbackCopyOperation<Storage, sIsCopyable>::kCopy,
+        &Storage::Destruct,
+        &IsValid
     };
+};
 
-    template<typename ClassType, ClassMemeberFunctionType<ClassType> sClassFunction>
-    struct SharedObjectManager final : public ObjectManagerInterface
-    {
-        SharedObjectManager(const SharedPointer<ClassType> &sharedPointer)
-            : mClassPointer{sharedPointer}
-        {
-        }
+template<class Target, bool sIsCopyable>
+constexpr CallbackOperations CallbackTargetOperations<Target, sIsCopyable>::kOperations;
 
-        ZQ_ALLOW_MOVE (SharedObjectManager)
-        ZQ_DISALLOW_COPY (SharedObjectManager)
+/**
+ * @brief The storage and the constructors of Callback and MoveOnlyCallback.
+ *
+ * Function pointers, member function bindings and small lambdas are stored
+ * inline (see kCallbackInlineSize), so creating, moving and copying them
+ * doesn't allocate. An invocation is a single indirect call.
+ */
+template<bool sIsCopyable, typename ReturnType, typename... ArgsTypes>
+class CallbackBase
+{
+public:
+    typedef ReturnType FunctionType(ArgsTypes...);
 
-        virtual ReturnType invoke(ArgsTypes&&... args) override
-        {
-            return (mClassPointer.get()->*sClassFunction)(Base::forward<ArgsTypes>(args)...);
-        }
+    /// @brief Get a pointer to member function type for ClassName.
+    template<typename ClassType>
+    using ClassMemeberFunctionType=ReturnType (ClassType::*)(ArgsTypes...);
 
-        virtual bool isValid() const override
-        {
-            return !!mClassPointer;
-        }
+    CallbackBase() = default;
 
-        virtual ~SharedObjectManager() override = default;
+    ~CallbackBase()
+    {
+        reset ();
+    }
 
-    private:
-       /// The object's pointer.
-       SharedPointer<ClassType> mClassPointer;
-    };
+    CallbackBase(CallbackBase &&other)
+    {
+        takeFrom (other);
+    }
 
-    UniquePointer<ObjectManagerInterface> mObjectManager;
-public:
+    CallbackBase &operator = (CallbackBase &&other) {
+        if (this != &other) {
+            reset ();
+            takeFrom (other);
+        }
 
-    ZQ_ALLOW_MOVE (Callback)
-    ZQ_DISALLOW_COPY (Callback)
+        return *this;
+    }
 
-    /// @brief Default constructor.
-    Callback() = default;
+    CallbackBase(const CallbackBase &other)
+    {
+        copyFrom (other);
+    }
+
+    CallbackBase &operator = (const CallbackBase &other) {
+        if (this != &other) {
+            reset ();
+            copyFrom (other);
+        }
+
+        return *this;
+    }
 
     /// Initilize from a regular function.
     template<FunctionType* sFunction>
-    Callback(StaticVariable<FunctionType*, sFunction>)
-        : mObjectManager{new RegularFunctionObjectManager <sFunction>}
+    CallbackBase(StaticVariable<FunctionType*, sFunction>)
     {
+        construct<FunctionBinding<sFunction>> ();
     }
 
     /// Initlize from a shared pointer.
     template<class ClassType, ClassMemeberFunctionType<ClassType> sFunction>
-    Callback(StaticVariable<ClassMemeberFunctionType<ClassType>, sFunction>,
-             const SharedPointer<ClassType> &sharedPointer)
-        : mObjectManager{new SharedObjectManager<ClassType, sFunction>(sharedPointer)}
+    CallbackBase(StaticVariable<ClassMemeberFunctionType<ClassType>, sFunction>,
+                 const SharedPointer<ClassType> &sharedPointer)
     {
+        construct<MemberFunctionBinding<SharedPointer<ClassType>, ClassType, sFunction>> (sharedPointer);
     }
 
-    /// Initlize from a unique pointer.
+    /// Initlize from a unique pointer (MoveOnlyCallback only).
     template<class ClassType, ClassMemeberFunctionType<ClassType> sFunction>
-    Callback(StaticVariable<ClassMemeberFunctionType<ClassType>, sFunction>,
-             UniquePointer<ClassType> &&uniquePointer)
-        : mObjectManager{new UniqueObjectManager<ClassType, sFunction>(Base::move(uniquePointer))}
+    CallbackBase(StaticVariable<ClassMemeberFunctionType<ClassType>, sFunction>,
+                 UniquePointer<ClassType> &&uniquePointer)
     {
+        construct<MemberFunctionBinding<UniquePointer<ClassType>, ClassType, sFunction>> (Base::move (uniquePointer));
     }
 
     /// Initlize from a regular pointer.
     template<class ClassType, ClassMemeberFunctionType<ClassType> sFunction>
-    Callback(StaticVariable<ClassMemeberFunctionType<ClassType>, sFunction>, ClassType *pointer)
-         : mObjectManager{new RegularObjectManager<ClassType, sFunction>(pointer)}
+    CallbackBase(StaticVariable<ClassMemeberFunctionType<ClassType>, sFunction>, ClassType *pointer)
     {
+        construct<MemberFunctionBinding<ClassType*, ClassType, sFunction>> (pointer);
     }
 
-    /// Initilize from an object manager.
-    Callback (UniquePointer<ObjectManagerInterface> &&objectManager)
-        : mObjectManager{Base::move(objectManager)}
+    /// Initilize from any other callable: a function pointer, a lambda.
+    template<class Functor,
+             class = EnableIf<! __is_base_of(CallbackBase, Functor)>>
+    CallbackBase(Functor functor)
     {
+        construct<Functor> (Base::move (functor));
     }
 
-    ReturnType operator() (ArgsTypes&&... args) {
-        ZQ_ASSERT (mObjectManager->isValid());
+    ReturnType operator() (ArgsTypes... args) {
+        ZQ_ASSERT (static_cast<bool>(*this));
 
-        return mObjectManager->invoke (Base::forward<ArgsTypes>(args)...);
+        return mInvoke (mStorage, Base::forward<ArgsTypes>(args)...);
     }
 
-    operator bool ()
+    operator bool () const
     {
-        return (mObjectManager && mObjectManager->isValid());
+        return (mInvoke && mOperations->isValid (mStorage));
+    }
+
+private:
+    template<FunctionType *sFunction>
+    struct FunctionBinding
+    {
+        ReturnType operator() (ArgsTypes&&... args)
+        {
+            return sFunction (Base::forward<ArgsTypes> (args)...);
+        }
+    };
+
+    template<class PointerType, class ClassType, ClassMemeberFunctionType<ClassType> sClassFunction>
+    struct MemberFunctionBinding
+    {
+        ReturnType operator() (ArgsTypes&&... args)
+        {
+            return ((*mClassPointer).*sClassFunction)(Base::forward<ArgsTypes>(args)...);
+        }
+
+        friend bool IsCallbackTargetValid (const MemberFunctionBinding &binding)
+        {
+            return !!binding.mClassPointer;
+        }
+
+        /// The object's pointer.
+        PointerType mClassPointer;
+    };
+
+    template<class Target>
+    static ReturnType Invoke (void *storage, ArgsTypes&&... args)
+    {
+        return (*CallbackTargetStorage<Target>::Get (storage))(Base::forward<ArgsTypes>(args)...);
+    }
+
+    template<class Target, class ...Args>
+    void construct (Args&&...args) {
+        CallbackTargetStorage<Target>::Construct (mStorage, Base::forward<Args>(args)...);
+
+        mInvoke = &Invoke<Target>;
+        mOperations = &CallbackTargetOperations<Target, sIsCopyable>::kOperations;
+    }
+
+    void takeFrom (CallbackBase &other) {
+        if (! other.mInvoke)
+            return;
+
+        other.mOperations->move (mStorage, other.mStorage);
+
+        mInvoke = other.mInvoke;
+        mOperations = other.mOperations;
+
+        other.mInvoke = nullptr;
+        other.mOperations = nullptr;
     }
+
+    void copyFrom (const CallbackBase &other) {
+        if (! other.mInvoke)
+            return;
+
+        ZQ_ASSERT (other.mOperations->copy != nullptr);
+        other.mOperations->copy (mStorage, other.mStorage);
+
+        mInvoke = other.mInvoke;
+        mOperations = other.mOperations;
+    }
+
+    void reset () {
+        if (! mInvoke)
+            return;
+
+        mOperations->destruct (mStorage);
+
+        mInvoke = nullptr;
+        mOperations = nullptr;
+    }
+
+    ReturnType (*mInvoke) (void *storage, ArgsTypes&&... args) = nullptr;
+    const CallbackOperations *mOperations = nullptr;
+
+    alignas(void*) char mStorage[kCallbackInlineSize];
+};
+
+} // namespace Internal
+
+template <typename F>
+class Callback;
+
+/**
+ * @brief A copyable callback: a function, a member function of an object
+ *        (by a pointer or a SharedPointer), or a copyable lambda.
+ */
+template <typename ReturnType_, typename... ArgsTypes>
+class Callback<ReturnType_(ArgsTypes...)> : public Internal::CallbackBase<true, ReturnType_, ArgsTypes...>
+{
+    typedef Internal::CallbackBase<true, ReturnType_, ArgsTypes...> CallbackBaseType;
+
+public:
+    typedef ReturnType_ ReturnType;
+
+    using CallbackBaseType::CallbackBaseType;
+
+    ZQ_ALLOW_COPY_AND_MOVE (Callback)
+
+    /// @brief Default constructor.
+    Callback() = default;
+};
+
+template <typename F>
+class MoveOnlyCallback;
+
+/**
+ * @brief Like Callback, but can also own its target: a member function of
+ *        an object in a UniquePointer, or a move only lambda.
+ */
+template <typename ReturnType_, typename... ArgsTypes>
+class MoveOnlyCallback<ReturnType_(ArgsTypes...)> : public Internal::CallbackBase<false, ReturnType_, ArgsTypes...>
+{
+    typedef Internal::CallbackBase<false, ReturnType_, ArgsTypes...> CallbackBaseType;
+
+public:
+    typedef ReturnType_ ReturnType;
+
+    using CallbackBaseType::CallbackBaseType;
+
+    ZQ_ALLOW_MOVE (MoveOnlyCallback)
+    ZQ_DISALLOW_COPY (MoveOnlyCallback)
+
+    /// @brief Default constructor.
+    MoveOnlyCallback() = default;
 };
 
 } // namespace Base
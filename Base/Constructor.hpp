@@ -61,6 +61,23 @@ struct CustomStorageConstructor {
     {
         pointer->~T();
     }
+
+    /// Move @a n elements from @a source to the uninitialized @a destination
+    /// and destruct them in @a source. A memcpy for trivially relocatable types.
+    void relocate(T *destination, T *source, SizeType n) {
+        if (IsTriviallyRelocatable<T>::value) {
+            if (n != 0)
+                __builtin_memcpy (static_cast<void *>(destination),
+                                  static_cast<const void *>(source),
+                                  n * sizeof (T));
+            return;
+        }
+
+        for (SizeType i = 0; i < n; ++i)
+            ::new(static_cast<void*>(&destination[i])) T{Base::move (source[i])};
+
+        destruct (source, n);
+    }
 };
 
 /**
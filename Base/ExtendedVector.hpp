@@ -142,23 +142,18 @@ public:
     }
 
     void expand (SizeType howMuch) {
-        auto newSize = size() + howMuch;
         auto currentUnderlyingVectorSize = getVector ().size();
 
         // If the underlying vector has more element at the end,
-        // "expand" the vector to them.
-        if (mIndexEnd != currentUnderlyingVectorSize) {
-            auto sizeVaildableForVirtualExpand = (currentUnderlyingVectorSize - mIndexEnd);
-            auto virtualExpandSize = min (howMuch, sizeVaildableForVirtualExpand);
-
-            newSize -= virtualExpandSize;
-            mIndexEnd = sizeVaildableForVirtualExpand-virtualExpandSize;
-        }
+        // "expand" the vector to them first.
+        auto sizeVaildableForVirtualExpand = (currentUnderlyingVectorSize - mIndexEnd);
 
         // If we need to expand more elements, do it.
-        if (newSize > 0) {
-            getVector ().expand (howMuch);
+        if (howMuch > sizeVaildableForVirtualExpand) {
+            getVector ().expand (howMuch - sizeVaildableForVirtualExpand);
         }
+
+        mIndexEnd += howMuch;
     }
 
     typedef typename VectorType::Iterator Iterator;
@@ -130,7 +130,22 @@ public:
         elements.resize (numberOfElements);
 
         for (typename Base::Vector<T>::SizeType i = 0; i < numberOfElements; ++i) {
-            elements[i] = readT ();
+            elements[i] = readT<T, sByteLength> ();
+        }
+
+        return elements;
+    }
+
+    /// Like readTVector, but into another vector type (e.g. SmallVector).
+    template <class VectorType>
+    VectorType readTVectorAs (SizeType numberOfElements) {
+        typedef typename VectorType::ElementType T;
+
+        VectorType elements;
+        elements.resize (numberOfElements);
+
+        for (SizeType i = 0; i < numberOfElements; ++i) {
+            elements[i] = readT<T> ();
         }
 
         return elements;
@@ -143,7 +158,7 @@ public:
     template<class T>
     Base::Expected<T, ReadError> tryReadT () {
         if (! canReadT<T> ())
-            return {ReadError::NoEnoguhLength};
+            return Base::Error (ReadError::NoEnoguhLength);
 
         return {readT<T>()};
     }
@@ -151,11 +166,19 @@ public:
     template<class T>
     Base::Expected<Base::Vector<T>, ReadError> tryReadTVector (SizeType numberOfElements) {
         if (! canReadVectorT<T>(numberOfElements))
-            return {ReadError::NoEnoguhLength};
+            return Base::Error (ReadError::NoEnoguhLength);
 
         return {readTVector<T>(numberOfElements)};
     }
 
+    template<class VectorType>
+    Base::Expected<VectorType, ReadError> tryReadTVectorAs (SizeType numberOfElements) {
+        if (! canReadVectorT<typename VectorType::ElementType>(numberOfElements))
+            return Base::Error (ReadError::NoEnoguhLength);
+
+        return {readTVectorAs<VectorType>(numberOfElements)};
+    }
+
     void skipBytes (SizeType length)
     {
         getVector ().increaseBegin (length);
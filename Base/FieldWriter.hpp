@@ -21,6 +21,7 @@
 #define ZIQE_FIELDWRITER_H
 
 #include "Base/ExtendedVector.hpp"
+#include "Base/SmallVector.hpp"
 
 ZQ_BEGIN_NAMESPACE
 namespace Base {
@@ -121,6 +122,13 @@ public:
         return (v.size () * sizeof (T)) + mySizeOfArgs (args...);
     }
 
+    template<class T, SizeType N, class ...Args>
+    static SizeType mySizeOfArgs (const SmallVector<T, N> &v,
+                                  const Args &...args)
+    {
+        return (v.size () * sizeof (T)) + mySizeOfArgs (args...);
+    }
+
     template<class T, class A, class B, class ...Args>
     static SizeType mySizeOfArgs (const ExtendedVector<T,A,B> &v,
                                   const Args &...args)
@@ -188,6 +196,13 @@ private:
         }
     }
 
+    template<class T, SizeType N>
+    void writeOneT (const SmallVector<T, N> &vector) {
+        for (auto &element : vector) {
+            writeOneT (element);
+        }
+    }
+
     template<class T, class A, class B>
     void writeOneT (const ExtendedVector<T, A, B> &vector) {
         for (auto &element : vector) {
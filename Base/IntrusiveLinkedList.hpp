@@ -0,0 +1,285 @@
+/**
+ * @file IntrusiveLinkedList.hpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2017 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ZIQE_INTRUSIVELINKEDLIST_H
+#define ZIQE_INTRUSIVELINKEDLIST_H
+
+#include "Base/Macros.hpp"
+#include "Base/Types.hpp"
+#include "Base/Checks.hpp"
+
+ZQ_BEGIN_NAMESPACE
+namespace Base {
+
+/**
+ * @brief The links of an object in an IntrusiveLinkedList, a member of the object.
+ */
+struct IntrusiveListHook
+{
+    IntrusiveListHook() = default;
+
+    // A copy of an object isn't in its list.
+    IntrusiveListHook(const IntrusiveListHook &)
+    {
+    }
+
+    IntrusiveListHook &operator = (const IntrusiveListHook &)
+    {
+        return *this;
+    }
+
+    bool isLinked () const
+    {
+        return mIsLinked;
+    }
+
+private:
+    template<class T, IntrusiveListHook T::*sHook>
+    friend class IntrusiveLinkedList;
+
+    IntrusiveListHook *mPrevious = nullptr;
+    IntrusiveListHook *mNext = nullptr;
+
+    bool mIsLinked = false;
+};
+
+/**
+ * @brief A doubly linked list of objects that hold their own links
+ *        (an IntrusiveListHook member, @tparam sHook).
+ *
+ * The list doesn't own, allocate or copy its objects: linking and unlinking
+ * never allocate. An object must be erased before it is destructed, and can
+ * be in one list per hook member.
+ *
+ * @note Not thread safe.
+ */
+template<class T, IntrusiveListHook T::*sHook>
+class IntrusiveLinkedList
+{
+public:
+    template<class ObjectType>
+    struct _Iterator
+    {
+        _Iterator() = default;
+
+        explicit _Iterator(IntrusiveListHook *current)
+            : mCurrent{current}
+        {
+        }
+
+        _Iterator &operator++ () {
+            mCurrent = mCurrent->mNext;
+
+            return *this;
+        }
+
+        _Iterator &operator-- () {
+            mCurrent = mCurrent->mPrevious;
+
+            return *this;
+        }
+
+        ObjectType &operator* () const{
+            ZQ_ASSERT (mCurrent != nullptr);
+
+            return *GetObject (mCurrent);
+        }
+
+        ObjectType *operator-> () const{
+            ZQ_ASSERT (mCurrent != nullptr);
+
+            return GetObject (mCurrent);
+        }
+
+        ZQ_DEFINE_EQUAL_AND_NOT_EQUAL_BY_MEMBER(_Iterator, mCurrent)
+
+    private:
+        friend class IntrusiveLinkedList;
+
+        IntrusiveListHook *mCurrent = nullptr;
+    };
+
+    typedef _Iterator<T> Iterator;
+    typedef _Iterator<const T> ConstIterator;
+
+    IntrusiveLinkedList() = default;
+
+    IntrusiveLinkedList(IntrusiveLinkedList &&other)
+    {
+        swap (other);
+    }
+
+    IntrusiveLinkedList &operator = (IntrusiveLinkedList &&other) {
+        swap (other);
+
+        return *this;
+    }
+
+    ZQ_DISALLOW_COPY (IntrusiveLinkedList)
+
+    ~IntrusiveLinkedList()
+    {
+        clear ();
+    }
+
+    /**
+     * @brief Link @a object before @a where.
+     */
+    Iterator insert (const Iterator &where, T &object) {
+        IntrusiveListHook *hook = &(object.*sHook);
+        ZQ_ASSERT (! hook->isLinked ());
+
+        IntrusiveListHook *next = where.mCurrent;
+        IntrusiveListHook *previous = (next == nullptr) ? mLast : next->mPrevious;
+
+        hook->mPrevious = previous;
+        hook->mNext = next;
+        hook->mIsLinked = true;
+
+        if (previous != nullptr)
+            previous->mNext = hook;
+        else
+            mFirst = hook;
+
+        if (next != nullptr)
+            next->mPrevious = hook;
+        else
+            mLast = hook;
+
+        ++mSize;
+
+        return Iterator{hook};
+    }
+
+    void pushBack (T &object)
+    {
+        insert (end (), object);
+    }
+
+    void pushFront (T &object)
+    {
+        insert (begin (), object);
+    }
+
+    /**
+     * @brief Unlink @a object from the list.
+     * @return An iterator to the object after it.
+     */
+    Iterator erase (T &object) {
+        IntrusiveListHook *hook = &(object.*sHook);
+        ZQ_ASSERT (hook->isLinked ());
+
+        if (hook->mPrevious != nullptr)
+            hook->mPrevious->mNext = hook->mNext;
+        else
+            mFirst = hook->mNext;
+
+        if (hook->mNext != nullptr)
+            hook->mNext->mPrevious = hook->mPrevious;
+        else
+            mLast = hook->mPrevious;
+
+        Iterator next{hook->mNext};
+
+        hook->mPrevious = hook->mNext = nullptr;
+        hook->mIsLinked = false;
+        --mSize;
+
+        return next;
+    }
+
+    Iterator erase (const Iterator &iterator)
+    {
+        return erase (*iterator);
+    }
+
+    /**
+     * @brief Unlink all the objects.
+     */
+    void clear () {
+        while (mFirst != nullptr)
+            erase (*GetObject (mFirst));
+    }
+
+    T &front ()
+    {
+        return *GetObject (mFirst);
+    }
+
+    T &back ()
+    {
+        return *GetObject (mLast);
+    }
+
+    Iterator begin ()
+    {
+        return Iterator{mFirst};
+    }
+
+    Iterator end ()
+    {
+        return Iterator{};
+    }
+
+    ConstIterator begin () const
+    {
+        return ConstIterator{mFirst};
+    }
+
+    ConstIterator end () const
+    {
+        return ConstIterator{};
+    }
+
+    SizeType size () const
+    {
+        return mSize;
+    }
+
+    bool isEmpty () const
+    {
+        return mFirst == nullptr;
+    }
+
+    void swap (IntrusiveLinkedList &other) {
+        Base::swap (mFirst, other.mFirst);
+        Base::swap (mLast, other.mLast);
+        Base::swap (mSize, other.mSize);
+    }
+
+private:
+    // The object that contains @a hook (container_of).
+    static T *GetObject (IntrusiveListHook *hook) {
+        // Any well aligned address would do, it's never dereferenced.
+        T *object = reinterpret_cast<T*>(alignof (T));
+        auto offset = reinterpret_cast<char*>(&(object->*sHook)) - reinterpret_cast<char*>(object);
+
+        return reinterpret_cast<T*>(reinterpret_cast<char*>(hook) - offset);
+    }
+
+    IntrusiveListHook *mFirst = nullptr;
+    IntrusiveListHook *mLast = nullptr;
+
+    SizeType mSize = 0;
+};
+
+} // namespace Base
+ZQ_END_NAMESPACE
+
+#endif // ZIQE_INTRUSIVELINKEDLIST_H
@@ -24,11 +24,20 @@
 #include "Base/Checks.hpp"
 #include "Base/Macros.hpp"
 #include "Base/Types.hpp"
+#include "Base/Constructor.hpp"
+#include "Base/NodePool.hpp"
 
 ZQ_BEGIN_NAMESPACE
 namespace Base {
 
-template <class T>
+/**
+ * @brief A doubly linked list.
+ *
+ * The nodes are allocated by @tparam NodeAllocator: by default from the list's
+ * own NodePool, so inserting and erasing don't hit the global allocator.
+ * Use IntrusiveLinkedList to link objects that are allocated elsewhere.
+ */
+template <class T, template<class> class NodeAllocator=NodePool>
 class LinkedList
 {
 public:
@@ -160,6 +169,7 @@ public:
     }
 
     LinkedList (LinkedList &&other)
+        : LinkedList()
     {
         swap(other);
     }
@@ -213,9 +223,9 @@ public:
 
         NodeType *newNode;
 
-        newNode = new NodeType{where.mCurrent->previous,
-                               where.mCurrent,
-                               Base::forward<Args>(args)...};
+        newNode = createNode (where.mCurrent->previous,
+                              where.mCurrent,
+                              Base::forward<Args>(args)...);
         auto previous = where.mCurrent->previous;
         if (previous)
             previous->next = newNode;
@@ -237,16 +247,16 @@ public:
         NodeType *newNode;
 
         if (where == cend ()) {
-            newNode = new NodeType{nullptr,
-                                   nullptr,
-                                   Base::forward<Args>(args)...};
+            newNode = createNode (nullptr,
+                                  nullptr,
+                                  Base::forward<Args>(args)...);
 
             // mBegin must be cend().
             mBegin = Iterator{newNode};
         } else {
-            newNode = new NodeType{where.mCurrent,
-                                   where.mCurrent->next,
-                                   Base::forward<Args>(args)...};
+            newNode = createNode (where.mCurrent,
+                                  where.mCurrent->next,
+                                  Base::forward<Args>(args)...);
             auto next = where.mCurrent->next;
             if (next)
                 next->previous = newNode;
@@ -296,7 +306,7 @@ public:
 
             ++iterator;
             --mSize;
-            delete currentCopy;
+            destroyNode (currentCopy);
 
         } while (iterator != end);
 
@@ -320,7 +330,7 @@ public:
         if (iterator.mCurrent->previous)
             iterator.mCurrent->previous->next = iterator.mCurrent->next;
 
-        delete iterator.mCurrent;
+        destroyNode (iterator.mCurrent);
         --mSize;
 
         if (iterator == cbegin ())
@@ -354,6 +364,9 @@ public:
         mBegin       = begin;
         mBeforeEnd   = beforeEnd;
         mSize        = size;
+
+        // The nodes belong to the allocator.
+        Base::swap (mNodeAllocator, other.mNodeAllocator);
     }
 
     SizeType size() const
@@ -463,7 +476,7 @@ private:
              iterator != insertEnd;
              ++iterator, ++mSize)
         {
-            self.mCurrent->next = new NodeType{self.mCurrent, nullptr, *iterator};
+            self.mCurrent->next = createNode (self.mCurrent, nullptr, *iterator);
             ++self;
         }
 
@@ -475,10 +488,24 @@ private:
             mBeforeEnd = self;
     }
 
+    template<class ...Args>
+    NodeType *createNode (Args&&... args)
+    {
+        return Constructor<NodeType>{}.construct (mNodeAllocator.allocate (1),
+                                                  Base::forward<Args>(args)...);
+    }
+
+    void destroyNode (NodeType *node) {
+        Constructor<NodeType>{}.destruct (node);
+        mNodeAllocator.deallocate (node);
+    }
+
     Iterator mBegin;
     Iterator mBeforeEnd;
 
     SizeType mSize;
+
+    NodeAllocator<NodeType> mNodeAllocator;
 };
 
 } // namespace Base
@@ -21,8 +21,17 @@
 #define ZIQE_LOGGER_H
 
 #include "CppCore/Logging.h"
+#include "CppCore/LogBuffer.h"
 #include "Macros.hpp"
 
+/**
+  Records with a level lower than this are compiled out: define it as
+  ZQ_LOG_LEVEL_INFO (or higher) to remove ZQ_LOG_DEBUG from hot paths.
+ */
+#ifndef ZQ_LOG_MINIMUM_LEVEL
+# define ZQ_LOG_MINIMUM_LEVEL ZQ_LOG_LEVEL_DEBUG
+#endif
+
 ZQ_BEGIN_NAMESPACE
 namespace Base {
 
@@ -59,12 +68,56 @@ public:
         ZQ_SYMBOL(ZqLogText) (string);
     }
 
+    /**
+       @brief Write a binary record to the current CPU's log ring.
+       @param location  The calling function (should have a static lifetime).
+       @param format    A printf format (should have a static lifetime).
+       @param args      Up to ZQ_LOG_RECORD_MAX_ARGUMENTS integers or pointers.
+
+       Unlike logMessage, this function doesn't format nor print anything: it is
+       cheap enough for hot paths. Every argument is passed as a 64 bit value,
+       so integers should be formatted with "%ll".
+     */
+    template<ZqLogLevel sLevel, class...Args>
+    static void logRecord (const char *location, const char *format, Args...args)
+    {
+        static_assert (sizeof...(Args) <= ZQ_LOG_RECORD_MAX_ARGUMENTS,
+                       "Too many arguments for a log record");
+
+        if (sLevel < ZQ_LOG_MINIMUM_LEVEL)
+            return;
+
+        uint64_t arguments[ZQ_LOG_RECORD_MAX_ARGUMENTS + 1] = {toLogArgument (args)...};
+
+        ZQ_SYMBOL(ZqLogRecordWrite) (sLevel, location, format,
+                                     arguments[0],
+                                     arguments[1],
+                                     arguments[2],
+                                     arguments[3]);
+    }
+
 private:
     Logger();
 
+    template<class T>
+    static uint64_t toLogArgument (T value)
+    {
+        return static_cast<uint64_t>(value);
+    }
+
+    template<class T>
+    static uint64_t toLogArgument (T *value)
+    {
+        return reinterpret_cast<uintptr_t>(value);
+    }
+
 };
 
-#define ZQ_LOG(msg) ZQ_SGMT_BEGIN ::Ziqe::Base::Logger::logMessage(ZQ_FUNCTION_STR); ::Ziqe::Base::Logger::logMessage (": \"" msg "\"\n"); ZQ_SGMT_END
+#define ZQ_LOG_DEBUG(format, ...) ::Ziqe::Base::Logger::logRecord<ZQ_LOG_LEVEL_DEBUG> (ZQ_FUNCTION_STR, format, ##__VA_ARGS__)
+#define ZQ_LOG_INFO(format, ...) ::Ziqe::Base::Logger::logRecord<ZQ_LOG_LEVEL_INFO> (ZQ_FUNCTION_STR, format, ##__VA_ARGS__)
+
+// msg is an argument and not a part of the format: a '%' in it is printed as is.
+#define ZQ_LOG(msg) ZQ_LOG_INFO ("\"%s\"", msg)
 #define ZQ_WARNING(msg) ZQ_SGMT_BEGIN ::Ziqe::Base::Logger::logMessage(ZQ_FUNCTION_STR); ::Ziqe::Base::Logger::logWarning (": \"" msg "\"\n"); ZQ_SGMT_END
 #define ZQ_ERROR(msg) ZQ_SGMT_BEGIN ::Ziqe::Base::Logger::logMessage(ZQ_FUNCTION_STR); ::Ziqe::Base::Logger::logError (": \"" msg "\"\n"); ZQ_SGMT_END
 
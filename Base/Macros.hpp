@@ -180,6 +180,18 @@ struct IsSame<T, T>
     static constexpr bool value = true;
 };
 
+/**
+  @brief Whether a T can be moved to another address with a memcpy
+         (without calling its move constructor and destructor).
+
+  Trivially copyable types are, specialize it for other types that are.
+ */
+template<class T>
+struct IsTriviallyRelocatable
+{
+    static constexpr bool value = __is_trivially_copyable(T);
+};
+
 template<class...Args>
 struct ParameterPack
 {
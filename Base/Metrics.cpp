@@ -0,0 +1,368 @@
+/**
+ * @file Metrics.cpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2017 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "Metrics.hpp"
+
+ZQ_BEGIN_NAMESPACE
+namespace Base {
+
+#ifndef ZQ_METRICS_DISABLE
+
+namespace {
+
+/**
+   @brief Append text to a fixed buffer, truncating silently.
+ */
+class TextWriter
+{
+public:
+    TextWriter (char *buffer, SizeType size)
+        : mBuffer{buffer}, mSize{size}
+    {
+    }
+
+    TextWriter &operator<< (const char *string)
+    {
+        for (; *string != '\0'; ++string)
+            put (*string);
+
+        return *this;
+    }
+
+    TextWriter &operator<< (uint64_t value)
+    {
+        char digits[20];
+        unsigned count = 0;
+
+        do {
+            digits[count++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+
+        while (count != 0)
+            put (digits[--count]);
+
+        return *this;
+    }
+
+    TextWriter &hex (uint64_t value)
+    {
+        static const char kDigits[] = "0123456789abcdef";
+        char digits[16];
+        unsigned count = 0;
+
+        do {
+            digits[count++] = kDigits[value & 0xf];
+            value >>= 4;
+        } while (value != 0);
+
+        *this << "0x";
+        while (count != 0)
+            put (digits[--count]);
+
+        return *this;
+    }
+
+    SizeType getLength () const
+    {
+        return mLength;
+    }
+
+private:
+    void put (char c)
+    {
+        if (mLength < mSize)
+            mBuffer[mLength++] = c;
+    }
+
+    char *mBuffer;
+    SizeType mSize;
+    SizeType mLength = 0;
+};
+
+} // namespace
+
+Metrics::Metric *Metrics::sMetrics = nullptr;
+
+void Metrics::registerMetric(Metric *metric)
+{
+    bool isRegistered = false;
+
+    // Only the first user registers it.
+    if (! __atomic_compare_exchange_n (&metric->mIsRegistered, &isRegistered, true, false,
+                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        return;
+
+    Metric *head = __atomic_load_n (&sMetrics, __ATOMIC_RELAXED);
+
+    do {
+        metric->mNext = head;
+    } while (! __atomic_compare_exchange_n (&sMetrics, &head, metric, true,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+SizeType Metrics::FormatAll(char *buffer, SizeType size)
+{
+    SizeType length = 0;
+
+    for (const Metric *metric = __atomic_load_n (&sMetrics, __ATOMIC_ACQUIRE);
+         metric != nullptr;
+         metric = metric->mNext)
+    {
+        length += metric->format (buffer + length, size - length);
+    }
+
+    return length;
+}
+
+uint64_t Metrics::Counter::get() const
+{
+    uint64_t value = 0;
+
+    for (const Cell &cell : mCells)
+        value += __atomic_load_n (&cell.value, __ATOMIC_RELAXED);
+
+    return value;
+}
+
+SizeType Metrics::Counter::format(char *buffer, SizeType size) const
+{
+    TextWriter writer{buffer, size};
+
+    writer << getName () << " " << get () << "\n";
+    return writer.getLength ();
+}
+
+unsigned Metrics::Histogram::BucketOf(uint64_t value)
+{
+    if (value < kSubBuckets)
+        return static_cast<unsigned>(value);
+
+    unsigned highestBit = 63 - __builtin_clzll (value);
+    if (highestBit >= kMaxBits)
+        return kBucketsCount - 1;
+
+    unsigned subBucket = (value >> (highestBit - kSubBucketsBits)) & (kSubBuckets - 1);
+
+    return (highestBit - kSubBucketsBits + 1) * kSubBuckets + subBucket;
+}
+
+uint64_t Metrics::Histogram::BucketLowerBound(unsigned bucket)
+{
+    if (bucket < kSubBuckets)
+        return bucket;
+
+    unsigned highestBit = bucket / kSubBuckets + kSubBucketsBits - 1;
+    uint64_t subBucket = bucket % kSubBuckets;
+
+    return (kSubBuckets + subBucket) << (highestBit - kSubBucketsBits);
+}
+
+void Metrics::Histogram::getSnapshot(Snapshot &snapshot) const
+{
+    snapshot = Snapshot{};
+
+    for (const Cell &cell : mCells) {
+        for (unsigned i = 0; i < kBucketsCount; ++i) {
+            uint64_t count = __atomic_load_n (&cell.buckets[i], __ATOMIC_RELAXED);
+
+            snapshot.buckets[i] += count;
+            snapshot.count += count;
+        }
+
+        snapshot.sum += __atomic_load_n (&cell.sum, __ATOMIC_RELAXED);
+        snapshot.max = max (snapshot.max, __atomic_load_n (&cell.max, __ATOMIC_RELAXED));
+    }
+}
+
+uint64_t Metrics::Histogram::Snapshot::getPercentile(unsigned percent) const
+{
+    if (count == 0)
+        return 0;
+
+    // The rank of the percentile, rounded up.
+    uint64_t rank = (count * percent + 99) / 100;
+    uint64_t seen = 0;
+
+    for (unsigned i = 0; i < kBucketsCount; ++i) {
+        seen += buckets[i];
+
+        if (seen >= rank && seen != 0)
+            return BucketLowerBound (i);
+    }
+
+    return BucketLowerBound (kBucketsCount - 1);
+}
+
+SizeType Metrics::Histogram::format(char *buffer, SizeType size) const
+{
+    return format (buffer, size, getName (), nullptr);
+}
+
+SizeType Metrics::Histogram::format(char *buffer,
+                                    SizeType size,
+                                    const char *name,
+                                    const uint64_t *key) const
+{
+    // Too big for a kernel stack.
+    static Snapshot snapshot;
+    TextWriter writer{buffer, size};
+
+    // FormatAll is called by a single reader at a time (see ZqMetricsFormatter).
+    getSnapshot (snapshot);
+
+    writer << name;
+    if (key != nullptr) {
+        writer << "[";
+        writer.hex (*key);
+        writer << "]";
+    }
+
+    const char *suffix = (mUnit == Unit::Nanoseconds) ? "_ns " : " ";
+
+    writer << " count " << snapshot.count
+           << " mean" << suffix << (snapshot.count != 0 ? snapshot.sum / snapshot.count : 0)
+           << " p50" << suffix << snapshot.getPercentile (50)
+           << " p90" << suffix << snapshot.getPercentile (90)
+           << " p99" << suffix << snapshot.getPercentile (99)
+           << " max" << suffix << snapshot.max
+           << "\n";
+
+    return writer.getLength ();
+}
+
+void Metrics::Ranking::publish(uint64_t group, const Row *rows, SizeType count)
+{
+    GroupRow merged[kCapacity];
+    SizeType mergedCount = 0;
+    SizeType next = 0;
+
+    registerOnFirstUse ();
+
+    // Take the table from the other publishers.
+    uint64_t sequence = __atomic_load_n (&mSequence, __ATOMIC_RELAXED);
+    do {
+        while ((sequence & 1) != 0)
+            sequence = __atomic_load_n (&mSequence, __ATOMIC_RELAXED);
+    } while (! __atomic_compare_exchange_n (&mSequence, &sequence, sequence + 1, true,
+                                            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+    __atomic_thread_fence (__ATOMIC_RELEASE);
+
+    // Merge the other groups' rows with the new ones, both are ranked.
+    for (SizeType i = 0; i < mCount && mergedCount < kCapacity; ++i) {
+        if (mRows[i].group == group)
+            continue;
+
+        for (; next < count && mergedCount < kCapacity
+               && rows[next].values[0] > mRows[i].row.values[0]; ++next)
+            merged[mergedCount++] = GroupRow{group, rows[next]};
+
+        if (mergedCount < kCapacity)
+            merged[mergedCount++] = mRows[i];
+    }
+
+    for (; next < count && mergedCount < kCapacity; ++next)
+        merged[mergedCount++] = GroupRow{group, rows[next]};
+
+    for (SizeType i = 0; i < mergedCount; ++i) {
+        __atomic_store_n (&mRows[i].group, merged[i].group, __ATOMIC_RELAXED);
+        __atomic_store_n (&mRows[i].row.key, merged[i].row.key, __ATOMIC_RELAXED);
+
+        for (SizeType column = 0; column < kMaxColumns; ++column)
+            __atomic_store_n (&mRows[i].row.values[column], merged[i].row.values[column], __ATOMIC_RELAXED);
+    }
+
+    __atomic_store_n (&mCount, mergedCount, __ATOMIC_RELAXED);
+    __atomic_store_n (&mSequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+SizeType Metrics::Ranking::format(char *buffer, SizeType size) const
+{
+    GroupRow rows[kCapacity];
+    uint64_t count = 0;
+
+    // Give up after a few tries rather than spinning on a busy publisher.
+    for (unsigned tries = 0; tries < 8; ++tries) {
+        uint64_t sequence = __atomic_load_n (&mSequence, __ATOMIC_ACQUIRE);
+
+        if ((sequence & 1) != 0)
+            continue;
+
+        count = __atomic_load_n (&mCount, __ATOMIC_RELAXED);
+        for (SizeType i = 0; i < count; ++i) {
+            rows[i].group = __atomic_load_n (&mRows[i].group, __ATOMIC_RELAXED);
+            rows[i].row.key = __atomic_load_n (&mRows[i].row.key, __ATOMIC_RELAXED);
+
+            for (SizeType column = 0; column < kMaxColumns; ++column)
+                rows[i].row.values[column] = __atomic_load_n (&mRows[i].row.values[column], __ATOMIC_RELAXED);
+        }
+
+        __atomic_thread_fence (__ATOMIC_ACQUIRE);
+        if (__atomic_load_n (&mSequence, __ATOMIC_RELAXED) == sequence)
+            break;
+
+        count = 0;
+    }
+
+    TextWriter writer{buffer, size};
+
+    for (SizeType i = 0; i < count; ++i) {
+        writer << getName () << "[" << rows[i].group << ":";
+        writer.hex (rows[i].row.key);
+        writer << "]";
+
+        for (SizeType column = 0; column < mColumnsCount && column < kMaxColumns; ++column)
+            writer << " " << mColumns[column] << " " << rows[i].row.values[column];
+
+        writer << "\n";
+    }
+
+    return writer.getLength ();
+}
+
+bool Metrics::StartExport()
+{
+    return ZQ_SYMBOL(ZqMetricsExportStart) (&Metrics::FormatAll) == 0;
+}
+
+void Metrics::StopExport()
+{
+    ZQ_SYMBOL(ZqMetricsExportStop) ();
+}
+
+#else // ZQ_METRICS_DISABLE
+
+bool Metrics::StartExport()
+{
+    return false;
+}
+
+void Metrics::StopExport()
+{
+}
+
+#endif // ZQ_METRICS_DISABLE
+
+Metrics::Metrics()
+{
+
+}
+
+}
+ZQ_END_NAMESPACE
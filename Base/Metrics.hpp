@@ -0,0 +1,473 @@
+/**
+ * @file Metrics.hpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2017 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ZIQE_METRICS_H
+#define ZIQE_METRICS_H
+
+#include "CppCore/Metrics.h"
+
+#include "Macros.hpp"
+#include "Types.hpp"
+
+/**
+  Define ZQ_METRICS_DISABLE to compile every counter, histogram and timer
+  into nothing.
+ */
+
+#ifndef ZQ_METRICS_MAX_CPUS
+/**
+  Every metric has a cell per CPU (up to this number, CPUs above it share cells).
+ */
+# define ZQ_METRICS_MAX_CPUS 16
+#endif
+
+ZQ_BEGIN_NAMESPACE
+namespace Base {
+
+class Metrics
+{
+public:
+#ifndef ZQ_METRICS_DISABLE
+    /**
+       @brief A named metric, registered for the export on its first use.
+
+       The constructors are constexpr, so metrics with a static storage
+       duration are ready without running global constructors (kernel
+       modules built without CONFIG_CONSTRUCTORS don't run them). A metric
+       shows up in the export after its first update.
+
+       Named metrics are never unregistered: they should have a static
+       storage duration (and a static name).
+     */
+    class Metric
+    {
+    public:
+        ZQ_DISALLOW_COPY (Metric)
+
+        const char *getName () const
+        {
+            return mName;
+        }
+
+        /**
+           @brief Append the metric's text representation to @a buffer.
+           @return The number of bytes written.
+         */
+        virtual SizeType format (char *buffer, SizeType size) const = 0;
+
+    protected:
+        /// Unnamed metrics aren't registered (used inside other metrics).
+        constexpr Metric () = default;
+
+        explicit constexpr Metric (const char *name)
+            : mName{name}
+        {
+        }
+
+        ~Metric () = default;
+
+        void registerOnFirstUse ()
+        {
+            if (mName != nullptr && ! __atomic_load_n (&mIsRegistered, __ATOMIC_RELAXED))
+                Metrics::registerMetric (this);
+        }
+
+    private:
+        friend class Metrics;
+
+        const char *mName = nullptr;
+        Metric *mNext = nullptr;
+        bool mIsRegistered = false;
+    };
+
+    /**
+       @brief A per-CPU event counter.
+     */
+    class Counter : public Metric
+    {
+    public:
+        explicit constexpr Counter (const char *name)
+            : Metric{name}
+        {
+        }
+
+        void add (uint64_t value=1)
+        {
+            registerOnFirstUse ();
+
+            // Relaxed and (almost) never contended: each CPU has its own cache line.
+            __atomic_fetch_add (&mCells[currentCell ()].value, value, __ATOMIC_RELAXED);
+        }
+
+        uint64_t get () const;
+
+        SizeType format (char *buffer, SizeType size) const override;
+
+    private:
+        struct alignas(64) Cell {
+            uint64_t value;
+        };
+
+        Cell mCells[ZQ_METRICS_MAX_CPUS] = {};
+    };
+
+    /**
+       @brief A per-CPU log-linear histogram of durations (in nanoseconds),
+              or of counts (Unit::Count).
+
+       Every power of two is split to kSubBuckets linear buckets, so the
+       relative error of a percentile is below 1/kSubBuckets.
+     */
+    class Histogram : public Metric
+    {
+    public:
+        static constexpr unsigned kSubBucketsBits = 2;
+        static constexpr unsigned kSubBuckets = 1 << kSubBucketsBits;
+
+        /// Values above 2^kMaxBits ns (~4.3 seconds) are counted in the last bucket.
+        static constexpr unsigned kMaxBits = 32;
+        static constexpr unsigned kBucketsCount = (kMaxBits - kSubBucketsBits + 1) * kSubBuckets;
+
+        enum class Unit {
+            Nanoseconds,
+            Count,
+        };
+
+        constexpr Histogram () = default;
+        explicit constexpr Histogram (const char *name, Unit unit=Unit::Nanoseconds)
+            : Metric{name}, mUnit{unit}
+        {
+        }
+
+        void record (uint64_t value)
+        {
+            registerOnFirstUse ();
+
+            Cell &cell = mCells[currentCell ()];
+            uint64_t max = __atomic_load_n (&cell.max, __ATOMIC_RELAXED);
+
+            __atomic_fetch_add (&cell.buckets[BucketOf (value)], 1, __ATOMIC_RELAXED);
+            __atomic_fetch_add (&cell.sum, value, __ATOMIC_RELAXED);
+
+            // Rarely taken: the maximum grows less and less often.
+            while (value > max
+                   && ! __atomic_compare_exchange_n (&cell.max, &max, value, true,
+                                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+            }
+        }
+
+        static unsigned BucketOf (uint64_t value);
+
+        /// @return The smallest value that falls in @a bucket.
+        static uint64_t BucketLowerBound (unsigned bucket);
+
+        struct Snapshot {
+            uint64_t buckets[kBucketsCount];
+            uint64_t count;
+            uint64_t sum;
+            uint64_t max;
+
+            /// @return An estimation of the @a percent percentile (0-100).
+            uint64_t getPercentile (unsigned percent) const;
+        };
+
+        void getSnapshot (Snapshot &snapshot) const;
+
+        SizeType format (char *buffer, SizeType size) const override;
+
+        /// Format this histogram under @a name, with an optional @a key.
+        SizeType format (char *buffer, SizeType size,
+                         const char *name, const uint64_t *key) const;
+
+    private:
+        struct alignas(64) Cell {
+            uint64_t buckets[kBucketsCount];
+            uint64_t sum;
+            uint64_t max;
+        };
+
+        Unit mUnit = Unit::Nanoseconds;
+        Cell mCells[ZQ_METRICS_MAX_CPUS] = {};
+    };
+
+    /**
+       @brief Up to @a sCapacity histograms, created on first use of each key
+              (e.g. a Protocol::Message::Type). Lock free.
+     */
+    template<SizeType sCapacity>
+    class KeyedHistograms : public Metric
+    {
+    public:
+        explicit constexpr KeyedHistograms (const char *name)
+            : Metric{name}
+        {
+        }
+
+        /**
+           @return The histogram of @a key, or nullptr when there are already
+                   sCapacity different keys (ScopedTimer accepts nullptr).
+         */
+        Histogram *get (uint64_t key)
+        {
+            registerOnFirstUse ();
+
+            // 0 marks a free slot.
+            uint64_t storedKey = key + 1;
+
+            for (SizeType i = 0; i < sCapacity; ++i) {
+                uint64_t current = __atomic_load_n (&mKeys[i], __ATOMIC_ACQUIRE);
+
+                if (current == 0) {
+                    uint64_t expected = 0;
+
+                    if (__atomic_compare_exchange_n (&mKeys[i], &expected, storedKey, false,
+                                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+                        return &mHistograms[i];
+
+                    // Someone else took this slot, maybe with our key.
+                    current = expected;
+                }
+
+                if (current == storedKey)
+                    return &mHistograms[i];
+            }
+
+            return nullptr;
+        }
+
+        SizeType format (char *buffer, SizeType size) const override
+        {
+            SizeType length = 0;
+
+            for (SizeType i = 0; i < sCapacity; ++i) {
+                uint64_t storedKey = __atomic_load_n (&mKeys[i], __ATOMIC_ACQUIRE);
+
+                if (storedKey == 0)
+                    break;
+
+                uint64_t key = storedKey - 1;
+
+                length += mHistograms[i].format (buffer + length, size - length,
+                                                 getName (), &key);
+            }
+
+            return length;
+        }
+
+    private:
+        uint64_t mKeys[sCapacity] = {};
+        Histogram mHistograms[sCapacity];
+    };
+
+    /**
+       @brief A ranked table of up to kCapacity rows, each with a key and up
+              to kMaxColumns values (e.g. the most contended pages).
+
+       Rows are ranked by their first value. Every publisher has its own
+       group (e.g. a process), and publish() replaces the rows of its group
+       only. Publishers are serialized, and the reader never sees a half
+       published table.
+     */
+    class Ranking : public Metric
+    {
+    public:
+        static constexpr SizeType kCapacity = 16;
+        static constexpr SizeType kMaxColumns = 4;
+
+        struct Row {
+            uint64_t key;
+            uint64_t values[kMaxColumns];
+        };
+
+        /// @a columns are the names of the values, they should be static.
+        constexpr Ranking (const char *name, const char *const *columns, SizeType columnsCount)
+            : Metric{name}, mColumns{columns}, mColumnsCount{columnsCount}
+        {
+        }
+
+        /**
+           @brief Replace the rows of @a group with @a rows, the highest
+                  rank first. The table keeps the kCapacity highest rows
+                  of all the groups.
+         */
+        void publish (uint64_t group, const Row *rows, SizeType count);
+
+        /// Remove the rows of @a group.
+        void withdraw (uint64_t group)
+        {
+            publish (group, nullptr, 0);
+        }
+
+        SizeType format (char *buffer, SizeType size) const override;
+
+    private:
+        struct GroupRow {
+            uint64_t group;
+            Row row;
+        };
+
+        const char *const *mColumns;
+        SizeType mColumnsCount;
+
+        /// Odd while publishing, publishers take it by making it odd.
+        uint64_t mSequence = 0;
+        uint64_t mCount = 0;
+        GroupRow mRows[kCapacity] = {};
+    };
+
+    /**
+       @brief Record the lifetime of this object into a histogram.
+     */
+    class ScopedTimer
+    {
+    public:
+        ZQ_DISALLOW_COPY (ScopedTimer)
+
+        explicit ScopedTimer (Histogram *histogram)
+            : mHistogram{histogram},
+              mStart{histogram != nullptr ? ZQ_SYMBOL(ZqMetricsTimestamp) () : 0}
+        {
+        }
+
+        explicit ScopedTimer (Histogram &histogram)
+            : ScopedTimer{&histogram}
+        {
+        }
+
+        /// Start timing now, the histogram is set later (e.g. once the key is known).
+        ScopedTimer ()
+            : mHistogram{nullptr},
+              mStart{ZQ_SYMBOL(ZqMetricsTimestamp) ()}
+        {
+        }
+
+        void setHistogram (Histogram *histogram)
+        {
+            mHistogram = histogram;
+        }
+
+        ~ScopedTimer ()
+        {
+            if (mHistogram != nullptr)
+                mHistogram->record (ZQ_SYMBOL(ZqMetricsTimestamp) () - mStart);
+        }
+
+    private:
+        Histogram *mHistogram;
+        uint64_t mStart;
+    };
+
+    /**
+       @brief Format every registered metric, a line per metric.
+       @return The number of bytes written (without a null terminator).
+     */
+    static SizeType FormatAll (char *buffer, SizeType size);
+
+private:
+    static unsigned currentCell ()
+    {
+        return ZQ_SYMBOL(ZqMetricsCurrentCpu) () % ZQ_METRICS_MAX_CPUS;
+    }
+
+    static void registerMetric (Metric *metric);
+
+    static Metric *sMetrics;
+
+#else // ZQ_METRICS_DISABLE
+    class Histogram;
+
+    class Counter
+    {
+    public:
+        explicit constexpr Counter (const char *) {}
+
+        void add (uint64_t=1) {}
+        uint64_t get () const { return 0; }
+    };
+
+    class Histogram
+    {
+    public:
+        enum class Unit {
+            Nanoseconds,
+            Count,
+        };
+
+        constexpr Histogram () {}
+        explicit constexpr Histogram (const char *, Unit=Unit::Nanoseconds) {}
+
+        void record (uint64_t) {}
+    };
+
+    template<SizeType sCapacity>
+    class KeyedHistograms
+    {
+    public:
+        explicit constexpr KeyedHistograms (const char *) {}
+
+        Histogram *get (uint64_t) { return nullptr; }
+    };
+
+    class Ranking
+    {
+    public:
+        static constexpr SizeType kCapacity = 16;
+        static constexpr SizeType kMaxColumns = 4;
+
+        struct Row {
+            uint64_t key;
+            uint64_t values[kMaxColumns];
+        };
+
+        constexpr Ranking (const char *, const char *const *, SizeType) {}
+
+        void publish (uint64_t, const Row *, SizeType) {}
+        void withdraw (uint64_t) {}
+    };
+
+    class ScopedTimer
+    {
+    public:
+        explicit ScopedTimer (Histogram *) {}
+        explicit ScopedTimer (Histogram &) {}
+        ScopedTimer () {}
+
+        void setHistogram (Histogram *) {}
+    };
+
+    static SizeType FormatAll (char *, SizeType) { return 0; }
+#endif // ZQ_METRICS_DISABLE
+
+    /**
+       @brief Start exporting the metrics: the debugfs file ziqe/metrics on
+              Linux, a periodically updated text file in usermode.
+       @return Whether the export has started.
+     */
+    static bool StartExport ();
+    static void StopExport ();
+
+private:
+    Metrics();
+};
+
+}
+ZQ_END_NAMESPACE
+
+#endif // ZIQE_METRICS_H
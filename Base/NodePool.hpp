@@ -0,0 +1,157 @@
+/**
+ * @file NodePool.hpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2017 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ZIQE_NODEPOOL_H
+#define ZIQE_NODEPOOL_H
+
+#include "Base/Macros.hpp"
+#include "Base/Types.hpp"
+#include "Base/Checks.hpp"
+#include "Base/Allocator.hpp"
+
+ZQ_BEGIN_NAMESPACE
+namespace Base {
+
+/**
+ * @brief Allocate single Ts (the nodes of a container) from chunks of memory.
+ *
+ * A freed node goes to a free list and is reused by the next allocation,
+ * the chunks are given back to the global allocator only when the pool is
+ * destructed. Chunks grow geometrically (from kFirstChunkSize nodes up to
+ * kMaxChunkSize), so a small container pays one small allocation and a big
+ * one rarely allocates.
+ *
+ * Has the interface of Allocator, for one element at a time.
+ *
+ * @note Not thread safe: every container has its own pool.
+ */
+template<class T>
+class NodePool
+{
+public:
+    static constexpr SizeType kFirstChunkSize = 8;
+    static constexpr SizeType kMaxChunkSize = 256;
+
+    NodePool() = default;
+
+    ~NodePool()
+    {
+        freeChunks ();
+    }
+
+    NodePool(NodePool &&other)
+    {
+        swap (other);
+    }
+
+    NodePool &operator = (NodePool &&other) {
+        swap (other);
+
+        return *this;
+    }
+
+    ZQ_DISALLOW_COPY (NodePool)
+
+    T *allocate (SizeType n = 1) {
+        ZQ_ASSERT (n == 1);
+        ZQ_UNUSED (n);
+
+        if (mFreeList == nullptr)
+            addChunk ();
+
+        Slot *slot = mFreeList;
+        mFreeList = slot->next;
+
+        return static_cast<T*>(static_cast<void*>(slot->storage));
+    }
+
+    void deallocate (T *pointer) {
+        Slot *slot = static_cast<Slot*>(static_cast<void*>(pointer));
+
+        slot->next = mFreeList;
+        mFreeList = slot;
+    }
+
+    /**
+     * @brief The number of nodes in all the chunks, used or free.
+     */
+    SizeType getCapacity () const
+    {
+        return mCapacity;
+    }
+
+    void swap (NodePool &other) {
+        Base::swap (mFreeList, other.mFreeList);
+        Base::swap (mChunks, other.mChunks);
+        Base::swap (mNextChunkSize, other.mNextChunkSize);
+        Base::swap (mCapacity, other.mCapacity);
+    }
+
+private:
+    union Slot {
+        Slot *next;
+        alignas(T) char storage[sizeof (T)];
+    };
+
+    // The first slot of every chunk links to the previous chunk.
+    void addChunk () {
+        SizeType size = mNextChunkSize;
+        Slot *chunk = mAllocator.allocate (size + 1);
+
+        chunk[0].next = mChunks;
+        mChunks = chunk;
+
+        // Link the new slots in order: consecutive allocations get consecutive nodes.
+        for (SizeType i = size; i > 0; --i) {
+            chunk[i].next = mFreeList;
+            mFreeList = &chunk[i];
+        }
+
+        mCapacity += size;
+        mNextChunkSize = min (size * 2, kMaxChunkSize);
+    }
+
+    void freeChunks () {
+        while (mChunks != nullptr) {
+            Slot *previous = mChunks[0].next;
+
+            mAllocator.deallocate (mChunks);
+            mChunks = previous;
+        }
+    }
+
+    Slot *mFreeList = nullptr;
+    Slot *mChunks = nullptr;
+
+    SizeType mNextChunkSize = kFirstChunkSize;
+    SizeType mCapacity = 0;
+
+    Allocator<Slot> mAllocator;
+};
+
+template<class T>
+constexpr SizeType NodePool<T>::kFirstChunkSize;
+
+template<class T>
+constexpr SizeType NodePool<T>::kMaxChunkSize;
+
+} // namespace Base
+ZQ_END_NAMESPACE
+
+#endif // ZIQE_NODEPOOL_H
@@ -0,0 +1,381 @@
+/**
+ * @file PageRadixTree.hpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2017 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ZIQE_PAGERADIXTREE_H
+#define ZIQE_PAGERADIXTREE_H
+
+#include "Base/Macros.hpp"
+#include "Base/Types.hpp"
+#include "Base/Checks.hpp"
+#include "Base/Allocator.hpp"
+
+#include "CppCore/Memory.h"
+
+ZQ_BEGIN_NAMESPACE
+namespace Base {
+
+/**
+ * @brief A record per page, by virtual page number, in a tree shaped like
+ *        a 4 level page table.
+ *
+ * Every level is indexed by kLevelBits bits of the page number: finding a
+ * page's record is kLevels dependent loads, without hashing or comparing.
+ * The directories and the leaves (kEntriesPerNode packed records) are
+ * allocated on the first store to their range, and a record that has
+ * never been stored is all zero bits (T{} for plain records). forEach()
+ * skips the ranges that have never been stored to.
+ *
+ * Lookups, stores and allocating nodes are lock free: a new node is
+ * published with a compare and swap, and the nodes are freed only by
+ * clear() and the destructor. load(), store(), compareExchange() and
+ * update() access a record atomically (for records of up to 8 bytes),
+ * the records find() and forEach() give are not protected.
+ *
+ * @note clear(), swap() and the destructor must not run concurrently with
+ *       any other member.
+ */
+template<class T>
+class PageRadixTree
+{
+public:
+    typedef uint64_t PageNumber;
+
+    static constexpr SizeType kLevelBits = 9;
+    static constexpr SizeType kLevels = 4;
+    static constexpr SizeType kEntriesPerNode = SizeType{1} << kLevelBits;
+
+    /// 36 bits: a 48 bit address space of 4KB pages.
+    static constexpr PageNumber kMaxPageNumber = (PageNumber{1} << (kLevelBits * kLevels)) - 1;
+
+    PageRadixTree() = default;
+
+    ~PageRadixTree()
+    {
+        clear ();
+    }
+
+    PageRadixTree(PageRadixTree &&other)
+    {
+        swap (other);
+    }
+
+    PageRadixTree &operator = (PageRadixTree &&other) {
+        swap (other);
+
+        return *this;
+    }
+
+    ZQ_DISALLOW_COPY (PageRadixTree)
+
+    static PageNumber GetPageNumber (uint64_t address)
+    {
+        return address / ZQ_PAGE_SIZE;
+    }
+
+    static uint64_t GetAddress (PageNumber page)
+    {
+        return page * ZQ_PAGE_SIZE;
+    }
+
+    /**
+     * @return The record of @a page, or nullptr if its leaf hasn't been
+     *         allocated.
+     */
+    ZQ_DEFINE_CONST_AND_NON_CONST (const T *, T *, find, (PageNumber page), {
+        Leaf *leaf = findLeaf (page);
+
+        if (leaf == nullptr)
+            return nullptr;
+
+        return &leaf->entries[GetIndex (page, 0)];
+    })
+
+    /**
+     * @return The record of @a page, allocating its leaf as needed, or nullptr
+     *         if @a page is above kMaxPageNumber.
+     */
+    T *findOrCreate (PageNumber page) {
+        if (page > kMaxPageNumber)
+            return nullptr;
+
+        // The pointer to the next node, of level @a level.
+        void **slot = &mRoot;
+
+        for (SizeType level = kLevels - 1; ; --level) {
+            void *node = __atomic_load_n (slot, __ATOMIC_ACQUIRE);
+
+            if (node == nullptr)
+                node = install (slot, level);
+
+            if (level == 0)
+                return &static_cast<Leaf *>(node)->entries[GetIndex (page, 0)];
+
+            slot = &static_cast<Directory *>(node)->children[GetIndex (page, level)];
+        }
+    }
+
+    /**
+     * @return The record of @a page, T{} if it has never been stored.
+     */
+    T load (PageNumber page) const
+    {
+        static_assert (kIsAtomicRecord, "Atomic access to records of up to 8 bytes");
+
+        const T *entry = find (page);
+        T value{};
+
+        if (entry != nullptr)
+            __atomic_load (const_cast<T *>(entry), &value, __ATOMIC_ACQUIRE);
+
+        return value;
+    }
+
+    /**
+     * @return false if @a page is above kMaxPageNumber.
+     */
+    bool store (PageNumber page, const T &value) {
+        static_assert (kIsAtomicRecord, "Atomic access to records of up to 8 bytes");
+
+        T copy{value};
+        T *entry = IsZero (copy) ? find (page) : findOrCreate (page);
+
+        // Storing zero to a leaf that doesn't exist is a no-op.
+        if (entry == nullptr)
+            return page <= kMaxPageNumber;
+
+        __atomic_store (entry, &copy, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    /**
+     * @brief Replace the record of @a page with @a desired if it is @a expected.
+     * @return Whether it has been replaced, @a expected is set to the record
+     *         if not.
+     */
+    bool compareExchange (PageNumber page, T &expected, const T &desired) {
+        static_assert (kIsAtomicRecord, "Atomic access to records of up to 8 bytes");
+
+        T copy{desired};
+        T *entry = findOrCreate (page);
+
+        if (entry == nullptr)
+            return false;
+
+        return __atomic_compare_exchange (entry, &expected, &copy, false,
+                                          __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    }
+
+    /**
+     * @brief Replace the record of @a page with @a function (record), atomically
+     *        (@a function may be called more than once).
+     * @return The new record.
+     */
+    template<class Function>
+    T update (PageNumber page, Function function) {
+        static_assert (kIsAtomicRecord, "Atomic access to records of up to 8 bytes");
+
+        T *entry = findOrCreate (page);
+        T current, desired;
+
+        if (entry == nullptr)
+            return T{};
+
+        __atomic_load (entry, &current, __ATOMIC_RELAXED);
+
+        do {
+            desired = function (current);
+        } while (! __atomic_compare_exchange (entry, &current, &desired, true,
+                                              __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+        return desired;
+    }
+
+    /**
+     * @brief Call @a function (page, record) for the records in [@a first, @a last]
+     *        that are not zero, by order.
+     */
+    template<class Function>
+    void forEach (PageNumber first, PageNumber last, Function function) {
+        void *root = __atomic_load_n (&mRoot, __ATOMIC_ACQUIRE);
+
+        if (root == nullptr || first > last || first > kMaxPageNumber)
+            return;
+
+        forEachInNode (root, kLevels - 1, 0, first, min (last, kMaxPageNumber), function);
+    }
+
+    template<class Function>
+    void forEach (Function function)
+    {
+        forEach (0, kMaxPageNumber, function);
+    }
+
+    /**
+     * @brief The number of allocated leaves, kEntriesPerNode records each.
+     */
+    SizeType getLeavesCount () const
+    {
+        return __atomic_load_n (&mLeavesCount, __ATOMIC_RELAXED);
+    }
+
+    void clear () {
+        if (mRoot != nullptr)
+            destroySubtree (mRoot, kLevels - 1);
+
+        mRoot = nullptr;
+        mLeavesCount = 0;
+    }
+
+    void swap (PageRadixTree &other) {
+        Base::swap (mRoot, other.mRoot);
+        Base::swap (mLeavesCount, other.mLeavesCount);
+    }
+
+private:
+    static constexpr bool kIsAtomicRecord = sizeof (T) <= sizeof (uint64_t)
+                                            && __is_trivially_copyable (T);
+
+    struct Directory
+    {
+        void *children[kEntriesPerNode];
+    };
+
+    struct Leaf
+    {
+        T entries[kEntriesPerNode];
+    };
+
+    static SizeType GetIndex (PageNumber page, SizeType level)
+    {
+        return static_cast<SizeType>(page >> (level * kLevelBits)) & (kEntriesPerNode - 1);
+    }
+
+    static bool IsZero (const T &value)
+    {
+        const unsigned char *bytes = static_cast<const unsigned char *>(static_cast<const void *>(&value));
+
+        for (SizeType i = 0; i < sizeof (T); ++i) {
+            if (bytes[i] != 0)
+                return false;
+        }
+
+        return true;
+    }
+
+    Leaf *findLeaf (PageNumber page) const
+    {
+        if (page > kMaxPageNumber)
+            return nullptr;
+
+        void *node = __atomic_load_n (&mRoot, __ATOMIC_ACQUIRE);
+
+        for (SizeType level = kLevels - 1; level > 0 && node != nullptr; --level)
+            node = __atomic_load_n (&static_cast<Directory *>(node)->children[GetIndex (page, level)],
+                                    __ATOMIC_ACQUIRE);
+
+        return static_cast<Leaf *>(node);
+    }
+
+    /// Allocate a node of @a level to the empty @a slot, or return the one another thread did.
+    void *install (void **slot, SizeType level) {
+        void *node = (level == 0) ? static_cast<void *>(Allocator<Leaf>{}.allocate (1))
+                                  : static_cast<void *>(Allocator<Directory>{}.allocate (1));
+        void *expected = nullptr;
+
+        __builtin_memset (node, 0, (level == 0) ? sizeof (Leaf) : sizeof (Directory));
+
+        if (! __atomic_compare_exchange_n (slot, &expected, node, false,
+                                           __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            destroyNode (node, level);
+            return expected;
+        }
+
+        if (level == 0)
+            __atomic_fetch_add (&mLeavesCount, 1, __ATOMIC_RELAXED);
+
+        return node;
+    }
+
+    static void destroyNode (void *node, SizeType level) {
+        if (level == 0)
+            Allocator<Leaf>{}.deallocate (static_cast<Leaf *>(node));
+        else
+            Allocator<Directory>{}.deallocate (static_cast<Directory *>(node));
+    }
+
+    static void destroySubtree (void *node, SizeType level) {
+        if (level > 0) {
+            for (void *child : static_cast<Directory *>(node)->children) {
+                if (child != nullptr)
+                    destroySubtree (child, level - 1);
+            }
+        }
+
+        destroyNode (node, level);
+    }
+
+    /// @a node of @a level has the pages from @a base, [@a first, @a last] are in it or after it.
+    template<class Function>
+    static void forEachInNode (void *node, SizeType level, PageNumber base,
+                               PageNumber first, PageNumber last, Function &function) {
+        SizeType shift = level * kLevelBits;
+        SizeType begin = (first > base) ? static_cast<SizeType>((first - base) >> shift) : 0;
+        SizeType end = static_cast<SizeType>(min<PageNumber>((last - base) >> shift, kEntriesPerNode - 1));
+
+        for (SizeType i = begin; i <= end; ++i) {
+            PageNumber childBase = base + (PageNumber{i} << shift);
+
+            if (level == 0) {
+                T &entry = static_cast<Leaf *>(node)->entries[i];
+
+                if (! IsZero (entry))
+                    function (childBase, entry);
+
+                continue;
+            }
+
+            void *child = __atomic_load_n (&static_cast<Directory *>(node)->children[i], __ATOMIC_ACQUIRE);
+            if (child != nullptr)
+                forEachInNode (child, level - 1, childBase, first, last, function);
+        }
+    }
+
+    void *mRoot = nullptr;
+    SizeType mLeavesCount = 0;
+};
+
+template<class T>
+constexpr SizeType PageRadixTree<T>::kLevelBits;
+
+template<class T>
+constexpr SizeType PageRadixTree<T>::kLevels;
+
+template<class T>
+constexpr SizeType PageRadixTree<T>::kEntriesPerNode;
+
+template<class T>
+constexpr typename PageRadixTree<T>::PageNumber PageRadixTree<T>::kMaxPageNumber;
+
+template<class T>
+constexpr bool PageRadixTree<T>::kIsAtomicRecord;
+
+} // namespace Base
+ZQ_END_NAMESPACE
+
+#endif // ZIQE_PAGERADIXTREE_H
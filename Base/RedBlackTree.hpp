@@ -23,6 +23,8 @@
 #include "Base/Macros.hpp"
 #include "Base/Memory.hpp"
 #include "Base/Checks.hpp"
+#include "Base/Constructor.hpp"
+#include "Base/NodePool.hpp"
 
 #include "Base/IteratorTools.hpp"
 
@@ -393,8 +395,8 @@ public:
 
         // If this tree doesn't have an head.
         if (result.resultParent == nullptr) {
-            mHead = mRightest = mLeftest = new Node{nullptr, nullptr, nullptr,
-                                                    key, Base::forward<Args>(args)...};
+            mHead = mRightest = mLeftest = createNode (nullptr, nullptr, nullptr,
+                                                       key, Base::forward<Args>(args)...);
 
             return {mHead, true};
         }
@@ -406,8 +408,8 @@ public:
             return {*(result.pResultAtParent), false};
 
 
-        auto newNode = new Node{result.resultParent, nullptr, nullptr,
-                                key, Base::forward<Args>(args)...};
+        auto newNode = createNode (result.resultParent, nullptr, nullptr,
+                                   key, Base::forward<Args>(args)...);
 
         *(result.pResultAtParent) = newNode;
 
@@ -467,6 +469,17 @@ public:
     })
 
 protected:
+    template<class...Args>
+    Node *createNode (Args&&... args)
+    {
+        return Constructor<Node>{}.construct (mNodePool.allocate (1), Base::forward<Args>(args)...);
+    }
+
+    void destroyNode (Node *node) {
+        Constructor<Node>{}.destruct (node);
+        mNodePool.deallocate (node);
+    }
+
     /**
         @brief  Try to find a node with key == @a key.
         @param key
@@ -508,6 +521,9 @@ protected:
 
     SizeType mSize;
 
+    /// The nodes are allocated from the tree's own pool.
+    NodePool<Node> mNodePool;
+
     CompareType    pComare;
     IsEqualType    pIsEqual;
 };
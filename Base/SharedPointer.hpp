@@ -23,82 +23,149 @@
 #include "Base/Macros.hpp"
 #include "Base/Memory.hpp"
 #include "Base/RawPointer.hpp"
+#include "Base/Atomic.hpp"
+#include "Base/ConstructableStorage.hpp"
 
 ZQ_BEGIN_NAMESPACE
 namespace Base {
 
-// TODO:  make CountType atomic: write an atomic API.
-template<class T, class DeleterType>
-struct _SharedPointerReferenceType
+/**
+ * @brief The counts of a SharedPointer's object.
+ *
+ * The count is the number of SharedPointers, the object is destroyed when
+ * it gets to zero. The weak count is the number of WeakPointers, plus one
+ * for all of the SharedPointers together: the reference is freed when it
+ * gets to zero. Both are atomic, so copies of a SharedPointer can be used
+ * and destroyed on different threads (the object itself isn't protected).
+ */
+struct _SharedPointerReferenceBase
 {
     typedef SizeType CountType;
 
-    struct WeakContainer {
-        WeakContainer(RawPointer<_SharedPointerReferenceType> reference)
-            : mReference{reference}
-        {
-            ++(reference->mWeakCount);
-        }
+    _SharedPointerReferenceBase() = default;
 
-        ~WeakContainer()
-        {
-            if (--(mReference->mWeakCount) == 0) {
-                delete mReference.get ();
-            }
-        }
+    ZQ_DISALLOW_COPY_AND_MOVE (_SharedPointerReferenceBase)
 
-        ZQ_DEFINE_CONST_AND_NON_CONST(const _SharedPointerReferenceType&,
-                                      _SharedPointerReferenceType,
-                                      get,
-                                      (),
-        {
-            return *mReference;
-        })
-
-    private:
-        RawPointer<_SharedPointerReferenceType> mReference;
-    };
-
-    struct SharedContainer {
-        SharedContainer(RawPointer<_SharedPointerReferenceType> reference)
-            : mWeakContainer{reference}
-        {
-            ++(mWeakContainer.get().mReferenceCount);
-        }
+    void increaseCount ()
+    {
+        mReferenceCount.fetchAdd (1, MemoryOrder::Relaxed);
+    }
+
+    /// Increase the count unless the object has been destroyed (for WeakPointer::lock).
+    bool tryIncreaseCount () {
+        auto count = mReferenceCount.load (MemoryOrder::Relaxed);
 
-        ~SharedContainer()
-        {
-            --(mWeakContainer.get().mReferenceCount);
+        while (count != 0) {
+            if (mReferenceCount.compareExchange (count, count + 1, MemoryOrder::Acquire))
+                return true;
         }
 
-        ZQ_DEFINE_CONST_AND_NON_CONST(const _SharedPointerReferenceType&,
-                                      _SharedPointerReferenceType,
-                                      get,
-                                      (),
-        {
-            return mWeakContainer.get ();
-        })
+        return false;
+    }
+
+    void decreaseCount () {
+        // The last one sees the writes of the others to the object.
+        if (mReferenceCount.fetchSub (1, MemoryOrder::AcquireRelease) != 1)
+            return;
+
+        destroyObject ();
+        decreaseWeakCount ();
+    }
+
+    void increaseWeakCount ()
+    {
+        mWeakCount.fetchAdd (1, MemoryOrder::Relaxed);
+    }
+
+    void decreaseWeakCount () {
+        if (mWeakCount.fetchSub (1, MemoryOrder::AcquireRelease) == 1)
+            destroy ();
+    }
+
+    CountType getReferenceCount () const
+    {
+        return mReferenceCount.load (MemoryOrder::Relaxed);
+    }
+
+protected:
+    virtual ~_SharedPointerReferenceBase() = default;
+
+    /// Destroy the object (the count got to zero).
+    virtual void destroyObject () = 0;
+
+    /// Free the reference (and the object's memory, when it is inside).
+    virtual void destroy () = 0;
+
+private:
+    Atomic<CountType> mReferenceCount{1};
+    Atomic<CountType> mWeakCount{1};
+};
+
+/**
+ * @brief The reference of an object that was allocated by itself:
+ *        @a DeleterType destroys it.
+ */
+template<class T, class DeleterType>
+struct _SharedPointerReferenceType : public _SharedPointerReferenceBase
+{
+    explicit _SharedPointerReferenceType(T *pointer)
+        : mPointer{pointer}
+    {
+    }
 
-    private:
-        WeakContainer mWeakContainer;
-    };
+protected:
+    virtual void destroyObject () override
+    {
+        mDeleter (mPointer);
+    }
 
-    _SharedPointerReferenceType() = default;
-    explicit _SharedPointerReferenceType(CountType count)
-        : mReferenceCount{count}
-    {}
+    virtual void destroy () override
+    {
+        delete this;
+    }
 
+private:
     T *mPointer;
 
     DeleterType mDeleter;
+};
+
+/**
+ * @brief A reference with its object inside: made by makeShared, a single
+ *        allocation for both.
+ */
+template<class T>
+struct _SharedPointerInlineReferenceType : public _SharedPointerReferenceBase
+{
+    template<class ...Args>
+    explicit _SharedPointerInlineReferenceType(Args&&... args)
+    {
+        mStorage.template construct<T> (Base::forward<Args>(args)...);
+    }
+
+    T *getPointer ()
+    {
+        return mStorage.template getAs<T> ();
+    }
+
+protected:
+    virtual void destroyObject () override
+    {
+        mStorage.template destruct<T> ();
+    }
+
+    virtual void destroy () override
+    {
+        delete this;
+    }
 
-    // The number of count-1
-    // 0 -> 1
-    // 1 -> 2
-    CountType mReferenceCount = 0;
+private:
+    Internal::ConstructableStorage<sizeof (T), alignof (T)> mStorage;
+};
 
-    // Reference count for the reference type.
-    CountType mWeakCount = 0;
+/// Take a reference that already counts the new pointer.
+struct _SharedPointerAdoptReference
+{
 };
 
 template<class T, class Deleter>
@@ -111,7 +178,7 @@ public:
     template<class OtherT, class OtherDeleter>
     friend class WeakPointer;
 
-    typedef _SharedPointerReferenceType<T,Deleter> _ReferenceType;
+    typedef _SharedPointerReferenceBase _ReferenceType;
     typedef typename _ReferenceType::CountType CountType;
 
     SharedPointerBase()
@@ -119,8 +186,15 @@ public:
     {
     }
 
+    /// Take the ownership of @a pointer (Deleter destroys it).
     explicit SharedPointerBase(T *pointer)
-        : mPointer{pointer}, mReference{nullptr}
+        : mPointer{pointer},
+          mReference{(pointer == nullptr) ? nullptr : new _SharedPointerReferenceType<T, Deleter>{pointer}}
+    {
+    }
+
+    SharedPointerBase(_SharedPointerAdoptReference, T *pointer, _ReferenceType *reference)
+        : mPointer{pointer}, mReference{reference}
     {
     }
 
@@ -153,49 +227,38 @@ public:
 
     ~SharedPointerBase()
     {
-        decreaseCountAndDeleteReferece ();
+        decreaseCount ();
     }
 
     template<class OtherT, class OtherDeleter>
     SharedPointerBase &operator= (SharedPointerBase<OtherT, OtherDeleter> &&other) {
-        decreaseCountAndDeleteReferece ();
-
-        mPointer = other.mPointer;
-        mReference = other.mReference;
-
-        other.mPointer = nullptr;
-        other.mReference = nullptr;
+        SharedPointerBase{Base::move (other)}.swap (*this);
 
         return *this;
     }
 
     template<class OtherT, class OtherDeleter>
     SharedPointerBase &operator= (const SharedPointerBase<OtherT, OtherDeleter> &other) {
-        decreaseCountAndDeleteReferece ();
-
-        mPointer = other.mPointer;
-        mReference = other.mReference;
-
-        increaseCount ();
+        SharedPointerBase{other}.swap (*this);
 
         return *this;
     }
 
     SharedPointerBase &operator= (SharedPointerBase &&other) {
-        swap (other);
+        SharedPointerBase{Base::move (other)}.swap (*this);
 
         return *this;
     }
 
     SharedPointerBase &operator= (const SharedPointerBase &other) {
-        mReference = other.mReference;
+        SharedPointerBase{other}.swap (*this);
 
         return *this;
     }
 
     void reset (T *pointer = nullptr)
     {
-        swap (SharedPointer(pointer));
+        SharedPointerBase{pointer}.swap (*this);
     }
 
     T *get()
@@ -230,13 +293,12 @@ public:
 
     ZQ_DEFINE_EQUAL_AND_NOT_EQUAL_BY_MEMBER (SharedPointerBase, mPointer)
 
+    /// The number of SharedPointers to the object, an estimate while other threads copy them.
     CountType getReferenceCount () const{
-        if (mPointer == nullptr)
+        if (mReference == nullptr)
             return 0;
-        else if (mReference == nullptr)
-            return 1;
-        else
-            return mReference->mReferenceCount+1;
+
+        return mReference->getReferenceCount ();
     }
 
     operator bool () const
@@ -256,74 +318,38 @@ public:
 
     void swap (SharedPointerBase &otherPointer)
     {
+        Base::swap (mPointer, otherPointer.mPointer);
         Base::swap (mReference, otherPointer.mReference);
     }
 
 protected:
-    void setPointer (T *pointer) {
-        decreaseCount ();
-
-        // leave mReference as it is: nullptr, or 0: one anyway.
-        mPointer = pointer;
-    }
-
-    void increaseCount ()  {
-        // if we have no object.
-        if (mPointer == nullptr)
-            return;
-
-        // 1 -> 2
-        if (mReference == nullptr)
-            mReference = new _ReferenceType{1};
-        else
-            ++(mReference->mReferenceCount);
-    }
-
-    void decreaseCountAndDeleteReferece ()
-    {
-        decreaseCount ();
+    void increaseCount () {
+        if (mReference != nullptr)
+            mReference->increaseCount ();
     }
 
-    void decreaseCount(bool shouldDeleteReferece=false) {
-        // if count==0
-        if (mPointer == nullptr)
-            return;
-
-        // if --count == 0
-        if (mReference == nullptr) {
-            deleteObject ();
-        } else if (mReference->mReferenceCount == 0) {
-            deleteObject ();
-
-            if (shouldDeleteReferece)
-                deleteReference ();
-        }
+    void decreaseCount () {
+        if (mReference != nullptr)
+            mReference->decreaseCount ();
 
         mReference = nullptr;
         mPointer = nullptr;
     }
 
-    void deleteObject () {
-        ZQ_ASSERT (mPointer != nullptr);
-
-        mReference->mDeleter (mPointer);
-    }
-
-    void deleteReference () {
-        if (mReference != nullptr)
-            delete mReference;
-    }
-
     T *mPointer;
 
-    /**
-     * @brief mReference
-     *
-     * If nullptr: count=1; else, count=ref.count+1.
-     */
+    /// nullptr when there is no object.
     _ReferenceType *mReference;
 };
 
+/**
+ * @brief A reference counted pointer: the object is destroyed with the
+ *        last copy.
+ *
+ * SharedPointer{new T} allocates a reference for the counts, makeShared()
+ * allocates it with the object. Copying and destroying the copies is
+ * thread safe.
+ */
 template<class T, class Deleter=DefaultDeleter<T>>
 class SharedPointer : public SharedPointerBase<T, Deleter>
 {
@@ -374,38 +400,229 @@ public:
     }
 };
 
+/**
+ * @brief A pointer to the object of a SharedPointer that doesn't keep it
+ *        alive: lock() gives a SharedPointer while the object exists.
+ */
 template<class T, class Deleter=DefaultDeleter<T>>
 class WeakPointer
 {
 public:
-    typedef _SharedPointerReferenceType<T,Deleter> _ReferenceType;
+    typedef _SharedPointerReferenceBase _ReferenceType;
     typedef typename _ReferenceType::CountType CountType;
 
+    WeakPointer()
+        : mPointer{nullptr}, mReference{nullptr}
+    {
+    }
+
     WeakPointer(const SharedPointer<T, Deleter> &sharedPointer)
-        : mReference{sharedPointer.mReference}
+        : mPointer{sharedPointer.mPointer}, mReference{sharedPointer.mReference}
+    {
+        increaseWeakCount ();
+    }
+
+    WeakPointer(const WeakPointer &other)
+        : mPointer{other.mPointer}, mReference{other.mReference}
     {
+        increaseWeakCount ();
+    }
+
+    WeakPointer(WeakPointer &&other)
+        : mPointer{other.mPointer}, mReference{other.mReference}
+    {
+        other.mPointer = nullptr;
+        other.mReference = nullptr;
+    }
+
+    ~WeakPointer()
+    {
+        if (mReference != nullptr)
+            mReference->decreaseWeakCount ();
+    }
+
+    WeakPointer &operator= (WeakPointer other) {
+        Base::swap (mPointer, other.mPointer);
+        Base::swap (mReference, other.mReference);
+
+        return *this;
     }
 
     bool isExpired () const
     {
-        return mReference->mReferenceCount == 0;
+        return mReference == nullptr || mReference->getReferenceCount () == 0;
     }
 
+    /// @return The object, or an empty pointer if it has been destroyed.
     SharedPointer<T, Deleter> lock()
     {
-        return SharedPointer<T, Deleter>{mReference};
+        if (mReference == nullptr || ! mReference->tryIncreaseCount ())
+            return {};
+
+        return SharedPointer<T, Deleter>{_SharedPointerAdoptReference{}, mPointer, mReference};
     }
 
 private:
-    typename _ReferenceType::WeakContainer mReference;
+    void increaseWeakCount ()
+    {
+        if (mReference != nullptr)
+            mReference->increaseWeakCount ();
+    }
+
+    T *mPointer;
+    _ReferenceType *mReference;
 };
 
+/**
+ * @brief Construct a T with @a args in a SharedPointer: the object and
+ *        its counts are allocated together.
+ */
 template<class T, class ...Args>
 SharedPointer<T> makeShared(Args&&... args)
 {
-    return SharedPointer<T>{new T{Base::forward<Args>(args)...}};
+    auto reference = new _SharedPointerInlineReferenceType<T>{Base::forward<Args>(args)...};
+
+    return SharedPointer<T>{_SharedPointerAdoptReference{}, reference->getPointer (), reference};
 }
 
+/**
+ * @brief The reference count of an object, a member of the object
+ *        (see IntrusiveSharedPointer).
+ */
+class IntrusiveReferenceCount
+{
+public:
+    typedef SizeType CountType;
+
+    IntrusiveReferenceCount() = default;
+
+    // A copy of an object isn't referenced by the pointers of the original.
+    IntrusiveReferenceCount(const IntrusiveReferenceCount &)
+    {
+    }
+
+    IntrusiveReferenceCount &operator = (const IntrusiveReferenceCount &)
+    {
+        return *this;
+    }
+
+    CountType getCount () const
+    {
+        return mCount.load (MemoryOrder::Relaxed);
+    }
+
+private:
+    template<class T, IntrusiveReferenceCount T::*sCount, class Deleter>
+    friend class IntrusiveSharedPointer;
+
+    Atomic<CountType> mCount{0};
+};
+
+/**
+ * @brief A SharedPointer to an object that has its own count (an
+ *        IntrusiveReferenceCount member, @tparam sCount).
+ *
+ * Nothing is allocated besides the object, and a pointer can be made
+ * again from a raw pointer to the object (e.g. `this`). There are no weak
+ * pointers: the object is destroyed by Deleter when its count gets to zero.
+ */
+template<class T, IntrusiveReferenceCount T::*sCount, class Deleter=DefaultDeleter<T>>
+class IntrusiveSharedPointer
+{
+public:
+    typedef IntrusiveReferenceCount::CountType CountType;
+
+    IntrusiveSharedPointer()
+        : mPointer{nullptr}
+    {
+    }
+
+    explicit IntrusiveSharedPointer(T *pointer)
+        : mPointer{pointer}
+    {
+        increaseCount ();
+    }
+
+    IntrusiveSharedPointer(const IntrusiveSharedPointer &other)
+        : mPointer{other.mPointer}
+    {
+        increaseCount ();
+    }
+
+    IntrusiveSharedPointer(IntrusiveSharedPointer &&other)
+        : mPointer{other.mPointer}
+    {
+        other.mPointer = nullptr;
+    }
+
+    ~IntrusiveSharedPointer()
+    {
+        decreaseCount ();
+    }
+
+    IntrusiveSharedPointer &operator= (IntrusiveSharedPointer other) {
+        swap (other);
+
+        return *this;
+    }
+
+    void reset (T *pointer = nullptr)
+    {
+        IntrusiveSharedPointer{pointer}.swap (*this);
+    }
+
+    T *get() const
+    {
+        return mPointer;
+    }
+
+    T &operator *() const
+    {
+        return *mPointer;
+    }
+
+    T *operator ->() const
+    {
+        return mPointer;
+    }
+
+    operator bool () const
+    {
+        return mPointer != nullptr;
+    }
+
+    ZQ_DEFINE_EQUAL_AND_NOT_EQUAL_BY_MEMBER (IntrusiveSharedPointer, mPointer)
+
+    CountType getReferenceCount () const
+    {
+        return (mPointer == nullptr) ? 0 : (mPointer->*sCount).getCount ();
+    }
+
+    void swap (IntrusiveSharedPointer &other)
+    {
+        Base::swap (mPointer, other.mPointer);
+    }
+
+private:
+    void increaseCount () {
+        if (mPointer != nullptr)
+            (mPointer->*sCount).mCount.fetchAdd (1, MemoryOrder::Relaxed);
+    }
+
+    void decreaseCount () {
+        if (mPointer == nullptr)
+            return;
+
+        // The last one sees the writes of the others to the object.
+        if ((mPointer->*sCount).mCount.fetchSub (1, MemoryOrder::AcquireRelease) == 1)
+            Deleter{}(mPointer);
+
+        mPointer = nullptr;
+    }
+
+    T *mPointer;
+};
+
 } // namespace Base
 ZQ_END_NAMESPACE
 
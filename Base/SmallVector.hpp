@@ -0,0 +1,358 @@
+/**
+ * @file SmallVector.hpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2017 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ZIQE_SMALLVECTOR_H
+#define ZIQE_SMALLVECTOR_H
+
+#include "Base/Types.hpp"
+#include "Base/Macros.hpp"
+
+#include "Base/Constructor.hpp"
+
+#include "Base/Allocator.hpp"
+#include "Base/IteratorTools.hpp"
+#include "Base/RawPointer.hpp"
+#include "Base/Checks.hpp"
+
+ZQ_BEGIN_NAMESPACE
+namespace Base {
+
+/**
+ * @brief A Vector that keeps up to @tparam N elements inline, and moves them
+ *        to the heap only when it grows beyond that.
+ *
+ * For the short arrays of the protocol messages (thread IDs, system call
+ * parameters): the common case doesn't allocate at all. Beyond @a N, grows
+ * geometrically like Vector.
+ *
+ * @note Moving a SmallVector moves its inline elements one by one,
+ *       keep @a N small.
+ */
+template<class T,
+         SizeType N,
+         class Allocator=Allocator<T>,
+         class Constructor=Constructor<T>>
+class SmallVector
+{
+    static_assert (N > 0, "Use Vector for no inline elements");
+
+public:
+    typedef T ElementType;
+    typedef Ziqe::SizeType SizeType;
+
+    typedef T* PointerType;
+    typedef T* Iterator;
+    typedef const T* ConstIterator;
+
+    static constexpr SizeType kInlineCapacity = N;
+
+    SmallVector() = default;
+
+    template<class InputIterator>
+    SmallVector(const InputIterator &begin, const InputIterator &end)
+        : SmallVector{begin, end, iteratorsRange(begin, end)}
+    {
+    }
+
+    template<class InputIterator>
+    SmallVector(const InputIterator &begin,
+                const InputIterator &end,
+                SizeType beginToEnd)
+    {
+        assign (begin, end, beginToEnd);
+    }
+
+    ~SmallVector()
+    {
+        deleteAll ();
+    }
+
+    SmallVector(SmallVector &&other)
+    {
+        takeFrom (other);
+    }
+
+    SmallVector &operator = (SmallVector &&other) {
+        if (this == &other)
+            return *this;
+
+        deleteAll ();
+        makeEmpty ();
+        takeFrom (other);
+
+        return *this;
+    }
+
+    SmallVector(const SmallVector &other)
+        : SmallVector{other.begin (), other.end (), other.size ()}
+    {
+    }
+
+    SmallVector &operator = (const SmallVector &other) {
+        if (this == &other)
+            return *this;
+
+        assign (other.begin (), other.end (), other.size ());
+
+        return *this;
+    }
+
+    ZQ_DEFINE_CONST_AND_NON_CONST (const T&, T&, operator[], (SizeType index),
+    {
+        return *(begin() + index);
+    })
+
+    ZQ_DEFINE_CONST_AND_NON_CONST (RawArray<const T>, RawArray<T>, toRawArray, (),
+    {
+        return {data (), size ()};
+    })
+
+    template<class InputIterator>
+    void assign(const InputIterator &begin, const InputIterator &end)
+    {
+        return assign (begin, end, iteratorsRange(begin, end));
+    }
+
+    template<class InputIterator>
+    void assign(const InputIterator &begin,
+                const InputIterator &end,
+                SizeType beginToEnd)
+    {
+        clear ();
+        reserve (beginToEnd);
+
+        mSize = insertToUninitilizedBuffer (0, begin, end);
+    }
+
+    /**
+     * @brief Resize the vector to @a newSize elements, construct each new element from @a args.
+     *
+     * Shrinking keeps the buffer (see shrinkToFit).
+     */
+    template<class ...Args>
+    void resize(SizeType newSize, Args &&...args) {
+        if (newSize <= mSize) {
+            shrinkWithoutFree (mSize - newSize);
+            return;
+        }
+
+        if (newSize > mCapacity)
+            grow (newSize);
+
+        for (; mSize < newSize; ++mSize)
+            mConstructor.construct (mPointer+mSize, args...);
+    }
+
+    /**
+     * @brief Destruct the last @a howMuch elements, but keep their memory.
+     */
+    void shrinkWithoutFree(SizeType howMuch) {
+        ZQ_ASSERT (mSize >= howMuch);
+
+        mSize -= howMuch;
+        mConstructor.destruct (mPointer+mSize, howMuch);
+    }
+
+    void clear ()
+    {
+        shrinkWithoutFree (mSize);
+    }
+
+    void reserve (SizeType capacity)
+    {
+        if (capacity > mCapacity)
+            reallocate (capacity);
+    }
+
+    /**
+     * @brief Free the unused heap capacity, move the elements back inline if they fit.
+     */
+    void shrinkToFit ()
+    {
+        if (isInline () || mCapacity == mSize)
+            return;
+
+        reallocate (mSize);
+    }
+
+    template<class ...Args>
+    void expand (SizeType size, Args&&...args)
+    {
+        resize (mSize + size, Base::forward<Args>(args)...);
+    }
+
+    template<class InputIterator>
+    void expand (InputIterator begin, InputIterator end, SizeType beginToEnd) {
+        if (mSize + beginToEnd > mCapacity)
+            grow (mSize + beginToEnd);
+
+        mSize += insertToUninitilizedBuffer (mSize, begin, end);
+    }
+
+    template<class InputIterator>
+    void expand (InputIterator begin, InputIterator end)
+    {
+        expand (begin, end, iteratorsRange (begin, end));
+    }
+
+    T *data()
+    {
+        return mPointer;
+    }
+
+    const T *data() const
+    {
+        return mPointer;
+    }
+
+    T *begin ()
+    {
+        return data();
+    }
+
+    const T *begin () const
+    {
+        return data();
+    }
+
+    T *end ()
+    {
+        return begin() + mSize;
+    }
+
+    const T *end () const
+    {
+        return begin() + mSize;
+    }
+
+    SizeType size() const
+    {
+        return mSize;
+    }
+
+    SizeType capacity() const
+    {
+        return mCapacity;
+    }
+
+    /**
+     * @brief Whether the elements are stored inline (no heap buffer).
+     */
+    bool isInline () const
+    {
+        return mPointer == getInlineStorage ();
+    }
+
+private:
+    T *getInlineStorage ()
+    {
+        return static_cast<T*>(static_cast<void*>(mInlineStorage));
+    }
+
+    const T *getInlineStorage () const
+    {
+        return static_cast<const T*>(static_cast<const void*>(mInlineStorage));
+    }
+
+    void makeEmpty () {
+        mPointer = getInlineStorage ();
+        mSize = 0;
+        mCapacity = N;
+    }
+
+    // Take @a other's elements: its heap buffer as is, or its inline elements
+    // one by one. Leaves @a other empty.
+    void takeFrom (SmallVector &other) {
+        if (other.isInline ()) {
+            mConstructor.relocate (getInlineStorage (), other.mPointer, other.mSize);
+            mSize = other.mSize;
+        } else {
+            mPointer = other.mPointer;
+            mSize = other.mSize;
+            mCapacity = other.mCapacity;
+        }
+
+        other.makeEmpty ();
+    }
+
+    void grow (SizeType minimumCapacity) {
+        reallocate (max (minimumCapacity, mCapacity * 2));
+    }
+
+    // Move the elements to a new buffer of @a newCapacity elements,
+    // or to the inline storage if they fit.
+    void reallocate (SizeType newCapacity) {
+        ZQ_ASSERT (newCapacity >= mSize);
+
+        PointerType pointer = getInlineStorage ();
+        if (newCapacity > N)
+            pointer = mAllocator.allocate (newCapacity);
+        else
+            newCapacity = N;
+
+        if (pointer == mPointer)
+            return;
+
+        mConstructor.relocate (pointer, mPointer, mSize);
+
+        if (! isInline ())
+            mAllocator.deallocate (mPointer);
+
+        mPointer = pointer;
+        mCapacity = newCapacity;
+    }
+
+    template<class InputIterator>
+    SizeType insertToUninitilizedBuffer (const SizeType index,
+                                         const InputIterator &begin,
+                                         const InputIterator &end) {
+        auto currentIndex = index;
+
+        for (auto iterator{begin}; iterator != end; ++iterator, ++currentIndex)
+        {
+            mConstructor.construct (&mPointer[currentIndex], *iterator);
+        }
+
+        return currentIndex-index;
+    }
+
+    void deleteAll () {
+        mConstructor.destruct (mPointer, mSize);
+
+        if (! isInline ())
+            mAllocator.deallocate (mPointer);
+    }
+
+    alignas(T) char mInlineStorage[N * sizeof (T)];
+
+    PointerType mPointer = getInlineStorage ();
+    SizeType mSize = 0;
+    SizeType mCapacity = N;
+
+    Allocator mAllocator;
+    Constructor mConstructor;
+};
+
+template<class T, SizeType N, class Allocator, class Constructor>
+constexpr SizeType SmallVector<T, N, Allocator, Constructor>::kInlineCapacity;
+
+} // namespace Base
+ZQ_END_NAMESPACE
+
+#endif // ZIQE_SMALLVECTOR_H
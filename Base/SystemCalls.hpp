@@ -40,15 +40,28 @@ public:
         return ZqCallSyscall (regs);
     }
 
-    static void setSystemCallHook (ZqSystemCallHookType hook)
+    static bool setSystemCallHook (ZqSystemCallHookType hook)
     {
-        ZqInitSystemCallsHook (hook);
+        return ZqInitSystemCallsHook (hook) == ZQ_TRUE;
     }
     static void unsetSystemCallHook ()
     {
         ZqUninitSystemCallsHook ();
     }
 
+    /**
+       @brief Only threads added here get to the system call hook, the
+              others leave it with a single check.
+     */
+    static ZqError addHookedThread (ZqThreadID thread)
+    {
+        return ZqSystemCallsHookAddThread (thread);
+    }
+    static void removeHookedThread (ZqThreadID thread)
+    {
+        ZqSystemCallsHookRemoveThread (thread);
+    }
+
 private:
     constexpr SystemCalls() = default;
 };
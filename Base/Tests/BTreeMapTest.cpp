@@ -0,0 +1,226 @@
+/**
+ * @file BTreeMapTest
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2016 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Base/BTreeMap.hpp"
+#include "Base/Vector.hpp"
+#include "PerDriver/EntryPoints.hpp"
+
+#define N 20000
+
+namespace {
+
+// A linear congruential generator, enough for shuffled keys.
+uint64_t nextRandom (uint64_t &state)
+{
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return state >> 33;
+}
+
+template<class MapType>
+bool isSorted (const MapType &map)
+{
+    Ziqe::SizeType count = 0;
+    bool hasPrevious = false;
+    uint64_t previous = 0;
+
+    for (auto iterator = map.begin (); iterator != map.end (); ++iterator)
+    {
+        if (hasPrevious && ! (previous < iterator.getKey ()))
+            return false;
+
+        previous = iterator.getKey ();
+        hasPrevious = true;
+        ++count;
+    }
+
+    return count == map.size ();
+}
+
+} // namespace
+
+ZQ_BEGIN_C_DECL void ZQ_PER_DRIVER_UNIQUE_SYMBOL(ZqOnLoad) (Ziqe::Base::RawPointer<Ziqe::OS::DriverContext>)
+{
+    using Ziqe::Base::BTreeMap;
+    using Ziqe::Base::Vector;
+    typedef BTreeMap<uint64_t, uint64_t> MapType;
+
+    // Random inserts, lookups and erases, against a bitmap of the present keys.
+    {
+        MapType map;
+        Vector<bool> isPresent;
+        uint64_t state = 1;
+
+        isPresent.resize (N, false);
+
+        for (int i = 0; i < 4 * N; ++i)
+        {
+            uint64_t key = nextRandom (state) % N;
+
+            if (nextRandom (state) % 3 != 0) {
+                auto result = map.insert (key, key * 2);
+
+                ZQ_ASSERT (result.first == ! isPresent[key]);
+                ZQ_ASSERT (result.second.getKey () == key);
+                ZQ_ASSERT (*result.second == key * 2);
+                isPresent[key] = true;
+            } else {
+                auto next = map.erase (key);
+
+                ZQ_ASSERT ((next != map.end ()) == isPresent[key] || next == map.end ());
+                isPresent[key] = false;
+            }
+        }
+
+        Ziqe::SizeType count = 0;
+        for (uint64_t key = 0; key < N; ++key)
+        {
+            auto iterator = map.find (key);
+
+            ZQ_ASSERT ((iterator != map.end ()) == isPresent[key]);
+            if (isPresent[key]) {
+                ZQ_ASSERT (*iterator == key * 2);
+                ++count;
+            }
+        }
+
+        ZQ_ASSERT (map.size () == count);
+        ZQ_ASSERT (isSorted (map));
+
+        // lowerBound: the first present key that is not less.
+        for (uint64_t key = 0; key < N; key += 7)
+        {
+            uint64_t expected = key;
+
+            while (expected < N && ! isPresent[expected])
+                ++expected;
+
+            auto iterator = map.lowerBound (key);
+            ZQ_ASSERT ((iterator == map.end ()) == (expected == N));
+            if (iterator != map.end ())
+                ZQ_ASSERT (iterator.getKey () == expected);
+        }
+
+        for (uint64_t key = 0; key < N; ++key)
+            map.erase (key);
+
+        ZQ_ASSERT (map.isEmpty ());
+        ZQ_ASSERT (map.begin () == map.end ());
+    }
+
+    // Ascending inserts, then erasing ranges.
+    {
+        MapType map;
+
+        for (uint64_t key = 0; key < N; ++key)
+            map.insert (key * 2, key);
+
+        // [100, 1000) of the keys are the even ones, 450 of them.
+        auto next = map.erase (200, 2000);
+        ZQ_ASSERT (map.size () == N - 900);
+        ZQ_ASSERT (next.getKey () == 2000);
+        ZQ_ASSERT (map.lowerBound (200).getKey () == 2000);
+        ZQ_ASSERT (isSorted (map));
+
+        // An odd bound and an empty range.
+        map.erase (3001, 3003);
+        ZQ_ASSERT (! map.isExist (3002));
+        ZQ_ASSERT (map.isExist (3000) && map.isExist (3004));
+        ZQ_ASSERT (map.erase (5, 6) == map.find (6));
+
+        // To the end.
+        map.erase (map.find (30000), map.end ());
+        ZQ_ASSERT (map.size () == N - 900 - 1 - (N - 15000));
+        ZQ_ASSERT (map.lowerBound (29999) == map.end ());
+        ZQ_ASSERT (isSorted (map));
+
+        // Everything.
+        map.erase (map.begin (), map.end ());
+        ZQ_ASSERT (map.isEmpty ());
+
+        map.insert (1, uint64_t{1});
+        ZQ_ASSERT (map.size () == 1 && *map.find (1) == 1);
+    }
+
+    // Bulk build, copies and moves.
+    {
+        Vector<Ziqe::Base::Pair<uint64_t, uint64_t>> sorted;
+
+        sorted.resize (N);
+        for (Ziqe::SizeType i = 0; i < N; ++i)
+            sorted[i] = {i * 3, i};
+
+        auto map = MapType::BuildFromSorted (sorted.begin (), sorted.end ());
+        ZQ_ASSERT (map.size () == N);
+        ZQ_ASSERT (isSorted (map));
+        ZQ_ASSERT (*map.find (300) == 100);
+        ZQ_ASSERT (map.lowerBound (301).getKey () == 303);
+
+        // A built map is a regular one.
+        ZQ_ASSERT (map.insert (301, uint64_t{7}).first);
+        // The iterators before the erase are invalid.
+        auto next = map.erase (0, 3 * 1000);
+        ZQ_ASSERT (next == map.find (3000));
+        ZQ_ASSERT (map.size () == N - 1000);
+
+        MapType copy{map};
+        ZQ_ASSERT (copy.size () == map.size ());
+        ZQ_ASSERT (isSorted (copy));
+        copy.insertOrAssign (3000, uint64_t{42});
+        ZQ_ASSERT (*copy.find (3000) == 42);
+        ZQ_ASSERT (*map.find (3000) == 1000);
+
+        MapType moved{Ziqe::Base::move (copy)};
+        ZQ_ASSERT (copy.isEmpty ());
+        ZQ_ASSERT (*moved.find (3000) == 42);
+
+        copy = moved;
+        ZQ_ASSERT (copy.size () == moved.size ());
+
+        auto empty = MapType::BuildFromSorted (sorted.begin (), sorted.begin ());
+        ZQ_ASSERT (empty.isEmpty ());
+    }
+
+    // Values that own memory are moved, not copied, between nodes.
+    {
+        BTreeMap<uint64_t, Vector<uint64_t>> map;
+        uint64_t state = 2;
+
+        for (int i = 0; i < N; ++i)
+        {
+            uint64_t key = nextRandom (state) % (N / 2);
+            Vector<uint64_t> value;
+
+            value.resize (3, key);
+            map.insertOrAssign (key, Ziqe::Base::move (value));
+        }
+
+        for (auto iterator = map.begin (); iterator != map.end (); ++iterator)
+            ZQ_ASSERT (iterator->size () == 3 && (*iterator)[2] == iterator.getKey ());
+
+        map.erase (N / 8, N / 4);
+        ZQ_ASSERT (map.lowerBound (N / 8) == map.lowerBound (N / 4));
+    }
+}
+
+void ZQ_PER_DRIVER_UNIQUE_SYMBOL(ZqOnUnload) (Ziqe::Base::RawPointer<Ziqe::OS::DriverContext>)
+{
+}
+
+ZQ_END_C_DECL
@@ -0,0 +1,212 @@
+/**
+ * @file BitsetTest
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2016 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Base/Bitset.hpp"
+#include "Base/Vector.hpp"
+#include "Base/Logger.hpp"
+#include "CppCore/Metrics.h"
+#include "PerDriver/EntryPoints.hpp"
+
+namespace {
+
+using Ziqe::SizeType;
+
+/// Check @a bits against @a expected, a bool per bit.
+template<class BitsType>
+void checkAgainst (const BitsType &bits, const Ziqe::Base::Vector<bool> &expected)
+{
+    SizeType count = 0;
+
+    ZQ_ASSERT (bits.size () == expected.size ());
+
+    for (SizeType i = 0; i < expected.size (); ++i) {
+        ZQ_ASSERT (bits.test (i) == expected[i]);
+        count += expected[i];
+    }
+
+    ZQ_ASSERT (bits.count () == count);
+    ZQ_ASSERT (bits.isEmpty () == (count == 0));
+
+    // From every index: the next set and clear bits.
+    SizeType nextSet = expected.size (), nextClear = expected.size ();
+    for (SizeType i = expected.size (); i-- > 0;) {
+        if (expected[i])
+            nextSet = i;
+        else
+            nextClear = i;
+
+        ZQ_ASSERT (bits.findNextSet (i) == nextSet);
+        ZQ_ASSERT (bits.findNextClear (i) == nextClear);
+    }
+
+    ZQ_ASSERT (bits.findNextSet (expected.size ()) == expected.size ());
+}
+
+/// Random ranges and bits on @a bits, checked against a Vector of bools.
+template<class BitsType>
+void randomOperations (BitsType &bits, uint64_t seed)
+{
+    Ziqe::Base::Vector<bool> expected;
+    expected.resize (bits.size (), false);
+
+    auto random = [&seed] (SizeType limit) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        return static_cast<SizeType>((seed >> 33) % limit);
+    };
+
+    for (int round = 0; round < 200; ++round) {
+        SizeType first = random (bits.size () + 1);
+        SizeType last = first + random (bits.size () - first + 1);
+        SizeType index = random (bits.size ());
+
+        switch (random (5)) {
+        case 0:
+            bits.setRange (first, last);
+            for (auto i = first; i < last; ++i)
+                expected[i] = true;
+            break;
+        case 1:
+            bits.resetRange (first, last);
+            for (auto i = first; i < last; ++i)
+                expected[i] = false;
+            break;
+        case 2:
+            bits.set (index);
+            expected[index] = true;
+            break;
+        case 3:
+            ZQ_ASSERT (bits.atomicTestAndClear (index) == expected[index]);
+            expected[index] = false;
+            break;
+        default:
+            ZQ_ASSERT (bits.atomicTestAndSet (index) == expected[index]);
+            expected[index] = true;
+            break;
+        }
+
+        SizeType count = 0;
+        for (auto i = first; i < last; ++i)
+            count += expected[i];
+
+        ZQ_ASSERT (bits.countRange (first, last) == count);
+    }
+
+    checkAgainst (bits, expected);
+}
+
+} // namespace
+
+ZQ_BEGIN_C_DECL void ZQ_PER_DRIVER_UNIQUE_SYMBOL(ZqOnLoad) (Ziqe::Base::RawPointer<Ziqe::OS::DriverContext>)
+{
+    using Ziqe::Base::Bitset;
+    using Ziqe::Base::BitVector;
+
+    // Word boundaries.
+    {
+        Bitset<130> bits;
+
+        ZQ_ASSERT (bits.isEmpty () && bits.findNextSet () == 130 && bits.findNextClear () == 0);
+
+        bits.setRange (60, 129);
+        ZQ_ASSERT (bits.count () == 69 && bits.countRange (63, 65) == 2);
+        ZQ_ASSERT (bits.findNextSet () == 60 && bits.findNextClear (60) == 129);
+        ZQ_ASSERT (bits.findNextClear (129) == 129 && bits.findNextClear (130) == 130);
+
+        bits.resetRange (64, 128);
+        ZQ_ASSERT (bits.count () == 5 && bits.findNextSet (64) == 128);
+
+        // Full words.
+        bits.clear ();
+        bits.setRange (0, 128);
+        ZQ_ASSERT (bits.getWords ()[0] == ~uint64_t{0} && bits.getWords ()[1] == ~uint64_t{0});
+        ZQ_ASSERT (bits.getWords ()[2] == 0 && bits.findNextClear () == 128);
+
+        Bitset<130> other;
+        other.set (129);
+        bits |= other;
+        ZQ_ASSERT (bits.count () == 129 && bits.test (129) && ! bits.test (128));
+
+        bits &= other;
+        ZQ_ASSERT (bits == other && bits.count () == 1);
+
+        SizeType visited = 0;
+        bits.forEachSet ([&visited] (SizeType index) {
+            ZQ_ASSERT (index == 129);
+            ++visited;
+        });
+        ZQ_ASSERT (visited == 1);
+    }
+
+    {
+        Bitset<64> bits;
+        randomOperations (bits, 1);
+
+        Bitset<1000> largeBits;
+        randomOperations (largeBits, 2);
+    }
+
+    // Resizing keeps the bits after size() clear.
+    {
+        BitVector bits{100};
+
+        bits.setRange (0, 100);
+        bits.resize (70);
+        ZQ_ASSERT (bits.count () == 70 && bits.getWordsCount () == 2);
+
+        bits.resize (200);
+        ZQ_ASSERT (bits.count () == 70 && bits.findNextSet (70) == 200);
+        ZQ_ASSERT (bits.findNextClear () == 70);
+
+        BitVector moved{Ziqe::Base::move (bits)};
+        ZQ_ASSERT (moved.size () == 200 && moved.count () == 70);
+
+        const SizeType sizes[] = {1, 63, 64, 65, 257, 4096};
+        for (auto size : sizes) {
+            BitVector randomBits{size};
+            randomOperations (randomBits, size);
+        }
+    }
+
+    // The dirty bitmap of 1 GiB of 4 KiB pages, a few pages written.
+    {
+        constexpr SizeType kPages = (SizeType{1} << 30) / 4096;
+
+        BitVector dirty{kPages};
+        SizeType found = 0;
+
+        for (SizeType i = 0; i < kPages; i += kPages / 8)
+            dirty.atomicTestAndSet (i + 17);
+
+        auto start = ZQ_SYMBOL(ZqMetricsTimestamp) ();
+        dirty.forEachSet ([&dirty, &found] (SizeType index) {
+            found += dirty.atomicTestAndClear (index);
+        });
+        auto scanNs = ZQ_SYMBOL(ZqMetricsTimestamp) () - start;
+
+        ZQ_ASSERT (found == 8 && dirty.isEmpty ());
+        ZQ_LOG_INFO ("Scanning a 1 GiB dirty bitmap: %llu ns", scanNs);
+    }
+}
+
+void ZQ_PER_DRIVER_UNIQUE_SYMBOL(ZqOnUnload) (Ziqe::Base::RawPointer<Ziqe::OS::DriverContext>)
+{
+}
+
+ZQ_END_C_DECL
@@ -0,0 +1,112 @@
+/**
+ * @file CallbackTest
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2016 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Base/Callback.hpp"
+#include "PerDriver/EntryPoints.hpp"
+
+namespace {
+
+int addOne (int value)
+{
+    return value + 1;
+}
+
+struct Adder
+{
+    int add (int value)
+    {
+        return value + mBase;
+    }
+
+    int mBase;
+};
+
+} // namespace
+
+ZQ_BEGIN_C_DECL void ZQ_PER_DRIVER_UNIQUE_SYMBOL(ZqOnLoad) (Ziqe::Base::RawPointer<Ziqe::OS::DriverContext>)
+{
+    using Ziqe::Base::Callback;
+    using Ziqe::Base::MoveOnlyCallback;
+    using Ziqe::Base::StaticVariable;
+    using Ziqe::Base::UniquePointer;
+
+    typedef int (Adder::*AddFunction)(int);
+
+    Callback<int (int)> empty;
+    ZQ_ASSERT (! empty);
+
+    // A regular function.
+    Callback<int (int)> function{StaticVariable<int (*)(int), &addOne>{}};
+    ZQ_ASSERT (function);
+    ZQ_ASSERT (function (1) == 2);
+
+    // A function pointer.
+    Callback<int (int)> functionPointer{&addOne};
+    ZQ_ASSERT (functionPointer (2) == 3);
+
+    // A member function by a pointer, invalid with a nullptr.
+    Adder adder{10};
+    Callback<int (int)> member{StaticVariable<AddFunction, &Adder::add>{}, &adder};
+    ZQ_ASSERT (member (1) == 11);
+
+    Callback<int (int)> nullMember{StaticVariable<AddFunction, &Adder::add>{}, static_cast<Adder*>(nullptr)};
+    ZQ_ASSERT (! nullMember);
+
+    // A lambda, copied and moved.
+    int calls = 0;
+    Callback<int (int)> lambda{[&calls, &adder] (int value) {
+        ++calls;
+        return value * adder.mBase;
+    }};
+
+    Callback<int (int)> copy{lambda};
+    ZQ_ASSERT (lambda (2) == 20);
+    ZQ_ASSERT (copy (3) == 30);
+    ZQ_ASSERT (calls == 2);
+
+    Callback<int (int)> moved{Ziqe::Base::move (copy)};
+    ZQ_ASSERT (! copy);
+    ZQ_ASSERT (moved (4) == 40);
+
+    moved = function;
+    ZQ_ASSERT (moved (4) == 5);
+
+    // A lambda larger than the inline storage.
+    int a = 1, b = 2, c = 3, d = 4;
+    Callback<int (int)> large{[a, b, c, d] (int value) {
+        return value + a + b + c + d;
+    }};
+    Callback<int (int)> largeCopy{large};
+    ZQ_ASSERT (large (0) == 10);
+    ZQ_ASSERT (largeCopy (1) == 11);
+
+    // A move only callback that owns its object.
+    MoveOnlyCallback<int (int)> unique{StaticVariable<AddFunction, &Adder::add>{},
+                                       UniquePointer<Adder>{new Adder{100}}};
+    MoveOnlyCallback<int (int)> movedUnique{Ziqe::Base::move (unique)};
+    ZQ_ASSERT (! unique);
+    ZQ_ASSERT (movedUnique (1) == 101);
+}
+
+void ZQ_PER_DRIVER_UNIQUE_SYMBOL(ZqOnUnload) (Ziqe::Base::RawPointer<Ziqe::OS::DriverContext>)
+{
+}
+
+ZQ_END_C_DECL
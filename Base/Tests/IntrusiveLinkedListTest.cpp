@@ -0,0 +1,112 @@
+/**
+ * @file IntrusiveLinkedListTest
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2016 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Base/IntrusiveLinkedList.hpp"
+#include "PerDriver/EntryPoints.hpp"
+
+#define N 20
+
+namespace {
+
+struct Object
+{
+    int value;
+
+    Ziqe::Base::IntrusiveListHook hook;
+    Ziqe::Base::IntrusiveListHook otherHook;
+};
+
+} // namespace
+
+ZQ_BEGIN_C_DECL void ZQ_PER_DRIVER_UNIQUE_SYMBOL(ZqOnLoad) (Ziqe::Base::RawPointer<Ziqe::OS::DriverContext>)
+{
+    using Ziqe::Base::IntrusiveLinkedList;
+
+    Object objects[N];
+    IntrusiveLinkedList<Object, &Object::hook> list;
+    IntrusiveLinkedList<Object, &Object::otherHook> reversed;
+
+    for (int i = 0; i < N; ++i)
+    {
+        objects[i].value = i;
+
+        list.pushBack (objects[i]);
+        reversed.pushFront (objects[i]);
+    }
+
+    ZQ_ASSERT (list.size () == N);
+    ZQ_ASSERT (&list.front () == &objects[0]);
+    ZQ_ASSERT (&reversed.front () == &objects[N-1]);
+
+    {
+        int i = 0;
+        for (const Object &object : list)
+        {
+            ZQ_ASSERT (object.value == i);
+
+            ++i;
+        }
+
+        ZQ_ASSERT (i == N);
+    }
+
+    // Erase the even objects from one list, the other list is not affected.
+    for (auto iterator = list.begin (); iterator != list.end ();)
+    {
+        if (iterator->value % 2 == 0)
+            iterator = list.erase (iterator);
+        else
+            ++iterator;
+    }
+
+    ZQ_ASSERT (list.size () == N / 2);
+    ZQ_ASSERT (! objects[0].hook.isLinked ());
+    ZQ_ASSERT (objects[1].hook.isLinked ());
+    ZQ_ASSERT (reversed.size () == N);
+
+    {
+        int i = 1;
+        for (const Object &object : list)
+        {
+            ZQ_ASSERT (object.value == i);
+
+            i += 2;
+        }
+    }
+
+    // Insert in the middle.
+    list.insert (++list.begin (), objects[2]);
+    ZQ_ASSERT ((++list.begin ())->value == 2);
+
+    // Moving a list moves the links.
+    IntrusiveLinkedList<Object, &Object::hook> moved{Ziqe::Base::move (list)};
+    ZQ_ASSERT (list.isEmpty ());
+    ZQ_ASSERT (moved.size () == N / 2 + 1);
+    ZQ_ASSERT (&moved.back () == &objects[N-1]);
+
+    moved.clear ();
+    ZQ_ASSERT (! objects[1].hook.isLinked ());
+}
+
+void ZQ_PER_DRIVER_UNIQUE_SYMBOL(ZqOnUnload) (Ziqe::Base::RawPointer<Ziqe::OS::DriverContext>)
+{
+}
+
+ZQ_END_C_DECL
@@ -0,0 +1,86 @@
+/**
+ * @file NodePoolTest
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2016 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Base/NodePool.hpp"
+#include "Base/LinkedList.hpp"
+#include "PerDriver/EntryPoints.hpp"
+
+#define N 1000
+
+ZQ_BEGIN_C_DECL void ZQ_PER_DRIVER_UNIQUE_SYMBOL(ZqOnLoad) (Ziqe::Base::RawPointer<Ziqe::OS::DriverContext>)
+{
+    using Ziqe::Base::NodePool;
+    using Ziqe::Base::LinkedList;
+
+    // Freed nodes are reused before a new chunk is allocated.
+    {
+        NodePool<Ziqe::SizeType> pool;
+        Ziqe::SizeType *nodes[NodePool<Ziqe::SizeType>::kFirstChunkSize];
+
+        for (auto &node : nodes)
+        {
+            node = pool.allocate ();
+        }
+
+        ZQ_ASSERT (pool.getCapacity () == NodePool<Ziqe::SizeType>::kFirstChunkSize);
+
+        auto *freed = nodes[3];
+        pool.deallocate (freed);
+        ZQ_ASSERT (pool.allocate () == freed);
+        ZQ_ASSERT (pool.getCapacity () == NodePool<Ziqe::SizeType>::kFirstChunkSize);
+
+        // The next chunk is twice as big.
+        pool.allocate ();
+        ZQ_ASSERT (pool.getCapacity () == 3 * NodePool<Ziqe::SizeType>::kFirstChunkSize);
+    }
+
+    // A list that inserts and erases repeatedly doesn't grow its pool.
+    {
+        LinkedList<int> list;
+
+        for (int i = 0; i < N; ++i)
+        {
+            list.emplace_back (i);
+            list.emplace_back (i);
+            list.pop_front ();
+        }
+
+        ZQ_ASSERT (list.size () == N);
+        ZQ_ASSERT (list.front () == N / 2);
+
+        for (int i = 0; i < N; ++i)
+        {
+            list.pop_front ();
+            list.emplace_back (i);
+        }
+
+        ZQ_ASSERT (list.back () == N - 1);
+
+        LinkedList<int> moved{Ziqe::Base::move (list)};
+        ZQ_ASSERT (moved.size () == N);
+        ZQ_ASSERT (list.size () == 0);
+    }
+}
+
+void ZQ_PER_DRIVER_UNIQUE_SYMBOL(ZqOnUnload) (Ziqe::Base::RawPointer<Ziqe::OS::DriverContext>)
+{
+}
+
+ZQ_END_C_DECL
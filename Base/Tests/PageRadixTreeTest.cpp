@@ -0,0 +1,158 @@
+/**
+ * @file PageRadixTreeTest
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2016 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Base/PageRadixTree.hpp"
+#include "PerDriver/EntryPoints.hpp"
+
+namespace {
+
+struct Record {
+    uint32_t revision;
+    uint8_t home;
+    bool isDirty;
+};
+
+} // namespace
+
+ZQ_BEGIN_C_DECL void ZQ_PER_DRIVER_UNIQUE_SYMBOL(ZqOnLoad) (Ziqe::Base::RawPointer<Ziqe::OS::DriverContext>)
+{
+    using Ziqe::Base::PageRadixTree;
+    typedef PageRadixTree<uint64_t> TreeType;
+    typedef TreeType::PageNumber PageNumber;
+
+    // Leaves are allocated by the first store to their range.
+    {
+        TreeType tree;
+
+        ZQ_ASSERT (tree.find (0) == nullptr);
+        ZQ_ASSERT (tree.load (12345) == 0);
+
+        // Storing zero doesn't allocate.
+        ZQ_ASSERT (tree.store (12345, 0));
+        ZQ_ASSERT (tree.getLeavesCount () == 0);
+
+        ZQ_ASSERT (tree.store (12345, 7));
+        ZQ_ASSERT (tree.getLeavesCount () == 1);
+        ZQ_ASSERT (tree.load (12345) == 7);
+        ZQ_ASSERT (*tree.find (12345) == 7);
+
+        // A neighbor in the same leaf exists, and is zero.
+        ZQ_ASSERT (tree.find (12346) != nullptr && *tree.find (12346) == 0);
+        ZQ_ASSERT (tree.find (12345 + TreeType::kEntriesPerNode) == nullptr);
+
+        ZQ_ASSERT (tree.store (TreeType::kMaxPageNumber, 1));
+        ZQ_ASSERT (tree.load (TreeType::kMaxPageNumber) == 1);
+        ZQ_ASSERT (tree.getLeavesCount () == 2);
+
+        // Above the tree's range.
+        ZQ_ASSERT (! tree.store (TreeType::kMaxPageNumber + 1, 1));
+        ZQ_ASSERT (tree.findOrCreate (TreeType::kMaxPageNumber + 1) == nullptr);
+        ZQ_ASSERT (tree.load (TreeType::kMaxPageNumber + 1) == 0);
+
+        ZQ_ASSERT (TreeType::GetPageNumber (3 * ZQ_PAGE_SIZE + 1) == 3);
+        ZQ_ASSERT (TreeType::GetAddress (3) == 3 * ZQ_PAGE_SIZE);
+
+        tree.clear ();
+        ZQ_ASSERT (tree.find (12345) == nullptr);
+        ZQ_ASSERT (tree.getLeavesCount () == 0);
+    }
+
+    // Atomic updates.
+    {
+        TreeType tree;
+        uint64_t expected = 0;
+
+        ZQ_ASSERT (tree.compareExchange (5, expected, 10));
+        ZQ_ASSERT (! tree.compareExchange (5, expected, 20));
+        ZQ_ASSERT (expected == 10);
+        ZQ_ASSERT (tree.compareExchange (5, expected, 20));
+
+        ZQ_ASSERT (tree.update (5, [] (uint64_t value) { return value | 1; }) == 21);
+        ZQ_ASSERT (tree.update (6, [] (uint64_t value) { return value + 1; }) == 1);
+        ZQ_ASSERT (tree.load (5) == 21 && tree.load (6) == 1);
+    }
+
+    // forEach visits the non zero records in a range, by order, across leaves and directories.
+    {
+        TreeType tree;
+        const PageNumber pages[] = {0, 1, 511, 512, 4000, 1 << 18, (PageNumber{1} << 27) + 3,
+                                    TreeType::kMaxPageNumber};
+
+        for (auto page : pages)
+            tree.store (page, page + 1);
+
+        tree.store (2, 0);
+
+        PageNumber visited[sizeof (pages) / sizeof (pages[0])];
+        Ziqe::SizeType count = 0;
+
+        tree.forEach ([&] (PageNumber page, uint64_t &value) {
+            ZQ_ASSERT (value == page + 1);
+            visited[count++] = page;
+        });
+
+        ZQ_ASSERT (count == sizeof (pages) / sizeof (pages[0]));
+        for (Ziqe::SizeType i = 0; i < count; ++i)
+            ZQ_ASSERT (visited[i] == pages[i]);
+
+        count = 0;
+        tree.forEach (511, 4000, [&] (PageNumber page, uint64_t &) {
+            visited[count++] = page;
+        });
+
+        ZQ_ASSERT (count == 3);
+        ZQ_ASSERT (visited[0] == 511 && visited[1] == 512 && visited[2] == 4000);
+
+        // Records can be changed while iterating.
+        tree.forEach (1 << 18, TreeType::kMaxPageNumber + 100, [&] (PageNumber, uint64_t &value) {
+            value = 0;
+        });
+
+        ZQ_ASSERT (tree.load (1 << 18) == 0);
+        ZQ_ASSERT (tree.load (TreeType::kMaxPageNumber) == 0);
+        ZQ_ASSERT (tree.load (4000) == 4001);
+
+        TreeType moved{Ziqe::Base::move (tree)};
+        ZQ_ASSERT (moved.load (4000) == 4001);
+        ZQ_ASSERT (tree.find (4000) == nullptr);
+    }
+
+    // Packed records.
+    {
+        PageRadixTree<Record> tree;
+
+        ZQ_ASSERT (tree.store (42, Record{3, 1, true}));
+
+        auto record = tree.update (42, [] (Record current) {
+            ++current.revision;
+            current.isDirty = false;
+            return current;
+        });
+
+        ZQ_ASSERT (record.revision == 4 && record.home == 1 && ! record.isDirty);
+        ZQ_ASSERT (tree.load (42).revision == 4);
+    }
+}
+
+void ZQ_PER_DRIVER_UNIQUE_SYMBOL(ZqOnUnload) (Ziqe::Base::RawPointer<Ziqe::OS::DriverContext>)
+{
+}
+
+ZQ_END_C_DECL
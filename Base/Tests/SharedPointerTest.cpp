@@ -0,0 +1,176 @@
+/**
+ * @file SharedPointerTest
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2016 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Base/SharedPointer.hpp"
+#include "PerDriver/EntryPoints.hpp"
+
+namespace {
+
+int gLiveObjects = 0;
+
+struct Object {
+    explicit Object(int value)
+        : value{value}
+    {
+        ++gLiveObjects;
+    }
+
+    virtual ~Object()
+    {
+        --gLiveObjects;
+    }
+
+    int value;
+};
+
+struct DerivedObject : public Object {
+    DerivedObject(int value, int other)
+        : Object{value}, other{other}
+    {
+    }
+
+    int other;
+};
+
+struct IntrusiveObject {
+    IntrusiveObject()
+    {
+        ++gLiveObjects;
+    }
+
+    ~IntrusiveObject()
+    {
+        --gLiveObjects;
+    }
+
+    Ziqe::Base::IntrusiveReferenceCount referenceCount;
+};
+
+} // namespace
+
+ZQ_BEGIN_C_DECL void ZQ_PER_DRIVER_UNIQUE_SYMBOL(ZqOnLoad) (Ziqe::Base::RawPointer<Ziqe::OS::DriverContext>)
+{
+    using Ziqe::Base::SharedPointer;
+    using Ziqe::Base::WeakPointer;
+    using Ziqe::Base::makeShared;
+
+    // Copies, assignments and moves.
+    {
+        SharedPointer<Object> empty;
+        ZQ_ASSERT (! empty && empty.getReferenceCount () == 0);
+
+        SharedPointer<Object> pointer{new Object{1}};
+        ZQ_ASSERT (pointer.getReferenceCount () == 1);
+
+        {
+            auto copy = pointer;
+            ZQ_ASSERT (pointer.getReferenceCount () == 2 && copy->value == 1);
+
+            SharedPointer<Object> other{new Object{2}};
+            other = copy;
+            ZQ_ASSERT (gLiveObjects == 1 && pointer.getReferenceCount () == 3);
+
+            // Self assignment keeps the object.
+            other = other;
+            ZQ_ASSERT (other.getReferenceCount () == 3 && other->value == 1);
+
+            auto moved = Ziqe::Base::move (other);
+            ZQ_ASSERT (! other && moved.getReferenceCount () == 3);
+        }
+
+        ZQ_ASSERT (pointer.getReferenceCount () == 1 && gLiveObjects == 1);
+
+        pointer.reset (new Object{3});
+        ZQ_ASSERT (gLiveObjects == 1 && pointer->value == 3);
+
+        pointer.reset ();
+        ZQ_ASSERT (gLiveObjects == 0 && ! pointer);
+    }
+
+    // makeShared, and a pointer to a base class.
+    {
+        auto derived = makeShared<DerivedObject> (4, 5);
+        ZQ_ASSERT (derived->value == 4 && derived->other == 5);
+
+        SharedPointer<Object> base{derived};
+        ZQ_ASSERT (derived.getReferenceCount () == 2 && base->value == 4);
+
+        derived.reset ();
+        ZQ_ASSERT (gLiveObjects == 1 && base.getReferenceCount () == 1);
+
+        base = SharedPointer<Object>{};
+        ZQ_ASSERT (gLiveObjects == 0);
+    }
+
+    // Weak pointers.
+    {
+        WeakPointer<Object> weak;
+        ZQ_ASSERT (weak.isExpired () && ! weak.lock ());
+
+        auto pointer = makeShared<Object> (6);
+        weak = WeakPointer<Object>{pointer};
+        ZQ_ASSERT (! weak.isExpired () && pointer.getReferenceCount () == 1);
+
+        {
+            auto locked = weak.lock ();
+            ZQ_ASSERT (locked == pointer && pointer.getReferenceCount () == 2);
+        }
+
+        // The reference lives with the weak pointer, the object doesn't.
+        pointer.reset ();
+        ZQ_ASSERT (gLiveObjects == 0 && weak.isExpired () && ! weak.lock ());
+    }
+
+    {
+        SharedPointer<int[]> array{new int[3]{7, 8, 9}};
+        auto copy = array;
+
+        ZQ_ASSERT (copy[2] == 9 && array.getReferenceCount () == 2);
+    }
+
+    // Intrusive counts.
+    {
+        typedef Ziqe::Base::IntrusiveSharedPointer<IntrusiveObject, &IntrusiveObject::referenceCount> PointerType;
+
+        PointerType pointer{new IntrusiveObject};
+        ZQ_ASSERT (pointer.getReferenceCount () == 1);
+
+        // Another pointer from the raw one shares the count.
+        PointerType again{pointer.get ()};
+        ZQ_ASSERT (pointer.getReferenceCount () == 2 && again == pointer);
+
+        {
+            auto copy = again;
+            ZQ_ASSERT (copy.getReferenceCount () == 3);
+        }
+
+        again.reset ();
+        ZQ_ASSERT (gLiveObjects == 1 && pointer.getReferenceCount () == 1);
+
+        pointer = PointerType{};
+        ZQ_ASSERT (gLiveObjects == 0);
+    }
+}
+
+void ZQ_PER_DRIVER_UNIQUE_SYMBOL(ZqOnUnload) (Ziqe::Base::RawPointer<Ziqe::OS::DriverContext>)
+{
+}
+
+ZQ_END_C_DECL
@@ -0,0 +1,126 @@
+/**
+ * @file SmallVectorTest
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2016 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Base/SmallVector.hpp"
+#include "PerDriver/EntryPoints.hpp"
+
+#define N 4
+
+namespace {
+
+int gAliveCounters;
+
+// A non trivially relocatable type that counts its live instances.
+struct Counter
+{
+    Counter(int value=0)
+        : mValue{value}
+    {
+        ++gAliveCounters;
+    }
+
+    Counter(const Counter &other)
+        : Counter{other.mValue}
+    {
+    }
+
+    Counter(Counter &&other)
+        : Counter{other.mValue}
+    {
+        other.mValue = -1;
+    }
+
+    Counter &operator = (const Counter &other) = default;
+
+    ~Counter()
+    {
+        --gAliveCounters;
+    }
+
+    int mValue;
+};
+
+} // namespace
+
+ZQ_BEGIN_C_DECL void ZQ_PER_DRIVER_UNIQUE_SYMBOL(ZqOnLoad) (Ziqe::Base::RawPointer<Ziqe::OS::DriverContext>)
+{
+    using Ziqe::Base::SmallVector;
+
+    // Up to N elements stay inline, then spill to the heap.
+    {
+        SmallVector<int, N> vector;
+
+        ZQ_ASSERT (vector.isInline ());
+        ZQ_ASSERT (vector.capacity () == N);
+
+        vector.resize (N, 1);
+        ZQ_ASSERT (vector.isInline ());
+
+        vector.resize (N * 10, 2);
+        ZQ_ASSERT (! vector.isInline ());
+        ZQ_ASSERT (vector.size () == N * 10);
+        ZQ_ASSERT (vector[N-1] == 1);
+        ZQ_ASSERT (vector[N] == 2);
+
+        // Moving a heap vector takes its buffer.
+        const int *data = vector.data ();
+        SmallVector<int, N> moved{Ziqe::Base::move (vector)};
+        ZQ_ASSERT (moved.data () == data);
+        ZQ_ASSERT (vector.size () == 0);
+        ZQ_ASSERT (vector.isInline ());
+
+        // Back inline when the elements fit.
+        moved.resize (N);
+        moved.shrinkToFit ();
+        ZQ_ASSERT (moved.isInline ());
+        ZQ_ASSERT (moved[N-1] == 1);
+    }
+
+    // Inline and heap elements are moved and destructed.
+    {
+        SmallVector<Counter, N> vector;
+
+        for (int i = 0; i < N; ++i)
+        {
+            vector.resize (vector.size () + 1, i);
+        }
+
+        SmallVector<Counter, N> moved{Ziqe::Base::move (vector)};
+        ZQ_ASSERT (gAliveCounters == N);
+        ZQ_ASSERT (moved[N-1].mValue == N-1);
+
+        SmallVector<Counter, N> copy{moved};
+        copy.resize (N * 2, 7);
+        ZQ_ASSERT (gAliveCounters == N * 3);
+        ZQ_ASSERT (copy[0].mValue == 0);
+
+        moved = Ziqe::Base::move (copy);
+        ZQ_ASSERT (gAliveCounters == N * 2);
+        ZQ_ASSERT (moved[N*2-1].mValue == 7);
+    }
+
+    ZQ_ASSERT (gAliveCounters == 0);
+}
+
+void ZQ_PER_DRIVER_UNIQUE_SYMBOL(ZqOnUnload) (Ziqe::Base::RawPointer<Ziqe::OS::DriverContext>)
+{
+}
+
+ZQ_END_C_DECL
@@ -0,0 +1,161 @@
+/**
+ * @file VectorTest
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2016 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Base/Vector.hpp"
+#include "PerDriver/EntryPoints.hpp"
+
+#define N 1000
+
+namespace {
+
+int gAliveCounters;
+
+// A non trivially relocatable type that counts its live instances.
+struct Counter
+{
+    Counter(int value=0)
+        : mValue{value}
+    {
+        ++gAliveCounters;
+    }
+
+    Counter(const Counter &other)
+        : Counter{other.mValue}
+    {
+    }
+
+    Counter(Counter &&other)
+        : Counter{other.mValue}
+    {
+        other.mValue = -1;
+    }
+
+    Counter &operator = (const Counter &other) = default;
+
+    ~Counter()
+    {
+        --gAliveCounters;
+    }
+
+    int mValue;
+};
+
+} // namespace
+
+ZQ_BEGIN_C_DECL void ZQ_PER_DRIVER_UNIQUE_SYMBOL(ZqOnLoad) (Ziqe::Base::RawPointer<Ziqe::OS::DriverContext>)
+{
+    using Ziqe::Base::Vector;
+
+    // Geometric growth: expanding one element at a time should reallocate
+    // only O(log N) times.
+    {
+        Vector<uint8_t> vector;
+        Ziqe::SizeType reallocations = 0;
+        const uint8_t *lastData = nullptr;
+
+        for (int i = 0; i < N; ++i)
+        {
+            vector.expand (1, static_cast<uint8_t>(i));
+
+            if (vector.data () != lastData) {
+                lastData = vector.data ();
+                ++reallocations;
+            }
+        }
+
+        ZQ_ASSERT (vector.size () == N);
+        ZQ_ASSERT (vector.capacity () >= N);
+        ZQ_ASSERT (reallocations <= 11);
+
+        for (int i = 0; i < N; ++i)
+        {
+            ZQ_ASSERT (vector[i] == static_cast<uint8_t>(i));
+        }
+
+        vector.shrinkToFit ();
+        ZQ_ASSERT (vector.capacity () == N);
+        ZQ_ASSERT (vector[N-1] == static_cast<uint8_t>(N-1));
+    }
+
+    // reserve: no reallocation until the reserved capacity is used.
+    {
+        Vector<int> vector;
+
+        vector.reserve (N);
+        ZQ_ASSERT (vector.capacity () == N);
+
+        const int *data = vector.data ();
+        vector.resize (N, 7);
+
+        ZQ_ASSERT (vector.data () == data);
+        for (int n : vector)
+        {
+            ZQ_ASSERT (n == 7);
+        }
+
+        // Shrinking keeps the buffer.
+        vector.resize (N / 2);
+        ZQ_ASSERT (vector.size () == N / 2);
+        ZQ_ASSERT (vector.capacity () == N);
+        ZQ_ASSERT (vector.data () == data);
+
+        vector.resize (0);
+        ZQ_ASSERT (vector.capacity () == 0);
+        ZQ_ASSERT (vector.data () == nullptr);
+    }
+
+    // Non trivially relocatable elements are moved and destructed.
+    {
+        Vector<Counter> vector;
+
+        for (int i = 0; i < N; ++i)
+        {
+            vector.resize (vector.size () + 1, i);
+        }
+
+        ZQ_ASSERT (gAliveCounters == N);
+        for (int i = 0; i < N; ++i)
+        {
+            ZQ_ASSERT (vector[i].mValue == i);
+        }
+
+        vector.shrinkWithoutFree (N / 2);
+        ZQ_ASSERT (gAliveCounters == N / 2);
+
+        Vector<Counter> copy{vector};
+        ZQ_ASSERT (gAliveCounters == N);
+        ZQ_ASSERT (copy.capacity () == N / 2);
+        ZQ_ASSERT (copy[N / 2 - 1].mValue == N / 2 - 1);
+
+        copy = copy;
+        ZQ_ASSERT (gAliveCounters == N);
+
+        vector.clear ();
+        ZQ_ASSERT (gAliveCounters == N / 2);
+    }
+
+    ZQ_ASSERT (gAliveCounters == 0);
+}
+
+void ZQ_PER_DRIVER_UNIQUE_SYMBOL(ZqOnUnload) (Ziqe::Base::RawPointer<Ziqe::OS::DriverContext>)
+{
+}
+
+ZQ_END_C_DECL
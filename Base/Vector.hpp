@@ -37,6 +37,10 @@ namespace Base {
 /**
  * @brief A very simple vector implementation, with no insert,push_back,pop_back,erase and more.
  *        Basicly, it's a normal dynamic array: what std::vector should really be.
+ *
+ * The buffer grows geometrically (it at least doubles), so a sequence of expands
+ * does O(log n) allocations. Elements of trivially relocatable types are moved to
+ * a new buffer with a single memcpy.
  */
 template<class T,
          class Allocator=Allocator<T>,
@@ -79,24 +83,26 @@ public:
 
     ~Vector()
     {
-        deleteAll (mPointer, mSize);
+        deleteAll ();
     }
 
     Vector(Vector &&other)
         : mPointer{other.mPointer},
           mSize{other.mSize},
+          mCapacity{other.mCapacity},
           mAllocator{move(other.mAllocator)},
-          mConstructor{move (other.mConstrutor)}
+          mConstructor{move (other.mConstructor)}
     {
         other.makeEmpty ();
     }
 
     Vector &operator = (Vector &&other) {
         // Delete the current data.
-        deleteAll (mPointer, mSize);
+        deleteAll ();
+        makeEmpty ();
 
         // Swap the empty *this with @a other.
-        swap (*this, other);
+        swap (other);
 
         return *this;
     }
@@ -113,7 +119,10 @@ public:
     })
 
     Vector &operator = (const Vector &other) {
-        // assign will deleteAll for us.
+        if (this == &other)
+            return *this;
+
+        // assign will destruct the current elements for us.
         assign (other.mPointer, other.mPointer+other.mSize, other.mSize);
 
         return *this;
@@ -135,35 +144,79 @@ public:
                 const InputIterator &end,
                 SizeType beginToEnd)
     {
-       resizeBuffer (beginToEnd);
-       insertToUninitilizedBuffer (0, begin, end);
+        clear ();
+        reserve (beginToEnd);
+
+        mSize = insertToUninitilizedBuffer (0, begin, end);
     }
 
+    /**
+     * @brief Resize the vector to @a newSize elements, construct each new element from @a args.
+     *
+     * Shrinking keeps the buffer (see shrinkToFit), except for resize(0) that frees it.
+     */
     template<class ...Args>
     void resize(SizeType newSize, Args &&...args) {
         if (newSize == mSize)
             return;
 
         if (newSize == 0) {
-            deleteAll (mPointer, mSize);
-            mPointer = nullptr;
-            mSize = 0;
+            deleteAll ();
+            makeEmpty ();
 
             return;
         }
 
-        SizeType oldSize = mSize;
-        resizeBuffer (newSize);
+        if (newSize < mSize) {
+            shrinkWithoutFree (mSize - newSize);
+            return;
+        }
+
+        if (newSize > mCapacity)
+            grow (newSize);
 
-        // Construct the new objects (If there are).
-        if (newSize > oldSize)
-            mConstructor.constructN (mPointer+oldSize, newSize-oldSize, Base::forward<Args>(args)...);
+        // Construct the new objects.
+        for (; mSize < newSize; ++mSize)
+            mConstructor.construct (mPointer+mSize, args...);
     }
 
+    /**
+     * @brief Destruct the last @a howMuch elements, but keep their memory.
+     */
     void shrinkWithoutFree(SizeType howMuch) {
         ZQ_ASSERT (mSize >= howMuch);
 
         mSize -= howMuch;
+        mConstructor.destruct (mPointer+mSize, howMuch);
+    }
+
+    /**
+     * @brief Destruct all the elements, but keep the buffer.
+     */
+    void clear ()
+    {
+        shrinkWithoutFree (mSize);
+    }
+
+    /**
+     * @brief Make sure that there is a room for at least @a capacity elements
+     *        without reallocating.
+     *
+     * Unlike the automatic growth, allocates exactly @a capacity elements.
+     */
+    void reserve (SizeType capacity)
+    {
+        if (capacity > mCapacity)
+            reallocate (capacity);
+    }
+
+    /**
+     * @brief Free the unused capacity.
+     */
+    void shrinkToFit ()
+    {
+        if (mCapacity != mSize)
+            reallocate (mSize);
     }
 
     template<class ...Args>
@@ -174,16 +227,16 @@ public:
 
     template<class InputIterator>
     void expand (InputIterator begin, InputIterator end, SizeType beginToEnd) {
-        SizeType oldSize = mSize;
+        if (mSize + beginToEnd > mCapacity)
+            grow (mSize + beginToEnd);
 
-        resizeBuffer (mSize + beginToEnd);
-        insertToUninitilizedBuffer (oldSize, begin, end);
+        mSize += insertToUninitilizedBuffer (mSize, begin, end);
     }
 
     template<class InputIterator>
     void expand (InputIterator begin, InputIterator end)
     {
-        expand (begin, end, countRange (begin, end));
+        expand (begin, end, iteratorsRange (begin, end));
     }
 
     /**
@@ -191,11 +244,12 @@ public:
      */
     template<class...InputIteratorsPairsOrTriples>
     void expandFew (const InputIteratorsPairsOrTriples&... beginAndEnds) {
-        SizeType oldSize = mSize;
-        SizeType size = plusArgs<SizeType> (countRange (beginAndEnds)...);
+        SizeType size = plusArgs<SizeType> (iteratorsRange (beginAndEnds)...);
+
+        if (mSize + size > mCapacity)
+            grow (mSize + size);
 
-        resizeBuffer (mSize + size);
-        expandFewInsertLoop (oldSize, beginAndEnds...);
+        expandFewInsertLoop (beginAndEnds...);
     }
 
     T *data()
@@ -233,64 +287,71 @@ public:
         return mSize;
     }
 
+    /**
+     * @brief The number of elements the buffer can hold without reallocating.
+     */
+    SizeType capacity() const
+    {
+        return mCapacity;
+    }
+
     void swap(Vector &other) {
         Base::swap (mPointer, other.mPointer);
         Base::swap (mSize, other.mSize);
+        Base::swap (mCapacity, other.mCapacity);
         Base::swap (mConstructor, other.mConstructor);
         Base::swap (mAllocator, other.mAllocator);
     }
 
 private:
     Vector(UniquePointer<T[]> &&array)
-        : mPointer{array.release ()}, mSize{array.size ()}
+        : mPointer{array.release ()}, mSize{array.size ()}, mCapacity{mSize}
     {
         array.reset ();
     }
 
     template<class Arg, class...Args>
-    void expandFewInsertLoop (SizeType currnetIndex,
-                              const Arg &beginAndEnd,
+    void expandFewInsertLoop (const Arg &beginAndEnd,
                               const Args&...args)
     {
-        currnetIndex += insertToUninitilizedBuffer (currnetIndex,
-                                                    beginAndEnd.first,
-                                                    beginAndEnd.second);
-        return expandFewInsertLoop (currnetIndex, args...);
+        mSize += insertToUninitilizedBuffer (mSize,
+                                             beginAndEnd.first,
+                                             beginAndEnd.second);
+        return expandFewInsertLoop (args...);
+    }
+
+    void expandFewInsertLoop ()
+    {
     }
 
     void makeEmpty () {
         mPointer = nullptr;
         mSize = 0;
+        mCapacity = 0;
     }
 
-    void resizeBuffer (SizeType newSize) {
-        if (mSize == newSize) {
-            // destruct without free ing.
-            mConstructor.destruct (mPointer, mSize);
-            return;
-        }
+    // Reallocate for at least @a minimumCapacity elements: at least double the
+    // current capacity, so a sequence of expands costs amortized O(1) per element.
+    void grow (SizeType minimumCapacity) {
+        reallocate (max (minimumCapacity, mCapacity * 2));
+    }
 
-        PointerType pointer{Base::move (mPointer)};
-        auto pointerSize = mSize;
+    // Move the elements to a new buffer of exactly @a newCapacity elements.
+    void reallocate (SizeType newCapacity) {
+        ZQ_ASSERT (newCapacity >= mSize);
 
-        if (newSize != 0) {
-            mPointer = mAllocator.allocate (newSize);
-            mSize = newSize;
-        } else {
-            makeEmpty();
-        }
+        PointerType pointer = nullptr;
+        if (newCapacity != 0)
+            pointer = mAllocator.allocate (newCapacity);
 
-        if (pointerSize != 0) {
-            moveOldBufferToNew (pointer, pointerSize, newSize);
-            deleteAll (pointer, pointerSize);
-        }
-    }
+        if (mSize != 0)
+            mConstructor.relocate (pointer, mPointer, mSize);
+
+        if (mPointer != nullptr)
+            mAllocator.deallocate (mPointer);
 
-    // Move oldBuffer to mPointer (maybe only particly).
-    void moveOldBufferToNew(PointerType &oldBuffer, SizeType oldSize, SizeType newSize) {
-        insertToUninitilizedBuffer (0,
-                                    makeMoveIterator (oldBuffer),
-                                    makeMoveIterator (oldBuffer + min(oldSize, newSize)));
+        mPointer = pointer;
+        mCapacity = newCapacity;
     }
 
     template<class InputIterator>
@@ -307,16 +368,17 @@ private:
         return currentIndex-index;
     }
 
-    void deleteAll (PointerType pointer, SizeType size) {
-        if (size == 0)
+    void deleteAll () {
+        if (mPointer == nullptr)
             return;
 
-        mConstructor.destruct (pointer, size);
-        mAllocator.deallocate (pointer);
+        mConstructor.destruct (mPointer, mSize);
+        mAllocator.deallocate (mPointer);
     }
 
     PointerType mPointer = nullptr;
     SizeType mSize = 0;
+    SizeType mCapacity = 0;
 
     Allocator mAllocator;
     Constructor mConstructor;
@@ -0,0 +1,163 @@
+/**
+ * @file CheckpointCompactor.cpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Main: copyright (C) 2016 Shmuel Hazan
+ *
+ * Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "CheckpointCompactor.hpp"
+
+#include "Base/Metrics.hpp"
+
+#include "CppCore/Memory.h"
+
+#include "Common/MemoryRevisionTree.hpp"
+
+namespace Ziqe {
+
+namespace {
+Base::Metrics::Counter gCompactedCheckpoints{"Checkpoint/compacted"};
+Base::Metrics::Counter gCompactedDiffs{"Checkpoint/compactedDiffs"};
+}
+
+constexpr SizeType CheckpointCompactor::kPagesPerStep;
+
+Base::Expected<CheckpointCompactor, CheckpointReader::Error> CheckpointCompactor::Create(CheckpointReader &&base,
+                                                                                       Base::Vector<CheckpointReader> &&deltas,
+                                                                                       CheckpointWriter &writer)
+{
+    if (base.getBaseRevision () != MemoryRevisionTree::kInitialID)
+        return Base::Error (CheckpointReader::Error::WrongBase);
+
+    auto revision = base.getRevision ();
+
+    for (const auto &delta : deltas) {
+        if (delta.getBaseRevision () != revision || delta.getRevision () <= revision)
+            return Base::Error (CheckpointReader::Error::WrongBase);
+
+        revision = delta.getRevision ();
+    }
+
+    return {CheckpointCompactor{Base::move (base), Base::move (deltas), writer}};
+}
+
+CheckpointCompactor::CheckpointCompactor(CheckpointReader &&base,
+                                         Base::Vector<CheckpointReader> &&deltas,
+                                         CheckpointWriter &writer)
+    : mBase{Base::move (base)}, mDeltas{Base::move (deltas)}, mWriter{&writer}
+{
+    for (const auto &delta : mDeltas)
+        mSquashed.merge (delta.getPageDiffs ());
+
+    mPages = mBase.getPendingPages ();
+
+    SizeType newPagesCount = 0;
+    for (const auto &diff : mSquashed.getPageDiffs ()) {
+        if (! mBase.hasPage (diff.getAddress ()))
+            ++newPagesCount;
+    }
+
+    SizeType position = mPages.size ();
+    mPages.expand (newPagesCount);
+
+    // The diffs are sorted, so are the new pages.
+    for (const auto &diff : mSquashed.getPageDiffs ()) {
+        if (! mBase.hasPage (diff.getAddress ()))
+            mPages[position++] = diff.getAddress ();
+    }
+
+    mPage.resize (ZQ_PAGE_SIZE);
+}
+
+ZqError CheckpointCompactor::step(SizeType maxPages)
+{
+    if (! mIsStarted) {
+        auto result = writeHead ();
+        if (result != ZQ_E_OK)
+            return result;
+
+        mIsStarted = true;
+    }
+
+    for (SizeType written = 0; written < maxPages && mNextPage < mPages.size (); ++written) {
+        auto result = writePage (mPages[mNextPage++]);
+        if (result != ZQ_E_OK)
+            return result;
+    }
+
+    if (mNextPage < mPages.size ())
+        return ZQ_E_AGAIN;
+
+    gCompactedCheckpoints.add ();
+    return mWriter->finish ();
+}
+
+ZqError CheckpointCompactor::writeHead()
+{
+    const auto &newest = getNewest ();
+
+    auto result = mWriter->start ();
+
+    if (result == ZQ_E_OK)
+        result = mWriter->addRevision (MemoryRevisionTree::kInitialID, newest.getRevision ());
+
+    // The threads and the areas are of the newest checkpoint.
+    for (SizeType i = 0; result == ZQ_E_OK && i < newest.getThreads ().size (); ++i) {
+        const auto &thread = newest.getThreads ()[i];
+
+        result = mWriter->addThread (thread.thread, thread.state);
+    }
+
+    for (SizeType i = 0; result == ZQ_E_OK && i < newest.getAreas ().size (); ++i) {
+        const auto &area = newest.getAreas ()[i];
+
+        result = mWriter->addArea (area.start, area.length, area.protection);
+    }
+
+    return result;
+}
+
+ZqError CheckpointCompactor::writePage(Address page)
+{
+    const uint8_t *content = nullptr;
+
+    if (mBase.hasPage (page)) {
+        auto taken = mBase.takePage (page);
+        if (! taken)
+            return ZQ_E_INVALID_ARG;
+
+        content = *taken;
+    }
+
+    auto diff = mSquashed.find (page);
+
+    // Unchanged: copy the page as it is in the file.
+    if (diff == nullptr && content != nullptr)
+        return mWriter->addPage (page, content);
+
+    if (content == nullptr)
+        memset (mPage.data (), 0, ZQ_PAGE_SIZE);
+    else
+        memcpy (mPage.data (), content, ZQ_PAGE_SIZE);
+
+    if (diff != nullptr) {
+        diff->apply (mPage.data ());
+        gCompactedDiffs.add ();
+    }
+
+    return mWriter->addPage (page, mPage.data ());
+}
+
+} // namespace Ziqe
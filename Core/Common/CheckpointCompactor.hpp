@@ -0,0 +1,115 @@
+/**
+ * @file CheckpointCompactor.hpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Main: copyright (C) 2016 Shmuel Hazan
+ *
+ * Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ZIQE_CORE_CHECKPOINTCOMPACTOR_H
+#define ZIQE_CORE_CHECKPOINTCOMPACTOR_H
+
+#include "Base/Types.hpp"
+#include "Base/Vector.hpp"
+#include "Base/Expected.hpp"
+
+#include "CppCore/Error.h"
+
+#include "Common/CheckpointReader.hpp"
+#include "Common/CheckpointWriter.hpp"
+
+#include "Protocol/MemoryRevision.hpp"
+
+namespace Ziqe {
+
+/**
+ * @brief Fold a chain of incremental checkpoints into their base, as a
+ *        new full checkpoint.
+ *
+ * The page diffs of the chain are squashed once, then every page of the
+ * base is copied, with its diff applied. The work is done in slices
+ * (step()), so it can run in the background between periodic checkpoints
+ * and keep the chain short: a restore reads a single full checkpoint.
+ *
+ * @note Not thread safe. The files' mappings and the writer must outlive
+ *       the compactor.
+ */
+class CheckpointCompactor
+{
+public:
+    typedef CheckpointReader::Address Address;
+
+    static constexpr SizeType kPagesPerStep = 256;
+
+    /**
+     * @param base    A full checkpoint.
+     * @param deltas  Incremental checkpoints, the first on @a base and
+     *                every other on the one before it.
+     */
+    static Base::Expected<CheckpointCompactor, CheckpointReader::Error> Create (CheckpointReader &&base,
+                                                                               Base::Vector<CheckpointReader> &&deltas,
+                                                                               CheckpointWriter &writer);
+
+    ZQ_ALLOW_MOVE (CheckpointCompactor)
+    ZQ_DISALLOW_COPY (CheckpointCompactor)
+
+    /**
+     * @brief Write up to @a maxPages pages of the new checkpoint.
+     * @return ZQ_E_AGAIN while there are pages left, ZQ_E_OK once the new
+     *         checkpoint is finished, ZQ_E_INVALID_ARG for a corrupted
+     *         page or the writer's error.
+     */
+    ZqError step (SizeType maxPages = kPagesPerStep);
+
+    /**
+     * @brief The revision of the new checkpoint (the newest delta's).
+     */
+    Protocol::MemoryRevision::ID getRevision () const
+    {
+        return getNewest ().getRevision ();
+    }
+
+private:
+    CheckpointCompactor(CheckpointReader &&base,
+                        Base::Vector<CheckpointReader> &&deltas,
+                        CheckpointWriter &writer);
+
+    const CheckpointReader &getNewest () const
+    {
+        return mDeltas.size () == 0 ? mBase : mDeltas[mDeltas.size () - 1];
+    }
+
+    /// The file header, the revision, the threads and the areas.
+    ZqError writeHead ();
+
+    ZqError writePage (Address page);
+
+    CheckpointReader mBase;
+    Base::Vector<CheckpointReader> mDeltas;
+    CheckpointWriter *mWriter;
+
+    /// The diffs of all the deltas, a newer one wins.
+    Protocol::MemoryRevision mSquashed;
+
+    /// The base's pages in its order, then the pages only the deltas have.
+    Base::Vector<Address> mPages;
+    SizeType mNextPage = 0;
+    bool mIsStarted = false;
+
+    Base::Vector<uint8_t> mPage;
+};
+
+} // namespace Ziqe
+
+#endif // ZIQE_CORE_CHECKPOINTCOMPACTOR_H
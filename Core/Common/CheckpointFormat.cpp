@@ -0,0 +1,107 @@
+/**
+ * @file CheckpointFormat.cpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Main: copyright (C) 2016 Shmuel Hazan
+ *
+ * Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "CheckpointFormat.hpp"
+
+namespace Ziqe {
+
+namespace {
+constexpr uint32_t kCrc32cPolynomial = 0x82f63b78;
+
+struct Crc32cTable {
+    Crc32cTable ()
+    {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+
+            for (int bit = 0; bit < 8; ++bit)
+                crc = (crc >> 1) ^ ((crc & 1) ? kCrc32cPolynomial : 0);
+
+            entries[i] = crc;
+        }
+    }
+
+    uint32_t entries[256];
+};
+
+const Crc32cTable gCrc32cTable;
+}
+
+uint32_t CheckpointFormat::Crc32c(const uint8_t *data, SizeType size, uint32_t crc)
+{
+    crc = ~crc;
+
+    for (SizeType i = 0; i < size; ++i)
+        crc = gCrc32cTable.entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+
+    return ~crc;
+}
+
+void CheckpointFormat::WriteChunkHeader(uint8_t *buffer, const ChunkHeader &header)
+{
+    Write32 (buffer, static_cast<uint32_t>(header.type));
+    Write32 (buffer + 4, header.payloadSize);
+    Write32 (buffer + 8, header.checksum);
+    Write32 (buffer + 12, 0);
+}
+
+CheckpointFormat::ChunkHeader CheckpointFormat::ReadChunkHeader(const uint8_t *buffer)
+{
+    return {static_cast<ChunkType>(Read32 (buffer)), Read32 (buffer + 4), Read32 (buffer + 8)};
+}
+
+void CheckpointFormat::WriteIndexEntry(uint8_t *buffer, const IndexEntry &entry)
+{
+    Write32 (buffer, static_cast<uint32_t>(entry.type));
+    Write32 (buffer + 4, entry.count);
+    Write64 (buffer + 8, entry.address);
+    Write64 (buffer + 16, entry.offset);
+}
+
+CheckpointFormat::IndexEntry CheckpointFormat::ReadIndexEntry(const uint8_t *buffer)
+{
+    return {static_cast<ChunkType>(Read32 (buffer)), Read32 (buffer + 4), Read64 (buffer + 8), Read64 (buffer + 16)};
+}
+
+void CheckpointFormat::Write32(uint8_t *buffer, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+        buffer[i] = static_cast<uint8_t>(value >> (i * 8));
+}
+
+void CheckpointFormat::Write64(uint8_t *buffer, uint64_t value)
+{
+    Write32 (buffer, static_cast<uint32_t>(value));
+    Write32 (buffer + 4, static_cast<uint32_t>(value >> 32));
+}
+
+uint32_t CheckpointFormat::Read32(const uint8_t *buffer)
+{
+    return  static_cast<uint32_t>(buffer[0])
+            | (static_cast<uint32_t>(buffer[1]) << 8)
+            | (static_cast<uint32_t>(buffer[2]) << 16)
+            | (static_cast<uint32_t>(buffer[3]) << 24);
+}
+
+uint64_t CheckpointFormat::Read64(const uint8_t *buffer)
+{
+    return static_cast<uint64_t>(Read32 (buffer)) | (static_cast<uint64_t>(Read32 (buffer + 4)) << 32);
+}
+
+} // namespace Ziqe
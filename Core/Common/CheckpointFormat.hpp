@@ -0,0 +1,119 @@
+/**
+ * @file CheckpointFormat.hpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Main: copyright (C) 2016 Shmuel Hazan
+ *
+ * Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ZIQE_CORE_CHECKPOINTFORMAT_H
+#define ZIQE_CORE_CHECKPOINTFORMAT_H
+
+#include "Base/Types.hpp"
+
+namespace Ziqe {
+
+/**
+ * @brief The layout of a checkpoint file.
+ *
+ * A file header, then chunks. Every chunk has a header and a payload:
+ *
+ *   File header : magic (u64), version (u32), page size (u32)
+ *   Chunk header: type (u32), payload size (u32), CRC-32C of the payload (u32), 0 (u32)
+ *
+ *   Thread   : thread (u64), registers count (u32), registers (u64 each)
+ *   Area     : start (u64), length (u64), protection (u32)
+ *   Pages    : first page (u64), count (u32), the pages' offset in the
+ *              payload (u32), padding, the pages. The pages are page
+ *              aligned in the file, so they can be mapped as they are.
+ *   ZeroPages: first page (u64), count (u32)
+ *   Revision : the base revision (u64, 0 for a full checkpoint), the
+ *              memory revision (u64) the checkpoint was taken at.
+ *   PageDiff : page (u64), runs size (u32), the runs (see Protocol::PageDiff).
+ *   Index    : an IndexEntry (type, count, first page, chunk offset) for
+ *              every chunk above.
+ *   End      : the index's offset (u64), the number of chunks (u64).
+ *              Always the last kEndChunkSize bytes of the file.
+ *
+ * Consecutive pages are written in runs of up to kMaxPagesPerChunk, and
+ * runs of zero pages take no space. A reader finds the index through the
+ * End chunk, so it doesn't have to read the pages to start.
+ *
+ * An incremental checkpoint has page diffs instead of pages: applied in
+ * order on its base checkpoint (the one taken at its base revision), it
+ * makes the process' memory at its revision. See CheckpointCompactor.
+ *
+ * All the integers are little endian.
+ */
+class CheckpointFormat
+{
+public:
+    static constexpr uint64_t kMagic = 0x003154504b43515aull; // "ZQCKPT1"
+    static constexpr uint32_t kVersion = 1;
+
+    static constexpr SizeType kMaxPagesPerChunk = 64;
+
+    enum class ChunkType : uint32_t {
+        Thread = 1,
+        Area,
+        Pages,
+        ZeroPages,
+        Index,
+        End,
+        Revision,
+        PageDiff
+    };
+
+    static constexpr SizeType kFileHeaderSize = 16;
+    static constexpr SizeType kChunkHeaderSize = 16;
+    static constexpr SizeType kIndexEntrySize = 24;
+    static constexpr SizeType kPagesHeaderSize = 16;
+    static constexpr SizeType kRunHeaderSize = 12;
+    static constexpr SizeType kEndChunkSize = kChunkHeaderSize + 16;
+    static constexpr SizeType kRevisionSize = 16;
+    static constexpr SizeType kPageDiffHeaderSize = 12;
+
+    struct ChunkHeader {
+        ChunkType type;
+        uint32_t payloadSize;
+        uint32_t checksum;
+    };
+
+    struct IndexEntry {
+        ChunkType type;
+        uint32_t count;
+        uint64_t address;
+        uint64_t offset;
+    };
+
+    /**
+     * @brief CRC-32C (Castagnoli) of @a size bytes, continuing @a crc.
+     */
+    static uint32_t Crc32c (const uint8_t *data, SizeType size, uint32_t crc = 0);
+
+    static void WriteChunkHeader (uint8_t *buffer, const ChunkHeader &header);
+    static ChunkHeader ReadChunkHeader (const uint8_t *buffer);
+
+    static void WriteIndexEntry (uint8_t *buffer, const IndexEntry &entry);
+    static IndexEntry ReadIndexEntry (const uint8_t *buffer);
+
+    static void Write32 (uint8_t *buffer, uint32_t value);
+    static void Write64 (uint8_t *buffer, uint64_t value);
+    static uint32_t Read32 (const uint8_t *buffer);
+    static uint64_t Read64 (const uint8_t *buffer);
+};
+
+} // namespace Ziqe
+
+#endif // ZIQE_CORE_CHECKPOINTFORMAT_H
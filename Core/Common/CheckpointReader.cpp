@@ -0,0 +1,275 @@
+/**
+ * @file CheckpointReader.cpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Main: copyright (C) 2016 Shmuel Hazan
+ *
+ * Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "CheckpointReader.hpp"
+
+#include "Base/Metrics.hpp"
+
+namespace Ziqe {
+
+namespace {
+Base::Metrics::Counter gRestoredPages{"Checkpoint/restoredPages"};
+Base::Metrics::Counter gCorruptedChunks{"Checkpoint/corruptedChunks"};
+}
+
+Base::Expected<CheckpointReader, CheckpointReader::Error> CheckpointReader::Open(const uint8_t *file, SizeType size)
+{
+    if (size < CheckpointFormat::kFileHeaderSize + CheckpointFormat::kEndChunkSize)
+        return Base::Error (Error::TooShort);
+
+    if (CheckpointFormat::Read64 (file) != CheckpointFormat::kMagic)
+        return Base::Error (Error::BadMagic);
+
+    if (CheckpointFormat::Read32 (file + 8) != CheckpointFormat::kVersion
+        || CheckpointFormat::Read32 (file + 12) != ZQ_PAGE_SIZE)
+        return Base::Error (Error::BadVersion);
+
+    CheckpointReader reader;
+
+    auto result = reader.readIndex (file, size);
+    if (! result)
+        return Base::Error (Base::move (result.getError ()));
+
+    return {Base::move (reader)};
+}
+
+Base::Expected<const uint8_t *, CheckpointReader::Error> CheckpointReader::takePage(Address page)
+{
+    auto iterator = mPendingPages.find (page);
+    if (iterator == mPendingPages.end ())
+        return Base::Error (Error::NotFound);
+
+    auto &run = mRuns[iterator->second];
+
+    if (run.type == CheckpointFormat::ChunkType::ZeroPages) {
+        mPendingPages.erase (iterator);
+        gRestoredPages.add ();
+        return {static_cast<const uint8_t *>(nullptr)};
+    }
+
+    // Verify the whole chunk the first time one of its pages is taken.
+    // A page that fails the check stays pending.
+    if (! run.isVerified) {
+        if (CheckpointFormat::Crc32c (run.payload, run.payloadSize) != run.checksum) {
+            gCorruptedChunks.add ();
+            return Base::Error (Error::BadChecksum);
+        }
+
+        run.isVerified = true;
+    }
+
+    mPendingPages.erase (iterator);
+    gRestoredPages.add ();
+    return {run.pages + (page - run.address)};
+}
+
+Base::Vector<CheckpointReader::Address> CheckpointReader::getPendingPages() const
+{
+    Base::Vector<Address> pages;
+    SizeType pagesCount = 0;
+
+    pages.resize (mPendingPages.size ());
+
+    for (SizeType i = 0; i < mRuns.size (); ++i) {
+        const auto &run = mRuns[i];
+
+        if (run.type != CheckpointFormat::ChunkType::Pages && run.type != CheckpointFormat::ChunkType::ZeroPages)
+            continue;
+
+        // Skip the pages that a later run has a copy of.
+        for (SizeType page = 0; page < run.count; ++page) {
+            auto address = run.address + page * ZQ_PAGE_SIZE;
+            auto iterator = mPendingPages.find (address);
+
+            if (iterator != mPendingPages.end () && iterator->second == i)
+                pages[pagesCount++] = address;
+        }
+    }
+
+    return pages;
+}
+
+Base::Expected<bool, CheckpointReader::Error> CheckpointReader::readIndex(const uint8_t *file, SizeType size)
+{
+    using Format = CheckpointFormat;
+
+    // Read a chunk's header and check that its payload is in the file.
+    auto readChunk = [file, size](uint64_t offset,
+                                  Format::ChunkType type,
+                                  Format::ChunkHeader &header) {
+        if (offset < Format::kFileHeaderSize || offset > size - Format::kChunkHeaderSize)
+            return false;
+
+        header = Format::ReadChunkHeader (file + offset);
+
+        return header.type == type
+               && header.payloadSize <= size - Format::kChunkHeaderSize - offset;
+    };
+
+    auto isValid = [file](uint64_t offset, const Format::ChunkHeader &header) {
+        return Format::Crc32c (file + offset + Format::kChunkHeaderSize, header.payloadSize) == header.checksum;
+    };
+
+    Format::ChunkHeader header;
+    uint64_t endOffset = size - Format::kEndChunkSize;
+
+    if (! readChunk (endOffset, Format::ChunkType::End, header) || header.payloadSize != 16)
+        return Base::Error (Error::Malformed);
+
+    if (! isValid (endOffset, header))
+        return Base::Error (Error::BadChecksum);
+
+    auto end = file + endOffset + Format::kChunkHeaderSize;
+    uint64_t indexOffset = Format::Read64 (end);
+    uint64_t chunksCount = Format::Read64 (end + 8);
+
+    if (! readChunk (indexOffset, Format::ChunkType::Index, header)
+        || header.payloadSize / Format::kIndexEntrySize != chunksCount
+        || header.payloadSize % Format::kIndexEntrySize != 0)
+        return Base::Error (Error::Malformed);
+
+    if (! isValid (indexOffset, header))
+        return Base::Error (Error::BadChecksum);
+
+    auto index = file + indexOffset + Format::kChunkHeaderSize;
+
+    // A run for every chunk (only the pages chunks use theirs): Vector
+    // reallocates on every expand.
+    mRuns.resize (chunksCount);
+
+    for (uint64_t i = 0; i < chunksCount; ++i) {
+        auto entry = Format::ReadIndexEntry (index + i * Format::kIndexEntrySize);
+
+        if (entry.offset >= indexOffset || ! readChunk (entry.offset, entry.type, header))
+            return Base::Error (Error::Malformed);
+
+        auto payload = file + entry.offset + Format::kChunkHeaderSize;
+
+        switch (entry.type) {
+        case Format::ChunkType::Thread: {
+            constexpr SizeType kWordsCount = Protocol::ThreadState::kWordsCount;
+
+            if (header.payloadSize != 12 + kWordsCount * sizeof (uint64_t)
+                || Format::Read32 (payload + 8) != kWordsCount)
+                return Base::Error (Error::Malformed);
+
+            if (! isValid (entry.offset, header))
+                return Base::Error (Error::BadChecksum);
+
+            ZqThreadRegisters registers;
+            auto words = reinterpret_cast<ZqRegisterType *>(&registers);
+
+            for (SizeType word = 0; word < kWordsCount; ++word)
+                words[word] = static_cast<ZqRegisterType>(Format::Read64 (payload + 12 + word * sizeof (uint64_t)));
+
+            mThreads.expand (1, Thread{Format::Read64 (payload), Protocol::ThreadState{registers}});
+            break;
+        }
+        case Format::ChunkType::Area:
+            if (header.payloadSize != 20)
+                return Base::Error (Error::Malformed);
+
+            if (! isValid (entry.offset, header))
+                return Base::Error (Error::BadChecksum);
+
+            mAreas.expand (1, Area{Format::Read64 (payload),
+                                   static_cast<SizeType>(Format::Read64 (payload + 8)),
+                                   Format::Read32 (payload + 16)});
+            break;
+
+        case Format::ChunkType::Pages:
+        case Format::ChunkType::ZeroPages: {
+            bool isZero = entry.type == Format::ChunkType::ZeroPages;
+            SizeType runHeaderSize = isZero ? Format::kRunHeaderSize : Format::kPagesHeaderSize;
+
+            if (header.payloadSize < runHeaderSize
+                || entry.count == 0
+                || entry.count > Format::kMaxPagesPerChunk
+                || entry.address % ZQ_PAGE_SIZE != 0
+                || Format::Read64 (payload) != entry.address
+                || Format::Read32 (payload + 8) != entry.count)
+                return Base::Error (Error::Malformed);
+
+            Run run{entry.type, entry.count, entry.address, payload, header.payloadSize, nullptr, header.checksum, false};
+
+            if (! isZero) {
+                auto pagesOffset = Format::Read32 (payload + 12);
+
+                if (pagesOffset < runHeaderSize
+                    || pagesOffset + entry.count * ZQ_PAGE_SIZE != header.payloadSize)
+                    return Base::Error (Error::Malformed);
+
+                run.pages = payload + pagesOffset;
+            }
+
+            mRuns[i] = run;
+
+            // A later copy of a page wins.
+            for (SizeType page = 0; page < entry.count; ++page) {
+                auto address = entry.address + page * ZQ_PAGE_SIZE;
+                auto iterator = mPendingPages.find (address);
+
+                if (iterator == mPendingPages.end ())
+                    mPendingPages.insert (address, i);
+                else
+                    iterator->second = i;
+            }
+            break;
+        }
+        case Format::ChunkType::Revision:
+            if (header.payloadSize != Format::kRevisionSize)
+                return Base::Error (Error::Malformed);
+
+            if (! isValid (entry.offset, header))
+                return Base::Error (Error::BadChecksum);
+
+            mBaseRevision = Format::Read64 (payload);
+            mRevision = Format::Read64 (payload + 8);
+            break;
+
+        case Format::ChunkType::PageDiff: {
+            // Diffs are small: verify and decode them now.
+            if (header.payloadSize < Format::kPageDiffHeaderSize
+                || Format::Read64 (payload) != entry.address
+                || entry.address % ZQ_PAGE_SIZE != 0
+                || Format::Read32 (payload + 8) != header.payloadSize - Format::kPageDiffHeaderSize)
+                return Base::Error (Error::Malformed);
+
+            if (! isValid (entry.offset, header))
+                return Base::Error (Error::BadChecksum);
+
+            auto runs = payload + Format::kPageDiffHeaderSize;
+            Base::Vector<uint8_t> runsCopy{runs, runs + (header.payloadSize - Format::kPageDiffHeaderSize)};
+
+            if (! Protocol::PageDiff::IsValidRuns (runsCopy))
+                return Base::Error (Error::Malformed);
+
+            // A later diff of a page wins.
+            mPageDiffs.addPageDiff (Protocol::PageDiff{entry.address, Base::move (runsCopy)});
+            break;
+        }
+        default:
+            return Base::Error (Error::Malformed);
+        }
+    }
+
+    return {true};
+}
+
+} // namespace Ziqe
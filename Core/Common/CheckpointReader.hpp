@@ -0,0 +1,166 @@
+/**
+ * @file CheckpointReader.hpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Main: copyright (C) 2016 Shmuel Hazan
+ *
+ * Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ZIQE_CORE_CHECKPOINTREADER_H
+#define ZIQE_CORE_CHECKPOINTREADER_H
+
+#include "Base/Types.hpp"
+#include "Base/Vector.hpp"
+#include "Base/HashTable.hpp"
+#include "Base/Expected.hpp"
+
+#include "Common/Types.hpp"
+#include "Common/PageDirectory.hpp"
+#include "Common/CheckpointFormat.hpp"
+
+#include "Protocol/ThreadState.hpp"
+#include "Protocol/MemoryRevision.hpp"
+
+namespace Ziqe {
+
+/**
+ * @brief Read a checkpoint (see CheckpointFormat) from a memory mapped file.
+ *
+ * Open() reads only the index, the threads and the areas. The pages are
+ * verified and returned when they are taken, so a restored process can
+ * start before its pages are read (or even paged in by the file's mapping).
+ *
+ * @note Not thread safe. The file's mapping must outlive the reader.
+ */
+class CheckpointReader
+{
+public:
+    typedef PageDirectory::Address Address;
+
+    enum class Error {
+        TooShort,
+        BadMagic,
+        BadVersion,
+        BadChecksum,
+        Malformed,
+        NotFound,
+        WrongBase
+    };
+
+    struct Thread {
+        HostedThreadID thread;
+        Protocol::ThreadState state;
+    };
+
+    struct Area {
+        Address start;
+        SizeType length;
+        uint32_t protection;
+    };
+
+    static Base::Expected<CheckpointReader, Error> Open (const uint8_t *file, SizeType size);
+
+    /// An empty checkpoint, to be assigned (in a Vector).
+    CheckpointReader() = default;
+
+    ZQ_ALLOW_MOVE (CheckpointReader)
+    ZQ_DISALLOW_COPY (CheckpointReader)
+
+    const Base::Vector<Thread> &getThreads () const
+    {
+        return mThreads;
+    }
+
+    const Base::Vector<Area> &getAreas () const
+    {
+        return mAreas;
+    }
+
+    /**
+     * @brief Whether @a page is in the checkpoint and hasn't been taken yet.
+     */
+    bool hasPage (Address page) const
+    {
+        return mPendingPages.find (page) != mPendingPages.end ();
+    }
+
+    /**
+     * @brief Get the content of @a page, once.
+     * @return A pointer to the page in the file, or nullptr for a zero page.
+     *         On Error::BadChecksum the page is not taken.
+     */
+    Base::Expected<const uint8_t *, Error> takePage (Address page);
+
+    /**
+     * @brief The pages that haven't been taken yet, in the file's order
+     *        (ascending in every run).
+     */
+    Base::Vector<Address> getPendingPages () const;
+
+    /**
+     * @brief The revision of the checkpoint this one is applied to, or
+     *        MemoryRevisionTree::kInitialID for a full checkpoint.
+     */
+    Protocol::MemoryRevision::ID getBaseRevision () const
+    {
+        return mBaseRevision;
+    }
+
+    Protocol::MemoryRevision::ID getRevision () const
+    {
+        return mRevision;
+    }
+
+    /**
+     * @brief The page diffs of an incremental checkpoint, already verified.
+     */
+    const Protocol::MemoryRevision &getPageDiffs () const
+    {
+        return mPageDiffs;
+    }
+
+private:
+    struct Run {
+        CheckpointFormat::ChunkType type;
+        SizeType count;
+        Address address;
+
+        /// The chunk's payload, and where the pages start in it.
+        const uint8_t *payload;
+        SizeType payloadSize;
+        const uint8_t *pages;
+        uint32_t checksum;
+
+        bool isVerified;
+    };
+
+    Base::Expected<bool, Error> readIndex (const uint8_t *file, SizeType size);
+
+    Base::Vector<Thread> mThreads;
+    Base::Vector<Area> mAreas;
+
+    /// Indexed by the chunk's index entry.
+    Base::Vector<Run> mRuns;
+
+    /// The pages that haven't been taken yet, and their runs.
+    Base::HashTable<Address, SizeType> mPendingPages;
+
+    Protocol::MemoryRevision::ID mBaseRevision = 0;
+    Protocol::MemoryRevision::ID mRevision = 0;
+    Protocol::MemoryRevision mPageDiffs;
+};
+
+} // namespace Ziqe
+
+#endif // ZIQE_CORE_CHECKPOINTREADER_H
@@ -0,0 +1,265 @@
+/**
+ * @file CheckpointWriter.cpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Main: copyright (C) 2016 Shmuel Hazan
+ *
+ * Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "CheckpointWriter.hpp"
+
+#include "Base/Metrics.hpp"
+
+#include "CppCore/Memory.h"
+
+namespace Ziqe {
+
+namespace {
+Base::Metrics::Counter gCheckpointPages{"Checkpoint/pages"};
+Base::Metrics::Counter gCheckpointZeroPages{"Checkpoint/zeroPages"};
+Base::Metrics::Counter gCheckpointBytes{"Checkpoint/bytes"};
+Base::Metrics::Counter gCheckpointPageDiffs{"Checkpoint/pageDiffs"};
+
+bool IsZeroPage (const uint8_t *content)
+{
+    const uint64_t *words = reinterpret_cast<const uint64_t *>(content);
+
+    for (SizeType i = 0; i < ZQ_PAGE_SIZE / sizeof (uint64_t); ++i) {
+        if (words[i] != 0)
+            return false;
+    }
+
+    return true;
+}
+}
+
+CheckpointWriter::CheckpointWriter(CheckpointOutputInterface &output)
+    : mOutput{&output}
+{
+    mRunPages.resize (CheckpointFormat::kMaxPagesPerChunk * ZQ_PAGE_SIZE);
+    mZeros.resize (ZQ_PAGE_SIZE, uint8_t{0});
+}
+
+ZqError CheckpointWriter::start()
+{
+    uint8_t header[CheckpointFormat::kFileHeaderSize];
+
+    CheckpointFormat::Write64 (header, CheckpointFormat::kMagic);
+    CheckpointFormat::Write32 (header + 8, CheckpointFormat::kVersion);
+    CheckpointFormat::Write32 (header + 12, ZQ_PAGE_SIZE);
+
+    return write (header, sizeof (header));
+}
+
+ZqError CheckpointWriter::addThread(HostedThreadID thread, const Protocol::ThreadState &state)
+{
+    constexpr SizeType kWordsCount = Protocol::ThreadState::kWordsCount;
+
+    uint8_t payload[12 + kWordsCount * sizeof (uint64_t)];
+    auto words = reinterpret_cast<const ZqRegisterType *>(&state.getRegisters ());
+
+    CheckpointFormat::Write64 (payload, thread);
+    CheckpointFormat::Write32 (payload + 8, kWordsCount);
+
+    for (SizeType i = 0; i < kWordsCount; ++i)
+        CheckpointFormat::Write64 (payload + 12 + i * sizeof (uint64_t), words[i]);
+
+    return writeChunk (CheckpointFormat::ChunkType::Thread, payload, sizeof (payload), 0, nullptr, 0, true);
+}
+
+ZqError CheckpointWriter::addArea(Address start, SizeType length, uint32_t protection)
+{
+    uint8_t payload[20];
+
+    CheckpointFormat::Write64 (payload, start);
+    CheckpointFormat::Write64 (payload + 8, length);
+    CheckpointFormat::Write32 (payload + 16, protection);
+
+    return writeChunk (CheckpointFormat::ChunkType::Area, payload, sizeof (payload), 0, nullptr, 0, true);
+}
+
+ZqError CheckpointWriter::addPage(Address page, const uint8_t *content)
+{
+    bool isZero = IsZeroPage (content);
+
+    if (mRunCount != 0
+        && (page != mRunStart + mRunCount * ZQ_PAGE_SIZE
+            || isZero != mIsZeroRun
+            || mRunCount == CheckpointFormat::kMaxPagesPerChunk)) {
+        auto result = flushRun ();
+        if (result != ZQ_E_OK)
+            return result;
+    }
+
+    if (mRunCount == 0) {
+        mRunStart = page;
+        mIsZeroRun = isZero;
+    }
+
+    if (! isZero)
+        memcpy (mRunPages.data () + mRunCount * ZQ_PAGE_SIZE, content, ZQ_PAGE_SIZE);
+
+    ++mRunCount;
+    return ZQ_E_OK;
+}
+
+ZqError CheckpointWriter::addRevision(Protocol::MemoryRevision::ID base, Protocol::MemoryRevision::ID revision)
+{
+    uint8_t payload[CheckpointFormat::kRevisionSize];
+
+    CheckpointFormat::Write64 (payload, base);
+    CheckpointFormat::Write64 (payload + 8, revision);
+
+    return writeChunk (CheckpointFormat::ChunkType::Revision, payload, sizeof (payload), 0, nullptr, 0, true);
+}
+
+ZqError CheckpointWriter::addPageDiff(const Protocol::PageDiff &diff)
+{
+    uint8_t head[CheckpointFormat::kPageDiffHeaderSize];
+    const auto &runs = diff.getRuns ();
+
+    CheckpointFormat::Write64 (head, diff.getAddress ());
+    CheckpointFormat::Write32 (head + 8, static_cast<uint32_t>(runs.size ()));
+
+    gCheckpointPageDiffs.add ();
+    return writeChunk (CheckpointFormat::ChunkType::PageDiff,
+                       head, sizeof (head),
+                       0,
+                       runs.data (), runs.size (),
+                       true);
+}
+
+ZqError CheckpointWriter::finish()
+{
+    auto result = flushRun ();
+    if (result != ZQ_E_OK)
+        return result;
+
+    uint64_t indexOffset = mOffset;
+
+    result = writeChunk (CheckpointFormat::ChunkType::Index,
+                         mIndex.data (), mIndexSize, 0, nullptr, 0, false);
+    if (result != ZQ_E_OK)
+        return result;
+
+    uint8_t end[16];
+
+    CheckpointFormat::Write64 (end, indexOffset);
+    CheckpointFormat::Write64 (end + 8, mChunksCount);
+
+    return writeChunk (CheckpointFormat::ChunkType::End, end, sizeof (end), 0, nullptr, 0, false);
+}
+
+ZqError CheckpointWriter::flushRun()
+{
+    if (mRunCount == 0)
+        return ZQ_E_OK;
+
+    uint8_t head[CheckpointFormat::kPagesHeaderSize];
+    auto count = static_cast<uint32_t>(mRunCount);
+
+    CheckpointFormat::Write64 (head, mRunStart);
+    CheckpointFormat::Write32 (head + 8, count);
+
+    ZqError result;
+
+    if (mIsZeroRun) {
+        gCheckpointZeroPages.add (mRunCount);
+        result = writeChunk (CheckpointFormat::ChunkType::ZeroPages,
+                             head, CheckpointFormat::kRunHeaderSize, 0, nullptr, 0, true);
+    } else {
+        // Page align the pages in the file.
+        auto pagesStart = mOffset + CheckpointFormat::kChunkHeaderSize + CheckpointFormat::kPagesHeaderSize;
+        auto padding = static_cast<SizeType>((ZQ_PAGE_SIZE - pagesStart % ZQ_PAGE_SIZE) % ZQ_PAGE_SIZE);
+
+        CheckpointFormat::Write32 (head + 12, static_cast<uint32_t>(CheckpointFormat::kPagesHeaderSize + padding));
+
+        gCheckpointPages.add (mRunCount);
+        result = writeChunk (CheckpointFormat::ChunkType::Pages,
+                             head, sizeof (head),
+                             padding,
+                             mRunPages.data (), mRunCount * ZQ_PAGE_SIZE,
+                             true);
+    }
+
+    mRunCount = 0;
+    return result;
+}
+
+ZqError CheckpointWriter::writeChunk(CheckpointFormat::ChunkType type,
+                                     const uint8_t *head,
+                                     SizeType headSize,
+                                     SizeType padding,
+                                     const uint8_t *body,
+                                     SizeType bodySize,
+                                     bool isIndexed)
+{
+    ZQ_ASSERT (padding <= mZeros.size ());
+
+    uint32_t checksum = CheckpointFormat::Crc32c (head, headSize);
+    checksum = CheckpointFormat::Crc32c (mZeros.data (), padding, checksum);
+    checksum = CheckpointFormat::Crc32c (body, bodySize, checksum);
+
+    if (isIndexed) {
+        CheckpointFormat::IndexEntry entry{type, 1, 0, mOffset};
+
+        if (type == CheckpointFormat::ChunkType::Pages || type == CheckpointFormat::ChunkType::ZeroPages) {
+            entry.address = mRunStart;
+            entry.count = static_cast<uint32_t>(mRunCount);
+        } else if (type == CheckpointFormat::ChunkType::PageDiff) {
+            entry.address = CheckpointFormat::Read64 (head);
+        }
+
+        // Grow geometrically: Vector reallocates on every expand.
+        if (mIndexSize + CheckpointFormat::kIndexEntrySize > mIndex.size ())
+            mIndex.resize (mIndex.size () * 2 + CheckpointFormat::kIndexEntrySize * 64);
+
+        CheckpointFormat::WriteIndexEntry (mIndex.data () + mIndexSize, entry);
+        mIndexSize += CheckpointFormat::kIndexEntrySize;
+
+        ++mChunksCount;
+    }
+
+    uint8_t header[CheckpointFormat::kChunkHeaderSize];
+    CheckpointFormat::WriteChunkHeader (header, {type,
+                                                 static_cast<uint32_t>(headSize + padding + bodySize),
+                                                 checksum});
+
+    auto result = write (header, sizeof (header));
+
+    if (result == ZQ_E_OK)
+        result = write (head, headSize);
+
+    if (result == ZQ_E_OK && padding != 0)
+        result = write (mZeros.data (), padding);
+
+    if (result == ZQ_E_OK && bodySize != 0)
+        result = write (body, bodySize);
+
+    return result;
+}
+
+ZqError CheckpointWriter::write(const uint8_t *data, SizeType size)
+{
+    auto result = mOutput->write (data, size);
+
+    if (result == ZQ_E_OK) {
+        mOffset += size;
+        gCheckpointBytes.add (size);
+    }
+
+    return result;
+}
+
+} // namespace Ziqe
@@ -0,0 +1,126 @@
+/**
+ * @file CheckpointWriter.hpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Main: copyright (C) 2016 Shmuel Hazan
+ *
+ * Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ZIQE_CORE_CHECKPOINTWRITER_H
+#define ZIQE_CORE_CHECKPOINTWRITER_H
+
+#include "Base/Types.hpp"
+#include "Base/Vector.hpp"
+
+#include "CppCore/Error.h"
+
+#include "Common/Types.hpp"
+#include "Common/PageDirectory.hpp"
+#include "Common/CheckpointFormat.hpp"
+#include "Common/CheckpointOutputInterface.hpp"
+
+#include "Protocol/ThreadState.hpp"
+#include "Protocol/MemoryRevision.hpp"
+
+namespace Ziqe {
+
+/**
+ * @brief Stream a checkpoint (see CheckpointFormat) to an output.
+ *
+ * Call start(), add the threads, the areas and the pages (in any order,
+ * but in ascending address order consecutive pages are written as a
+ * single chunk), then finish(). Only a single run of pages is buffered.
+ *
+ * @note Not thread safe.
+ */
+class CheckpointWriter
+{
+public:
+    typedef PageDirectory::Address Address;
+
+    explicit CheckpointWriter(CheckpointOutputInterface &output);
+
+    ZQ_ALLOW_MOVE (CheckpointWriter)
+    ZQ_DISALLOW_COPY (CheckpointWriter)
+
+    /**
+     * @brief Write the file header.
+     */
+    ZqError start ();
+
+    ZqError addThread (HostedThreadID thread, const Protocol::ThreadState &state);
+    ZqError addArea (Address start, SizeType length, uint32_t protection);
+
+    /**
+     * @brief Add the content of @a page (ZQ_PAGE_SIZE bytes).
+     */
+    ZqError addPage (Address page, const uint8_t *content);
+
+    /**
+     * @brief Record the memory revision the checkpoint is taken at, and
+     *        for an incremental checkpoint, the revision of its base.
+     */
+    ZqError addRevision (Protocol::MemoryRevision::ID base, Protocol::MemoryRevision::ID revision);
+
+    /**
+     * @brief Add the changes to a page since the base checkpoint, for an
+     *        incremental checkpoint.
+     */
+    ZqError addPageDiff (const Protocol::PageDiff &diff);
+
+    /**
+     * @brief Write the last run of pages, the index and the End chunk.
+     */
+    ZqError finish ();
+
+    uint64_t getWrittenBytes () const
+    {
+        return mOffset;
+    }
+
+private:
+    ZqError flushRun ();
+
+    /// Write a chunk: @a head, @a padding zero bytes and then @a body.
+    ZqError writeChunk (CheckpointFormat::ChunkType type,
+                        const uint8_t *head,
+                        SizeType headSize,
+                        SizeType padding,
+                        const uint8_t *body,
+                        SizeType bodySize,
+                        bool isIndexed);
+
+    ZqError write (const uint8_t *data, SizeType size);
+
+    CheckpointOutputInterface *mOutput;
+    uint64_t mOffset = 0;
+
+    /// The current run of consecutive pages: all zero pages or none.
+    Address mRunStart = 0;
+    SizeType mRunCount = 0;
+    bool mIsZeroRun = false;
+    Base::Vector<uint8_t> mRunPages;
+
+    /// The entries of the index, written by finish().
+    Base::Vector<uint8_t> mIndex;
+    SizeType mIndexSize = 0;
+    uint64_t mChunksCount = 0;
+
+    /// Zeros, for the padding.
+    Base::Vector<uint8_t> mZeros;
+};
+
+} // namespace Ziqe
+
+#endif // ZIQE_CORE_CHECKPOINTWRITER_H
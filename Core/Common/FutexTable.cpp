@@ -0,0 +1,122 @@
+/**
+ * @file FutexTable.cpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Main: copyright (C) 2016 Shmuel Hazan
+ *
+ * Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "FutexTable.hpp"
+
+#include "Base/Metrics.hpp"
+
+namespace Ziqe {
+
+namespace {
+Base::Metrics::Counter gFutexWaits{"Futex/waits"};
+Base::Metrics::Counter gFutexWoken{"Futex/woken"};
+Base::Metrics::Counter gFutexEmptyWakes{"Futex/emptyWakes"};
+}
+
+void FutexTable::addWaiter(Address futex, const Waiter &waiter)
+{
+    auto iterator = mQueues.find (futex);
+
+    if (iterator == mQueues.end ())
+        iterator = mQueues.insert (futex, QueueType{}).second;
+
+    iterator->second.expand (1, waiter);
+    gFutexWaits.add ();
+}
+
+Base::Vector<FutexTable::Waiter> FutexTable::wake(Address futex, SizeType count, BitsetType bitset)
+{
+    Base::Vector<Waiter> woken;
+    auto iterator = mQueues.find (futex);
+
+    if (iterator == mQueues.end () || count == 0) {
+        gFutexEmptyWakes.add ();
+        return woken;
+    }
+
+    auto &queue = iterator->second;
+    SizeType kept = 0;
+
+    // Take the matching waiters out, keeping the others in order.
+    for (SizeType i = 0; i < queue.size (); ++i) {
+        if (woken.size () < count && (queue[i].bitset & bitset) != 0)
+            woken.expand (1, queue[i]);
+        else
+            queue[kept++] = queue[i];
+    }
+
+    shrinkQueue (iterator, kept);
+
+    gFutexWoken.add (woken.size ());
+    return woken;
+}
+
+bool FutexTable::removeWaiter(Address futex, HostedThreadID thread)
+{
+    auto iterator = mQueues.find (futex);
+
+    if (iterator == mQueues.end ())
+        return false;
+
+    auto &queue = iterator->second;
+
+    for (SizeType i = 0; i < queue.size (); ++i) {
+        if (queue[i].thread != thread)
+            continue;
+
+        for (; i + 1 < queue.size (); ++i)
+            queue[i] = queue[i + 1];
+
+        shrinkQueue (iterator, queue.size () - 1);
+        return true;
+    }
+
+    return false;
+}
+
+void FutexTable::removePeer(PageDirectory::PeerIndex peer)
+{
+    for (auto iterator = mQueues.begin (); iterator != mQueues.end ();) {
+        auto &queue = iterator->second;
+        SizeType kept = 0;
+
+        for (SizeType i = 0; i < queue.size (); ++i) {
+            if (queue[i].peer != peer)
+                queue[kept++] = queue[i];
+        }
+
+        if (kept == 0) {
+            iterator = mQueues.erase (iterator);
+        } else {
+            queue.shrinkWithoutFree (queue.size () - kept);
+            ++iterator;
+        }
+    }
+}
+
+void FutexTable::shrinkQueue(Base::HashTable<Address, QueueType>::Iterator iterator, SizeType newSize)
+{
+    // Erase the whole queue (rather than shrinking it to nothing) so its buffer gets freed.
+    if (newSize == 0)
+        mQueues.erase (iterator);
+    else
+        iterator->second.shrinkWithoutFree (iterator->second.size () - newSize);
+}
+
+} // namespace Ziqe
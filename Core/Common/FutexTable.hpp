@@ -0,0 +1,98 @@
+/**
+ * @file FutexTable.hpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Main: copyright (C) 2016 Shmuel Hazan
+ *
+ * Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ZIQE_CORE_FUTEXTABLE_H
+#define ZIQE_CORE_FUTEXTABLE_H
+
+#include "Base/Types.hpp"
+#include "Base/HashTable.hpp"
+#include "Base/Vector.hpp"
+
+#include "Common/Types.hpp"
+#include "Common/PageDirectory.hpp"
+
+namespace Ziqe {
+
+/**
+ * @brief The wait queues of the futexes in the pages homed at this peer.
+ *
+ * A futex lives with its page: the home serializes the page's ownership
+ * and the futex's waits and wakes, so a waiter that checked the futex's
+ * value can't miss a wake (the waker has to take the page from it first,
+ * through the home).
+ *
+ * @note Not thread safe.
+ */
+class FutexTable
+{
+public:
+    typedef uint64_t Address;
+    typedef uint32_t BitsetType;
+
+    static constexpr BitsetType kMatchAny = ~BitsetType{0};
+
+    struct Waiter {
+        PageDirectory::PeerIndex peer;
+        HostedThreadID thread;
+        BitsetType bitset;
+    };
+
+    FutexTable() = default;
+
+    ZQ_ALLOW_MOVE (FutexTable)
+    ZQ_DISALLOW_COPY (FutexTable)
+
+    /**
+     * @brief Queue @a waiter at the end of @a futex 's queue.
+     */
+    void addWaiter (Address futex, const Waiter &waiter);
+
+    /**
+     * @brief Dequeue up to @a count waiters whose bitset intersects @a bitset,
+     *        the oldest first.
+     */
+    Base::Vector<Waiter> wake (Address futex, SizeType count, BitsetType bitset = kMatchAny);
+
+    /**
+     * @brief Dequeue the wait of @a thread (canceled by a timeout or a signal).
+     * @return false if it isn't waiting anymore (a wake is on its way).
+     */
+    bool removeWaiter (Address futex, HostedThreadID thread);
+
+    /**
+     * @brief Forget the waiters of a peer that left the process.
+     */
+    void removePeer (PageDirectory::PeerIndex peer);
+
+    bool hasWaiters (Address futex) const
+    {
+        return mQueues.find (futex) != mQueues.end ();
+    }
+
+private:
+    typedef Base::Vector<Waiter> QueueType;
+
+    void shrinkQueue (Base::HashTable<Address, QueueType>::Iterator iterator, SizeType newSize);
+
+    Base::HashTable<Address, QueueType> mQueues;
+};
+
+} // namespace Ziqe
+
+#endif // ZIQE_CORE_FUTEXTABLE_H
@@ -0,0 +1,52 @@
+/**
+ * @file FutexWaitInterface.hpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Main: copyright (C) 2016 Shmuel Hazan
+ *
+ * Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ZIQE_FUTEXWAITINTERFACE_HPP
+#define ZIQE_FUTEXWAITINTERFACE_HPP
+
+#include "CppCore/Error.h"
+
+#include "Common/Types.hpp"
+
+namespace Ziqe {
+
+/**
+   @brief Resumes the local threads that wait on a futex, used by the
+          distributed futex service (ProcessPeersServer::futexWait).
+ */
+class FutexWaitInterface
+{
+public:
+    FutexWaitInterface();
+    virtual ~FutexWaitInterface();
+
+    /**
+       @brief The FUTEX_WAIT of @a thread has ended with @a result:
+              ZQ_E_OK when woken, ZQ_E_AGAIN when the futex's value was
+              changed and ZQ_E_TIMED_OUT when it was canceled.
+
+       Might be called before ProcessPeersServer::futexWait returns, and
+       once per wait.
+     */
+    virtual void onFutexWaitDone (HostedThreadID thread, ZqError result) = 0;
+};
+
+} // namespace Ziqe
+
+#endif // ZIQE_FUTEXWAITINTERFACE_HPP
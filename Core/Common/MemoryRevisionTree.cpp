@@ -19,37 +19,83 @@
  */
 #include "MemoryRevisionTree.hpp"
 
-#include "Base/RedBlackTree.hpp"
+#include "Base/Metrics.hpp"
 
 namespace Ziqe {
 
+namespace {
+Base::Metrics::Counter gDiscardedRevisions{"Revisions/discarded"};
+}
+
+constexpr Protocol::MemoryRevision::ID MemoryRevisionTree::kInitialID;
+
 MemoryRevisionTree::MemoryRevisionTree()
 {
+}
+
+Protocol::MemoryRevision::ID MemoryRevisionTree::addRevision(MemoryRevision &&revision)
+{
+    auto id = mNextID++;
+
+    mRevisions.expand (1, Entry{id, Base::move (revision)});
+    return id;
+}
+
+Protocol::MemoryRevision MemoryRevisionTree::diff(const MemoryRevision::ID &first) const
+{
+    ZQ_ASSERT (first >= mDiscardedID);
 
+    MemoryRevision squashed;
+
+    for (SizeType i = upperBound (first); i < mRevisions.size (); ++i)
+        squashed.merge (mRevisions[i].revision);
+
+    return squashed;
 }
 
-Protocol::MemoryRevision MemoryRevisionTree::diff(const MemoryRevision::ID &first) const{
-    // First phase: check which data should we have in the new revision.
-    // Second phase: actually prepare the new revision.
-    // TODO redblack tree
+void MemoryRevisionTree::discard(const MemoryRevision::ID &last)
+{
+    auto end = upperBound (last);
+    if (end == 0)
+        return;
 
-//    RedBlackTree<ZqUserAddress, UglyPointer<Vector<uint8_t>>> memoryMap;
+    gDiscardedRevisions.add (end);
+    mDiscardedID = mRevisions[end - 1].id;
 
-//    for (auto &revision : revisions) {
-//        for (auto &revisionChange : revision) {
-//            memoryMap[revisionChange.address] = ref(revisionChange);
-//        }
-//    }
+    // Shrinking a vector to nothing doesn't free it.
+    if (end == mRevisions.size ()) {
+        mRevisions = Base::Vector<Entry>{};
+        return;
+    }
 
-//    for (auto &change : memoryMap)
-//    {
+    for (SizeType i = end; i < mRevisions.size (); ++i)
+        mRevisions[i - end] = Base::move (mRevisions[i]);
 
-//    }
+    mRevisions.shrinkWithoutFree (end);
 }
 
 const Protocol::MemoryRevision &MemoryRevisionTree::currentRevision() const
 {
-//    return mIDtoRevision.before_end ();
+    if (mRevisions.size () == 0)
+        return mEmpty;
+
+    return mRevisions[mRevisions.size () - 1].revision;
+}
+
+SizeType MemoryRevisionTree::upperBound(const MemoryRevision::ID &id) const
+{
+    SizeType first = 0, last = mRevisions.size ();
+
+    while (first < last) {
+        SizeType middle = first + (last - first) / 2;
+
+        if (mRevisions[middle].id <= id)
+            first = middle + 1;
+        else
+            last = middle;
+    }
+
+    return first;
 }
 
 } // namespace Ziqe
@@ -20,31 +20,92 @@
 #ifndef ZIQE_MEMORYREVISIONTREE_H
 #define ZIQE_MEMORYREVISIONTREE_H
 
-#include "Base/HashTable.hpp"
+#include "Base/Vector.hpp"
 
-#include "Core/Protocol/MemoryRevision.hpp"
+#include "Protocol/MemoryRevision.hpp"
 
 namespace Ziqe {
 
+/**
+ * @brief The memory revisions of a process, by ID.
+ *
+ * Revisions get increasing IDs as they are added. A diff squashes the
+ * revisions after a given one, so a peer (or a checkpoint) that has an
+ * old revision gets only what changed since. The revisions nobody will
+ * diff from anymore are discarded.
+ *
+ * @note Not thread safe.
+ */
 class MemoryRevisionTree
 {
 public:
+    using MemoryRevision=Protocol::MemoryRevision;
+
+    /// The ID before the first revision.
+    static constexpr MemoryRevision::ID kInitialID = 0;
+
     MemoryRevisionTree();
 
-    using MemoryRevision=Protocol::MemoryRevision;
+    ZQ_ALLOW_MOVE (MemoryRevisionTree)
+    ZQ_DISALLOW_COPY (MemoryRevisionTree)
+
+    /**
+     * @brief Add the newest revision.
+     * @return Its ID.
+     */
+    MemoryRevision::ID addRevision (MemoryRevision &&revision);
 
     /**
      * @brief Create a memory revision that represents one or more memory
      *        revisions.
      * @param first  An older memory revision to start diff-ing from.
-     * @return
+     * @return The revisions after @a first, squashed (a newer change wins).
      */
     MemoryRevision diff (const MemoryRevision::ID &first) const;
 
+    /**
+     * @brief Forget the revisions up to @a last (included). Diffs from
+     *        before @a last can't be made anymore.
+     */
+    void discard (const MemoryRevision::ID &last);
+
+    /**
+     * @return The newest revision, or an empty one.
+     */
     const MemoryRevision &currentRevision () const;
 
+    MemoryRevision::ID getCurrentID () const
+    {
+        return mNextID - 1;
+    }
+
+    /// The newest discarded revision.
+    MemoryRevision::ID getDiscardedID () const
+    {
+        return mDiscardedID;
+    }
+
+    SizeType getRevisionsCount () const
+    {
+        return mRevisions.size ();
+    }
+
 private:
-    Base::RedBlackTree<MemoryRevision::ID, MemoryRevision> mIDtoRevision;
+    struct Entry {
+        MemoryRevision::ID id;
+        MemoryRevision revision;
+    };
+
+    /// The index of the first revision newer than @a id.
+    SizeType upperBound (const MemoryRevision::ID &id) const;
+
+    /// Sorted by ID.
+    Base::Vector<Entry> mRevisions;
+
+    MemoryRevision::ID mDiscardedID = kInitialID;
+    MemoryRevision::ID mNextID = kInitialID + 1;
+
+    MemoryRevision mEmpty;
 };
 
 } // namespace Ziqe
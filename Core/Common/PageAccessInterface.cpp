@@ -0,0 +1,39 @@
+/**
+ * @file PageAccessInterface.cpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Main: copyright (C) 2016 Shmuel Hazan
+ *
+ * Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "PageAccessInterface.hpp"
+
+namespace Ziqe {
+
+PageAccessInterface::PageAccessInterface()
+{
+
+}
+
+PageAccessInterface::~PageAccessInterface()
+{
+
+}
+
+PageBlocks::Pages PageAccessInterface::takeWrittenPages(Address, SizeType pagesCount)
+{
+    return PageBlocks::CreateFirstPages (pagesCount);
+}
+
+} // namespace Ziqe
@@ -0,0 +1,82 @@
+/**
+ * @file PageAccessInterface.hpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Main: copyright (C) 2016 Shmuel Hazan
+ *
+ * Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ZIQE_PAGEACCESSINTERFACE_HPP
+#define ZIQE_PAGEACCESSINTERFACE_HPP
+
+#include "Base/Vector.hpp"
+
+#include "Common/PageDirectory.hpp"
+#include "Common/PageBlocks.hpp"
+#include "Protocol/MemoryRevision.hpp"
+
+namespace Ziqe {
+
+/**
+   @brief Access to the local copy of the process' pages, used by the
+          page ownership protocol.
+ */
+class PageAccessInterface
+{
+public:
+    typedef PageDirectory::Address Address;
+
+    PageAccessInterface();
+    virtual ~PageAccessInterface();
+
+    /**
+       @brief Copy the local content of @a page (ZQ_PAGE_SIZE bytes).
+     */
+    virtual Base::Vector<uint8_t> readPage (Address page) = 0;
+
+    /**
+       @brief Replace the local content of @a page.
+     */
+    virtual void writePage (Address page, const Base::Vector<uint8_t> &content) = 0;
+
+    /**
+       @brief Write only the bytes changed by @a diff to its page. Under
+              release consistency the local threads may be writing other
+              parts of the page at the same time.
+     */
+    virtual void applyPageDiff (const Protocol::PageDiff &diff) = 0;
+
+    /**
+       @brief Let the local threads access @a page as @a state allows:
+              nothing when Invalid, read when Shared and write when Modified.
+
+       An access that isn't allowed should end up in
+       ProcessPeersServer::requestPage.
+     */
+    virtual void setPageAccess (Address page, PageDirectory::State state) = 0;
+
+    /**
+       @brief The pages of @a block (of @a pagesCount pages, see
+              PageBlocks) written since the previous call.
+
+       The default reports all of them. Implementations with a dirty
+       tracker (ZqDirtyTrackerCollect) keep the transfers of large blocks
+       and the incremental checkpoints to the written pages only.
+     */
+    virtual PageBlocks::Pages takeWrittenPages (Address block, SizeType pagesCount);
+};
+
+} // namespace Ziqe
+
+#endif // ZIQE_PAGEACCESSINTERFACE_HPP
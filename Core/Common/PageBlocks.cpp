@@ -0,0 +1,85 @@
+/**
+ * @file PageBlocks.cpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Main: copyright (C) 2016 Shmuel Hazan
+ *
+ * Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "PageBlocks.hpp"
+
+#include "Base/Checks.hpp"
+
+namespace Ziqe {
+
+constexpr SizeType PageBlocks::kMaxPagesPerBlock;
+
+PageBlocks::Pages PageBlocks::CreateFirstPages(SizeType count)
+{
+    ZQ_ASSERT (count <= kMaxPagesPerBlock);
+
+    Pages pages;
+
+    pages.setRange (0, count);
+    return pages;
+}
+
+PageBlocks::PageBlocks(SizeType pagesPerBlock)
+    : mPagesPerBlock{pagesPerBlock}
+{
+    ZQ_ASSERT (pagesPerBlock > 0 && pagesPerBlock <= kMaxPagesPerBlock);
+    ZQ_ASSERT ((pagesPerBlock & (pagesPerBlock - 1)) == 0);
+}
+
+WrittenPages::WrittenPages()
+{
+}
+
+void WrittenPages::add(Address block, const PageBlocks::Pages &pages)
+{
+    if (pages.isEmpty ())
+        return;
+
+    auto iterator = mBlocks.find (block);
+
+    if (iterator == mBlocks.end ())
+        mBlocks.insert (block, pages);
+    else
+        iterator->second |= pages;
+}
+
+const PageBlocks::Pages *WrittenPages::find(Address block) const
+{
+    auto iterator = mBlocks.find (block);
+
+    if (iterator == mBlocks.end ())
+        return nullptr;
+
+    return &iterator->second;
+}
+
+PageBlocks::Pages WrittenPages::take(Address block)
+{
+    auto iterator = mBlocks.find (block);
+
+    if (iterator == mBlocks.end ())
+        return {};
+
+    auto pages = iterator->second;
+
+    mBlocks.erase (iterator);
+    return pages;
+}
+
+} // namespace Ziqe
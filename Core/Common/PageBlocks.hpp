@@ -0,0 +1,130 @@
+/**
+ * @file PageBlocks.hpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Main: copyright (C) 2016 Shmuel Hazan
+ *
+ * Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ZIQE_CORE_PAGEBLOCKS_H
+#define ZIQE_CORE_PAGEBLOCKS_H
+
+#include "Base/Types.hpp"
+#include "Base/HashTable.hpp"
+#include "Base/Bitset.hpp"
+
+#include "CppCore/Memory.h"
+
+#include "Common/PageDirectory.hpp"
+
+namespace Ziqe {
+
+/**
+ * @brief The granularity the process' pages are owned and transferred at:
+ *        blocks of 2**n pages (aligned to their size), e.g. 16 pages
+ *        (64 KiB) or 512 pages (a 2 MiB transparent huge page).
+ *
+ * A large sequential heap faults once per block instead of once per page,
+ * and a block is sent in a single message (MessageWithBlock). The pages
+ * of a block that were written are kept in a bitmap (Pages), so a writer
+ * gives back only them and the diffs stay as precise as with single pages.
+ *
+ * A single page per block (the default) is the plain page protocol.
+ */
+class PageBlocks
+{
+public:
+    typedef PageDirectory::Address Address;
+
+    static constexpr SizeType kMaxPagesPerBlock = 512;
+
+    /**
+     * @brief A set of pages of a block, by their index in it.
+     */
+    typedef Base::Bitset<kMaxPagesPerBlock> Pages;
+
+    /// The first @a count pages.
+    static Pages CreateFirstPages (SizeType count);
+
+    /**
+     * @param pagesPerBlock A power of two, up to kMaxPagesPerBlock.
+     */
+    explicit PageBlocks(SizeType pagesPerBlock = 1);
+
+    ZQ_ALLOW_COPY_AND_MOVE (PageBlocks)
+
+    SizeType getPagesPerBlock () const
+    {
+        return mPagesPerBlock;
+    }
+
+    bool isSinglePage () const
+    {
+        return mPagesPerBlock == 1;
+    }
+
+    /// The block that contains @a address.
+    Address getBlock (Address address) const
+    {
+        return address & ~(static_cast<Address>(mPagesPerBlock * ZQ_PAGE_SIZE) - 1);
+    }
+
+    /// The index of @a page in its block.
+    SizeType getIndex (Address page) const
+    {
+        return static_cast<SizeType>((page - getBlock (page)) / ZQ_PAGE_SIZE);
+    }
+
+    static Address GetPage (Address block, SizeType index)
+    {
+        return block + index * ZQ_PAGE_SIZE;
+    }
+
+private:
+    SizeType mPagesPerBlock;
+};
+
+/**
+ * @brief The pages written in the blocks this peer owns, since it got
+ *        their ownership.
+ *
+ * @note Not thread safe.
+ */
+class WrittenPages
+{
+public:
+    typedef PageBlocks::Address Address;
+
+    WrittenPages();
+
+    ZQ_DISALLOW_COPY (WrittenPages)
+
+    void add (Address block, const PageBlocks::Pages &pages);
+
+    /// @return The written pages of @a block, or null if none.
+    const PageBlocks::Pages *find (Address block) const;
+
+    /**
+     * @brief Forget the written pages of @a block: it has been given back.
+     * @return The pages that were written.
+     */
+    PageBlocks::Pages take (Address block);
+
+private:
+    Base::HashTable<Address, PageBlocks::Pages> mBlocks;
+};
+
+} // namespace Ziqe
+
+#endif // ZIQE_CORE_PAGEBLOCKS_H
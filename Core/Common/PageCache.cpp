@@ -0,0 +1,175 @@
+/**
+ * @file PageCache.cpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Main: copyright (C) 2016 Shmuel Hazan
+ *
+ * Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "PageCache.hpp"
+
+#include "Base/Metrics.hpp"
+
+#include "CppCore/Memory.h"
+
+namespace Ziqe {
+
+namespace {
+Base::Metrics::Counter gCachedPages{"PageCache/inserted"};
+Base::Metrics::Counter gEvictedPages{"PageCache/evicted"};
+
+uint64_t RotateLeft (uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+uint64_t FinalMix (uint64_t value)
+{
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdull;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ull;
+    value ^= value >> 33;
+
+    return value;
+}
+}
+
+constexpr SizeType PageCache::kDefaultCapacity;
+
+PageCache::PageCache(SizeType capacity)
+{
+    ZQ_ASSERT (capacity != 0);
+
+    mOrder.resize (capacity);
+}
+
+PageCache::~PageCache()
+{
+    for (auto &lowAndEntry : mPages)
+        mPool.deallocate (lowAndEntry.second.content);
+}
+
+PageCache::Hash PageCache::HashPage(const uint8_t *content)
+{
+    constexpr uint64_t kFirstFactor = 0x87c37b91114253d5ull;
+    constexpr uint64_t kSecondFactor = 0x4cf5ad432745937full;
+
+    // A page is a whole number of blocks: no tail.
+    static_assert (ZQ_PAGE_SIZE % 16 == 0, "A page should be made of 16 byte blocks");
+
+    uint64_t first = 0, second = 0;
+
+    for (SizeType offset = 0; offset < ZQ_PAGE_SIZE; offset += 16) {
+        uint64_t firstBlock, secondBlock;
+
+        memcpy (&firstBlock, content + offset, sizeof (firstBlock));
+        memcpy (&secondBlock, content + offset + 8, sizeof (secondBlock));
+
+        firstBlock *= kFirstFactor;
+        firstBlock = RotateLeft (firstBlock, 31);
+        firstBlock *= kSecondFactor;
+        first ^= firstBlock;
+
+        first = RotateLeft (first, 27);
+        first += second;
+        first = first * 5 + 0x52dce729;
+
+        secondBlock *= kSecondFactor;
+        secondBlock = RotateLeft (secondBlock, 33);
+        secondBlock *= kFirstFactor;
+        second ^= secondBlock;
+
+        second = RotateLeft (second, 31);
+        second += first;
+        second = second * 5 + 0x38495ab5;
+    }
+
+    first ^= ZQ_PAGE_SIZE;
+    second ^= ZQ_PAGE_SIZE;
+
+    first += second;
+    second += first;
+
+    first = FinalMix (first);
+    second = FinalMix (second);
+
+    first += second;
+    second += first;
+
+    return {first, second};
+}
+
+bool PageCache::IsZeroPage(const uint8_t *content)
+{
+    for (SizeType offset = 0; offset < ZQ_PAGE_SIZE; offset += sizeof (uint64_t)) {
+        uint64_t word;
+
+        memcpy (&word, content + offset, sizeof (word));
+        if (word != 0)
+            return false;
+    }
+
+    return true;
+}
+
+void PageCache::insert(const Hash &hash, const uint8_t *content)
+{
+    auto iterator = mPages.find (hash.low);
+
+    if (iterator != mPages.end ()) {
+        // Another page with the same low half: replace it in its place.
+        if (iterator->second.high != hash.high) {
+            memcpy (iterator->second.content, content, ZQ_PAGE_SIZE);
+            iterator->second.high = hash.high;
+        }
+
+        return;
+    }
+
+    // Evict the oldest page, if it is still there.
+    if (mPages.size () == mOrder.size ()) {
+        auto oldest = mPages.find (mOrder[mNext]);
+
+        ZQ_ASSERT (oldest != mPages.end ());
+        mPool.deallocate (oldest->second.content);
+        mPages.erase (oldest);
+
+        gEvictedPages.add ();
+    }
+
+    auto copy = mPool.allocate ();
+    if (copy == nullptr)
+        return;
+
+    memcpy (copy, content, ZQ_PAGE_SIZE);
+    mPages.insert (hash.low, Entry{hash.high, copy});
+
+    mOrder[mNext] = hash.low;
+    mNext = (mNext + 1) % mOrder.size ();
+
+    gCachedPages.add ();
+}
+
+const uint8_t *PageCache::find(const Hash &hash) const
+{
+    auto iterator = mPages.find (hash.low);
+
+    if (iterator == mPages.end () || iterator->second.high != hash.high)
+        return nullptr;
+
+    return iterator->second.content;
+}
+
+} // namespace Ziqe
@@ -0,0 +1,101 @@
+/**
+ * @file PageCache.hpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Main: copyright (C) 2016 Shmuel Hazan
+ *
+ * Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ZIQE_CORE_PAGECACHE_H
+#define ZIQE_CORE_PAGECACHE_H
+
+#include "Base/Types.hpp"
+#include "Base/HashTable.hpp"
+#include "Base/Vector.hpp"
+
+#include "Common/PagePool.hpp"
+
+namespace Ziqe {
+
+/**
+ * @brief Copies of pages, by a 128 bit hash of their content.
+ *
+ * A page that has been transferred once can be sent again as its hash: if
+ * the receiver finds the hash here it doesn't need the content. The cache
+ * keeps the last @a capacity pages inserted.
+ *
+ * @note Not thread safe.
+ */
+class PageCache
+{
+public:
+    struct Hash {
+        uint64_t low;
+        uint64_t high;
+
+        bool operator == (const Hash &other) const
+        {
+            return low == other.low && high == other.high;
+        }
+    };
+
+    static constexpr SizeType kDefaultCapacity = 1024;
+
+    explicit PageCache(SizeType capacity = kDefaultCapacity);
+    ~PageCache();
+
+    ZQ_DISALLOW_COPY (PageCache)
+
+    /**
+     * @brief MurmurHash3 (x64, 128 bit) of @a content (ZQ_PAGE_SIZE bytes).
+     */
+    static Hash HashPage (const uint8_t *content);
+
+    static bool IsZeroPage (const uint8_t *content);
+
+    /**
+     * @brief Keep a copy of @a content (ZQ_PAGE_SIZE bytes) whose hash is
+     *        @a hash, instead of the oldest copy when the cache is full.
+     */
+    void insert (const Hash &hash, const uint8_t *content);
+
+    /**
+     * @return The content whose hash is @a hash, or nullptr.
+     */
+    const uint8_t *find (const Hash &hash) const;
+
+    SizeType size () const
+    {
+        return mPages.size ();
+    }
+
+private:
+    struct Entry {
+        uint64_t high;
+        uint8_t *content;
+    };
+
+    /// By the low half of the hash: a page with the same low half replaces it.
+    Base::HashTable<uint64_t, Entry> mPages;
+
+    /// The low halves, in the order they were inserted (a ring).
+    Base::Vector<uint64_t> mOrder;
+    SizeType mNext = 0;
+
+    PagePool mPool;
+};
+
+} // namespace Ziqe
+
+#endif // ZIQE_CORE_PAGECACHE_H
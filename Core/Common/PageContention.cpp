@@ -0,0 +1,252 @@
+/**
+ * @file PageContention.cpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Main: copyright (C) 2016 Shmuel Hazan
+ *
+ * Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "PageContention.hpp"
+
+#include "Base/Metrics.hpp"
+
+#include "CppCore/Metrics.h"
+
+namespace Ziqe {
+
+namespace {
+const char *const kReportColumns[] = {"transfers", "writers", "interval_ns", "policy"};
+
+Base::Metrics::Ranking gContendedPages{"Contention/pages", kReportColumns, 4};
+Base::Metrics::Counter gPinnedPages{"Contention/pinnedPages"};
+Base::Metrics::Counter gMergedPages{"Contention/mergedPages"};
+Base::Metrics::Counter gHeldRequests{"Contention/heldRequests"};
+Base::Metrics::Counter gForgottenPages{"Contention/forgottenPages"};
+
+uint64_t gNextReportGroup = 1;
+}
+
+SizeType PageContention::Stats::getWritersCount() const
+{
+    return static_cast<SizeType>(__builtin_popcountll (writers));
+}
+
+bool PageContention::Stats::isContended() const
+{
+    return transfers >= kContendedTransfers
+           && getWritersCount () >= 2
+           && meanFaultInterval <= kContendedInterval;
+}
+
+PageContention::PageContention()
+    : mReportGroup{__atomic_fetch_add (&gNextReportGroup, 1, __ATOMIC_RELAXED)}
+{
+}
+
+PageContention::~PageContention()
+{
+    if (mReportGroup != 0)
+        gContendedPages.withdraw (mReportGroup);
+}
+
+PageContention::PageContention(PageContention &&other)
+    : mPages{Base::move (other.mPages)},
+      mFaults{other.mFaults},
+      mReportGroup{other.mReportGroup}
+{
+    other.mReportGroup = 0;
+}
+
+PageContention &PageContention::operator=(PageContention &&other)
+{
+    if (mReportGroup != 0)
+        gContendedPages.withdraw (mReportGroup);
+
+    mPages = Base::move (other.mPages);
+    mFaults = other.mFaults;
+    mReportGroup = other.mReportGroup;
+    other.mReportGroup = 0;
+
+    return *this;
+}
+
+PageContention::Policy PageContention::onFault(Address page, PeerIndex peer, bool isWrite, bool isTransfer)
+{
+    auto iterator = mPages.find (page);
+    if (iterator == mPages.end ())
+        iterator = mPages.insert (page, Stats{}).second;
+
+    auto &stats = iterator->second;
+    uint64_t now = ZQ_SYMBOL(ZqMetricsTimestamp) ();
+
+    if (stats.faults != 0) {
+        uint64_t interval = now - stats.lastFault;
+
+        stats.meanFaultInterval = (stats.faults == 1) ? interval
+                                                      : (stats.meanFaultInterval * 7 + interval) / 8;
+    }
+
+    ++stats.faults;
+    stats.lastFault = now;
+
+    if (isTransfer)
+        ++stats.transfers;
+
+    if (isWrite) {
+        ++stats.writeFaults;
+        stats.writers |= PageDirectory::PeerSet{1} << peer;
+
+        if (stats.majorityVotes == 0) {
+            stats.majorityWriter = peer;
+            stats.majorityVotes = 1;
+        } else if (stats.majorityWriter == peer) {
+            ++stats.majorityVotes;
+        } else {
+            --stats.majorityVotes;
+        }
+    }
+
+    if (stats.policy == Policy::Default) {
+        stats.policy = ChoosePolicy (stats);
+
+        if (stats.policy == Policy::Pin) {
+            stats.pinnedPeer = stats.majorityWriter;
+            gPinnedPages.add ();
+        } else if (stats.policy == Policy::DiffMerge) {
+            gMergedPages.add ();
+        }
+    }
+
+    if (stats.policy == Policy::Pin && peer == stats.pinnedPeer)
+        stats.pinnedPeerLastFault = now;
+
+    auto policy = stats.policy;
+
+    if ((stats.faults % kReportInterval) == 0)
+        publishReport ();
+
+    // Invalidates stats.
+    if ((++mFaults % kAgeInterval) == 0)
+        forgetIdlePages (now);
+
+    return policy;
+}
+
+bool PageContention::shouldHold(Address page, PeerIndex peer) const
+{
+    auto stats = find (page);
+
+    if (stats == nullptr || stats->policy != Policy::Pin || stats->pinnedPeer == peer)
+        return false;
+
+    if (ZQ_SYMBOL(ZqMetricsTimestamp) () - stats->pinnedPeerLastFault >= kPinHold)
+        return false;
+
+    gHeldRequests.add ();
+    return true;
+}
+
+PageContention::Policy PageContention::getPolicy(Address page) const
+{
+    auto stats = find (page);
+
+    return stats != nullptr ? stats->policy : Policy::Default;
+}
+
+const PageContention::Stats *PageContention::find(Address page) const
+{
+    auto iterator = mPages.find (page);
+
+    if (iterator == mPages.end ())
+        return nullptr;
+
+    return &iterator->second;
+}
+
+Base::Vector<PageContention::PageStats> PageContention::getMostContended(SizeType count) const
+{
+    Base::Vector<PageStats> most;
+    SizeType mostCount = 0;
+
+    most.resize (count);
+
+    // Insertion into a short sorted array: count is small.
+    for (const auto &pageAndStats : mPages) {
+        const auto &stats = pageAndStats.second;
+
+        if (stats.transfers == 0)
+            continue;
+
+        if (mostCount == count && most[count - 1].second.transfers >= stats.transfers)
+            continue;
+
+        SizeType i = (mostCount < count) ? mostCount++ : count - 1;
+
+        for (; i > 0 && most[i - 1].second.transfers < stats.transfers; --i)
+            most[i] = most[i - 1];
+
+        most[i] = PageStats{pageAndStats.first, stats};
+    }
+
+    most.shrinkWithoutFree (count - mostCount);
+    return most;
+}
+
+void PageContention::publishReport() const
+{
+    Base::Metrics::Ranking::Row rows[Base::Metrics::Ranking::kCapacity];
+    auto most = getMostContended (Base::Metrics::Ranking::kCapacity);
+
+    for (SizeType i = 0; i < most.size (); ++i) {
+        const auto &stats = most[i].second;
+
+        rows[i].key = most[i].first;
+        rows[i].values[0] = stats.transfers;
+        rows[i].values[1] = stats.getWritersCount ();
+        rows[i].values[2] = stats.meanFaultInterval;
+        rows[i].values[3] = static_cast<uint64_t>(stats.policy);
+    }
+
+    if (mReportGroup != 0)
+        gContendedPages.publish (mReportGroup, rows, most.size ());
+}
+
+void PageContention::forgetIdlePages(uint64_t now)
+{
+    for (auto iterator = mPages.begin (); iterator != mPages.end ();) {
+        const auto &stats = iterator->second;
+
+        if (stats.policy != Policy::DiffMerge && now - stats.lastFault >= kIdleTimeout) {
+            iterator = mPages.erase (iterator);
+            gForgottenPages.add ();
+        } else {
+            ++iterator;
+        }
+    }
+}
+
+PageContention::Policy PageContention::ChoosePolicy(const Stats &stats)
+{
+    if (! stats.isContended ())
+        return Policy::Default;
+
+    // The vote balance is at least half of the writes only when the
+    // majority writer made 3/4 of them.
+    if (stats.majorityVotes * 2 >= stats.writeFaults)
+        return Policy::Pin;
+
+    return Policy::DiffMerge;
+}
+
+} // namespace Ziqe
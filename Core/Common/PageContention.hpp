@@ -0,0 +1,165 @@
+/**
+ * @file PageContention.hpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Main: copyright (C) 2016 Shmuel Hazan
+ *
+ * Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ZIQE_CORE_PAGECONTENTION_H
+#define ZIQE_CORE_PAGECONTENTION_H
+
+#include "Base/Types.hpp"
+#include "Base/HashTable.hpp"
+#include "Base/Vector.hpp"
+
+#include "Common/PageDirectory.hpp"
+
+namespace Ziqe {
+
+/**
+ * @brief Write conflict statistics of the pages homed at this peer, used to
+ *        find the pages that move between peers all the time (usually
+ *        false sharing) and to choose a policy for them.
+ *
+ * A page is contended when it was transferred (recalled or invalidated)
+ * at least kContendedTransfers times, by at least two writers, and the
+ * faults on it are less than kContendedInterval apart on average. Then:
+ *
+ *  Pin      : One writer makes most of the writes (3/4 or more). The
+ *             page is held by it for kPinHold after each of its faults,
+ *             other requests are retried meanwhile.
+ *  DiffMerge: The writes are spread between the writers. The page is
+ *             switched to release consistency (see
+ *             ProcessPeersServer::enableReleaseConsistency).
+ *
+ * A page that had no faults for kIdleTimeout is forgotten, and a pinned
+ * page goes back to the default policy. Merged pages stay merged, as the
+ * peers keep them so.
+ *
+ * The most contended pages are published to the metric Contention/pages,
+ * in a group of their own for every PageContention.
+ *
+ * @note Not thread safe.
+ */
+class PageContention
+{
+public:
+    typedef PageDirectory::Address Address;
+    typedef PageDirectory::PeerIndex PeerIndex;
+    typedef PageDirectory::PeerSet PeerSet;
+
+    static constexpr uint64_t kContendedTransfers = 8;
+    static constexpr uint64_t kContendedInterval = 10 * 1000 * 1000;
+    static constexpr uint64_t kPinHold = 1000 * 1000;
+
+    /// Publish the report every this number of faults.
+    static constexpr uint64_t kReportInterval = 256;
+
+    /// Forget the idle pages every this number of faults.
+    static constexpr uint64_t kAgeInterval = 4096;
+    static constexpr uint64_t kIdleTimeout = 1000 * 1000 * 1000;
+
+    enum class Policy : uint8_t {
+        Default,
+        Pin,
+        DiffMerge
+    };
+
+    struct Stats {
+        uint64_t faults = 0;
+        uint64_t writeFaults = 0;
+
+        /// Faults that took the page from other peers.
+        uint64_t transfers = 0;
+
+        PeerSet writers = 0;
+
+        /// The most frequent writer (a majority vote), and its votes
+        /// minus the other writers' votes.
+        PeerIndex majorityWriter = 0;
+        uint64_t majorityVotes = 0;
+
+        /// In nanoseconds.
+        uint64_t lastFault = 0;
+        /// An exponential moving average of the time between faults.
+        uint64_t meanFaultInterval = 0;
+
+        Policy policy = Policy::Default;
+
+        /// Valid when pinned: the pinned peer and its last fault.
+        PeerIndex pinnedPeer = 0;
+        uint64_t pinnedPeerLastFault = 0;
+
+        SizeType getWritersCount () const;
+        bool isContended () const;
+    };
+
+    PageContention();
+    ~PageContention();
+
+    PageContention (PageContention &&other);
+    PageContention &operator= (PageContention &&other);
+    ZQ_DISALLOW_COPY (PageContention)
+
+    /**
+     * @brief Record a fault of @a peer on @a page (a request received by
+     *        the home).
+     * @param isTransfer Whether the request took the page from other peers.
+     * @return The page's policy, it might be new.
+     */
+    Policy onFault (Address page, PeerIndex peer, bool isWrite, bool isTransfer);
+
+    /**
+     * @brief Whether the request of @a peer for @a page should be retried,
+     *        as the page is pinned to another peer that used it recently.
+     */
+    bool shouldHold (Address page, PeerIndex peer) const;
+
+    Policy getPolicy (Address page) const;
+
+    const Stats *find (Address page) const;
+
+    typedef Base::Pair<Address, Stats> PageStats;
+
+    /**
+     * @brief Up to @a count pages, the most transferred first.
+     */
+    Base::Vector<PageStats> getMostContended (SizeType count) const;
+
+    /**
+     * @brief Publish the most contended pages to the Contention/pages metric.
+     */
+    void publishReport () const;
+
+    /**
+     * @brief Forget the pages that had no faults since @a now - kIdleTimeout,
+     *        except the merged pages.
+     */
+    void forgetIdlePages (uint64_t now);
+
+private:
+    static Policy ChoosePolicy (const Stats &stats);
+
+    Base::HashTable<Address, Stats> mPages;
+
+    uint64_t mFaults = 0;
+
+    /// Our group in Contention/pages, 0 when moved from.
+    uint64_t mReportGroup;
+};
+
+} // namespace Ziqe
+
+#endif // ZIQE_CORE_PAGECONTENTION_H
@@ -0,0 +1,344 @@
+/**
+ * @file PageDirectory.cpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Main: copyright (C) 2016 Shmuel Hazan
+ *
+ * Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "PageDirectory.hpp"
+
+#include "Base/Checks.hpp"
+#include "Base/Metrics.hpp"
+
+#include "CppCore/Memory.h"
+
+namespace Ziqe {
+
+namespace {
+Base::Metrics::Counter gInvalidationsSent{"Directory/invalidationsSent"};
+Base::Metrics::Counter gRecalls{"Directory/recalls"};
+Base::Metrics::Counter gRetries{"Directory/retries"};
+
+SizeType countPeers (PageDirectory::PeerSet peers)
+{
+    return static_cast<SizeType>(__builtin_popcountll (peers));
+}
+}
+
+PageDirectory::PeerIndex PageDirectory::GetHome(Address page, PeerSet members)
+{
+    if (members == 0) {
+        ZQ_ASSERT_REPORT_NOT_REACHED ("A home out of no peers");
+        return 0;
+    }
+
+    PeerSet rest = members;
+    PeerIndex home = 0;
+    uint64_t highestWeight = 0;
+
+    // Rendezvous hashing: the home is the member with the highest weight
+    // for the page, so only the pages of a joining or leaving peer move.
+    do {
+        auto peer = static_cast<PeerIndex>(__builtin_ctzll (rest));
+        uint64_t weight = (page / ZQ_PAGE_SIZE) ^ ((peer + 1) * 0x9e3779b97f4a7c15ull);
+
+        // The splitmix64 finalizer.
+        weight = (weight ^ (weight >> 30)) * 0xbf58476d1ce4e5b9ull;
+        weight = (weight ^ (weight >> 27)) * 0x94d049bb133111ebull;
+        weight ^= weight >> 31;
+
+        if (rest == members || weight > highestWeight) {
+            home = peer;
+            highestWeight = weight;
+        }
+
+        rest &= rest - 1;
+    } while (rest != 0);
+
+    return home;
+}
+
+PageDirectory::Actions PageDirectory::onReadRequest(Address page, PeerIndex requester)
+{
+    auto *maybeEntry = getEntry (page);
+    if (maybeEntry == nullptr)
+        return {};
+
+    auto &entry = *maybeEntry;
+
+    if (entry.isBusy)
+        return Retry (requester);
+
+    switch (entry.state) {
+    case State::Invalid:
+        entry.state = State::Shared;
+        entry.sharers = PeerBit (requester);
+        return SendPage (requester, false);
+
+    case State::Shared:
+        entry.sharers |= PeerBit (requester);
+        return SendPage (requester, false);
+
+    case State::Modified: {
+        // Already has the newest copy.
+        if (entry.owner == requester)
+            return {};
+
+        Actions actions;
+
+        entry.isBusy = true;
+        entry.isPendingCancelled = false;
+        entry.isPendingWrite = false;
+        entry.pendingRequester = requester;
+
+        actions.recall = true;
+        actions.recallForWrite = false;
+        actions.owner = entry.owner;
+
+        gRecalls.add ();
+        return actions;
+    }
+    }
+
+    return {};
+}
+
+PageDirectory::Actions PageDirectory::onWriteRequest(Address page, PeerIndex requester)
+{
+    auto *maybeEntry = getEntry (page);
+    if (maybeEntry == nullptr)
+        return {};
+
+    auto &entry = *maybeEntry;
+
+    if (entry.isBusy)
+        return Retry (requester);
+
+    switch (entry.state) {
+    case State::Invalid:
+        entry.state = State::Modified;
+        entry.owner = requester;
+        return SendPage (requester, true);
+
+    case State::Shared: {
+        PeerSet others = entry.sharers & ~PeerBit (requester);
+
+        if (others == 0) {
+            entry.state = State::Modified;
+            entry.owner = requester;
+            entry.sharers = 0;
+            return SendPage (requester, true);
+        }
+
+        Actions actions;
+
+        entry.isBusy = true;
+        entry.isPendingCancelled = false;
+        entry.isPendingWrite = true;
+        entry.pendingRequester = requester;
+        entry.pendingAcks = countPeers (others);
+
+        actions.invalidate = others;
+
+        gInvalidationsSent.add (entry.pendingAcks);
+        return actions;
+    }
+
+    case State::Modified: {
+        if (entry.owner == requester)
+            return {};
+
+        Actions actions;
+
+        entry.isBusy = true;
+        entry.isPendingCancelled = false;
+        entry.isPendingWrite = true;
+        entry.pendingRequester = requester;
+
+        actions.recall = true;
+        actions.recallForWrite = true;
+        actions.owner = entry.owner;
+
+        gRecalls.add ();
+        return actions;
+    }
+    }
+
+    return {};
+}
+
+PageDirectory::Actions PageDirectory::onInvalidateAck(Address page, PeerIndex from)
+{
+    auto *maybeEntry = getEntry (page);
+    if (maybeEntry == nullptr)
+        return {};
+
+    auto &entry = *maybeEntry;
+
+    if (! entry.isBusy || entry.state != State::Shared
+        || (entry.sharers & PeerBit (from)) == 0) {
+        ZQ_ASSERT_REPORT_NOT_REACHED ("Unexpected InvalidatePageOK");
+        return {};
+    }
+
+    entry.sharers &= ~PeerBit (from);
+    if (--entry.pendingAcks != 0)
+        return {};
+
+    return completePending (entry);
+}
+
+PageDirectory::Actions PageDirectory::onPageReturned(Address page, PeerIndex from)
+{
+    auto *maybeEntry = getEntry (page);
+    if (maybeEntry == nullptr)
+        return {};
+
+    auto &entry = *maybeEntry;
+
+    if (! entry.isBusy || entry.state != State::Modified || entry.owner != from) {
+        ZQ_ASSERT_REPORT_NOT_REACHED ("Unexpected GivePage");
+        return {};
+    }
+
+    // A recall for a read leaves the old owner with a read only copy.
+    entry.state = State::Shared;
+    entry.sharers = entry.isPendingWrite ? 0 : PeerBit (from);
+
+    return completePending (entry);
+}
+
+PageDirectory::Actions PageDirectory::onDiffApplied(Address page, PeerIndex writer)
+{
+    auto *maybeEntry = getEntry (page);
+    if (maybeEntry == nullptr)
+        return {};
+
+    auto &entry = *maybeEntry;
+
+    if (entry.isBusy || entry.state == State::Modified) {
+        ZQ_ASSERT_REPORT_NOT_REACHED ("PageDiffs for a page with a writable copy");
+        return {};
+    }
+
+    Actions actions;
+
+    actions.invalidate = entry.sharers & ~PeerBit (writer);
+
+    // The writer's copy has its own changes, but not the changes of the
+    // other writers; it is dropped when their diffs are applied.
+    entry.state = State::Shared;
+    entry.sharers = PeerBit (writer);
+
+    gInvalidationsSent.add (countPeers (actions.invalidate));
+    return actions;
+}
+
+Base::Vector<PageDirectory::PageActions> PageDirectory::removePeer(PeerIndex peer)
+{
+    Base::Vector<PageActions> completed;
+
+    mEntries.forEach ([&] (EntriesTree::PageNumber pageNumber, Entry &entry) {
+        bool isCompleted = false;
+
+        if (entry.isBusy && entry.pendingRequester == peer)
+            entry.isPendingCancelled = true;
+
+        if (entry.state == State::Modified && entry.owner == peer) {
+            // Its changes are lost, the home's copy is the newest we have.
+            entry.state = entry.isBusy ? State::Shared : State::Invalid;
+            entry.sharers = 0;
+            isCompleted = entry.isBusy;
+        } else if (entry.state == State::Shared && (entry.sharers & PeerBit (peer)) != 0) {
+            entry.sharers &= ~PeerBit (peer);
+
+            // The requester of an upgrade isn't invalidated: no ack was
+            // expected from it.
+            if (entry.isBusy && peer != entry.pendingRequester)
+                isCompleted = --entry.pendingAcks == 0;
+        }
+
+        if (isCompleted)
+            completed.expand (1, PageActions{EntriesTree::GetAddress (pageNumber), completePending (entry)});
+    });
+
+    return completed;
+}
+
+const PageDirectory::Entry *PageDirectory::find(Address page) const
+{
+    return mEntries.find (EntriesTree::GetPageNumber (page));
+}
+
+PageDirectory::Entry *PageDirectory::getEntry(Address page)
+{
+    auto entry = mEntries.findOrCreate (EntriesTree::GetPageNumber (page));
+
+    if (entry == nullptr)
+        ZQ_ASSERT_REPORT_NOT_REACHED ("A page above the user address space");
+
+    return entry;
+}
+
+PageDirectory::Actions PageDirectory::Retry(PeerIndex requester)
+{
+    Actions actions;
+
+    actions.reply = Actions::Reply::Retry;
+    actions.replyTo = requester;
+
+    gRetries.add ();
+    return actions;
+}
+
+PageDirectory::Actions PageDirectory::SendPage(PeerIndex requester, bool isWrite)
+{
+    Actions actions;
+
+    actions.reply = Actions::Reply::SendPage;
+    actions.replyIsWrite = isWrite;
+    actions.replyTo = requester;
+
+    return actions;
+}
+
+PageDirectory::Actions PageDirectory::completePending(Entry &entry)
+{
+    PeerIndex requester = entry.pendingRequester;
+
+    entry.isBusy = false;
+
+    if (entry.isPendingCancelled) {
+        entry.isPendingCancelled = false;
+
+        if (entry.state == State::Shared && entry.sharers == 0)
+            entry.state = State::Invalid;
+
+        return {};
+    }
+
+    if (entry.isPendingWrite) {
+        entry.state = State::Modified;
+        entry.owner = requester;
+        entry.sharers = 0;
+    } else {
+        entry.state = State::Shared;
+        entry.sharers |= PeerBit (requester);
+    }
+
+    return SendPage (requester, entry.isPendingWrite);
+}
+
+} // namespace Ziqe
@@ -0,0 +1,201 @@
+/**
+ * @file PageDirectory.hpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Main: copyright (C) 2016 Shmuel Hazan
+ *
+ * Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ZIQE_CORE_PAGEDIRECTORY_H
+#define ZIQE_CORE_PAGEDIRECTORY_H
+
+#include "Base/Types.hpp"
+#include "Base/PageRadixTree.hpp"
+#include "Base/Vector.hpp"
+
+#include "Common/Types.hpp"
+
+namespace Ziqe {
+
+/**
+ * @brief The ownership state of the pages homed at this peer.
+ *
+ * Every page has a home peer (see GetHome) that keeps its directory entry,
+ * so the directory is spread between the process peers instead of being
+ * kept by the process owner. A page is in one of three states:
+ *
+ *  Invalid : Only the home's copy exists.
+ *  Shared  : The home's copy is valid, and so are the read only copies of
+ *            the sharers.
+ *  Modified: A single peer (the owner) has the only valid, writable copy.
+ *
+ * Transitions (the messages are sent by the caller, see Actions):
+ *
+ *  Read  (GetMemory)  : Invalid/Shared -> Shared, the page is sent from the
+ *                       home (GetMemoryResult). Modified -> the owner is
+ *                       recalled (RecallPage); when it gives the page back
+ *                       (GivePage) it stays a sharer -> Shared.
+ *  Write (WriteMemory): Invalid -> Modified, the page is given from the home
+ *                       (GivePage). Shared -> every other sharer is
+ *                       invalidated (InvalidatePage); after the last
+ *                       InvalidatePageOK -> Modified. Modified -> the owner
+ *                       is recalled and invalidated -> Modified.
+ *
+ * While waiting for acknowledgments or for a recalled page, the entry is
+ * busy and other requests for that page should be retried.
+ *
+ * Under release consistency the peers never ask for writable copies: they
+ * write to their read only copies (keeping twins, see TwinPages) and send
+ * the changes to the home on a sync event (PageDiffs). The home applies
+ * them to its copy and invalidates the other sharers (onDiffApplied), so
+ * pages stay Shared and concurrent writers are merged instead of recalled.
+ *
+ * @note Not thread safe.
+ */
+class PageDirectory
+{
+public:
+    typedef uint64_t Address;
+
+    /// The index of a peer in the process' members, the same on every
+    /// peer (see ProcessPeersServer).
+    typedef uint8_t PeerIndex;
+
+    /// A bitmap of PeerIndex.
+    typedef uint64_t PeerSet;
+
+    static constexpr SizeType MaxPeers = sizeof (PeerSet) * 8;
+
+    enum class State : uint8_t {
+        Invalid,
+        Shared,
+        Modified
+    };
+
+    /**
+     * @brief What the home should send after handling a message.
+     */
+    struct Actions {
+        enum class Reply : uint8_t {
+            None,
+            /// Send the home's copy to replyTo: GetMemoryResult for a read,
+            /// GivePage for a write.
+            SendPage,
+            /// The page is busy, ask replyTo to try again.
+            Retry,
+        };
+
+        /// Send InvalidatePage to these peers.
+        PeerSet invalidate = 0;
+
+        /// Send RecallPage to the owner; it should drop its copy too
+        /// when recallForWrite is set.
+        bool recall = false;
+        bool recallForWrite = false;
+        PeerIndex owner = 0;
+
+        Reply reply = Reply::None;
+        bool replyIsWrite = false;
+        PeerIndex replyTo = 0;
+    };
+
+    /// A page that has never been requested has a zeroed entry.
+    struct Entry {
+        State state = State::Invalid;
+
+        /// Valid when Modified.
+        PeerIndex owner = 0;
+
+        /// Valid when Shared.
+        PeerSet sharers = 0;
+
+        /// A request that waits for acknowledgments or for a recalled page.
+        bool isBusy = false;
+        bool isPendingWrite = false;
+        /// The requester left, finish the transaction without a reply.
+        bool isPendingCancelled = false;
+        PeerIndex pendingRequester = 0;
+        SizeType pendingAcks = 0;
+    };
+
+    PageDirectory() = default;
+
+    ZQ_ALLOW_MOVE (PageDirectory)
+    ZQ_DISALLOW_COPY (PageDirectory)
+
+    /**
+     * @brief The home of @a page out of @a members, every peer of the
+     *        process including this one. Peers that agree on the members
+     *        agree on the homes.
+     */
+    static PeerIndex GetHome (Address page, PeerSet members);
+
+    static PeerSet PeerBit (PeerIndex peer)
+    {
+        return PeerSet{1} << peer;
+    }
+
+    Actions onReadRequest (Address page, PeerIndex requester);
+    Actions onWriteRequest (Address page, PeerIndex requester);
+
+    /**
+     * @brief A sharer dropped its copy (InvalidatePageOK).
+     */
+    Actions onInvalidateAck (Address page, PeerIndex from);
+
+    /**
+     * @brief A recalled owner gave its page back (GivePage). The caller
+     *        should update the home's copy before sending the actions.
+     */
+    Actions onPageReturned (Address page, PeerIndex from);
+
+    /**
+     * @brief Release consistency: @a writer 's changes to @a page have been
+     *        applied to the home's copy. The other sharers are invalidated,
+     *        without waiting for their acknowledgments.
+     */
+    Actions onDiffApplied (Address page, PeerIndex writer);
+
+    typedef Base::Pair<Address, Actions> PageActions;
+
+    /**
+     * @brief Forget a peer that left the process, as if it dropped all
+     *        its copies. Pages it owned fall back to the home's copy.
+     * @return The actions of requests that were waiting only for it.
+     */
+    Base::Vector<PageActions> removePeer (PeerIndex peer);
+
+    /**
+     * @return The entry of @a page, nullptr (or an Invalid entry) if it has
+     *         never been requested.
+     */
+    const Entry *find (Address page) const;
+
+private:
+    typedef Base::PageRadixTree<Entry> EntriesTree;
+
+    /// nullptr for a page above the user address space.
+    Entry *getEntry (Address page);
+
+    static Actions Retry (PeerIndex requester);
+    static Actions SendPage (PeerIndex requester, bool isWrite);
+
+    Actions completePending (Entry &entry);
+
+    EntriesTree mEntries;
+};
+
+} // namespace Ziqe
+
+#endif // ZIQE_CORE_PAGEDIRECTORY_H
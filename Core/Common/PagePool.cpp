@@ -0,0 +1,91 @@
+/**
+ * @file PagePool.cpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Main: copyright (C) 2016 Shmuel Hazan
+ *
+ * Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "PagePool.hpp"
+
+#include "CppCore/DirtyTracking.h"
+
+namespace Ziqe {
+
+PagePool::PagePool(SizeType pagesPerChunk)
+    : mPagesPerChunk{pagesPerChunk}
+{
+}
+
+PagePool::~PagePool()
+{
+    for (auto chunk : mChunks)
+        ZQ_SYMBOL(ZqDirtyTrackerDeallocatePages) (chunk, mPagesPerChunk * ZQ_PAGE_SIZE);
+}
+
+PagePool::PagePool(PagePool &&other)
+    : mFreePages{other.mFreePages},
+      mChunks{Base::move (other.mChunks)},
+      mPagesPerChunk{other.mPagesPerChunk}
+{
+    other.mFreePages = nullptr;
+}
+
+PagePool &PagePool::operator=(PagePool &&other)
+{
+    for (auto chunk : mChunks)
+        ZQ_SYMBOL(ZqDirtyTrackerDeallocatePages) (chunk, mPagesPerChunk * ZQ_PAGE_SIZE);
+
+    mFreePages = other.mFreePages;
+    mChunks = Base::move (other.mChunks);
+    mPagesPerChunk = other.mPagesPerChunk;
+    other.mFreePages = nullptr;
+
+    return *this;
+}
+
+uint8_t *PagePool::allocate()
+{
+    if (mFreePages == nullptr && ! allocateChunk ())
+        return nullptr;
+
+    auto page = mFreePages;
+    mFreePages = page->next;
+
+    return reinterpret_cast<uint8_t *>(page);
+}
+
+void PagePool::deallocate(uint8_t *page)
+{
+    auto freePage = reinterpret_cast<FreePage *>(page);
+
+    freePage->next = mFreePages;
+    mFreePages = freePage;
+}
+
+bool PagePool::allocateChunk()
+{
+    auto chunk = static_cast<uint8_t *>(ZQ_SYMBOL(ZqDirtyTrackerAllocatePages) (mPagesPerChunk * ZQ_PAGE_SIZE));
+    if (chunk == nullptr)
+        return false;
+
+    mChunks.expand (1, chunk);
+
+    for (SizeType i = 0; i < mPagesPerChunk; ++i)
+        deallocate (chunk + i * ZQ_PAGE_SIZE);
+
+    return true;
+}
+
+} // namespace Ziqe
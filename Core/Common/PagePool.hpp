@@ -0,0 +1,77 @@
+/**
+ * @file PagePool.hpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Main: copyright (C) 2016 Shmuel Hazan
+ *
+ * Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ZIQE_CORE_PAGEPOOL_H
+#define ZIQE_CORE_PAGEPOOL_H
+
+#include "Base/Types.hpp"
+#include "Base/Vector.hpp"
+
+namespace Ziqe {
+
+/**
+ * @brief A pool of page sized buffers.
+ *
+ * Pages are allocated in chunks and kept on a free list after they are
+ * returned, so taking a page is a pointer pop. The memory is given back
+ * only when the pool is destroyed.
+ *
+ * The pages are never reported by the dirty tracker, so copying into them
+ * doesn't make the next revision bigger.
+ *
+ * @note Not thread safe.
+ */
+class PagePool
+{
+public:
+    PagePool(SizeType pagesPerChunk = 64);
+    ~PagePool();
+
+    PagePool (PagePool &&other);
+    PagePool &operator= (PagePool &&other);
+    ZQ_DISALLOW_COPY (PagePool)
+
+    /**
+     * @brief Take a page from the pool.
+     * @return nullptr if a new chunk was needed and couldn't be allocated.
+     */
+    uint8_t *allocate ();
+
+    /**
+     * @brief Return @a page (a result of allocate()) to the pool.
+     */
+    void deallocate (uint8_t *page);
+
+private:
+    struct FreePage {
+        FreePage *next;
+    };
+
+    bool allocateChunk ();
+
+    FreePage *mFreePages = nullptr;
+
+    Base::Vector<uint8_t *> mChunks;
+
+    SizeType mPagesPerChunk;
+};
+
+} // namespace Ziqe
+
+#endif // ZIQE_CORE_PAGEPOOL_H
@@ -17,43 +17,91 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
-#include "ProcessMemoryManager.h"
+#include "ProcessMemoryManager.hpp"
 
-#include "ZiqeAPI/Memory.h"
+#include "CppCore/Memory.h"
+#include "Base/Checks.hpp"
+#include "Base/Metrics.hpp"
 
 namespace Ziqe {
 
-ProcessMemoryManager::ProcessMemoryManager()
-    : mModifiedPages{makeUnique<SpinLock>()}
-{
-
+namespace {
+Base::Metrics::Histogram gMapUserPageLatency{"Common/mapUserPage"};
+Base::Metrics::Histogram gCreateRevisionLatency{"Common/createRevision"};
+Base::Metrics::Counter gWritePageFaults{"Common/writePageFaults"};
 }
 
-void ProcessMemoryManager::onWritePageFault(ZqUserAddress address) {
-    ZqUserAddress alignedAddress = ZQ_PAGE_ALIGN (address);
-
-    mModifiedPages.get ().first.emplace_back (Pair<MappedPageType, ZqUserAddress>{mapUserPage (alignedAddress),
-                                                                                  alignedAddress});
-    setPageWrite (address);
+ProcessMemoryManager::Snapshot::~Snapshot()
+{
+    for (auto page : mPages)
+        mPool->deallocate (page);
 }
 
-MemoryRevision ProcessMemoryManager::createRevision()
+Base::Expected<ProcessMemoryManager, ZqError> ProcessMemoryManager::Create()
 {
-    auto listAndLock = mModifiedPages.get ();
+    auto maybeDirtyTracker = OS::DirtyTracker::Create ();
+    if (! maybeDirtyTracker)
+        return Base::Error (Base::move (maybeDirtyTracker.getError ()));
+
+    auto maybePageCache = OS::Map::UserPageCache::Create ();
+    if (! maybePageCache)
+        return Base::Error (Base::move (maybePageCache.getError ()));
 
-    return newRevision.fromChangedPages (listAndLock.first);
+    return {ProcessMemoryManager{Base::move (*maybeDirtyTracker), Base::move (*maybePageCache)}};
 }
 
-void ProcessMemoryManager::setPageWrite()
+ProcessMemoryManager::ProcessMemoryManager(OS::DirtyTracker &&dirtyTracker,
+                                           OS::Map::UserPageCache &&pageCache)
+    : mDirtyTracker{Base::move (dirtyTracker)},
+      mPageCache{Base::move (pageCache)}
 {
 }
 
-ProcessMemoryManager::MappedPageType ProcessMemoryManager::mapUserPage(ZqUserAddress address) {
-    ZqKernelAddress kernelAddress;
+Base::Expected<ProcessMemoryManager::Snapshot, ZqError> ProcessMemoryManager::createRevision()
+{
+    Base::Metrics::ScopedTimer timer{gCreateRevisionLatency};
+    Snapshot snapshot{mPagePool};
+
+    mDirtyAddresses.shrinkWithoutFree (mDirtyAddresses.size ());
+
+    // Only record the addresses here: the callback runs while the kernel
+    // holds the previous epoch.
+    auto onDirtyPage = [this] (ZqUserAddress address) {
+        mDirtyAddresses.expand (1, address);
+    };
+
+    auto result = mDirtyTracker.collect (onDirtyPage);
+    if (result != ZQ_E_OK)
+        return Base::Error (Base::move (result));
+
+    gWritePageFaults.add (mDirtyAddresses.size ());
+
+    snapshot.mAddresses.reserve (mDirtyAddresses.size ());
+    snapshot.mPages.reserve (mDirtyAddresses.size ());
+
+    // The snapshot returns the pages it has to the pool on failure.
+    for (auto address : mDirtyAddresses) {
+        auto maybeMappedPage = mapUserPage (address);
+        if (! maybeMappedPage)
+            return Base::Error (Base::move (maybeMappedPage.getError ()));
+
+        auto page = mPagePool.allocate ();
+        if (page == nullptr)
+            return Base::Error (ZqError{ZQ_E_NO_MEMORY});
+
+        memcpy (page, maybeMappedPage->getKernelAddress (), ZQ_PAGE_SIZE);
+
+        snapshot.mAddresses.expand (1, address);
+        snapshot.mPages.expand (1, page);
+    }
+
+    return {Base::move (snapshot)};
+}
 
-    DEBUG_CHECK (ZqMapUserAddressToKernel (address, ZQ_PAGE_SIZE, &kernelAddress) != ZQ_TRUE);
+Base::Expected<ProcessMemoryManager::MappedPageType, ZqError> ProcessMemoryManager::mapUserPage(ZqUserAddress address) {
+    Base::Metrics::ScopedTimer timer{gMapUserPageLatency};
 
-    return MappedPageType{kernelAddress};
+    return mPageCache.getPage (address, PROT_READ);
 }
 
 } // namespace Ziqe
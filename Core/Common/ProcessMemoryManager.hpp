@@ -20,43 +20,104 @@
 #ifndef ZIQE_PROCESSMEMORYMANAGER_H
 #define ZIQE_PROCESSMEMORYMANAGER_H
 
-#include "Base/LocalProcess.h"
-#include "Base/LinkedList.h"
-#include "Base/SpinLock.h"
+#include "Base/Vector.hpp"
+#include "Base/Expected.hpp"
 
-#include "MemoryRevision.h"
+#include "OS/Memory.hpp"
+
+#include "PagePool.hpp"
 
 namespace Ziqe {
 
 class ProcessMemoryManager
 {
 public:
-    ProcessMemoryManager();
+    /**
+     * @brief A copy of the pages that were written during a single epoch.
+     *
+     * The pages are borrowed from the manager's pool, and returned to it
+     * when the snapshot is destroyed.
+     */
+    class Snapshot
+    {
+    public:
+        ZQ_ALLOW_MOVE (Snapshot)
+        ZQ_DISALLOW_COPY (Snapshot)
 
-    void onWritePageFault (ZqUserAddress address);
+        ~Snapshot();
 
-    MemoryRevision createRevision ();
+        SizeType size () const
+        {
+            return mAddresses.size ();
+        }
 
-private:
-    void setAllPagesReadOnly ();
-    void setPageWrite ();
+        ZqUserAddress getAddress (SizeType index) const
+        {
+            return mAddresses[index];
+        }
 
-    MappedPageType mapUserPage(ZqUserAddress address);
+        const uint8_t *getPage (SizeType index) const
+        {
+            return mPages[index];
+        }
 
-    template<class T>
-    struct UnmapUserAddressDeleter
-    {
-        void operator() (T *pointer)
+    private:
+        friend class ProcessMemoryManager;
+
+        Snapshot(PagePool &pool)
+            : mPool{&pool}
         {
-            ZqUnmapUserAddressToKernel (static_cast<ZqKernelAddress>(pointer));
         }
+
+        Base::Vector<ZqUserAddress> mAddresses;
+        Base::Vector<uint8_t *> mPages;
+
+        PagePool *mPool;
     };
 
-    typedef UniquePointer<Byte[], UnmapUserAddressDeleter<Byte> MappedPageType;
+    /**
+     * @brief Start tracking the current process.
+     * @return ZQ_E_NOT_SUPPORTED if the platform can't track writes (e.g.
+     *         Linux before 5.8).
+     */
+    static Base::Expected<ProcessMemoryManager, ZqError> Create ();
+
+    /// The snapshots point to the manager's pool: move it only while it
+    /// has none.
+    ZQ_ALLOW_MOVE (ProcessMemoryManager)
+    ZQ_DISALLOW_COPY (ProcessMemoryManager)
+
+    /**
+     * @brief End the current epoch: copy every page that have been written
+     *        since the previous call and write protect the memory again.
+     *
+     * Costs O(dirty pages), nothing is allocated or copied on the fault path.
+     * On failure the epoch is still over: its pages are lost.
+     */
+    Base::Expected<Snapshot, ZqError> createRevision ();
+
+private:
+    ZQ_ALLOW_EXPECTED();
+
+    ProcessMemoryManager(OS::DirtyTracker &&dirtyTracker,
+                         OS::Map::UserPageCache &&pageCache);
+
+    // Pinned and mapped until the last reference goes away.
+    typedef OS::Map::UserPageCache::Page MappedPageType;
+
+    Base::Expected<MappedPageType, ZqError> mapUserPage(ZqUserAddress address);
+
+    // Write faults are recorded by the kernel, one bit per page.
+    OS::DirtyTracker mDirtyTracker;
+
+    // Pages that get dirty again are already pinned and mapped.
+    OS::Map::UserPageCache mPageCache;
 
-    UniqueSpinLocked<LinkedList<Pair<MappedPageType, ZqUserAddress>>> mModifiedPages;
+    PagePool mPagePool;
 
-    LocalProcess mLocalProcess;
+    // The addresses collected in the current epoch, kept between calls
+    // so its buffer is reused.
+    Base::Vector<ZqUserAddress> mDirtyAddresses;
 };
 
 } // namespace Ziqe
@@ -19,10 +19,31 @@
  */
 #include "ProcessPeersServer.hpp"
 
+#include "Base/Metrics.hpp"
+
+#include "CppCore/Memory.h"
+
 namespace Ziqe {
 
-ProcessPeersServer::ProcessPeersServer(Protocol::MessageServer &&messageServer)
-    : mServer{Base::move (messageServer)}
+namespace {
+Base::Metrics::Counter gPagesSent{"Transfer/pagesSent"};
+Base::Metrics::Counter gZeroPagesSent{"Transfer/zeroPagesSent"};
+Base::Metrics::Counter gHashesSent{"Transfer/hashesSent"};
+Base::Metrics::Counter gHashMisses{"Transfer/hashMisses"};
+Base::Metrics::Counter gBlocksSent{"Transfer/blocksSent"};
+Base::Metrics::Counter gBlockPagesSent{"Transfer/blockPagesSent"};
+}
+
+ProcessPeersServer::ProcessPeersServer(Protocol::MessageServer &&messageServer,
+                                       PageDirectory::PeerIndex memberIndex,
+                                       Base::UniquePointer<PageAccessInterface> &&pageAccess,
+                                       Base::UniquePointer<FutexWaitInterface> &&futexWait,
+                                       Base::UniquePointer<ThreadMigrationInterface> &&threadMigration)
+    : mServer{Base::move (messageServer)},
+      mPageAccess{Base::move (pageAccess)},
+      mPeerIndex{memberIndex},
+      mFutexWait{Base::move (futexWait)},
+      mThreadMigration{Base::move (threadMigration)}
 {
     sendHello ();
 }
@@ -34,11 +55,167 @@ ProcessPeersServer::~ProcessPeersServer()
 
 void ProcessPeersServer::onMessageReceived(const Protocol::Message &type,
                                            Protocol::MessageStream::MessageFieldReader &fieldReader,
-                                           const Protocol::MessageStream &messageStream)
+                                           Protocol::MessageStream &messageStream)
 {
     using Protocol::Message;
 
+    auto maybeFrom = mOtherServers.getRead ().first.findPeerIndex (messageStream.getInfo ());
+
     switch (type.getType ()) {
+    case Message::Type::GetMemory:
+    case Message::Type::WriteMemory:
+    case Message::Type::InvalidatePageOK: {
+        auto message = Protocol::MessageWithPageAddress::ReadFrom (type.getType (), fieldReader);
+        if (! message || ! maybeFrom)
+            return;
+
+        if (type.getType () == Message::Type::InvalidatePageOK)
+            onInvalidatePageOKReceived (*maybeFrom, message->getAddress ());
+        else
+            onPageRequestReceived (*maybeFrom,
+                                   message->getAddress (),
+                                   type.getType () == Message::Type::WriteMemory);
+        break;
+    }
+    case Message::Type::GetMemoryResult:
+    case Message::Type::GivePage: {
+        auto message = Protocol::MessageWithPage::ReadFrom (type.getType (), fieldReader);
+        if (! message || ! maybeFrom)
+            return;
+
+        // It may be sent again by its hash.
+        mPageCache.insert (PageCache::HashPage (message->getPage ().data ()), message->getPage ().data ());
+
+        onPageContentReceived (*maybeFrom,
+                               message->getAddress (),
+                               message->getPage (),
+                               type.getType () == Message::Type::GivePage);
+        break;
+    }
+    case Message::Type::GetMemoryResultZero:
+    case Message::Type::GivePageZero: {
+        auto message = Protocol::MessageWithPageAddress::ReadFrom (type.getType (), fieldReader);
+        if (! message || ! maybeFrom)
+            return;
+
+        Base::Vector<uint8_t> zeros;
+        zeros.resize (ZQ_PAGE_SIZE, uint8_t{0});
+
+        onPageContentReceived (*maybeFrom,
+                               message->getAddress (),
+                               zeros,
+                               type.getType () == Message::Type::GivePageZero);
+        break;
+    }
+    case Message::Type::GetMemoryResultByHash:
+    case Message::Type::GivePageByHash:
+    case Message::Type::GetMemoryResultMiss:
+    case Message::Type::GivePageMiss: {
+        auto message = Protocol::MessageWithPageHash::ReadFrom (type.getType (), fieldReader);
+        if (! message || ! maybeFrom)
+            return;
+
+        PageCache::Hash hash{message->getHashLow (), message->getHashHigh ()};
+        bool isGive = type.getType () == Message::Type::GivePageByHash
+                      || type.getType () == Message::Type::GivePageMiss;
+
+        if (type.getType () == Message::Type::GetMemoryResultMiss || type.getType () == Message::Type::GivePageMiss)
+            onPageMissReceived (*maybeFrom, message->getAddress (), hash, isGive);
+        else
+            onPageHashReceived (*maybeFrom, message->getAddress (), hash, isGive);
+        break;
+    }
+    case Message::Type::GetMemoryResultBlock:
+    case Message::Type::GivePageBlock: {
+        auto message = Protocol::MessageWithBlock::ReadFrom (type.getType (), fieldReader);
+        if (! message || ! maybeFrom)
+            return;
+
+        onBlockReceived (*maybeFrom, *message, type.getType () == Message::Type::GivePageBlock);
+        break;
+    }
+    case Message::Type::RecallPage:
+    case Message::Type::RecallPageForWrite:
+    case Message::Type::InvalidatePage:
+    case Message::Type::MergePage:
+    case Message::Type::PageBusy: {
+        auto message = Protocol::MessageWithPageAddress::ReadFrom (type.getType (), fieldReader);
+        if (! message)
+            return;
+
+        if (type.getType () == Message::Type::InvalidatePage)
+            onInvalidatePageReceived (message->getAddress ());
+        else if (type.getType () == Message::Type::MergePage)
+            onMergePageReceived (message->getAddress ());
+        else if (type.getType () == Message::Type::PageBusy)
+            ; // The faulting thread will fault again and request it again.
+        else
+            onRecallPageReceived (message->getAddress (),
+                                  type.getType () == Message::Type::RecallPageForWrite);
+        break;
+    }
+    case Message::Type::PageDiffs: {
+        auto message = Protocol::MessageWithRevision::ReadFrom (type.getType (), fieldReader);
+        if (! message || ! maybeFrom)
+            return;
+
+        onPageDiffsReceived (*maybeFrom, message->getRevision ());
+        break;
+    }
+    case Message::Type::FutexWait:
+    case Message::Type::FutexWake:
+    case Message::Type::FutexWaitDone:
+    case Message::Type::FutexCancel: {
+        auto message = Protocol::MessageWithFutex::ReadFrom (type.getType (), fieldReader);
+        if (! message || ! maybeFrom)
+            return;
+
+        if (type.getType () == Message::Type::FutexWait)
+            onFutexWaitReceived (*maybeFrom,
+                                 message->getThread (),
+                                 message->getAddress (),
+                                 message->getValue (),
+                                 message->getBitset ());
+        else if (type.getType () == Message::Type::FutexWake)
+            onFutexWakeReceived (message->getAddress (), message->getValue (), message->getBitset ());
+        else if (type.getType () == Message::Type::FutexCancel)
+            onFutexCancelReceived (*maybeFrom, message->getThread (), message->getAddress ());
+        else
+            mFutexWait->onFutexWaitDone (message->getThread (),
+                                         static_cast<ZqError>(static_cast<int32_t>(message->getValue ())));
+        break;
+    }
+    case Message::Type::MigrateThreadPages:
+    case Message::Type::MigrateThreadPagesOK:
+    case Message::Type::MigrateThreadOK: {
+        auto message = Protocol::MessageWithPageAddresses::ReadFrom (type.getType (), fieldReader);
+        if (! message || ! maybeFrom)
+            return;
+
+        if (type.getType () == Message::Type::MigrateThreadPages)
+            onMigrateThreadPagesReceived (*maybeFrom, message->getThread (), message->getPages ());
+        else if (type.getType () == Message::Type::MigrateThreadPagesOK)
+            onMigrateThreadPagesOKReceived (message->getThread ());
+        else
+            onMigrateThreadOKReceived (message->getThread ());
+        break;
+    }
+    case Message::Type::MigrateThread: {
+        auto message = Protocol::MessageWithThreadState::ReadFrom (type.getType (), fieldReader);
+        if (! message || ! maybeFrom)
+            return;
+
+        onMigrateThreadReceived (*maybeFrom, message->getThread (), message->getPages (), message->getState ());
+        break;
+    }
+    case Message::Type::ProcessPeerFeatures: {
+        auto message = Protocol::MessageWithFeatures::ReadFrom (type.getType (), fieldReader);
+        if (! message || ! maybeFrom)
+            return;
+
+        onFeaturesReceived (*maybeFrom, message->getFeatures ());
+        break;
+    }
     case Message::Type::StopThread:
         break;
     case Message::Type::ContinueThread:
@@ -47,10 +224,24 @@ void ProcessPeersServer::onMessageReceived(const Protocol::Message &type,
         break;
     case Message::Type::ProcessPeerRunThread:
         break;
-    case Message::Type::ProcessPeerHello:
+    case Message::Type::ProcessPeerHello: {
+        auto message = Protocol::MessageWithMemberAndThreadIDs::ReadFrom (type.getType (), fieldReader);
+        if (! message)
+            return;
+
+        const auto &threads = message->getThreadIDs ();
+        onHelloReceived (messageStream, message->getMember (), {threads.data (), threads.size ()});
         break;
-    case Message::Type::ProcessPeerGoodbye:
+    }
+    case Message::Type::ProcessPeerGoodbye: {
+        auto message = Protocol::MessageWithThreadIDs::ReadFrom (type.getType (), fieldReader);
+        if (! message)
+            return;
+
+        const auto &threads = message->getThreadIDs ();
+        onGoodbyeReceived (messageStream, {threads.data (), threads.size ()});
         break;
+    }
     default:
         return;
     }
@@ -99,19 +290,985 @@ void ProcessPeersServer::onRunThreadReceived(Protocol::MessageStream &stream, Ho
 
 }
 
-void ProcessPeersServer::onHelloReceived(Protocol::MessageStream &stream, const Base::RawArray<HostedThreadID> &newThreads)
+void ProcessPeersServer::onHelloReceived(Protocol::MessageStream &stream,
+                                         PageDirectory::PeerIndex member,
+                                         const Base::RawArray<const HostedThreadID> &newThreads)
 {
-    mOtherServers.getWrite ().first.addThreads (newThreads, stream.getInfo ());
+    if (member >= PageDirectory::MaxPeers || member == mPeerIndex) {
+        ZQ_ASSERT_REPORT_NOT_REACHED ("ProcessPeerHello with our member index");
+        return;
+    }
+
+    // The pages' homes are about to change.
+    finishRestore ();
+
+    auto writeOtherServers = mOtherServers.getWrite ();
+
+    if (! writeOtherServers.first.addPeer (member, stream.getInfo ())) {
+        ZQ_ASSERT_REPORT_NOT_REACHED ("ProcessPeerHello with another peer's member index");
+        return;
+    }
+
+    writeOtherServers.first.addThreads (newThreads, stream.getInfo ());
 }
 
-void ProcessPeersServer::onGoodbyeReceived(Protocol::MessageStream &stream, const Base::RawArray<HostedThreadID> &leavingThreads)
+void ProcessPeersServer::onGoodbyeReceived(Protocol::MessageStream &stream, const Base::RawArray<const HostedThreadID> &leavingThreads)
 {
     mOtherServers.getWrite ().first.removeThreads (leavingThreads);
+
+    auto maybePeer = mOtherServers.getRead ().first.findPeerIndex (stream.getInfo ());
+    if (! maybePeer)
+        return;
+
+    for (const auto &pageAndActions : mPageDirectory.removePeer (*maybePeer))
+        performDirectoryActions (pageAndActions.first, pageAndActions.second);
+
+    mFutexTable.removePeer (*maybePeer);
+    mPeerFeatures.erase (*maybePeer);
+
+    // Its pages are homed by the others from now on.
+    mOtherServers.getWrite ().first.removePeer (*maybePeer);
+}
+
+void ProcessPeersServer::onFeaturesReceived(PageDirectory::PeerIndex from,
+                                            Protocol::MessageWithFeatures::FeaturesType features)
+{
+    auto iterator = mPeerFeatures.find (from);
+
+    if (iterator != mPeerFeatures.end ()) {
+        iterator->second = features;
+        return;
+    }
+
+    mPeerFeatures.insert (from, features);
+
+    // A new peer: it doesn't know ours yet.
+    sendToPeer (from, Protocol::ProcessPeerFeaturesMessage{mFeatures});
+}
+
+bool ProcessPeersServer::isCompressingPagesTo(PageDirectory::PeerIndex peer) const
+{
+    if ((mFeatures & Protocol::MessageWithFeatures::PageCompression) == 0)
+        return false;
+
+    auto iterator = mPeerFeatures.find (peer);
+
+    return iterator != mPeerFeatures.end ()
+           && (iterator->second & Protocol::MessageWithFeatures::PageCompression) != 0;
+}
+
+void ProcessPeersServer::disablePageCompression()
+{
+    mFeatures &= ~Protocol::MessageWithFeatures::PageCompression;
+
+    sendFeatures ();
+}
+
+void ProcessPeersServer::requestPage(PageDirectory::Address page, bool isWrite)
+{
+    page = mBlocks.getBlock (page);
+
+    if (mRestoredCheckpoint) {
+        for (SizeType i = 0; i < mBlocks.getPagesPerBlock (); ++i)
+            loadRestoredPage (PageBlocks::GetPage (page, i));
+    }
+
+    if (isWrite && isReleaseConsistent (page)) {
+        // Write to our read only copy, the home gets the changes on release().
+        if (getLocalAccess (page) == PageDirectory::State::Shared
+            && mTwinPages.makeTwin (page, mPageAccess->readPage (page).data ())) {
+            setLocalAccess (page, PageDirectory::State::Modified);
+            return;
+        }
+
+        // Get a read only copy first, the thread will fault again to write.
+        isWrite = false;
+    }
+
+    auto home = getHome (page);
+
+    if (home == mPeerIndex) {
+        onPageRequestReceived (mPeerIndex, page, isWrite);
+    } else if (isWrite) {
+        sendToPeer (home, Protocol::WriteMemoryMessage{page});
+    } else {
+        sendToPeer (home, Protocol::GetMemoryMessage{page});
+    }
+}
+
+void ProcessPeersServer::onPageRequestReceived(PageDirectory::PeerIndex from,
+                                               PageDirectory::Address page,
+                                               bool isWrite)
+{
+    if (! applyContentionPolicy (from, page, isWrite)) {
+        // Our own thread will fault again.
+        if (from != mPeerIndex)
+            sendToPeer (from, Protocol::PageBusyMessage{page});
+
+        return;
+    }
+
+    auto actions = isWrite ? mPageDirectory.onWriteRequest (page, from)
+                           : mPageDirectory.onReadRequest (page, from);
+
+    mPageContention.onFault (page, from, isWrite, actions.recall || actions.invalidate != 0);
+
+    performDirectoryActions (page, actions);
+}
+
+bool ProcessPeersServer::applyContentionPolicy(PageDirectory::PeerIndex from,
+                                               PageDirectory::Address page,
+                                               bool &isWrite)
+{
+    switch (mPageContention.getPolicy (page)) {
+    case PageContention::Policy::Default:
+        return true;
+
+    case PageContention::Policy::Pin:
+        return ! mPageContention.shouldHold (page, from);
+
+    case PageContention::Policy::DiffMerge:
+        // Blocks stay with a single writer.
+        if (! mBlocks.isSinglePage ())
+            return true;
+
+        break;
+    }
+
+    if (mMergedPages.find (page) == mMergedPages.end ()) {
+        auto entry = mPageDirectory.find (page);
+
+        // Switch when no peer has a writable copy: the writers keep twins
+        // of read only copies from now on.
+        if (entry != nullptr && (entry->isBusy || entry->state == PageDirectory::State::Modified))
+            return true;
+
+        mMergedPages.insert (page, true);
+        sendToAll (Protocol::MergePageMessage{page});
+    }
+
+    // A writer that didn't get MergePage yet gets a read only copy, and
+    // asks again until it does.
+    isWrite = false;
+    return true;
+}
+
+void ProcessPeersServer::onInvalidatePageOKReceived(PageDirectory::PeerIndex from,
+                                                    PageDirectory::Address page)
+{
+    performDirectoryActions (page, mPageDirectory.onInvalidateAck (page, from));
+}
+
+void ProcessPeersServer::onPageReturnedReceived(PageDirectory::PeerIndex from,
+                                                PageDirectory::Address page,
+                                                const Base::Vector<uint8_t> &content)
+{
+    // The home's copy is the newest again.
+    mPageAccess->writePage (page, content);
+
+    performDirectoryActions (page, mPageDirectory.onPageReturned (page, from));
+}
+
+void ProcessPeersServer::release()
+{
+    auto pages = mTwinPages.getPages ();
+    if (pages.size () == 0)
+        return;
+
+    Base::Vector<Protocol::MemoryRevision> revisionPerHome;
+    // Up to the highest member index.
+    revisionPerHome.resize (PageDirectory::MaxPeers - static_cast<SizeType>(__builtin_clzll (getMembers ())));
+
+    for (auto page : pages) {
+        auto diff = takeLocalDiff (page);
+        if (diff.isEmpty ())
+            continue;
+
+        auto home = getHome (page);
+
+        // Our memory is the home's copy, the changes are already there.
+        if (home == mPeerIndex)
+            performDirectoryActions (page, mPageDirectory.onDiffApplied (page, mPeerIndex));
+        else
+            revisionPerHome[home].addPageDiff (Base::move (diff));
+    }
+
+    for (SizeType home = 0; home < revisionPerHome.size (); ++home) {
+        if (revisionPerHome[home].isEmpty ())
+            continue;
+
+        sendPagesToPeer (static_cast<PageDirectory::PeerIndex>(home),
+                         Protocol::PageDiffsMessage{Base::move (revisionPerHome[home])});
+    }
+
+    closeRevision ();
+}
+
+void ProcessPeersServer::onPageDiffsReceived(PageDirectory::PeerIndex from,
+                                             const Protocol::MemoryRevision &revision)
+{
+    for (const auto &diff : revision.getPageDiffs ()) {
+        auto page = diff.getAddress ();
+
+        if (getHome (page) != mPeerIndex) {
+            ZQ_ASSERT_REPORT_NOT_REACHED ("PageDiffs sent to a peer that isn't the home");
+            continue;
+        }
+
+        // Merge: only the bytes the writer changed are replaced, our own
+        // changes (and our twin's copy of them) stay.
+        mPageAccess->applyPageDiff (diff);
+        mTwinPages.applyToTwin (diff);
+
+        performDirectoryActions (page, mPageDirectory.onDiffApplied (page, from));
+    }
+}
+
+void ProcessPeersServer::onPageReceived(PageDirectory::Address page,
+                                        const Base::Vector<uint8_t> &content,
+                                        bool isWritable)
+{
+    mPageAccess->writePage (page, content);
+    setLocalAccess (page, isWritable ? PageDirectory::State::Modified
+                                     : PageDirectory::State::Shared);
+}
+
+void ProcessPeersServer::onPageContentReceived(PageDirectory::PeerIndex from,
+                                               PageDirectory::Address page,
+                                               const Base::Vector<uint8_t> &content,
+                                               bool isGive)
+{
+    // The home gives pages to the requesters, the owners give them back to the home.
+    if (isGive && getHome (page) == mPeerIndex)
+        onPageReturnedReceived (from, page, content);
+    else
+        onPageReceived (page, content, isGive);
+}
+
+void ProcessPeersServer::onPageHashReceived(PageDirectory::PeerIndex from,
+                                            PageDirectory::Address page,
+                                            const PageCache::Hash &hash,
+                                            bool isGive)
+{
+    auto content = mPageCache.find (hash);
+
+    if (content == nullptr) {
+        if (isGive)
+            sendToPeer (from, Protocol::GivePageMissMessage{page, hash.low, hash.high});
+        else
+            sendToPeer (from, Protocol::GetMemoryResultMissMessage{page, hash.low, hash.high});
+
+        return;
+    }
+
+    onPageContentReceived (from, page, Base::Vector<uint8_t>{content, content + ZQ_PAGE_SIZE}, isGive);
+}
+
+void ProcessPeersServer::onPageMissReceived(PageDirectory::PeerIndex from,
+                                            PageDirectory::Address page,
+                                            const PageCache::Hash &hash,
+                                            bool isGive)
+{
+    gHashMisses.add ();
+
+    // The content we hashed, if it is still cached. Otherwise the page
+    // hasn't changed since: it is in a transaction.
+    auto cached = mPageCache.find (hash);
+    auto content = cached != nullptr ? Base::Vector<uint8_t>{cached, cached + ZQ_PAGE_SIZE}
+                                     : mPageAccess->readPage (page);
+
+    gPagesSent.add ();
+
+    if (isGive)
+        sendPagesToPeer (from, Protocol::GivePageMessage{page, Base::move (content)});
+    else
+        sendPagesToPeer (from, Protocol::GetMemoryResultMessage{page, Base::move (content)});
+}
+
+void ProcessPeersServer::onBlockReceived(PageDirectory::PeerIndex from,
+                                         const Protocol::MessageWithBlock &message,
+                                         bool isGive)
+{
+    auto block = message.getAddress ();
+
+    if (block != mBlocks.getBlock (block) || message.getPagesCount () != mBlocks.getPagesPerBlock ()) {
+        ZQ_ASSERT_REPORT_NOT_REACHED ("A block of another size, the peers' blocks should be the same");
+        return;
+    }
+
+    Base::Vector<uint8_t> zeros;
+
+    for (SizeType i = 0; i < message.getPagesCount (); ++i) {
+        if (! message.isSent (i))
+            continue;
+
+        if (message.isZero (i)) {
+            if (zeros.size () == 0)
+                zeros.resize (ZQ_PAGE_SIZE, uint8_t{0});
+
+            mPageAccess->writePage (PageBlocks::GetPage (block, i), zeros);
+        } else {
+            mPageAccess->writePage (PageBlocks::GetPage (block, i), message.getPage (i));
+        }
+    }
+
+    // The same as onPageContentReceived: the pages that weren't given
+    // back haven't been written since the home gave them.
+    if (isGive && getHome (block) == mPeerIndex)
+        performDirectoryActions (block, mPageDirectory.onPageReturned (block, from));
+    else
+        setLocalAccess (block, isGive ? PageDirectory::State::Modified
+                                      : PageDirectory::State::Shared);
+}
+
+void ProcessPeersServer::onInvalidatePageReceived(PageDirectory::Address page)
+{
+    setLocalAccess (page, PageDirectory::State::Invalid);
+
+    if (isReleaseConsistent (page)) {
+        // Another writer released its changes. Send ours before dropping
+        // the copy so the home merges both. Nothing waits for an acknowledgment.
+        if (mTwinPages.hasTwin (page)) {
+            Protocol::MemoryRevision revision;
+
+            revision.addPageDiff (takeLocalDiff (page));
+            if (! revision.isEmpty ())
+                sendPagesToPeer (getHome (page), Protocol::PageDiffsMessage{Base::move (revision)});
+        }
+
+        return;
+    }
+
+    sendToPeer (getHome (page), Protocol::InvalidatePageOKMessage{page});
+}
+
+void ProcessPeersServer::onRecallPageReceived(PageDirectory::Address page, bool isForWrite)
+{
+    // Stop the writes before copying.
+    setLocalAccess (page, isForWrite ? PageDirectory::State::Invalid
+                                     : PageDirectory::State::Shared);
+
+    sendPage (getHome (page), page, true);
+}
+
+void ProcessPeersServer::onMergePageReceived(PageDirectory::Address page)
+{
+    if (mMergedPages.find (page) == mMergedPages.end ())
+        mMergedPages.insert (page, true);
+}
+
+void ProcessPeersServer::migrateThread(HostedThreadID thread, PageDirectory::PeerIndex destination)
+{
+    ZQ_ASSERT (globalToLocalThread (thread) != nullptr);
+    ZQ_ASSERT (destination != mPeerIndex);
+
+    // Start a new epoch: the first round sends every page we have anyway.
+    mThreadMigration->collectWrittenPages ();
+
+    Base::Vector<PageDirectory::Address> residentPages;
+
+    mLocalAccess.forEach ([&] (LocalAccessTree::PageNumber block, PageDirectory::State &) {
+        residentPages.resize (residentPages.size () + 1, LocalAccessTree::GetAddress (block));
+    });
+
+    auto iterator = mMigrations.insert (thread, ThreadMigration{thread, destination}).second;
+    auto pages = iterator->second.firstRound (Base::move (residentPages));
+
+    sendToPeer (destination, Protocol::MigrateThreadPagesMessage{thread, Base::move (pages)});
+}
+
+void ProcessPeersServer::onMigrateThreadPagesOKReceived(HostedThreadID thread)
+{
+    auto iterator = mMigrations.find (thread);
+    if (iterator == mMigrations.end ())
+        return;
+
+    auto &migration = iterator->second;
+    auto pages = migration.nextRound (mThreadMigration->collectWrittenPages ());
+
+    if (pages.size () != 0) {
+        sendToPeer (migration.getDestination (),
+                    Protocol::MigrateThreadPagesMessage{thread, Base::move (pages)});
+        return;
+    }
+
+    auto localThread = globalToLocalThread (thread);
+    if (localThread == nullptr) {
+        // Exited meanwhile.
+        mMigrations.erase (iterator);
+        return;
+    }
+
+    // Stop and copy: the thread stays stopped (here) until the destination runs it.
+    localThread->stop ();
+
+    Protocol::ThreadState state{localThread->getThreadInfo ().registers};
+
+    sendToPeer (migration.getDestination (),
+                Protocol::MigrateThreadMessage{thread,
+                                               migration.lastRound (mThreadMigration->collectWrittenPages ()),
+                                               Base::move (state)});
+}
+
+void ProcessPeersServer::onMigrateThreadOKReceived(HostedThreadID thread)
+{
+    auto iterator = mMigrations.find (thread);
+    if (iterator == mMigrations.end ())
+        return;
+
+    iterator->second.onDone ();
+    mMigrations.erase (iterator);
+
+    auto localThread = mProcessLocalThreads.find (thread);
+    if (localThread == mProcessLocalThreads.end ())
+        return;
+
+    localThread->second.kill ();
+    mProcessLocalThreads.erase (localThread);
+}
+
+void ProcessPeersServer::onMigrateThreadPagesReceived(PageDirectory::PeerIndex from,
+                                                      HostedThreadID thread,
+                                                      const Base::Vector<PageDirectory::Address> &pages)
+{
+    // Read only copies: the thread is still writing to some of them.
+    for (auto page : pages) {
+        if (getLocalAccess (page) == PageDirectory::State::Invalid)
+            requestPage (page, false);
+    }
+
+    sendToPeer (from, Protocol::MigrateThreadPagesOKMessage{thread, Base::Vector<PageDirectory::Address>{}});
+}
+
+void ProcessPeersServer::onMigrateThreadReceived(PageDirectory::PeerIndex from,
+                                                 HostedThreadID thread,
+                                                 const Base::Vector<PageDirectory::Address> &pages,
+                                                 const Protocol::ThreadState &state)
+{
+    // The thread is likely to write to these again. It doesn't wait for
+    // them: it faults on the ones that are still on their way.
+    for (auto page : pages) {
+        if (getLocalAccess (page) != PageDirectory::State::Modified)
+            requestPage (page, true);
+    }
+
+    mThreadMigration->runMigratedThread (thread, state);
+
+    sendToPeer (from, Protocol::MigrateThreadOKMessage{thread, Base::Vector<PageDirectory::Address>{}});
+}
+
+ZqError ProcessPeersServer::checkpoint(CheckpointWriter &writer)
+{
+    // The pages we write without twins are taken as they are now: the
+    // incremental checkpoints have only the writes from now on.
+    mLocalAccess.forEach ([&] (LocalAccessTree::PageNumber block, PageDirectory::State &state) {
+        auto page = LocalAccessTree::GetAddress (block);
+
+        if (state == PageDirectory::State::Modified && ! mTwinPages.hasTwin (page))
+            recordWrittenPages (page);
+    });
+
+    // The changes from now on are in the next revisions.
+    mIsKeepingRevisions = true;
+    mWrittenRevision = takeCheckpointRevision ();
+
+    auto result = writer.addRevision (MemoryRevisionTree::kInitialID, mWrittenRevision);
+    if (result != ZQ_E_OK)
+        return result;
+
+    result = writeCheckpointThreads (writer);
+    if (result != ZQ_E_OK)
+        return result;
+
+    mLocalAccess.forEach ([&] (LocalAccessTree::PageNumber block, PageDirectory::State &state) {
+        auto page = LocalAccessTree::GetAddress (block);
+
+        // Stop at the first error.
+        if (result != ZQ_E_OK)
+            return;
+
+        if (state != PageDirectory::State::Modified) {
+            if (getHome (page) != mPeerIndex)
+                return;
+
+            // Written by another peer: it writes the page.
+            auto entry = mPageDirectory.find (page);
+            if (entry != nullptr && entry->state == PageDirectory::State::Modified && entry->owner != mPeerIndex)
+                return;
+        }
+
+        for (SizeType i = 0; i < mBlocks.getPagesPerBlock () && result == ZQ_E_OK; ++i) {
+            result = writer.addPage (PageBlocks::GetPage (page, i),
+                                     mPageAccess->readPage (PageBlocks::GetPage (page, i)).data ());
+        }
+    });
+
+    return result;
+}
+
+ZqError ProcessPeersServer::checkpointIncremental(CheckpointWriter &writer)
+{
+    if (mCheckpointedRevision == MemoryRevisionTree::kInitialID) {
+        ZQ_ASSERT_REPORT_NOT_REACHED ("An incremental checkpoint without a base");
+        return ZQ_E_INVALID_ARG;
+    }
+
+    release ();
+
+    // The pages we still write without twins.
+    mLocalAccess.forEach ([&] (LocalAccessTree::PageNumber block, PageDirectory::State &state) {
+        auto page = LocalAccessTree::GetAddress (block);
+
+        if (state == PageDirectory::State::Modified && ! mTwinPages.hasTwin (page))
+            recordWrittenPages (page);
+    });
+
+    mWrittenRevision = takeCheckpointRevision ();
+
+    auto result = writer.addRevision (mCheckpointedRevision, mWrittenRevision);
+    if (result != ZQ_E_OK)
+        return result;
+
+    result = writeCheckpointThreads (writer);
+    if (result != ZQ_E_OK)
+        return result;
+
+    // Costs what has been written since, not the process' size.
+    auto changes = mRevisions.diff (mCheckpointedRevision);
+
+    for (const auto &diff : changes.getPageDiffs ()) {
+        result = writer.addPageDiff (diff);
+        if (result != ZQ_E_OK)
+            return result;
+    }
+
+    return ZQ_E_OK;
+}
+
+void ProcessPeersServer::commitCheckpoint()
+{
+    mCheckpointedRevision = mWrittenRevision;
+    mRevisions.discard (mCheckpointedRevision);
+}
+
+ZqError ProcessPeersServer::writeCheckpointThreads(CheckpointWriter &writer)
+{
+    for (auto iterator = mProcessLocalThreads.begin (); iterator != mProcessLocalThreads.end (); ++iterator) {
+        auto result = writer.addThread (iterator->first,
+                                        Protocol::ThreadState{iterator->second.getThreadInfo ().registers});
+        if (result != ZQ_E_OK)
+            return result;
+    }
+
+    return ZQ_E_OK;
+}
+
+void ProcessPeersServer::restore(CheckpointReader &&reader)
+{
+    ZQ_ASSERT (mOtherServers.getRead ().first.getMembers () == 0);
+    ZQ_ASSERT (reader.getBaseRevision () == MemoryRevisionTree::kInitialID);
+
+    mRestoredCheckpoint.construct (Base::move (reader));
+
+    for (const auto &thread : mRestoredCheckpoint->getThreads ())
+        mThreadMigration->runMigratedThread (thread.thread, thread.state);
+}
+
+void ProcessPeersServer::loadRestoredPage(PageDirectory::Address page)
+{
+    if (! mRestoredCheckpoint->hasPage (page))
+        return;
+
+    auto content = mRestoredCheckpoint->takePage (page);
+
+    if (! content) {
+        ZQ_ASSERT_REPORT_NOT_REACHED ("A corrupted page in the restored checkpoint");
+    } else if (*content == nullptr) {
+        Base::Vector<uint8_t> zeros;
+
+        zeros.resize (ZQ_PAGE_SIZE, uint8_t{0});
+        mPageAccess->writePage (page, zeros);
+    } else {
+        mPageAccess->writePage (page, Base::Vector<uint8_t>{*content, *content + ZQ_PAGE_SIZE});
+    }
+
+    // Then it is requested like any other page homed here.
+}
+
+void ProcessPeersServer::finishRestore()
+{
+    if (! mRestoredCheckpoint)
+        return;
+
+    for (auto page : mRestoredCheckpoint->getPendingPages ())
+        loadRestoredPage (page);
+
+    mRestoredCheckpoint.destruct ();
+}
+
+void ProcessPeersServer::futexWait(HostedThreadID thread,
+                                   PageDirectory::Address address,
+                                   uint32_t expected,
+                                   FutexTable::BitsetType bitset)
+{
+    auto page = GetPageOf (address);
+
+    // Our copy is the newest: the home can't read it.
+    if (getLocalAccess (page) == PageDirectory::State::Modified) {
+        uint32_t value;
+
+        memcpy (&value, mPageAccess->readPage (page).data () + (address - page), sizeof (value));
+        if (value != expected) {
+            mFutexWait->onFutexWaitDone (thread, ZQ_E_AGAIN);
+            return;
+        }
+    }
+
+    auto home = getHome (page);
+
+    if (home == mPeerIndex)
+        onFutexWaitReceived (mPeerIndex, thread, address, expected, bitset);
+    else
+        sendToPeer (home, Protocol::FutexWaitMessage{address, thread, expected, bitset});
+}
+
+SizeType ProcessPeersServer::futexWake(PageDirectory::Address address,
+                                       SizeType count,
+                                       FutexTable::BitsetType bitset)
+{
+    auto home = getHome (GetPageOf (address));
+
+    if (home == mPeerIndex)
+        return onFutexWakeReceived (address, count, bitset);
+
+    typedef Protocol::MessageWithFutex::ValueType CountType;
+
+    // INT_MAX (wake all) and friends fit in the message.
+    auto maxCount = static_cast<SizeType>(static_cast<CountType>(-1));
+    auto messageCount = static_cast<CountType>(count < maxCount ? count : maxCount);
+
+    sendToPeer (home, Protocol::FutexWakeMessage{address, HostedThreadID{0}, messageCount, bitset});
+    return 0;
+}
+
+void ProcessPeersServer::futexCancel(HostedThreadID thread, PageDirectory::Address address)
+{
+    auto home = getHome (GetPageOf (address));
+
+    if (home == mPeerIndex)
+        onFutexCancelReceived (mPeerIndex, thread, address);
+    else
+        sendToPeer (home, Protocol::FutexCancelMessage{address, thread, 0u, 0u});
+}
+
+void ProcessPeersServer::onFutexWaitReceived(PageDirectory::PeerIndex from,
+                                             HostedThreadID thread,
+                                             PageDirectory::Address address,
+                                             uint32_t expected,
+                                             FutexTable::BitsetType bitset)
+{
+    ZQ_ASSERT (bitset != 0);
+
+    auto result = checkFutexValue (from, address, expected);
+
+    if (result == ZQ_E_OK)
+        mFutexTable.addWaiter (address, {from, thread, bitset});
+    else
+        completeFutexWait (from, thread, address, result);
+}
+
+SizeType ProcessPeersServer::onFutexWakeReceived(PageDirectory::Address address,
+                                                 SizeType count,
+                                                 FutexTable::BitsetType bitset)
+{
+    // The common case: an uncontended unlock.
+    if (! mFutexTable.hasWaiters (address))
+        return 0;
+
+    auto woken = mFutexTable.wake (address, count, bitset);
+
+    for (const auto &waiter : woken)
+        completeFutexWait (waiter.peer, waiter.thread, address, ZQ_E_OK);
+
+    return woken.size ();
+}
+
+void ProcessPeersServer::onFutexCancelReceived(PageDirectory::PeerIndex from,
+                                               HostedThreadID thread,
+                                               PageDirectory::Address address)
+{
+    // Otherwise it has been woken already, and the waiter gets ZQ_E_OK.
+    if (mFutexTable.removeWaiter (address, thread))
+        completeFutexWait (from, thread, address, ZQ_E_TIMED_OUT);
+}
+
+ZqError ProcessPeersServer::checkFutexValue(PageDirectory::PeerIndex waiter,
+                                            PageDirectory::Address address,
+                                            uint32_t expected)
+{
+    auto page = GetPageOf (address);
+    auto entry = mPageDirectory.find (mBlocks.getBlock (page));
+
+    if (entry != nullptr) {
+        // Being moved, or written by another peer: the value might have
+        // changed. The waiter will check it again.
+        if (entry->isBusy)
+            return ZQ_E_AGAIN;
+
+        if (entry->state == PageDirectory::State::Modified)
+            return entry->owner == waiter ? ZQ_E_OK : ZQ_E_AGAIN;
+    }
+
+    // No writer: our copy is the newest. A writer has to take the page
+    // from us (and be serialized after this wait) before changing it.
+    uint32_t value;
+
+    memcpy (&value, mPageAccess->readPage (page).data () + (address - page), sizeof (value));
+    return value == expected ? ZQ_E_OK : ZQ_E_AGAIN;
+}
+
+void ProcessPeersServer::completeFutexWait(PageDirectory::PeerIndex waiter,
+                                           HostedThreadID thread,
+                                           PageDirectory::Address address,
+                                           ZqError result)
+{
+    if (waiter == mPeerIndex) {
+        mFutexWait->onFutexWaitDone (thread, result);
+    } else {
+        sendToPeer (waiter, Protocol::FutexWaitDoneMessage{address,
+                                                           thread,
+                                                           static_cast<uint32_t>(result),
+                                                           FutexTable::kMatchAny});
+    }
+}
+
+void ProcessPeersServer::performDirectoryActions(PageDirectory::Address page,
+                                                 const PageDirectory::Actions &actions)
+{
+    using Actions = PageDirectory::Actions;
+
+    // This peer is a sharer and an owner like the others, but its messages
+    // are handled in place.
+    for (SizeType peer = 0; peer < PageDirectory::MaxPeers; ++peer) {
+        if ((actions.invalidate & (PageDirectory::PeerSet{1} << peer)) == 0)
+            continue;
+
+        if (peer == mPeerIndex) {
+            // The diffs are applied to our memory: it is always the newest copy.
+            if (isReleaseConsistent (page))
+                continue;
+
+            setLocalAccess (page, PageDirectory::State::Invalid);
+            performDirectoryActions (page, mPageDirectory.onInvalidateAck (page, mPeerIndex));
+        } else {
+            sendToPeer (static_cast<PageDirectory::PeerIndex>(peer), Protocol::InvalidatePageMessage{page});
+        }
+    }
+
+    if (actions.recall) {
+        if (actions.owner == mPeerIndex) {
+            setLocalAccess (page, actions.recallForWrite ? PageDirectory::State::Invalid
+                                                         : PageDirectory::State::Shared);
+            performDirectoryActions (page, mPageDirectory.onPageReturned (page, mPeerIndex));
+        } else if (actions.recallForWrite) {
+            sendToPeer (actions.owner, Protocol::RecallPageForWriteMessage{page});
+        } else {
+            sendToPeer (actions.owner, Protocol::RecallPageMessage{page});
+        }
+    }
+
+    switch (actions.reply) {
+    case Actions::Reply::None:
+        break;
+
+    case Actions::Reply::SendPage:
+        if (actions.replyTo == mPeerIndex) {
+            // Our memory is the home's copy.
+            setLocalAccess (page, actions.replyIsWrite ? PageDirectory::State::Modified
+                                                       : PageDirectory::State::Shared);
+        } else {
+            sendPage (actions.replyTo, page, actions.replyIsWrite);
+        }
+        break;
+
+    case Actions::Reply::Retry:
+        if (actions.replyTo != mPeerIndex)
+            sendToPeer (actions.replyTo, Protocol::PageBusyMessage{page});
+        break;
+    }
+}
+
+void ProcessPeersServer::sendPage(PageDirectory::PeerIndex peer, PageDirectory::Address page, bool isGive)
+{
+    if (! mBlocks.isSinglePage ()) {
+        sendBlock (peer, page, isGive);
+        return;
+    }
+
+    auto content = mPageAccess->readPage (page);
+
+    if (PageCache::IsZeroPage (content.data ())) {
+        gZeroPagesSent.add ();
+
+        if (isGive)
+            sendToPeer (peer, Protocol::GivePageZeroMessage{page});
+        else
+            sendToPeer (peer, Protocol::GetMemoryResultZeroMessage{page});
+
+        return;
+    }
+
+    auto hash = PageCache::HashPage (content.data ());
+
+    // Transferred before: the peer may have it. A page we've never seen
+    // is sent as it is, without an extra round trip.
+    if (mPageCache.find (hash) != nullptr) {
+        gHashesSent.add ();
+
+        if (isGive)
+            sendToPeer (peer, Protocol::GivePageByHashMessage{page, hash.low, hash.high});
+        else
+            sendToPeer (peer, Protocol::GetMemoryResultByHashMessage{page, hash.low, hash.high});
+
+        return;
+    }
+
+    mPageCache.insert (hash, content.data ());
+    gPagesSent.add ();
+
+    if (isGive)
+        sendPagesToPeer (peer, Protocol::GivePageMessage{page, Base::move (content)});
+    else
+        sendPagesToPeer (peer, Protocol::GetMemoryResultMessage{page, Base::move (content)});
+}
+
+void ProcessPeersServer::sendBlock(PageDirectory::PeerIndex peer, PageDirectory::Address block, bool isGive)
+{
+    using Protocol::MessageWithBlock;
+
+    auto pagesCount = mBlocks.getPagesPerBlock ();
+
+    // The home has the rest: it gave us the block, and only we wrote it since.
+    auto written = mWrittenPages.take (block);
+    auto sent = peer == getHome (block) ? written : PageBlocks::CreateFirstPages (pagesCount);
+
+    auto wordsCount = MessageWithBlock::GetWordsCount (pagesCount);
+    Base::Vector<MessageWithBlock::BitmapWordType> sentPages{sent.getWords (), sent.getWords () + wordsCount};
+    Base::Vector<MessageWithBlock::BitmapWordType> zeroPages;
+    Base::Vector<Base::Vector<uint8_t>> pages;
+
+    zeroPages.resize (wordsCount, MessageWithBlock::BitmapWordType{0});
+    pages.resize (pagesCount);
+
+    for (auto i = sent.findNextSet (); i < pagesCount; i = sent.findNextSet (i + 1)) {
+        auto content = mPageAccess->readPage (PageBlocks::GetPage (block, i));
+
+        if (PageCache::IsZeroPage (content.data ())) {
+            Base::Bits::Set (zeroPages.data (), i);
+            gZeroPagesSent.add ();
+        } else {
+            pages[i] = Base::move (content);
+        }
+    }
+
+    gBlocksSent.add ();
+    gBlockPagesSent.add (sent.count ());
+
+    if (isGive)
+        sendPagesToPeer (peer, Protocol::GivePageBlockMessage{block,
+                                                              Base::move (sentPages),
+                                                              Base::move (zeroPages),
+                                                              Base::move (pages)});
+    else
+        sendPagesToPeer (peer, Protocol::GetMemoryResultBlockMessage{block,
+                                                                     Base::move (sentPages),
+                                                                     Base::move (zeroPages),
+                                                                     Base::move (pages)});
+}
+
+void ProcessPeersServer::setLocalAccess(PageDirectory::Address page, PageDirectory::State state)
+{
+    if (state != PageDirectory::State::Modified
+        && getLocalAccess (page) == PageDirectory::State::Modified
+        && ! mTwinPages.hasTwin (page)) {
+        recordWrittenPages (page);
+    }
+
+    for (SizeType i = 0; i < mBlocks.getPagesPerBlock (); ++i)
+        mPageAccess->setPageAccess (PageBlocks::GetPage (page, i), state);
+
+    mLocalAccess.store (LocalAccessTree::GetPageNumber (page), state);
+}
+
+PageDirectory::State ProcessPeersServer::getLocalAccess(PageDirectory::Address page) const
+{
+    // Invalid (zero) when never set.
+    return mLocalAccess.load (LocalAccessTree::GetPageNumber (mBlocks.getBlock (page)));
+}
+
+Protocol::PageDiff ProcessPeersServer::takeLocalDiff(PageDirectory::Address page)
+{
+    // Stop the writes before comparing, the next write makes a new twin.
+    if (getLocalAccess (page) == PageDirectory::State::Modified)
+        setLocalAccess (page, PageDirectory::State::Shared);
+
+    auto diff = mTwinPages.takeDiff (page, mPageAccess->readPage (page).data ());
+
+    recordChange (diff);
+    return diff;
+}
+
+void ProcessPeersServer::closeRevision()
+{
+    if (mOpenRevision.isEmpty ())
+        return;
+
+    mRevisions.addRevision (Base::move (mOpenRevision));
+    mOpenRevision = Protocol::MemoryRevision{};
+}
+
+Protocol::MemoryRevision::ID ProcessPeersServer::takeCheckpointRevision()
+{
+    // Even when empty: every checkpoint has its own revision.
+    auto id = mRevisions.addRevision (Base::move (mOpenRevision));
+
+    mOpenRevision = Protocol::MemoryRevision{};
+    return id;
+}
+
+void ProcessPeersServer::recordChange(const Protocol::PageDiff &diff)
+{
+    if (mIsKeepingRevisions && ! diff.isEmpty ())
+        mOpenRevision.addPageDiff (Protocol::PageDiff{diff});
+}
+
+void ProcessPeersServer::recordWrittenPages(PageDirectory::Address block)
+{
+    auto written = mPageAccess->takeWrittenPages (block, mBlocks.getPagesPerBlock ());
+
+    if (! mBlocks.isSinglePage ())
+        mWrittenPages.add (block, written);
+
+    // Written without a twin: the whole pages are the change. Only the
+    // pages written since the previous call, the rest are recorded already.
+    if (! mIsKeepingRevisions)
+        return;
+
+    written.forEachSet ([this, block] (SizeType i) {
+        auto page = PageBlocks::GetPage (block, i);
+        recordChange (Protocol::PageDiff::CreateFull (page, mPageAccess->readPage (page).data ()));
+    });
 }
 
 void ProcessPeersServer::sendHello()
 {
-   sendToAll (Protocol::ProcessPeerHelloMessage {getProcessThreadIDs ()});
+   sendToAll (Protocol::ProcessPeerHelloMessage {mPeerIndex, getProcessThreadIDs ()});
+   sendFeatures ();
+}
+
+void ProcessPeersServer::sendFeatures()
+{
+    sendToAll (Protocol::ProcessPeerFeaturesMessage{mFeatures});
 }
 
 void ProcessPeersServer::sendGoodbye()
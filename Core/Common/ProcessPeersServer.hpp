@@ -26,9 +26,24 @@
 #include "Base/LocalThread.hpp"
 #include "Base/LinkedList.hpp"
 #include "Base/HashTable.hpp"
+#include "Base/PageRadixTree.hpp"
+#include "Base/Optional.hpp"
 
 #include "Common/Types.hpp"
 #include "Common/MessageStreamFactoryInterface.hpp"
+#include "Common/PageAccessInterface.hpp"
+#include "Common/PageDirectory.hpp"
+#include "Common/PageContention.hpp"
+#include "Common/TwinPages.hpp"
+#include "Common/PageCache.hpp"
+#include "Common/PageBlocks.hpp"
+#include "Common/FutexTable.hpp"
+#include "Common/FutexWaitInterface.hpp"
+#include "Common/ThreadMigration.hpp"
+#include "Common/ThreadMigrationInterface.hpp"
+#include "Common/CheckpointWriter.hpp"
+#include "Common/CheckpointReader.hpp"
+#include "Common/MemoryRevisionTree.hpp"
 
 #include "Protocol/ThreadState.hpp"
 #include "Protocol/MemoryMap.hpp"
@@ -51,7 +66,7 @@ public:
 
         typedef Base::LinkedList<StreamInfoAndReferenceCount> ConnectionListType;
 
-        void addThreads(const Base::RawArray<HostedThreadID> &threadsToAdd,
+        void addThreads(const Base::RawArray<const HostedThreadID> &threadsToAdd,
                         const StreamInfoType &info)
         {
             mConnectionsList.emplace_back (info, threadsToAdd.size ());
@@ -63,7 +78,7 @@ public:
             }
         }
 
-        void removeThreads (const Base::RawArray<HostedThreadID> &threadsToRemove) {
+        void removeThreads (const Base::RawArray<const HostedThreadID> &threadsToRemove) {
             for (const auto &threadID : threadsToRemove) {
                 auto theradIDIterator = mThreadIDToStream.find (threadID);
 
@@ -80,6 +95,62 @@ public:
             return mConnectionsList;
         }
 
+        /**
+         * @brief Add a process peer, under the member index it announced
+         *        (ProcessPeerHello).
+         * @return false if another peer has this index.
+         */
+        bool addPeer (PageDirectory::PeerIndex index, const StreamInfoType &info) {
+            ZQ_ASSERT (index < PageDirectory::MaxPeers);
+
+            for (const auto &peer : mPeers) {
+                if (peer.first == index)
+                    return peer.second == info;
+            }
+
+            mPeers.expand (1, MemberType{index, info});
+            mMembers |= PageDirectory::PeerBit (index);
+            return true;
+        }
+
+        void removePeer (PageDirectory::PeerIndex index) {
+            for (SizeType i = 0; i < mPeers.size (); ++i) {
+                if (mPeers[i].first != index)
+                    continue;
+
+                mPeers[i] = mPeers[mPeers.size () - 1];
+                mPeers.shrinkWithoutFree (1);
+                mMembers &= ~PageDirectory::PeerBit (index);
+                return;
+            }
+        }
+
+        Base::Optional<PageDirectory::PeerIndex> findPeerIndex (const StreamInfoType &info) const {
+            for (const auto &peer : mPeers) {
+                if (peer.second == info)
+                    return {peer.first};
+            }
+
+            return {};
+        }
+
+        const StreamInfoType &getPeerInfo (PageDirectory::PeerIndex index) const
+        {
+            for (const auto &peer : mPeers) {
+                if (peer.first == index)
+                    return peer.second;
+            }
+
+            ZQ_ASSERT_REPORT_NOT_REACHED ("Not a peer of this process");
+            return mPeers[0].second;
+        }
+
+        /// The other peers' member indexes.
+        PageDirectory::PeerSet getMembers () const
+        {
+            return mMembers;
+        }
+
         enum class FindThreadStreamError {
             InvalidThreadID
         };
@@ -99,6 +170,11 @@ public:
 
         ConnectionListType mConnectionsList;
         Base::HashTable<HostedThreadID, typename ConnectionListType::Iterator> mThreadIDToStream;
+
+        typedef Base::Pair<PageDirectory::PeerIndex, StreamInfoType> MemberType;
+
+        Base::Vector<MemberType> mPeers;
+        PageDirectory::PeerSet mMembers = 0;
     };
 
     /**
@@ -107,7 +183,18 @@ public:
     typedef Base::RWLocked<OtherServers>        LockedConnections;
     typedef Base::RawPointer<LockedConnections> ConnectionsType;
 
-    ProcessPeersServer(Protocol::MessageServer &&messageServer);
+    /**
+     * @param memberIndex This peer's index in the process' members, given
+     *        by the process owner (0) when it spreads the process to this
+     *        peer, and never reused while the process runs. Every peer
+     *        announces its index in its ProcessPeerHello, so all the peers
+     *        agree on the indexes and on the pages' homes.
+     */
+    ProcessPeersServer(Protocol::MessageServer &&messageServer,
+                       PageDirectory::PeerIndex memberIndex,
+                       Base::UniquePointer<PageAccessInterface> &&pageAccess,
+                       Base::UniquePointer<FutexWaitInterface> &&futexWait,
+                       Base::UniquePointer<ThreadMigrationInterface> &&threadMigration);
     ~ProcessPeersServer();
 
     ZQ_ALLOW_MOVE (ProcessPeersServer)
@@ -118,6 +205,157 @@ public:
         return &mOtherServers;
     }
 
+    /**
+     * @brief Ask @a page 's home for a read only (or a writable) copy.
+     *        Called when a local thread faults on a page it can't access.
+     */
+    void requestPage (PageDirectory::Address page, bool isWrite);
+
+    /**
+     * @brief Use release consistency instead of single writer ownership.
+     *
+     * Writes to shared pages are kept local (with a twin) until the next
+     * release(), and concurrent writes to different parts of a page are
+     * merged at the page's home. Should be enabled by all the process
+     * peers, before any page is shared.
+     */
+    void enableReleaseConsistency ()
+    {
+        ZQ_ASSERT (mBlocks.isSinglePage ());
+
+        mIsReleaseConsistent = true;
+    }
+
+    /**
+     * @brief Own and transfer the pages in blocks of @a pagesPerBlock
+     *        pages (see PageBlocks), e.g. 512 for 2 MiB huge pages.
+     *
+     * For large sequential heaps: a fault brings a whole block, and a
+     * writer gives back only the pages it wrote. Should be set by all the
+     * process peers, before any page is shared. Release consistency (and
+     * the DiffMerge contention policy) works with single pages only.
+     */
+    void setPagesPerBlock (SizeType pagesPerBlock)
+    {
+        ZQ_ASSERT (! mIsReleaseConsistent);
+
+        mBlocks = PageBlocks{pagesPerBlock};
+    }
+
+    /**
+     * @brief Stop compressing the pages sent to the other peers, and ask
+     *        them to stop compressing theirs (e.g. on a fast local network,
+     *        where the CPU is the bottleneck).
+     *
+     * Pages are compressed (see Protocol::PageCompressor) on the connections
+     * whose both sides support it, which is the default.
+     */
+    void disablePageCompression ();
+
+    /**
+     * @brief A sync event (a system call, a futex operation): send the
+     *        changes made since the last release to the pages' homes.
+     *
+     * Does nothing when no page is written under release consistency.
+     */
+    void release ();
+
+    const PageContention &getPageContention () const
+    {
+        return mPageContention;
+    }
+
+    /**
+     * @brief FUTEX_WAIT_BITSET: block @a thread until a wake on @a address
+     *        whose bitset intersects @a bitset, if it still contains @a expected.
+     *
+     * The wait is queued at the home of @a address 's page, the result is
+     * reported through FutexWaitInterface::onFutexWaitDone. Like a local
+     * futex, ZQ_E_AGAIN might be reported even if the value hasn't changed
+     * (e.g. when the page is moving between peers) and the caller should
+     * check it again.
+     */
+    void futexWait (HostedThreadID thread,
+                    PageDirectory::Address address,
+                    uint32_t expected,
+                    FutexTable::BitsetType bitset = FutexTable::kMatchAny);
+
+    /**
+     * @brief FUTEX_WAKE_BITSET: wake up to @a count threads that wait on @a address.
+     * @return The number of threads woken, when the futex is homed here. Wakes
+     *         of remote futexes are asynchronous (the waker doesn't wait for
+     *         the home), and 0 is returned.
+     *
+     * Under release consistency, release() should be called first so the
+     * woken threads see the waker's writes.
+     */
+    SizeType futexWake (PageDirectory::Address address,
+                        SizeType count,
+                        FutexTable::BitsetType bitset = FutexTable::kMatchAny);
+
+    /**
+     * @brief Stop the wait of @a thread on @a address (a timeout or a
+     *        signal). It ends with ZQ_E_TIMED_OUT, unless a wake is
+     *        already on its way.
+     */
+    void futexCancel (HostedThreadID thread, PageDirectory::Address address);
+
+    /**
+     * @brief Move a local thread to @a destination, while it keeps running.
+     *
+     * The pages it uses are pre-copied in rounds (see ThreadMigration),
+     * then it is stopped for a single round trip: its registers and
+     * the pages it wrote last are sent, and the destination runs it
+     * and fetches the rest of its pages on demand.
+     */
+    void migrateThread (HostedThreadID thread, PageDirectory::PeerIndex destination);
+
+    /**
+     * @brief Write this peer's part of the process to @a writer: the
+     *        local threads' states and the pages this peer is responsible
+     *        for (written here, or homed here and not written elsewhere).
+     *
+     * The threads should be stopped. The caller starts @a writer, adds
+     * the memory areas, finishes it and then calls commitCheckpoint().
+     * From then on, the local changes are kept as memory revisions for
+     * the incremental checkpoints.
+     */
+    ZqError checkpoint (CheckpointWriter &writer);
+
+    /**
+     * @brief Write the changes to this peer's part of the process since
+     *        the last committed checkpoint to @a writer, as an incremental
+     *        checkpoint: the local threads' states and the squashed diffs
+     *        of the memory revisions since (see CheckpointCompactor).
+     *
+     * The local changes are released first. The pages written without
+     * release consistency have no twins: they are written in full, when
+     * this peer gives up writing them or while it still holds them, if
+     * they have been written since (see PageAccessInterface::takeWrittenPages).
+     * Called like checkpoint(), after a checkpoint has been committed.
+     *
+     * @return ZQ_E_INVALID_ARG if there's no checkpoint to base on.
+     */
+    ZqError checkpointIncremental (CheckpointWriter &writer);
+
+    /**
+     * @brief The checkpoint written last is stored: the next incremental
+     *        checkpoint is based on it, and the revisions before it are
+     *        discarded.
+     */
+    void commitCheckpoint ();
+
+    /**
+     * @brief Run the threads of @a reader and load its pages lazily, when
+     *        they are first requested.
+     *
+     * The process is restored on a single peer, from a full checkpoint
+     * (see CheckpointCompactor for a chain of incremental ones). The
+     * pages left are loaded before another peer joins (the pages' homes
+     * change).
+     */
+    void restore (CheckpointReader &&reader);
+
 private:
     LocalThread *globalToLocalThread (HostedThreadID threadID) {
         auto iterator = mProcessLocalThreads.find (threadID);
@@ -131,7 +369,7 @@ private:
     // Main message processor.
     void onMessageReceived (const Protocol::Message &type,
                             Protocol::MessageStream::MessageFieldReader &fieldReader,
-                            const Protocol::MessageStream &messageStream) ;
+                            Protocol::MessageStream &messageStream) ;
 
     // Messages processors.
     void onStopThreadReceived (Protocol::MessageStream &stream, HostedThreadID threadID);
@@ -143,10 +381,171 @@ private:
                               Protocol::MemoryMap &currentMemoryMap,
                               Protocol::ThreadState &state);
 
-    void onHelloReceived (Protocol::MessageStream &stream, const Base::RawArray<HostedThreadID> &newThreads);
-    void onGoodbyeReceived (Protocol::MessageStream &stream, const Base::RawArray<HostedThreadID> &leavingThreads);
+    void onHelloReceived (Protocol::MessageStream &stream,
+                          PageDirectory::PeerIndex member,
+                          const Base::RawArray<const HostedThreadID> &newThreads);
+    void onGoodbyeReceived (Protocol::MessageStream &stream, const Base::RawArray<const HostedThreadID> &leavingThreads);
+    void onFeaturesReceived (PageDirectory::PeerIndex from, Protocol::MessageWithFeatures::FeaturesType features);
+
+    // Page ownership: as the page's home.
+    void onPageRequestReceived (PageDirectory::PeerIndex from, PageDirectory::Address page, bool isWrite);
+    void onInvalidatePageOKReceived (PageDirectory::PeerIndex from, PageDirectory::Address page);
+    void onPageReturnedReceived (PageDirectory::PeerIndex from,
+                                 PageDirectory::Address page,
+                                 const Base::Vector<uint8_t> &content);
+    void onPageDiffsReceived (PageDirectory::PeerIndex from, const Protocol::MemoryRevision &revision);
+
+    /// Apply the contention policy of @a page, before handling a request.
+    /// @return false if the request should be retried.
+    bool applyContentionPolicy (PageDirectory::PeerIndex from, PageDirectory::Address page, bool &isWrite);
+
+    // Page ownership: as a peer that uses the page.
+    void onPageReceived (PageDirectory::Address page, const Base::Vector<uint8_t> &content, bool isWritable);
+
+    // Page transfers (GetMemoryResult and GivePage), by content or by hash.
+    void onPageContentReceived (PageDirectory::PeerIndex from,
+                                PageDirectory::Address page,
+                                const Base::Vector<uint8_t> &content,
+                                bool isGive);
+    void onPageHashReceived (PageDirectory::PeerIndex from,
+                             PageDirectory::Address page,
+                             const PageCache::Hash &hash,
+                             bool isGive);
+    void onPageMissReceived (PageDirectory::PeerIndex from,
+                             PageDirectory::Address page,
+                             const PageCache::Hash &hash,
+                             bool isGive);
+    void onBlockReceived (PageDirectory::PeerIndex from,
+                          const Protocol::MessageWithBlock &message,
+                          bool isGive);
+    void onInvalidatePageReceived (PageDirectory::Address page);
+    void onRecallPageReceived (PageDirectory::Address page, bool isForWrite);
+    void onMergePageReceived (PageDirectory::Address page);
+
+    // Live migration: as the source.
+    void onMigrateThreadPagesOKReceived (HostedThreadID thread);
+    void onMigrateThreadOKReceived (HostedThreadID thread);
+
+    // Live migration: as the destination.
+    void onMigrateThreadPagesReceived (PageDirectory::PeerIndex from,
+                                       HostedThreadID thread,
+                                       const Base::Vector<PageDirectory::Address> &pages);
+    void onMigrateThreadReceived (PageDirectory::PeerIndex from,
+                                  HostedThreadID thread,
+                                  const Base::Vector<PageDirectory::Address> &pages,
+                                  const Protocol::ThreadState &state);
+
+    // Futexes: as the home of the futex's page.
+    void onFutexWaitReceived (PageDirectory::PeerIndex from,
+                              HostedThreadID thread,
+                              PageDirectory::Address address,
+                              uint32_t expected,
+                              FutexTable::BitsetType bitset);
+    SizeType onFutexWakeReceived (PageDirectory::Address address,
+                                  SizeType count,
+                                  FutexTable::BitsetType bitset);
+    void onFutexCancelReceived (PageDirectory::PeerIndex from,
+                                HostedThreadID thread,
+                                PageDirectory::Address address);
+
+    /// Compare the futex's value with @a expected, when the home can tell.
+    ZqError checkFutexValue (PageDirectory::PeerIndex waiter,
+                             PageDirectory::Address address,
+                             uint32_t expected);
+
+    /// Tell the waiter's peer (or our FutexWaitInterface) that the wait is over.
+    void completeFutexWait (PageDirectory::PeerIndex waiter,
+                            HostedThreadID thread,
+                            PageDirectory::Address address,
+                            ZqError result);
+
+    static PageDirectory::Address GetPageOf (PageDirectory::Address address)
+    {
+        return address & ~static_cast<PageDirectory::Address>(ZQ_PAGE_SIZE - 1);
+    }
+
+    bool isReleaseConsistent (PageDirectory::Address page) const
+    {
+        return mIsReleaseConsistent || mMergedPages.find (page) != mMergedPages.end ();
+    }
+
+    void performDirectoryActions (PageDirectory::Address page, const PageDirectory::Actions &actions);
+
+    /// Copy @a page from the restored checkpoint to our memory (the home's
+    /// copy), if it hasn't been loaded yet.
+    void loadRestoredPage (PageDirectory::Address page);
+    void finishRestore ();
+
+    /**
+     * @brief Send our copy of @a page to @a peer: GivePage if @a isGive,
+     *        GetMemoryResult otherwise. A zero page is sent without its
+     *        content, a page that has been transferred before as its hash.
+     */
+    void sendPage (PageDirectory::PeerIndex peer, PageDirectory::Address page, bool isGive);
+    void sendBlock (PageDirectory::PeerIndex peer, PageDirectory::Address block, bool isGive);
+
+    /// Set the local threads' access to @a page and remember it.
+    void setLocalAccess (PageDirectory::Address page, PageDirectory::State state);
+    PageDirectory::State getLocalAccess (PageDirectory::Address page) const;
+
+    /// Compare @a page with its twin, drop the twin and get the changes.
+    Protocol::PageDiff takeLocalDiff (PageDirectory::Address page);
+
+    /// Add the local changes since the last revision as a new revision.
+    void closeRevision ();
+
+    /// Close the revision a checkpoint is taken at.
+    Protocol::MemoryRevision::ID takeCheckpointRevision ();
+
+    /// Remember a local change for the incremental checkpoints.
+    void recordChange (const Protocol::PageDiff &diff);
+
+    /// Take the pages of @a block written (without twins) since the
+    /// previous call: keep them for the home and record them in full.
+    void recordWrittenPages (PageDirectory::Address block);
+
+    ZqError writeCheckpointThreads (CheckpointWriter &writer);
+
+    /// Every member of the process, including this peer.
+    PageDirectory::PeerSet getMembers ()
+    {
+        return mOtherServers.getRead ().first.getMembers () | PageDirectory::PeerBit (mPeerIndex);
+    }
+
+    PageDirectory::PeerIndex getHome (PageDirectory::Address page)
+    {
+        auto members = getMembers ();
+
+        // Alone: every page is homed here.
+        if (members == PageDirectory::PeerBit (mPeerIndex))
+            return mPeerIndex;
+
+        return PageDirectory::GetHome (mBlocks.getBlock (page), members);
+    }
+
+    template<class MessageType>
+    void sendToPeer (PageDirectory::PeerIndex peer, const MessageType &message) {
+        auto info = mOtherServers.getRead ().first.getPeerInfo (peer);
+        auto newStream = mMessageFactory->createMessageStream (info.first, info.second);
+
+        newStream.sendMessage (message);
+    }
+
+    /// Like sendToPeer, for the messages with pages: compressed when both sides support it.
+    template<class MessageType>
+    void sendPagesToPeer (PageDirectory::PeerIndex peer, MessageType &&message) {
+        auto info = mOtherServers.getRead ().first.getPeerInfo (peer);
+        auto newStream = mMessageFactory->createMessageStream (info.first, info.second);
+
+        if (isCompressingPagesTo (peer))
+            newStream.setPageCompressor (&mPageCompressor);
+
+        newStream.sendPageMessage (message);
+    }
+
+    bool isCompressingPagesTo (PageDirectory::PeerIndex peer) const;
 
-    Base::Vector<HostedThreadID> getProcessThreadIDs () const
+    Protocol::MessageWithThreadIDs::ThreadIDs getProcessThreadIDs () const
     {
         return {mProcessLocalThreads.keysBegin (), mProcessLocalThreads.keysEnd ()};
     }
@@ -164,6 +563,7 @@ private:
 
     // Global Senders
     void sendHello ();
+    void sendFeatures ();
     void sendGoodbye ();
 
     // Stream Specific Senders.
@@ -179,6 +579,73 @@ private:
     Base::HashTable<HostedThreadID, LocalThread> mProcessLocalThreads;
 
     Base::UniquePointer<MessageStreamFactoryInterface> mMessageFactory;
+
+    /// The directory of the pages homed here.
+    PageDirectory mPageDirectory;
+
+    Base::UniquePointer<PageAccessInterface> mPageAccess;
+
+    /// This peer's member index.
+    PageDirectory::PeerIndex mPeerIndex;
+
+    /// The granularity the pages are owned at: the directory, the local
+    /// access and the transfers are by block.
+    PageBlocks mBlocks;
+
+    /// The pages written in the blocks we own (multiple page blocks only).
+    WrittenPages mWrittenPages;
+
+    typedef Base::PageRadixTree<PageDirectory::State> LocalAccessTree;
+
+    /// The access the local threads have to the process' pages (by block),
+    /// Invalid when missing.
+    LocalAccessTree mLocalAccess;
+
+    bool mIsReleaseConsistent = false;
+
+    /// Pages switched to release consistency by their homes (MergePage).
+    Base::HashTable<PageDirectory::Address, bool> mMergedPages;
+
+    /// Release consistency: the pages written since the last release().
+    TwinPages mTwinPages;
+
+    /// The pages sent and received, by their content's hash.
+    PageCache mPageCache;
+
+    /// Compresses the pages sent to the peers that support it.
+    Protocol::PageCompressor mPageCompressor;
+
+    /// The protocol features (Protocol::MessageWithFeatures) this peer supports.
+    Protocol::MessageWithFeatures::FeaturesType mFeatures = Protocol::MessageWithFeatures::PageCompression;
+
+    /// The features of the other peers, missing until they have sent them.
+    Base::HashTable<PageDirectory::PeerIndex, Protocol::MessageWithFeatures::FeaturesType> mPeerFeatures;
+
+    /// Write conflicts on the pages homed here.
+    PageContention mPageContention;
+
+    /// The waiters of the futexes in the pages homed here.
+    FutexTable mFutexTable;
+
+    Base::UniquePointer<FutexWaitInterface> mFutexWait;
+
+    Base::UniquePointer<ThreadMigrationInterface> mThreadMigration;
+
+    /// The local threads that are being migrated.
+    Base::HashTable<HostedThreadID, ThreadMigration> mMigrations;
+
+    /// The pages of the restored checkpoint that haven't been loaded yet.
+    Base::Optional<CheckpointReader> mRestoredCheckpoint;
+
+    /// The local changes since the last committed checkpoint, kept only
+    /// once a checkpoint has been taken.
+    MemoryRevisionTree mRevisions;
+    Protocol::MemoryRevision mOpenRevision;
+    bool mIsKeepingRevisions = false;
+
+    /// The revisions of the last committed checkpoint and of the one written last.
+    Protocol::MemoryRevision::ID mCheckpointedRevision = MemoryRevisionTree::kInitialID;
+    Protocol::MemoryRevision::ID mWrittenRevision = MemoryRevisionTree::kInitialID;
 };
 
 } // namespace Ziqe
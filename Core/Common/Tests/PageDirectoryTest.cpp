@@ -0,0 +1,105 @@
+/**
+ * @file PageDirectoryTest
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2017 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Common/PageDirectory.hpp"
+#include "PerDriver/EntryPoints.hpp"
+
+ZQ_BEGIN_C_DECL void ZQ_PER_DRIVER_UNIQUE_SYMBOL(ZqOnLoad) (Ziqe::Base::RawPointer<Ziqe::OS::DriverContext>)
+{
+    using Ziqe::PageDirectory;
+    typedef PageDirectory::Actions Actions;
+
+    const PageDirectory::Address page = 0x7000;
+
+    // Homes: agreed on by the members' indexes, and only the pages of a
+    // joining peer move.
+    {
+        PageDirectory::PeerSet members = PageDirectory::PeerBit (0) | PageDirectory::PeerBit (3);
+        PageDirectory::PeerSet joined = members | PageDirectory::PeerBit (5);
+        Ziqe::SizeType homedAtNew = 0;
+
+        for (PageDirectory::Address address = 0; address < 1024 * ZQ_PAGE_SIZE; address += ZQ_PAGE_SIZE) {
+            auto home = PageDirectory::GetHome (address, members);
+            auto newHome = PageDirectory::GetHome (address, joined);
+
+            ZQ_ASSERT (home == 0 || home == 3);
+            ZQ_ASSERT (newHome == home || newHome == 5);
+
+            if (newHome == 5)
+                ++homedAtNew;
+        }
+
+        ZQ_ASSERT (homedAtNew > 1024 / 6 && homedAtNew < 1024 / 2);
+        ZQ_ASSERT (PageDirectory::GetHome (page, PageDirectory::PeerBit (7)) == 7);
+    }
+
+    // The requester of an upgrade (a sharer) leaves while its invalidations
+    // are pending: the upgrade still waits for the other sharers' acks.
+    {
+        PageDirectory directory;
+
+        directory.onReadRequest (page, 1);
+        directory.onReadRequest (page, 2);
+        directory.onReadRequest (page, 3);
+
+        auto actions = directory.onWriteRequest (page, 1);
+        ZQ_ASSERT (actions.invalidate == (PageDirectory::PeerBit (2) | PageDirectory::PeerBit (3)));
+        ZQ_ASSERT (directory.find (page)->pendingAcks == 2);
+
+        ZQ_ASSERT (directory.removePeer (1).size () == 0);
+        ZQ_ASSERT (directory.find (page)->isBusy);
+        ZQ_ASSERT (directory.find (page)->pendingAcks == 2);
+
+        actions = directory.onInvalidateAck (page, 2);
+        ZQ_ASSERT (actions.reply == Actions::Reply::None);
+        ZQ_ASSERT (directory.find (page)->isBusy);
+
+        // Cancelled: no page is sent, and nobody has a copy.
+        actions = directory.onInvalidateAck (page, 3);
+        ZQ_ASSERT (actions.reply == Actions::Reply::None);
+        ZQ_ASSERT (! directory.find (page)->isBusy);
+        ZQ_ASSERT (directory.find (page)->state == PageDirectory::State::Invalid);
+        ZQ_ASSERT (directory.find (page)->sharers == 0);
+    }
+
+    // A sharer that is invalidated leaves: it counts as its ack.
+    {
+        PageDirectory directory;
+
+        directory.onReadRequest (page, 1);
+        directory.onReadRequest (page, 2);
+
+        directory.onWriteRequest (page, 1);
+
+        auto completed = directory.removePeer (2);
+        ZQ_ASSERT (completed.size () == 1);
+        ZQ_ASSERT (completed[0].first == page);
+        ZQ_ASSERT (completed[0].second.reply == Actions::Reply::SendPage);
+        ZQ_ASSERT (completed[0].second.replyTo == 1 && completed[0].second.replyIsWrite);
+        ZQ_ASSERT (directory.find (page)->state == PageDirectory::State::Modified);
+        ZQ_ASSERT (directory.find (page)->owner == 1);
+    }
+}
+
+void ZQ_PER_DRIVER_UNIQUE_SYMBOL(ZqOnUnload) (Ziqe::Base::RawPointer<Ziqe::OS::DriverContext>)
+{
+}
+
+ZQ_END_C_DECL
@@ -0,0 +1,138 @@
+/**
+ * @file ThreadMigration.cpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Main: copyright (C) 2016 Shmuel Hazan
+ *
+ * Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "ThreadMigration.hpp"
+
+#include "Base/Metrics.hpp"
+
+#include "CppCore/Metrics.h"
+
+namespace Ziqe {
+
+namespace {
+Base::Metrics::Counter gMigrations{"Migration/threads"};
+Base::Metrics::Counter gPreCopiedPages{"Migration/preCopiedPages"};
+Base::Metrics::Counter gHotPages{"Migration/hotPages"};
+Base::Metrics::Histogram gRounds{"Migration/rounds", Base::Metrics::Histogram::Unit::Count};
+Base::Metrics::Histogram gStopCopyPages{"Migration/stopCopyPages", Base::Metrics::Histogram::Unit::Count};
+Base::Metrics::Histogram gStopTime{"Migration/stopTime"};
+Base::Metrics::Histogram gTotalTime{"Migration/totalTime"};
+}
+
+ThreadMigration::ThreadMigration(HostedThreadID thread, PeerIndex destination)
+    : mThread{thread}, mDestination{destination}
+{
+}
+
+Base::Vector<ThreadMigration::Address> ThreadMigration::firstRound(Base::Vector<Address> &&residentPages)
+{
+    mStartTime = ZQ_SYMBOL(ZqMetricsTimestamp) ();
+    mRounds = 1;
+    mLastWrittenCount = residentPages.size ();
+
+    gPreCopiedPages.add (residentPages.size ());
+    return Base::move (residentPages);
+}
+
+Base::Vector<ThreadMigration::Address> ThreadMigration::nextRound(const Base::Vector<Address> &writtenPages)
+{
+    Base::Vector<Address> pages;
+
+    if (shouldStop (writtenPages.size ())) {
+        defer (writtenPages);
+        return pages;
+    }
+
+    Base::HashTable<Address, bool> written;
+    Base::HashTable<Address, bool> deferred;
+
+    for (auto page : writtenPages) {
+        if (written.find (page) != written.end ())
+            continue;
+
+        written.insert (page, true);
+
+        if (mLastWritten.find (page) == mLastWritten.end ())
+            pages.expand (1, page);
+        else
+            deferred.insert (page, true);
+    }
+
+    // Deferred pages that weren't written again have cooled down.
+    for (auto iterator = mDeferred.begin (); iterator != mDeferred.end (); ++iterator) {
+        if (written.find (iterator->first) == written.end ())
+            pages.expand (1, iterator->first);
+    }
+
+    gHotPages.add (deferred.size ());
+    gPreCopiedPages.add (pages.size ());
+
+    mLastWritten = Base::move (written);
+    mDeferred = Base::move (deferred);
+    mLastWrittenCount = writtenPages.size ();
+    ++mRounds;
+
+    // Only hot pages are left (empty): stop.
+    return pages;
+}
+
+Base::Vector<ThreadMigration::Address> ThreadMigration::lastRound(const Base::Vector<Address> &writtenPages)
+{
+    mStopTime = ZQ_SYMBOL(ZqMetricsTimestamp) ();
+
+    defer (writtenPages);
+
+    Base::Vector<Address> pages;
+
+    for (auto iterator = mDeferred.begin (); iterator != mDeferred.end (); ++iterator)
+        pages.expand (1, iterator->first);
+
+    gRounds.record (mRounds);
+    gStopCopyPages.record (pages.size ());
+
+    return pages;
+}
+
+void ThreadMigration::onDone()
+{
+    auto now = ZQ_SYMBOL(ZqMetricsTimestamp) ();
+
+    gStopTime.record (now - mStopTime);
+    gTotalTime.record (now - mStartTime);
+    gMigrations.add ();
+}
+
+bool ThreadMigration::shouldStop(SizeType writtenPages) const
+{
+    if (mRounds >= kMaxRounds || writtenPages <= kStopCopyPages)
+        return true;
+
+    // The thread writes faster than we send: the rounds don't converge.
+    return mRounds >= 2 && writtenPages >= mLastWrittenCount;
+}
+
+void ThreadMigration::defer(const Base::Vector<Address> &pages)
+{
+    for (auto page : pages) {
+        if (mDeferred.find (page) == mDeferred.end ())
+            mDeferred.insert (page, true);
+    }
+}
+
+} // namespace Ziqe
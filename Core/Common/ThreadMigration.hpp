@@ -0,0 +1,129 @@
+/**
+ * @file ThreadMigration.hpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Main: copyright (C) 2016 Shmuel Hazan
+ *
+ * Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ZIQE_CORE_THREADMIGRATION_H
+#define ZIQE_CORE_THREADMIGRATION_H
+
+#include "Base/Types.hpp"
+#include "Base/HashTable.hpp"
+#include "Base/Vector.hpp"
+
+#include "Common/Types.hpp"
+#include "Common/PageDirectory.hpp"
+
+namespace Ziqe {
+
+/**
+ * @brief The pre-copy rounds of a live thread migration, on the source peer.
+ *
+ * While the thread keeps running, every round sends the destination the
+ * pages written since the previous round (the first round sends all the
+ * pages this peer has), and the destination fetches copies of them. The
+ * thread is stopped once the pages left are few (kStopCopyPages), the
+ * rounds don't make progress anymore or after kMaxRounds. Then only its
+ * registers and the last written pages are sent: the stop time depends
+ * on kStopCopyPages and not on the working set's size.
+ *
+ * Pages written in two consecutive rounds are hot: sending them again would
+ * only take them from the thread, so they are deferred until a round that
+ * doesn't write them, or until the stop.
+ *
+ * @note Not thread safe.
+ */
+class ThreadMigration
+{
+public:
+    typedef PageDirectory::Address Address;
+    typedef PageDirectory::PeerIndex PeerIndex;
+
+    static constexpr SizeType kMaxRounds = 8;
+    static constexpr SizeType kStopCopyPages = 64;
+
+    ThreadMigration(HostedThreadID thread, PeerIndex destination);
+
+    ZQ_ALLOW_MOVE (ThreadMigration)
+    ZQ_DISALLOW_COPY (ThreadMigration)
+
+    /**
+     * @brief The pages of the first round: the pages the thread can access.
+     */
+    Base::Vector<Address> firstRound (Base::Vector<Address> &&residentPages);
+
+    /**
+     * @brief The destination has the previous round, @a writtenPages were
+     *        written meanwhile.
+     * @return The pages of the next round, empty if it is time to stop the thread.
+     */
+    Base::Vector<Address> nextRound (const Base::Vector<Address> &writtenPages);
+
+    /**
+     * @brief The thread is stopped, after writing @a writtenPages since the
+     *        last nextRound.
+     * @return The last dirty set: the pages that haven't been sent since
+     *         they were written.
+     */
+    Base::Vector<Address> lastRound (const Base::Vector<Address> &writtenPages);
+
+    /**
+     * @brief The destination runs the thread.
+     */
+    void onDone ();
+
+    HostedThreadID getThread () const
+    {
+        return mThread;
+    }
+
+    PeerIndex getDestination () const
+    {
+        return mDestination;
+    }
+
+    SizeType getRounds () const
+    {
+        return mRounds;
+    }
+
+private:
+    bool shouldStop (SizeType writtenPages) const;
+
+    void defer (const Base::Vector<Address> &pages);
+
+    HostedThreadID mThread;
+    PeerIndex mDestination;
+
+    SizeType mRounds = 0;
+
+    /// The number of pages written in the previous round.
+    SizeType mLastWrittenCount = 0;
+
+    /// The pages written in the previous round.
+    Base::HashTable<Address, bool> mLastWritten;
+
+    /// Written pages that haven't been sent yet.
+    Base::HashTable<Address, bool> mDeferred;
+
+    /// Nanoseconds.
+    uint64_t mStartTime = 0;
+    uint64_t mStopTime = 0;
+};
+
+} // namespace Ziqe
+
+#endif // ZIQE_CORE_THREADMIGRATION_H
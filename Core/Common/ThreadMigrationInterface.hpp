@@ -0,0 +1,61 @@
+/**
+ * @file ThreadMigrationInterface.hpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Main: copyright (C) 2016 Shmuel Hazan
+ *
+ * Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ZIQE_THREADMIGRATIONINTERFACE_HPP
+#define ZIQE_THREADMIGRATIONINTERFACE_HPP
+
+#include "Base/Vector.hpp"
+
+#include "Common/Types.hpp"
+#include "Common/PageDirectory.hpp"
+
+#include "Protocol/ThreadState.hpp"
+
+namespace Ziqe {
+
+/**
+   @brief The local side of a live thread migration
+          (ProcessPeersServer::migrateThread).
+ */
+class ThreadMigrationInterface
+{
+public:
+    ThreadMigrationInterface();
+    virtual ~ThreadMigrationInterface();
+
+    /**
+       @brief End the current dirty tracking epoch: the pages that have
+              been written since the previous call (e.g. with
+              ProcessMemoryManager).
+
+       The pages are tracked for the whole process, so the pages written
+       by the other local threads are sent too.
+     */
+    virtual Base::Vector<PageDirectory::Address> collectWrittenPages () = 0;
+
+    /**
+       @brief Run a thread that has been migrated to this peer (or
+              restored from a checkpoint), from @a state.
+     */
+    virtual void runMigratedThread (HostedThreadID thread, const Protocol::ThreadState &state) = 0;
+};
+
+} // namespace Ziqe
+
+#endif // ZIQE_THREADMIGRATIONINTERFACE_HPP
@@ -0,0 +1,96 @@
+/**
+ * @file TwinPages.cpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Main: copyright (C) 2016 Shmuel Hazan
+ *
+ * Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "TwinPages.hpp"
+
+#include "Base/Checks.hpp"
+#include "Base/Metrics.hpp"
+
+#include "CppCore/Memory.h"
+
+namespace Ziqe {
+
+namespace {
+Base::Metrics::Counter gTwinsCreated{"Common/twinsCreated"};
+Base::Metrics::Histogram gDiffBytes{"Common/diffBytes"};
+}
+
+TwinPages::TwinPages()
+{
+}
+
+TwinPages::~TwinPages()
+{
+    for (auto &pageAndTwin : mTwins)
+        mPool.deallocate (pageAndTwin.second);
+}
+
+bool TwinPages::makeTwin(Address page, const uint8_t *content)
+{
+    ZQ_ASSERT (! hasTwin (page));
+
+    auto twin = mPool.allocate ();
+    if (twin == nullptr)
+        return false;
+
+    memcpy (twin, content, ZQ_PAGE_SIZE);
+    mTwins.insert (page, twin);
+
+    gTwinsCreated.add ();
+    return true;
+}
+
+void TwinPages::applyToTwin(const Protocol::PageDiff &diff)
+{
+    auto iterator = mTwins.find (diff.getAddress ());
+
+    if (iterator != mTwins.end ())
+        diff.apply (iterator->second);
+}
+
+Protocol::PageDiff TwinPages::takeDiff(Address page, const uint8_t *current)
+{
+    auto iterator = mTwins.find (page);
+
+    ZQ_ASSERT (iterator != mTwins.end ());
+
+    auto twin = iterator->second;
+    auto diff = Protocol::PageDiff::Create (page, twin, current);
+
+    mTwins.erase (iterator);
+    mPool.deallocate (twin);
+
+    gDiffBytes.record (diff.getRuns ().size ());
+    return diff;
+}
+
+Base::Vector<TwinPages::Address> TwinPages::getPages() const
+{
+    Base::Vector<Address> pages;
+
+    pages.resize (mTwins.size ());
+
+    SizeType i = 0;
+    for (const auto &pageAndTwin : mTwins)
+        pages[i++] = pageAndTwin.first;
+
+    return pages;
+}
+
+} // namespace Ziqe
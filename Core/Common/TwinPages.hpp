@@ -0,0 +1,90 @@
+/**
+ * @file TwinPages.hpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Main: copyright (C) 2016 Shmuel Hazan
+ *
+ * Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ZIQE_CORE_TWINPAGES_H
+#define ZIQE_CORE_TWINPAGES_H
+
+#include "Base/Types.hpp"
+#include "Base/HashTable.hpp"
+#include "Base/Vector.hpp"
+
+#include "Common/PagePool.hpp"
+#include "Protocol/MemoryRevision.hpp"
+
+namespace Ziqe {
+
+/**
+ * @brief The twins of the pages written under release consistency.
+ *
+ * Before the first write to a shared page, a copy of it (its twin) is
+ * kept. On the next sync event the page is compared with its twin and
+ * only the changed bytes (a PageDiff) are sent to the page's home, so
+ * peers that write different parts of the same page don't take the page
+ * from each other.
+ *
+ * @note Not thread safe.
+ */
+class TwinPages
+{
+public:
+    typedef Protocol::PageDiff::Address Address;
+
+    TwinPages();
+    ~TwinPages();
+
+    ZQ_DISALLOW_COPY (TwinPages)
+
+    bool hasTwin (Address page) const
+    {
+        return mTwins.find (page) != mTwins.end ();
+    }
+
+    /**
+     * @brief Keep a copy of @a content (ZQ_PAGE_SIZE bytes), the content of
+     *        @a page before it is written.
+     * @return false if there was no memory for the twin.
+     */
+    bool makeTwin (Address page, const uint8_t *content);
+
+    /**
+     * @brief Apply another peer's changes to the twin of @a diff 's page
+     *        (if it has one), so they won't show up in this peer's diff.
+     */
+    void applyToTwin (const Protocol::PageDiff &diff);
+
+    /**
+     * @brief Compare @a current (the content of @a page) with its twin and
+     *        drop the twin.
+     */
+    Protocol::PageDiff takeDiff (Address page, const uint8_t *current);
+
+    /**
+     * @brief The pages that have a twin.
+     */
+    Base::Vector<Address> getPages () const;
+
+private:
+    Base::HashTable<Address, uint8_t *> mTwins;
+
+    PagePool mPool;
+};
+
+} // namespace Ziqe
+
+#endif // ZIQE_CORE_TWINPAGES_H
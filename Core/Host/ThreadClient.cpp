@@ -19,9 +19,16 @@
  */
 #include "ThreadClient.hpp"
 
+#include "Base/Metrics.hpp"
+
 namespace Ziqe {
 namespace Host {
 
+namespace {
+Base::Metrics::Histogram gDoSystemCallLatency{"Host/doSystemCall"};
+Base::Metrics::Histogram gGetAndReserveMemoryLatency{"Host/getAndReserveMemory"};
+}
+
 ThreadClient::ThreadClient(Base::UniquePointer<Protocol::MessageStream> &&stream)
     : mThreadOwnerStream{Base::move (stream)}
 {
@@ -32,6 +39,8 @@ ZqRegisterType ThreadClient::doSystemCall(ZqSystemCallIDType id,
                                                const Base::RawArray<ZqRegisterType> parameters,
                                                Protocol::MemoryRevision &revision)
 {
+    Base::Metrics::ScopedTimer timer{gDoSystemCallLatency};
+
     sendThreadOwnerMessage (Protocol::MessagesGenerator::makeDoSystemCall (id,
                                                                            parameters,
                                                                            revision));
@@ -41,6 +50,8 @@ ZqRegisterType ThreadClient::doSystemCall(ZqSystemCallIDType id,
 }
 
 ZqUserAddress ThreadClient::getAndReserveMemory(SizeType bytesCount) {
+    Base::Metrics::ScopedTimer timer{gGetAndReserveMemoryLatency};
+
     sendThreadOwnerMessage (Protocol::MessagesGenerator::makeGetAndReserveMemory (bytesCount));
 
     waitUntilTaskComplete (mGetAndReserveMemoryTask);
@@ -19,29 +19,265 @@
  */
 #include "MemoryRevision.hpp"
 
+#include "Base/Checks.hpp"
+
+#include "CppCore/Memory.h"
+
 namespace Ziqe {
 namespace Protocol {
 
-#if 0
+namespace {
+constexpr SizeType kRunHeaderSize = 2 * sizeof (PageDiff::RunFieldType);
 
-MemoryRevision MemoryRevision::mergeNew(const MemoryRevision &revision) const {
-    MemoryRevision thisCopy{*this};
+struct Run {
+    SizeType offset;
+    SizeType length;
+    const uint8_t *data;
 
-    thisCopy.mRevisionChanges.merge (revision.mRevisionChanges);
-    return thisCopy;
+    SizeType end () const
+    {
+        return offset + length;
+    }
+};
+
+SizeType writeRun (uint8_t *output, SizeType offset, SizeType length, const uint8_t *data)
+{
+    auto offsetField = static_cast<PageDiff::RunFieldType>(offset);
+    auto lengthField = static_cast<PageDiff::RunFieldType>(length);
+
+    memcpy (output, &offsetField, sizeof (offsetField));
+    memcpy (output + sizeof (offsetField), &lengthField, sizeof (lengthField));
+    memcpy (output + kRunHeaderSize, data, length);
+
+    return kRunHeaderSize + length;
+}
+
+Base::Vector<Run> decodeRuns (const Base::Vector<uint8_t> &runs)
+{
+    Base::Vector<Run> decoded;
+    SizeType runsCount = 0;
+
+    // Count first, to allocate once.
+    for (SizeType position = 0; position < runs.size (); ++runsCount) {
+        PageDiff::RunFieldType length;
+
+        memcpy (&length, runs.data () + position + sizeof (PageDiff::RunFieldType), sizeof (length));
+        position += kRunHeaderSize + length;
+    }
+
+    decoded.resize (runsCount);
+
+    SizeType position = 0;
+    for (SizeType i = 0; i < runsCount; ++i) {
+        PageDiff::RunFieldType offset, length;
+
+        memcpy (&offset, runs.data () + position, sizeof (offset));
+        memcpy (&length, runs.data () + position + sizeof (offset), sizeof (length));
+
+        decoded[i] = Run{offset, length, runs.data () + position + kRunHeaderSize};
+        position += kRunHeaderSize + length;
+    }
+
+    return decoded;
+}
+}
+
+PageDiff::PageDiff(Address page, Base::Vector<uint8_t> &&runs)
+    : mAddress{page}, mRuns{Base::move (runs)}
+{
+}
+
+PageDiff PageDiff::Create(Address page, const uint8_t *twin, const uint8_t *current)
+{
+    typedef uint64_t WordType;
+    constexpr SizeType kWordsCount = ZQ_PAGE_SIZE / sizeof (WordType);
+
+    // The worst case is a changed word after every unchanged word.
+    Base::Vector<uint8_t> runs;
+    runs.resize (ZQ_PAGE_SIZE + (kWordsCount / 2 + 1) * kRunHeaderSize);
+
+    SizeType runsSize = 0;
+    SizeType word = 0;
+
+    while (word < kWordsCount) {
+        WordType twinWord, currentWord;
+
+        memcpy (&twinWord, twin + word * sizeof (WordType), sizeof (WordType));
+        memcpy (&currentWord, current + word * sizeof (WordType), sizeof (WordType));
+
+        if (twinWord == currentWord) {
+            ++word;
+            continue;
+        }
+
+        SizeType firstWord = word;
+
+        for (++word; word < kWordsCount; ++word) {
+            memcpy (&twinWord, twin + word * sizeof (WordType), sizeof (WordType));
+            memcpy (&currentWord, current + word * sizeof (WordType), sizeof (WordType));
+
+            if (twinWord == currentWord)
+                break;
+        }
+
+        SizeType offset = firstWord * sizeof (WordType);
+        runsSize += writeRun (runs.data () + runsSize,
+                              offset,
+                              (word - firstWord) * sizeof (WordType),
+                              current + offset);
+    }
+
+    if (runsSize == 0)
+        runs.resize (0);
+    else
+        runs.shrinkWithoutFree (runs.size () - runsSize);
+
+    return PageDiff{page, Base::move (runs)};
+}
+
+PageDiff PageDiff::CreateFull(Address page, const uint8_t *content)
+{
+    Base::Vector<uint8_t> runs;
+
+    runs.resize (kRunHeaderSize + ZQ_PAGE_SIZE);
+    writeRun (runs.data (), 0, ZQ_PAGE_SIZE, content);
+
+    return PageDiff{page, Base::move (runs)};
+}
+
+void PageDiff::apply(uint8_t *page) const
+{
+    for (const auto &run : decodeRuns (mRuns))
+        memcpy (page + run.offset, run.data, run.length);
+}
+
+void PageDiff::merge(const PageDiff &newer)
+{
+    ZQ_ASSERT (newer.mAddress == mAddress);
+
+    if (newer.isEmpty ())
+        return;
+
+    if (isEmpty ()) {
+        mRuns = newer.mRuns;
+        return;
+    }
+
+    auto older = decodeRuns (mRuns);
+    auto newerRuns = decodeRuns (newer.mRuns);
+
+    // A newer run can split an older run into two, adding a header.
+    Base::Vector<uint8_t> merged;
+    merged.resize (mRuns.size () + newer.mRuns.size () + newerRuns.size () * kRunHeaderSize);
+
+    SizeType mergedSize = 0;
+    SizeType i = 0, j = 0;
+
+    // The older bytes before start are either written or overwritten.
+    SizeType start = older[0].offset;
+    SizeType newerEnd = 0;
+
+    while (i < older.size () || j < newerRuns.size ()) {
+        if (i < older.size () && start >= older[i].end ()) {
+            if (++i < older.size ())
+                start = older[i].offset > newerEnd ? older[i].offset : newerEnd;
+
+            continue;
+        }
+
+        if (j < newerRuns.size () && (i == older.size () || newerRuns[j].offset <= start)) {
+            const auto &run = newerRuns[j++];
+
+            mergedSize += writeRun (merged.data () + mergedSize, run.offset, run.length, run.data);
+
+            newerEnd = run.end ();
+            if (start < newerEnd)
+                start = newerEnd;
+
+            continue;
+        }
+
+        // The part of the older run before the next newer run.
+        SizeType end = older[i].end ();
+        if (j < newerRuns.size () && newerRuns[j].offset < end)
+            end = newerRuns[j].offset;
+
+        mergedSize += writeRun (merged.data () + mergedSize,
+                                start,
+                                end - start,
+                                older[i].data + (start - older[i].offset));
+        start = end;
+    }
+
+    merged.shrinkWithoutFree (merged.size () - mergedSize);
+    mRuns = Base::move (merged);
+}
+
+bool PageDiff::IsValidRuns(const Base::Vector<uint8_t> &runs)
+{
+    SizeType position = 0;
+    SizeType previousEnd = 0;
+
+    while (position < runs.size ()) {
+        RunFieldType offset, length;
+
+        if (runs.size () - position < kRunHeaderSize)
+            return false;
+
+        memcpy (&offset, runs.data () + position, sizeof (offset));
+        memcpy (&length, runs.data () + position + sizeof (offset), sizeof (length));
+
+        if (length == 0
+            || offset < previousEnd
+            || SizeType{offset} + length > ZQ_PAGE_SIZE
+            || runs.size () - position - kRunHeaderSize < length)
+            return false;
+
+        previousEnd = SizeType{offset} + length;
+        position += kRunHeaderSize + length;
+    }
+
+    return true;
 }
 
 MemoryRevision::MemoryRevision()
 {
+}
+
+void MemoryRevision::addPageDiff(PageDiff &&diff)
+{
+    if (diff.isEmpty ())
+        return;
+
+    // diff is moved only if it is inserted.
+    auto result = mPageDiffs.insert (diff.getAddress (), Base::move (diff));
 
+    if (! result.first)
+        result.second->merge (diff);
 }
 
 void MemoryRevision::merge(const MemoryRevision &revision)
 {
-    mRevisionChanges.merge (revision.mRevisionChanges);
+    for (const auto &diff : revision.mPageDiffs)
+        addPageDiff (PageDiff{diff});
 }
 
-#endif
+MemoryRevision MemoryRevision::mergeNew(const MemoryRevision &revision) const {
+    MemoryRevision thisCopy{*this};
+
+    thisCopy.merge (revision);
+    return thisCopy;
+}
+
+const PageDiff *MemoryRevision::find(PageDiff::Address page) const
+{
+    auto iterator = mPageDiffs.find (page);
+
+    if (iterator == mPageDiffs.end ())
+        return nullptr;
+
+    return &*iterator;
+}
 
 } // namespace Ziqe
 } // namespace Protocol
@@ -21,26 +21,108 @@
 #define ZIQE_MEMORYREVISION_H
 
 #include "Base/Types.hpp"
-#include "Base/HashTable.hpp"
+#include "Base/Vector.hpp"
+#include "Base/BTreeMap.hpp"
 
-#include "ZiqeAPI/Types.h"
-
-#include "MemoryMap.hpp"
-#include "Object.hpp"
+#include "CppCore/Types.h"
 
 namespace Ziqe {
 namespace Protocol {
 
+/**
+ * @brief The bytes of a page that changed since its twin (its copy from
+ *        before the changes).
+ *
+ * The changes are kept as runs: [uint16 offset][uint16 length][length bytes],
+ * sorted by offset and never overlapping, so a diff is small when only a
+ * few words of the page have been written.
+ */
+class PageDiff
+{
+public:
+    typedef uint64_t Address;
+    typedef uint16_t RunFieldType;
+
+    PageDiff() = default;
+    PageDiff(Address page, Base::Vector<uint8_t> &&runs);
+
+    ZQ_ALLOW_COPY_AND_MOVE (PageDiff)
+
+    /**
+     * @brief Compare @a current with its @a twin (both ZQ_PAGE_SIZE bytes),
+     *        word by word.
+     */
+    static PageDiff Create (Address page, const uint8_t *twin, const uint8_t *current);
+
+    /**
+     * @brief A diff that replaces the whole page with @a content
+     *        (ZQ_PAGE_SIZE bytes), for a page without a twin.
+     */
+    static PageDiff CreateFull (Address page, const uint8_t *content);
+
+    /**
+     * @brief Write the changes to @a page (ZQ_PAGE_SIZE bytes).
+     */
+    void apply (uint8_t *page) const;
+
+    /**
+     * @brief Merge @a newer into this diff. Where both changed the same
+     *        bytes, @a newer wins.
+     */
+    void merge (const PageDiff &newer);
+
+    bool isEmpty () const
+    {
+        return mRuns.size () == 0;
+    }
+
+    Address getAddress () const
+    {
+        return mAddress;
+    }
+
+    /**
+     * @brief The encoded runs, as sent on the wire.
+     */
+    const Base::Vector<uint8_t> &getRuns () const
+    {
+        return mRuns;
+    }
+
+    /**
+     * @brief Check that @a runs are well formed (in the page, sorted and
+     *        not overlapping), before using runs received from a peer.
+     */
+    static bool IsValidRuns (const Base::Vector<uint8_t> &runs);
+
+private:
+    Address mAddress = 0;
+
+    Base::Vector<uint8_t> mRuns;
+};
+
+/**
+ * @brief The changes a process instance made to the memory between two sync
+ *        events, as a diff per changed page.
+ *
+ * The diffs are in a BTreeMap by their page's address, so adding a diff
+ * to (or merging) a revision of a big process doesn't move the others.
+ */
 class MemoryRevision
 {
 public:
     typedef uint64_t ID;
+    typedef Base::BTreeMap<PageDiff::Address, PageDiff> PageDiffsMap;
 
     MemoryRevision();
     ZQ_ALLOW_COPY_AND_MOVE (MemoryRevision)
 
-    // TODO: memory map
-#if 0
+    /**
+     * @brief Add the changes to a page. If this revision already changed
+     *        it, the diffs are merged and @a diff wins.
+     */
+    void addPageDiff (PageDiff &&diff);
+
     /**
      * @brief Merge this two revision. If there're a collision, @c revision
      *        will win.
@@ -50,26 +132,26 @@ public:
 
     MemoryRevision mergeNew (const MemoryRevision &revision) const;
 
-    MemoryRevision fromChangedPages (const Base::LinkedList<Pair<ZqUserAddress,
-                                     Base::Vector<uint8_t>>> &pagesAndPreviousPagesList);
+    /**
+     * @return The diff of @a page or nullptr if this revision didn't change it.
+     */
+    const PageDiff *find (PageDiff::Address page) const;
 
-private:
-    Base::LinkedList<Base::Vector<uint8_t>> comparePages(ZqUserAddress address,
-                                                         const Base::Vector<uint8_t> &previousPage)
+    /**
+     * @brief The diffs, iterated in their pages' order.
+     */
+    const PageDiffsMap &getPageDiffs () const
     {
-//        ZqKernelAddress mappedAddress;
-//        auto result = ZqMapUserAddressToKernel (address,
-//                                                static_cast<ZqSizeType>(previousPage.size ()),
-//                                                &mappedAddress);
-
-//        DEBUG_CHECK (result == ZQ_TRUE);
+        return mPageDiffs;
+    }
 
-        // Compare Bytes and insert the differences to the linked list.
-        return {};
+    bool isEmpty () const
+    {
+        return mPageDiffs.isEmpty ();
     }
 
-    MemoryMap mRevisionChanges;
-#endif
+private:
+    PageDiffsMap mPageDiffs;
 };
 
 } // namespace Ziqe
@@ -22,10 +22,16 @@
 
 #include "Base/Types.hpp"
 #include "Base/Vector.hpp"
+#include "Base/SmallVector.hpp"
 #include "Base/Expected.hpp"
 
+#include "CppCore/Memory.h"
+
 #include "Common/Types.hpp"
 
+#include "Protocol/MemoryRevision.hpp"
+#include "Protocol/PageCompressor.hpp"
+
 #include <limits>
 
 namespace Ziqe {
@@ -122,14 +128,52 @@ public:
     enum class Type : MessageTypeInteger {
         /// Process Peer Messages: the 2**15 bit is on.
         ///
-        /// @brief Get the value of a remote memory. Used to
-        ///        be sent to all of the this process' Process Servers.
+        /// Page ownership, see Ziqe::PageDirectory. Requests are sent to
+        /// the page's home peer.
+        ///
+        /// @brief Get a read only copy of a page.
         GetMemory           = 0x8001,
         GetMemoryResult     = 0x8005,
-        /// @brief Write a value to a remote memory.
+        /// @brief Content addressed transfer (see Ziqe::PageCache): the
+        ///        128 bit hash of a page that has been transferred before.
+        GetMemoryResultByHash   = 0x8006,
+        /// @brief A zero page, no payload.
+        GetMemoryResultZero     = 0x8007,
+        /// @brief The receiver of a ...ByHash doesn't have the page in its
+        ///        cache: send the content (GetMemoryResult).
+        GetMemoryResultMiss     = 0x8008,
+        /// @brief The pages of a block, when pages are owned in blocks
+        ///        (see Ziqe::PageBlocks).
+        GetMemoryResultBlock    = 0x8009,
+        /// @brief Get a writable copy (the ownership) of a page.
         WriteMemory         = 0x8010,
-        /// @brief Give a memory page to a Process Peer.
+        /// @brief Give a memory page and its ownership to a Process Peer:
+        ///        from the home to a writer, or from a recalled owner back
+        ///        to the home.
         GivePage            = 0x8015,
+        /// @brief Tell an owner to give its page back to the home and keep
+        ///        a read only copy.
+        RecallPage          = 0x8016,
+        /// @brief The same as above, without keeping a copy.
+        RecallPageForWrite  = 0x8017,
+        /// @brief Tell a sharer to drop its copy.
+        InvalidatePage      = 0x8018,
+        InvalidatePageOK    = 0x8019,
+        /// @brief The page is in a transaction, request it again.
+        PageBusy            = 0x801a,
+        /// @brief Release consistency: the changes a peer made to pages
+        ///        homed at the receiver, sent on a sync event.
+        PageDiffs           = 0x801b,
+        /// @brief The home switched a contended page to release
+        ///        consistency (see Ziqe::PageContention).
+        MergePage           = 0x801c,
+        /// @brief The same as GetMemoryResult's ByHash, Zero and Miss.
+        GivePageByHash      = 0x801d,
+        GivePageZero        = 0x801e,
+        GivePageMiss        = 0x801f,
+        /// @brief The same as GetMemoryResultBlock. A block given back to
+        ///        its home has only the pages that were written.
+        GivePageBlock       = 0x8011,
         /// @brief Tell a peer to stop running a thread.
 
         StopThread          = 0x8020,
@@ -141,9 +185,22 @@ public:
         ContinueThread     = 0x8030,
         ContinueThreadOK   = 0x8031,
 
+        /// @brief Live migration: a pre-copy round, the pages the
+        ///        destination should fetch (see Ziqe::ThreadMigration).
+        MigrateThreadPages      = 0x8035,
+        /// @brief The destination has asked for the round's pages.
+        MigrateThreadPagesOK    = 0x8036,
+        /// @brief The thread is stopped: its registers and last written pages.
+        MigrateThread           = 0x8037,
+        /// @brief The destination runs the thread.
+        MigrateThreadOK         = 0x8038,
+
         /// @brief Tell all of a process' Process Peers
         ///        that there's a new Process Peer.
         ProcessPeerHello    = 0x8045,
+        /// @brief The optional protocol features a Process Peer supports
+        ///        (sent with ProcessPeerHello, and once in reply).
+        ProcessPeerFeatures = 0x8046,
         /// @brief The same as above but goodbye.
         ProcessPeerGoodbye  = 0x8050,
         /// @brief Tell a process peer to run a thread.
@@ -153,6 +210,18 @@ public:
 
         GetAndReserveMemory,
 
+        /// @brief Block a thread on a futex word (sent to the home of
+        ///        the futex's page, see Ziqe::FutexTable).
+        FutexWait           = 0x8060,
+        /// @brief Wake threads that wait on a futex word. Sent to the
+        ///        home, one way.
+        FutexWake           = 0x8061,
+        /// @brief The home tells the waiter's peer that the wait is over
+        ///        (woken, the value has changed or canceled).
+        FutexWaitDone       = 0x8062,
+        /// @brief Stop waiting (e.g. a timeout or a signal).
+        FutexCancel         = 0x8063,
+
         /// Thread Owner P2P: The 2**14 bit is on.
         /// @brief Tell a Process Owner Peer to run a system call
         ///        as a specific thread.
@@ -254,12 +323,15 @@ private:
 
 class MessageWithThreadIDs : public Message {
 public:
-    MessageWithThreadIDs(MessageType type, Base::Vector<HostedThreadID> &&threadIDs)
-        : Message{type}, mThreadIDs{threadIDs}
+    /// A process has a few threads: keep them inline.
+    typedef Base::SmallVector<HostedThreadID, 8> ThreadIDs;
+
+    MessageWithThreadIDs(MessageType type, ThreadIDs &&threadIDs)
+        : Message{type}, mThreadIDs{Base::move (threadIDs)}
     {
     }
 
-    const Base::Vector<HostedThreadID> &getThreadIDs () const
+    const ThreadIDs &getThreadIDs () const
     {
         return mThreadIDs;
     }
@@ -268,18 +340,19 @@ public:
     typedef uint16_t ArraySizeType;
 
     template<class ReaderType>
-    static Base::Expected<MessageWithThreadIDs, Message::ParseError> ReadFrom(ReaderType &reader) {
+    static Base::Expected<MessageWithThreadIDs, Message::ParseError> ReadFrom(MessageType type,
+                                                                              ReaderType &reader) {
         if (! reader.template canReadT<ArraySizeType>())
-            return {Message::ParseError::TooShort};
+            return Base::Error (Message::ParseError::TooShort);
 
         // Read the array size.
         auto arraySize = reader.template readT<ArraySizeType>();
-        auto vector = reader.template readTVector<HostedThreadID>(arraySize);
+        auto threadIDs = reader.template tryReadTVectorAs<ThreadIDs>(arraySize);
 
-        if (! vector)
-            return {Message::ParseError::TooShort};
+        if (! threadIDs)
+            return Base::Error (Message::ParseError::TooShort);
 
-        return {Base::move (vector)};
+        return {MessageWithThreadIDs{type, Base::move (*threadIDs)}};
     }
 
     template<class WriterType>
@@ -298,8 +371,730 @@ public:
     }
 
 private:
-    Base::Vector<HostedThreadID> mThreadIDs;
+    ThreadIDs mThreadIDs;
+
+};
+
+/**
+ * @brief A process peer's threads and its member index (see
+ *        ProcessPeersServer), the same on every peer of the process.
+ */
+class MessageWithMemberAndThreadIDs : public MessageWithThreadIDs {
+public:
+    typedef uint8_t MemberIndexType;
+
+    MessageWithMemberAndThreadIDs(MessageType type, MemberIndexType member, ThreadIDs &&threadIDs)
+        : MessageWithThreadIDs{type, Base::move (threadIDs)}, mMember{member}
+    {
+    }
+
+    MemberIndexType getMember () const
+    {
+        return mMember;
+    }
+
+    template<class ReaderType>
+    static Base::Expected<MessageWithMemberAndThreadIDs, Message::ParseError> ReadFrom(MessageType type,
+                                                                                       ReaderType &reader) {
+        if (! reader.template canReadT<MemberIndexType>())
+            return Base::Error (Message::ParseError::TooShort);
+
+        auto member = reader.template readT<MemberIndexType>();
+        auto threadIDs = MessageWithThreadIDs::ReadFrom (type, reader);
+
+        if (! threadIDs)
+            return Base::Error (Base::move (threadIDs.getError ()));
+
+        return {MessageWithMemberAndThreadIDs{member, Base::move (*threadIDs)}};
+    }
+
+    template<class WriterType>
+    void writeToWriter (WriterType &writer) const{
+        ZQ_ASSERT (getThreadIDs ().size () <= std::numeric_limits<uint16_t>::max ());
+
+        writer.writeT (static_cast<const Message&>(*this),
+                       mMember,
+                       static_cast<ArraySizeType> (getThreadIDs ().size ()),
+                       getThreadIDs ());
+    }
+
+    SizeType writableSize () const{
+        return MessageWithThreadIDs::writableSize () + sizeof (mMember);
+    }
+
+private:
+    MessageWithMemberAndThreadIDs(MemberIndexType member, MessageWithThreadIDs &&threadIDs)
+        : MessageWithThreadIDs{Base::move (threadIDs)}, mMember{member}
+    {
+    }
+
+    MemberIndexType mMember;
+};
+
+class MessageWithPageAddress : public Message {
+public:
+    typedef uint64_t AddressType;
+
+    MessageWithPageAddress(MessageType type, AddressType address)
+        : Message{type}, mAddress{address}
+    {
+    }
+
+    AddressType getAddress () const
+    {
+        return mAddress;
+    }
+
+    template<class ReaderType>
+    static Base::Expected<MessageWithPageAddress, Message::ParseError> ReadFrom(MessageType type,
+                                                                                ReaderType &reader) {
+        if (! reader.template canReadT<AddressType>())
+            return Base::Error (Message::ParseError::TooShort);
+
+        return {MessageWithPageAddress{type, reader.template readT<AddressType>()}};
+    }
+
+    template<class WriterType>
+    void writeToWriter (WriterType &writer) const
+    {
+        writer.writeT (static_cast<const Message&>(*this), mAddress);
+    }
+
+    SizeType writableSize () const
+    {
+        return sizeof (mAddress) + Message::writableSize ();
+    }
+
+private:
+    AddressType mAddress;
+};
+
+/**
+ * @brief Bytes of a known size, raw or compressed (see PageCompressor):
+ *
+ *   encoding (u8), raw: the bytes; LZ4: compressed size (u16), the block.
+ */
+class EncodedBytes {
+public:
+    typedef uint16_t CompressedSizeType;
+
+    template<class ReaderType>
+    static Base::Expected<Base::Vector<uint8_t>, Message::ParseError> ReadFrom(ReaderType &reader, SizeType size) {
+        if (! reader.template canReadT<uint8_t>())
+            return Base::Error (Message::ParseError::TooShort);
+
+        auto encoding = static_cast<PageCompressor::Encoding>(reader.template readT<uint8_t>());
+
+        if (encoding == PageCompressor::Encoding::Raw) {
+            auto bytes = reader.template tryReadTVector<uint8_t>(size);
+            if (! bytes)
+                return Base::Error (Message::ParseError::TooShort);
+
+            return {Base::move (*bytes)};
+        }
+
+        if (encoding != PageCompressor::Encoding::Lz4)
+            return Base::Error (Message::ParseError::Other);
+
+        if (! reader.template canReadT<CompressedSizeType>())
+            return Base::Error (Message::ParseError::TooShort);
+
+        auto compressed = reader.template tryReadTVector<uint8_t>(reader.template readT<CompressedSizeType>());
+        if (! compressed)
+            return Base::Error (Message::ParseError::TooShort);
+
+        Base::Vector<uint8_t> bytes;
+        bytes.resize (size);
+
+        if (! PageCompressor::Decompress (compressed->data (), compressed->size (), bytes.data (), size))
+            return Base::Error (Message::ParseError::Other);
+
+        return {Base::move (bytes)};
+    }
+
+    /// Write @a compressed if it isn't empty, and @a raw otherwise.
+    template<class WriterType>
+    static void WriteToWriter (WriterType &writer,
+                               const Base::Vector<uint8_t> &raw,
+                               const Base::Vector<uint8_t> &compressed)
+    {
+        if (compressed.size () == 0) {
+            writer.writeT (static_cast<uint8_t>(PageCompressor::Encoding::Raw), raw);
+            return;
+        }
+
+        writer.writeT (static_cast<uint8_t>(PageCompressor::Encoding::Lz4),
+                       static_cast<CompressedSizeType>(compressed.size ()),
+                       compressed);
+    }
+
+    static SizeType WritableSize (const Base::Vector<uint8_t> &raw, const Base::Vector<uint8_t> &compressed)
+    {
+        if (compressed.size () == 0)
+            return sizeof (uint8_t) + raw.size ();
+
+        return sizeof (uint8_t) + sizeof (CompressedSizeType) + compressed.size ();
+    }
+};
+
+/**
+ * @brief A page address and its content (ZQ_PAGE_SIZE bytes, see EncodedBytes).
+ */
+class MessageWithPage : public MessageWithPageAddress {
+public:
+    MessageWithPage(MessageType type, AddressType address, Base::Vector<uint8_t> &&page)
+        : MessageWithPageAddress{type, address}, mPage{Base::move (page)}
+    {
+    }
+
+    const Base::Vector<uint8_t> &getPage () const
+    {
+        return mPage;
+    }
+
+    /**
+     * @brief Send the page compressed, if @a compressor finds it worth it.
+     */
+    void compressPages (PageCompressor &compressor)
+    {
+        mCompressed = compressor.compress (mPage);
+    }
+
+    template<class ReaderType>
+    static Base::Expected<MessageWithPage, Message::ParseError> ReadFrom(MessageType type,
+                                                                         ReaderType &reader) {
+        if (! reader.template canReadT<AddressType>())
+            return Base::Error (Message::ParseError::TooShort);
+
+        auto address = reader.template readT<AddressType>();
+        auto page = EncodedBytes::ReadFrom (reader, ZQ_PAGE_SIZE);
+
+        if (! page)
+            return Base::Error (Base::move (page.getError ()));
+
+        return {MessageWithPage{type, address, Base::move (*page)}};
+    }
+
+    template<class WriterType>
+    void writeToWriter (WriterType &writer) const
+    {
+        ZQ_ASSERT (mPage.size () == ZQ_PAGE_SIZE);
+
+        MessageWithPageAddress::writeToWriter (writer);
+        EncodedBytes::WriteToWriter (writer, mPage, mCompressed);
+    }
+
+    SizeType writableSize () const
+    {
+        return MessageWithPageAddress::writableSize () + EncodedBytes::WritableSize (mPage, mCompressed);
+    }
+
+private:
+    Base::Vector<uint8_t> mPage;
+
+    /// Empty when sent raw.
+    Base::Vector<uint8_t> mCompressed;
+};
+
+/**
+ * @brief The pages of a block (see Ziqe::PageBlocks): its address, its
+ *        pages count, which pages are sent and which of the sent ones are
+ *        zero (bitmaps of u64 words), and the content of the other sent
+ *        pages (EncodedBytes).
+ */
+class MessageWithBlock : public MessageWithPageAddress {
+public:
+    typedef uint16_t PagesCountType;
+    typedef uint64_t BitmapWordType;
+
+    static constexpr SizeType kBitsPerWord = sizeof (BitmapWordType) * 8;
+
+    /**
+     * @param pages By their index in the block: the content of the sent
+     *              pages, empty for the zero pages and the ones not sent.
+     */
+    MessageWithBlock(MessageType type,
+                     AddressType address,
+                     Base::Vector<BitmapWordType> &&sentPages,
+                     Base::Vector<BitmapWordType> &&zeroPages,
+                     Base::Vector<Base::Vector<uint8_t>> &&pages)
+        : MessageWithPageAddress{type, address},
+          mSentPages{Base::move (sentPages)},
+          mZeroPages{Base::move (zeroPages)},
+          mPages{Base::move (pages)}
+    {
+    }
+
+    static SizeType GetWordsCount (SizeType pagesCount)
+    {
+        return (pagesCount + kBitsPerWord - 1) / kBitsPerWord;
+    }
+
+    SizeType getPagesCount () const
+    {
+        return mPages.size ();
+    }
+
+    bool isSent (SizeType index) const
+    {
+        return IsSet (mSentPages, index);
+    }
+
+    bool isZero (SizeType index) const
+    {
+        return IsSet (mZeroPages, index);
+    }
+
+    /// The content of a sent page that isn't zero.
+    const Base::Vector<uint8_t> &getPage (SizeType index) const
+    {
+        return mPages[index];
+    }
+
+    void compressPages (PageCompressor &compressor)
+    {
+        mCompressed.resize (mPages.size ());
+        for (SizeType i = 0; i < mPages.size (); ++i) {
+            if (hasContent (i))
+                mCompressed[i] = compressor.compress (mPages[i]);
+        }
+    }
+
+    template<class ReaderType>
+    static Base::Expected<MessageWithBlock, Message::ParseError> ReadFrom(MessageType type,
+                                                                          ReaderType &reader) {
+        if (! reader.template canReadT<AddressType>())
+            return Base::Error (Message::ParseError::TooShort);
+
+        auto address = reader.template readT<AddressType>();
+
+        if (! reader.template canReadT<PagesCountType>())
+            return Base::Error (Message::ParseError::TooShort);
+
+        auto pagesCount = reader.template readT<PagesCountType>();
+
+        auto sentPages = reader.template tryReadTVector<BitmapWordType>(GetWordsCount (pagesCount));
+        if (! sentPages)
+            return Base::Error (Message::ParseError::TooShort);
+
+        auto zeroPages = reader.template tryReadTVector<BitmapWordType>(GetWordsCount (pagesCount));
+        if (! zeroPages)
+            return Base::Error (Message::ParseError::TooShort);
+
+        Base::Vector<Base::Vector<uint8_t>> pages;
+        pages.resize (pagesCount);
+
+        for (SizeType i = 0; i < pagesCount; ++i) {
+            if (! IsSet (*sentPages, i) || IsSet (*zeroPages, i))
+                continue;
+
+            auto page = EncodedBytes::ReadFrom (reader, ZQ_PAGE_SIZE);
+            if (! page)
+                return Base::Error (Base::move (page.getError ()));
+
+            pages[i] = Base::move (*page);
+        }
+
+        return {MessageWithBlock{type, address, Base::move (*sentPages), Base::move (*zeroPages), Base::move (pages)}};
+    }
+
+    template<class WriterType>
+    void writeToWriter (WriterType &writer) const
+    {
+        ZQ_ASSERT (mPages.size () <= std::numeric_limits<PagesCountType>::max ());
+
+        MessageWithPageAddress::writeToWriter (writer);
+        writer.writeT (static_cast<PagesCountType>(mPages.size ()), mSentPages, mZeroPages);
+
+        for (SizeType i = 0; i < mPages.size (); ++i) {
+            if (hasContent (i))
+                EncodedBytes::WriteToWriter (writer, mPages[i], getCompressed (i));
+        }
+    }
+
+    SizeType writableSize () const
+    {
+        SizeType size = MessageWithPageAddress::writableSize ()
+                        + sizeof (PagesCountType)
+                        + (mSentPages.size () + mZeroPages.size ()) * sizeof (BitmapWordType);
+
+        for (SizeType i = 0; i < mPages.size (); ++i) {
+            if (hasContent (i))
+                size += EncodedBytes::WritableSize (mPages[i], getCompressed (i));
+        }
+
+        return size;
+    }
+
+private:
+    static bool IsSet (const Base::Vector<BitmapWordType> &bitmap, SizeType index)
+    {
+        return (bitmap[index / kBitsPerWord] >> (index % kBitsPerWord)) & 1;
+    }
+
+    bool hasContent (SizeType index) const
+    {
+        return isSent (index) && ! isZero (index);
+    }
+
+    const Base::Vector<uint8_t> &getCompressed (SizeType index) const
+    {
+        static const Base::Vector<uint8_t> kRaw;
+
+        return index < mCompressed.size () ? mCompressed[index] : kRaw;
+    }
+
+    Base::Vector<BitmapWordType> mSentPages;
+    Base::Vector<BitmapWordType> mZeroPages;
+    Base::Vector<Base::Vector<uint8_t>> mPages;
+
+    /// By the page's index, empty when sent raw.
+    Base::Vector<Base::Vector<uint8_t>> mCompressed;
+};
+
+/**
+ * @brief A page address and a 128 bit hash of its content.
+ */
+class MessageWithPageHash : public MessageWithPageAddress {
+public:
+    typedef uint64_t HashHalfType;
+
+    MessageWithPageHash(MessageType type, AddressType address, HashHalfType low, HashHalfType high)
+        : MessageWithPageAddress{type, address}, mLow{low}, mHigh{high}
+    {
+    }
+
+    HashHalfType getHashLow () const
+    {
+        return mLow;
+    }
+
+    HashHalfType getHashHigh () const
+    {
+        return mHigh;
+    }
+
+    template<class ReaderType>
+    static Base::Expected<MessageWithPageHash, Message::ParseError> ReadFrom(MessageType type,
+                                                                             ReaderType &reader) {
+        if (! reader.template canReadT<AddressType, sizeof (AddressType) + 2 * sizeof (HashHalfType)>())
+            return Base::Error (Message::ParseError::TooShort);
+
+        auto address = reader.template readT<AddressType>();
+        auto low = reader.template readT<HashHalfType>();
+        auto high = reader.template readT<HashHalfType>();
+
+        return {MessageWithPageHash{type, address, low, high}};
+    }
+
+    template<class WriterType>
+    void writeToWriter (WriterType &writer) const
+    {
+        MessageWithPageAddress::writeToWriter (writer);
+        writer.writeT (mLow, mHigh);
+    }
+
+    SizeType writableSize () const
+    {
+        return MessageWithPageAddress::writableSize () + sizeof (mLow) + sizeof (mHigh);
+    }
+
+private:
+    HashHalfType mLow;
+    HashHalfType mHigh;
+};
+
+/**
+ * @brief A memory revision: a list of page diffs. The runs of every
+ *        diff are EncodedBytes.
+ */
+class MessageWithRevision : public Message {
+public:
+    typedef uint32_t DiffsCountType;
+    typedef uint16_t RunsSizeType;
+
+    MessageWithRevision(MessageType type, MemoryRevision &&revision)
+        : Message{type}, mRevision{Base::move (revision)}
+    {
+    }
+
+    const MemoryRevision &getRevision () const
+    {
+        return mRevision;
+    }
+
+    /**
+     * @brief Send the diffs compressed, the ones @a compressor finds it
+     *        worth it for.
+     */
+    void compressPages (PageCompressor &compressor)
+    {
+        const auto &diffs = mRevision.getPageDiffs ();
+        SizeType i = 0;
+
+        mCompressed.resize (diffs.size ());
+        for (const auto &diff : diffs)
+            mCompressed[i++] = compressor.compress (diff.getRuns ());
+    }
+
+    template<class ReaderType>
+    static Base::Expected<MessageWithRevision, Message::ParseError> ReadFrom(MessageType type,
+                                                                             ReaderType &reader) {
+        if (! reader.template canReadT<DiffsCountType>())
+            return Base::Error (Message::ParseError::TooShort);
+
+        auto diffsCount = reader.template readT<DiffsCountType>();
+        MemoryRevision revision;
+
+        for (DiffsCountType i = 0; i < diffsCount; ++i) {
+            if (! reader.template canReadT<PageDiff::Address>())
+                return Base::Error (Message::ParseError::TooShort);
+
+            auto address = reader.template readT<PageDiff::Address>();
+
+            if (! reader.template canReadT<RunsSizeType>())
+                return Base::Error (Message::ParseError::TooShort);
+
+            auto runs = EncodedBytes::ReadFrom (reader, reader.template readT<RunsSizeType>());
+            if (! runs)
+                return Base::Error (Base::move (runs.getError ()));
+
+            if (! PageDiff::IsValidRuns (*runs))
+                return Base::Error (Message::ParseError::Other);
+
+            revision.addPageDiff (PageDiff{address, Base::move (*runs)});
+        }
+
+        return {MessageWithRevision{type, Base::move (revision)}};
+    }
+
+    template<class WriterType>
+    void writeToWriter (WriterType &writer) const
+    {
+        const auto &diffs = mRevision.getPageDiffs ();
+        SizeType i = 0;
+
+        writer.writeT (static_cast<const Message&>(*this),
+                       static_cast<DiffsCountType>(diffs.size ()));
+
+        for (const auto &diff : diffs) {
+            ZQ_ASSERT (diff.getRuns ().size () <= std::numeric_limits<RunsSizeType>::max ());
+
+            writer.writeT (diff.getAddress (),
+                           static_cast<RunsSizeType>(diff.getRuns ().size ()));
+            EncodedBytes::WriteToWriter (writer, diff.getRuns (), getCompressed (i++));
+        }
+    }
+
+    SizeType writableSize () const
+    {
+        const auto &diffs = mRevision.getPageDiffs ();
+        SizeType size = Message::writableSize () + sizeof (DiffsCountType);
+        SizeType i = 0;
+
+        for (const auto &diff : diffs)
+            size += sizeof (PageDiff::Address)
+                    + sizeof (RunsSizeType)
+                    + EncodedBytes::WritableSize (diff.getRuns (), getCompressed (i++));
+
+        return size;
+    }
+
+private:
+    const Base::Vector<uint8_t> &getCompressed (SizeType index) const
+    {
+        static const Base::Vector<uint8_t> kRaw;
+
+        return index < mCompressed.size () ? mCompressed[index] : kRaw;
+    }
+
+    MemoryRevision mRevision;
+
+    /// By the diff's index (in the pages' order), empty when sent raw.
+    Base::Vector<Base::Vector<uint8_t>> mCompressed;
+};
+
+/**
+ * @brief The optional protocol features a Process Peer supports.
+ */
+class MessageWithFeatures : public Message {
+public:
+    typedef uint32_t FeaturesType;
+
+    enum Feature : FeaturesType {
+        /// It reads compressed pages, and wants to get them.
+        PageCompression = 1u << 0
+    };
+
+    MessageWithFeatures(MessageType type, FeaturesType features)
+        : Message{type}, mFeatures{features}
+    {
+    }
+
+    FeaturesType getFeatures () const
+    {
+        return mFeatures;
+    }
+
+    template<class ReaderType>
+    static Base::Expected<MessageWithFeatures, Message::ParseError> ReadFrom(MessageType type,
+                                                                             ReaderType &reader) {
+        if (! reader.template canReadT<FeaturesType>())
+            return Base::Error (Message::ParseError::TooShort);
+
+        return {MessageWithFeatures{type, reader.template readT<FeaturesType>()}};
+    }
+
+    template<class WriterType>
+    void writeToWriter (WriterType &writer) const
+    {
+        writer.writeT (static_cast<const Message&>(*this), mFeatures);
+    }
+
+    SizeType writableSize () const
+    {
+        return Message::writableSize () + sizeof (mFeatures);
+    }
+
+private:
+    FeaturesType mFeatures;
+};
+
+/**
+ * @brief A futex operation: the futex's address, the waiting thread,
+ *        a value (the expected value, the number of threads to wake
+ *        or a ZqError result) and the FUTEX_*_BITSET bitset.
+ */
+class MessageWithFutex : public Message {
+public:
+    typedef uint64_t AddressType;
+    typedef uint32_t ValueType;
+    typedef uint32_t BitsetType;
+
+    MessageWithFutex(MessageType type,
+                     AddressType address,
+                     HostedThreadID thread,
+                     ValueType value,
+                     BitsetType bitset)
+        : Message{type}, mAddress{address}, mThread{thread}, mValue{value}, mBitset{bitset}
+    {
+    }
+
+    AddressType getAddress () const
+    {
+        return mAddress;
+    }
+
+    HostedThreadID getThread () const
+    {
+        return mThread;
+    }
+
+    ValueType getValue () const
+    {
+        return mValue;
+    }
+
+    BitsetType getBitset () const
+    {
+        return mBitset;
+    }
+
+    template<class ReaderType>
+    static Base::Expected<MessageWithFutex, Message::ParseError> ReadFrom(MessageType type,
+                                                                          ReaderType &reader) {
+        if (! reader.template canReadT<AddressType, kPayloadSize>())
+            return Base::Error (Message::ParseError::TooShort);
+
+        auto address = reader.template readT<AddressType>();
+        auto thread = reader.template readT<HostedThreadID>();
+        auto value = reader.template readT<ValueType>();
+        auto bitset = reader.template readT<BitsetType>();
+
+        return {MessageWithFutex{type, address, thread, value, bitset}};
+    }
+
+    template<class WriterType>
+    void writeToWriter (WriterType &writer) const
+    {
+        writer.writeT (static_cast<const Message&>(*this), mAddress, mThread, mValue, mBitset);
+    }
+
+    SizeType writableSize () const
+    {
+        return Message::writableSize () + kPayloadSize;
+    }
 
+private:
+    static constexpr SizeType kPayloadSize = sizeof (AddressType)
+                                             + sizeof (HostedThreadID)
+                                             + sizeof (ValueType)
+                                             + sizeof (BitsetType);
+
+    AddressType mAddress;
+    HostedThreadID mThread;
+    ValueType mValue;
+    BitsetType mBitset;
+};
+
+/**
+ * @brief A thread and a list of page addresses.
+ */
+class MessageWithPageAddresses : public Message {
+public:
+    typedef uint64_t AddressType;
+    typedef uint32_t CountType;
+
+    MessageWithPageAddresses(MessageType type, HostedThreadID thread, Base::Vector<AddressType> &&pages)
+        : Message{type}, mThread{thread}, mPages{Base::move (pages)}
+    {
+    }
+
+    HostedThreadID getThread () const
+    {
+        return mThread;
+    }
+
+    const Base::Vector<AddressType> &getPages () const
+    {
+        return mPages;
+    }
+
+    template<class ReaderType>
+    static Base::Expected<MessageWithPageAddresses, Message::ParseError> ReadFrom(MessageType type,
+                                                                                  ReaderType &reader) {
+        if (! reader.template canReadT<HostedThreadID, sizeof (HostedThreadID) + sizeof (CountType)>())
+            return Base::Error (Message::ParseError::TooShort);
+
+        auto thread = reader.template readT<HostedThreadID>();
+        auto pages = reader.template tryReadTVector<AddressType>(reader.template readT<CountType>());
+
+        if (! pages)
+            return Base::Error (Message::ParseError::TooShort);
+
+        return {MessageWithPageAddresses{type, thread, Base::move (*pages)}};
+    }
+
+    template<class WriterType>
+    void writeToWriter (WriterType &writer) const
+    {
+        writer.writeT (static_cast<const Message&>(*this),
+                       mThread,
+                       static_cast<CountType>(mPages.size ()),
+                       mPages);
+    }
+
+    SizeType writableSize () const
+    {
+        return Message::writableSize ()
+                + sizeof (mThread)
+                + sizeof (CountType)
+                + mPages.size () * sizeof (AddressType);
+    }
+
+private:
+    HostedThreadID mThread;
+    Base::Vector<AddressType> mPages;
 };
 
 class MessageWithThreadInfo {
@@ -335,27 +1130,51 @@ public:
     typedef uint16_t ParametersSizeType;
     typedef uint64_t ParameterType;
 
-    MessageWithSystemCallRequest(Base::Vector<ZqRegisterType> &&message);
+    /// The system call number and up to 6 parameters.
+    typedef Base::SmallVector<ParameterType, 7> Parameters;
+
+    MessageWithSystemCallRequest(MessageType type, Parameters &&parameters)
+        : Message{type}, mParameters{Base::move (parameters)}
+    {
+    }
+
+    const Parameters &getParameters () const
+    {
+        return mParameters;
+    }
 
     template<class ReaderType>
-    static Base::Expected<MessageWithSystemCallRequest, ParseError> ReadFrom (ReaderType &reader) {
+    static Base::Expected<MessageWithSystemCallRequest, ParseError> ReadFrom (MessageType type,
+                                                                              ReaderType &reader) {
+        if (! reader.template canReadT<ParametersSizeType>())
+            return Base::Error (ParseError::TooShort);
+
         auto arraySize = reader.template readT<ParametersSizeType> ();
-        auto array = reader.template readTVector<ParameterType> (arraySize);
+        auto parameters = reader.template tryReadTVectorAs<Parameters> (arraySize);
+
+        if (! parameters)
+            return Base::Error (ParseError::TooShort);
 
-        return {};
+        return {MessageWithSystemCallRequest{type, Base::move (*parameters)}};
     }
 
     template<class WriterType>
-    void writeToWriter(WriterType &writer) {
+    void writeToWriter(WriterType &writer) const {
         ZQ_ASSERT (std::numeric_limits<ParametersSizeType>::max () >= mParameters.size ());
 
-        writer.write (static_cast<Message&>(*this),
-                      static_cast<ParametersSizeType>(mParameters.size ()),
-                      mParameters);
+        writer.writeT (static_cast<const Message&>(*this),
+                       static_cast<ParametersSizeType>(mParameters.size ()),
+                       mParameters);
+    }
+
+    SizeType writableSize () const
+    {
+        return Message::writableSize () + sizeof (ParametersSizeType)
+                + mParameters.size () * sizeof (ParameterType);
     }
 
 private:
-    Base::Vector<ParameterType> mParameters;
+    Parameters mParameters;
 
 };
 
@@ -368,11 +1187,41 @@ typedef MessageWithType<Message::Type::KillThreadOK, MessageWithThreadID>
 typedef MessageWithType<Message::Type::StopThread, MessageWithThreadID>         StopThreadMessage;
 typedef MessageWithType<Message::Type::StopThreadOK, MessageWithThreadID>       StopThreadOKMessage;
 
-typedef MessageWithType<Message::Type::ProcessPeerHello, MessageWithThreadIDs>  ProcessPeerHelloMessage;
+typedef MessageWithType<Message::Type::ProcessPeerHello, MessageWithMemberAndThreadIDs> ProcessPeerHelloMessage;
 typedef MessageWithType<Message::Type::ProcessPeerGoodbye, MessageWithThreadIDs>ProcessPeerGoodbyeMessage;
+typedef MessageWithType<Message::Type::ProcessPeerFeatures, MessageWithFeatures> ProcessPeerFeaturesMessage;
 
 typedef MessageWithType<Message::Type::DoSystemCall, MessageWithSystemCallRequest> DoSystemCallMessage;
 
+typedef MessageWithType<Message::Type::GetMemory, MessageWithPageAddress>           GetMemoryMessage;
+typedef MessageWithType<Message::Type::GetMemoryResult, MessageWithPage>            GetMemoryResultMessage;
+typedef MessageWithType<Message::Type::WriteMemory, MessageWithPageAddress>         WriteMemoryMessage;
+typedef MessageWithType<Message::Type::GivePage, MessageWithPage>                   GivePageMessage;
+typedef MessageWithType<Message::Type::GetMemoryResultByHash, MessageWithPageHash>  GetMemoryResultByHashMessage;
+typedef MessageWithType<Message::Type::GetMemoryResultZero, MessageWithPageAddress> GetMemoryResultZeroMessage;
+typedef MessageWithType<Message::Type::GetMemoryResultMiss, MessageWithPageHash>    GetMemoryResultMissMessage;
+typedef MessageWithType<Message::Type::GivePageByHash, MessageWithPageHash>         GivePageByHashMessage;
+typedef MessageWithType<Message::Type::GivePageZero, MessageWithPageAddress>        GivePageZeroMessage;
+typedef MessageWithType<Message::Type::GivePageMiss, MessageWithPageHash>           GivePageMissMessage;
+typedef MessageWithType<Message::Type::GetMemoryResultBlock, MessageWithBlock>      GetMemoryResultBlockMessage;
+typedef MessageWithType<Message::Type::GivePageBlock, MessageWithBlock>             GivePageBlockMessage;
+typedef MessageWithType<Message::Type::RecallPage, MessageWithPageAddress>          RecallPageMessage;
+typedef MessageWithType<Message::Type::RecallPageForWrite, MessageWithPageAddress>  RecallPageForWriteMessage;
+typedef MessageWithType<Message::Type::InvalidatePage, MessageWithPageAddress>      InvalidatePageMessage;
+typedef MessageWithType<Message::Type::InvalidatePageOK, MessageWithPageAddress>    InvalidatePageOKMessage;
+typedef MessageWithType<Message::Type::PageBusy, MessageWithPageAddress>            PageBusyMessage;
+typedef MessageWithType<Message::Type::PageDiffs, MessageWithRevision>              PageDiffsMessage;
+typedef MessageWithType<Message::Type::MergePage, MessageWithPageAddress>           MergePageMessage;
+
+typedef MessageWithType<Message::Type::MigrateThreadPages, MessageWithPageAddresses>   MigrateThreadPagesMessage;
+typedef MessageWithType<Message::Type::MigrateThreadPagesOK, MessageWithPageAddresses> MigrateThreadPagesOKMessage;
+typedef MessageWithType<Message::Type::MigrateThreadOK, MessageWithPageAddresses>      MigrateThreadOKMessage;
+
+typedef MessageWithType<Message::Type::FutexWait, MessageWithFutex>                 FutexWaitMessage;
+typedef MessageWithType<Message::Type::FutexWake, MessageWithFutex>                 FutexWakeMessage;
+typedef MessageWithType<Message::Type::FutexWaitDone, MessageWithFutex>             FutexWaitDoneMessage;
+typedef MessageWithType<Message::Type::FutexCancel, MessageWithFutex>               FutexCancelMessage;
+
 } // namespace Ziqe
 } // namespace Protocol
 
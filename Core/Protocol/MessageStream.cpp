@@ -24,6 +24,14 @@
 namespace Ziqe {
 namespace Protocol {
 
+namespace {
+// Keyed by Message::Type.
+Base::Metrics::KeyedHistograms<32> gReceiveMessageLatency{"Protocol/receiveMessage"};
+Base::Metrics::Counter gInvalidMessages{"Protocol/invalidMessages"};
+}
+
+Base::Metrics::Histogram MessageStream::sSendMessageLatency{"Protocol/sendMessage"};
+
 MessageStream::MessageStream(Base::UniquePointer<Net::Stream> &&stream)
     : mStream{Base::move(stream)},
       mReader{mStream->getInputStreamVector ()},
@@ -94,8 +102,11 @@ MessageStream::~MessageStream()
 }
 
 Base::Expected<Base::Pair<Message::Type, Base::RawPointer<MessageStream::MessageFieldReader> >, MessageStream::ReceiveMessageError> MessageStream::receiveMessage() {
+    Base::Metrics::ScopedTimer timer;
+
     if (! mReader.canReadT<Message::Type>()) {
         ZQ_ASSERT_REPORT_NOT_REACHED ("Message too short");
+        gInvalidMessages.add ();
         return {ReceiveMessageError::Other};
     }
 
@@ -103,10 +114,12 @@ Base::Expected<Base::Pair<Message::Type, Base::RawPointer<MessageStream::Message
 
     if (! Message::IsValidMessageType (type)) {
         ZQ_ASSERT_REPORT_NOT_REACHED ("Invalid message type received");
+        gInvalidMessages.add ();
 
         return {ReceiveMessageError::Other};
     }
 
+    timer.setHistogram (gReceiveMessageLatency.get (static_cast<uint64_t>(type)));
 
     return {type, &mReader};
 }
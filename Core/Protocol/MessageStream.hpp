@@ -21,6 +21,7 @@
 #define ZIQE_MESSAGESTREAM_H
 
 #include "Base/FieldReader.hpp"
+#include "Base/Metrics.hpp"
 
 #include "Network/UdpStream.hpp"
 #include "Network/TcpStream.hpp"
@@ -28,6 +29,7 @@
 #include "Common/Types.hpp"
 #include "Protocol/Message.hpp"
 #include "Protocol/MemoryRevision.hpp"
+#include "Protocol/PageCompressor.hpp"
 
 namespace Ziqe {
 namespace Protocol {
@@ -87,10 +89,33 @@ public:
 
     template<class MessageType>
     void sendMessage(const MessageType &messageData) {
+        Base::Metrics::ScopedTimer timer{sSendMessageLatency};
+
         messageData.writeToWriter (mWriter);
         mWriter.getVector ().sync ();
     }
 
+    /**
+     * @brief Send a page-bearing message (one with compressPages), compressed
+     *        if a compressor has been set.
+     */
+    template<class MessageType>
+    void sendPageMessage(MessageType &&messageData) {
+        if (mPageCompressor != nullptr)
+            messageData.compressPages (*mPageCompressor);
+
+        sendMessage (messageData);
+    }
+
+    /**
+     * @brief Compress page-bearing messages with @a compressor (or not, if null).
+     *        Should be set only if the other side supports it.
+     */
+    void setPageCompressor (PageCompressor *compressor)
+    {
+        mPageCompressor = compressor;
+    }
+
     Base::Pair<Address, Port>
     getInfo () const
     {
@@ -98,10 +123,14 @@ public:
     }
 
 private:
+    static Base::Metrics::Histogram sSendMessageLatency;
+
     Base::UniquePointer<Net::Stream> mStream;
 
     MessageFieldWriter mWriter;
     MessageFieldReader mReader;
+
+    PageCompressor *mPageCompressor = nullptr;
 };
 
 } // namespace Ziqe
@@ -0,0 +1,277 @@
+/**
+ * @file PageCompressor.cpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2016 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "PageCompressor.hpp"
+
+#include "Base/Checks.hpp"
+#include "Base/Metrics.hpp"
+
+#include "CppCore/Memory.h"
+
+namespace Ziqe {
+namespace Protocol {
+
+namespace {
+Base::Metrics::Counter gCompressedPages{"Compression/compressed"};
+Base::Metrics::Counter gIncompressiblePages{"Compression/incompressible"};
+Base::Metrics::Counter gSkippedPages{"Compression/skipped"};
+Base::Metrics::Counter gSavedBytes{"Compression/savedBytes"};
+
+// The LZ4 block format: the last match starts kMatchLimit bytes before
+// the end, and the last kLastLiterals bytes are always literals.
+constexpr SizeType kMinMatch = 4;
+constexpr SizeType kMatchLimit = 12;
+constexpr SizeType kLastLiterals = 5;
+constexpr SizeType kMaxOffset = 0xffff;
+
+uint32_t Read32 (const uint8_t *pointer)
+{
+    uint32_t value;
+
+    memcpy (&value, pointer, sizeof (value));
+    return value;
+}
+
+/// Write a length's extra bytes (the part that didn't fit in the token).
+uint8_t *WriteLength (uint8_t *output, SizeType length)
+{
+    for (; length >= 255; length -= 255)
+        *output++ = 255;
+
+    *output++ = static_cast<uint8_t>(length);
+    return output;
+}
+
+/// The worst case size of a sequence.
+SizeType SequenceSize (SizeType literals)
+{
+    return 1 + literals / 255 + 1 + literals + 2 + 1;
+}
+
+/// Read a length's extra bytes.
+bool ReadLength (const uint8_t *input, SizeType size, SizeType &position, SizeType &length)
+{
+    uint8_t byte;
+
+    do {
+        if (position == size)
+            return false;
+
+        byte = input[position++];
+        length += byte;
+    } while (byte == 255);
+
+    return true;
+}
+}
+
+constexpr SizeType PageCompressor::kMaxInputSize;
+constexpr SizeType PageCompressor::kMinInputSize;
+constexpr SizeType PageCompressor::kMinSavingsRatio;
+constexpr SizeType PageCompressor::kMaxSkippedPages;
+constexpr SizeType PageCompressor::kHashBits;
+
+PageCompressor::PageCompressor()
+{
+}
+
+Base::Vector<uint8_t> PageCompressor::compress(const Base::Vector<uint8_t> &data)
+{
+    if (data.size () < kMinInputSize)
+        return {};
+
+    if (mSkipped < mSkipLength) {
+        ++mSkipped;
+        gSkippedPages.add ();
+        return {};
+    }
+
+    mSkipped = 0;
+
+    ZQ_ASSERT (data.size () <= kMaxInputSize);
+
+    // Only worth it if it saves at least 1/kMinSavingsRatio.
+    Base::Vector<uint8_t> compressed;
+    compressed.resize (data.size () - data.size () / kMinSavingsRatio);
+
+    auto size = compressBlock (data.data (), data.size (), compressed.data (), compressed.size ());
+
+    if (size == 0) {
+        mSkipLength = mSkipLength == 0 ? 1 : mSkipLength * 2;
+        if (mSkipLength > kMaxSkippedPages)
+            mSkipLength = kMaxSkippedPages;
+
+        gIncompressiblePages.add ();
+        return {};
+    }
+
+    mSkipLength = 0;
+
+    gCompressedPages.add ();
+    gSavedBytes.add (data.size () - size);
+
+    compressed.shrinkWithoutFree (compressed.size () - size);
+    return compressed;
+}
+
+SizeType PageCompressor::compressBlock(const uint8_t *input, SizeType size, uint8_t *output, SizeType capacity)
+{
+    uint8_t *out = output;
+    uint8_t *outEnd = output + capacity;
+    SizeType anchor = 0;
+
+    auto hash = [](uint32_t sequence) {
+        return (sequence * 2654435761u) >> (32 - kHashBits);
+    };
+
+    // Write the literals since the anchor and a match (if matchLength != 0).
+    auto writeSequence = [&](SizeType literals, SizeType offset, SizeType matchLength) {
+        if (static_cast<SizeType>(outEnd - out) < SequenceSize (literals))
+            return false;
+
+        uint8_t *token = out++;
+        *token = static_cast<uint8_t>((literals >= 15 ? 15 : literals) << 4);
+
+        if (literals >= 15)
+            out = WriteLength (out, literals - 15);
+
+        memcpy (out, input + anchor, literals);
+        out += literals;
+
+        if (matchLength == 0)
+            return true;
+
+        *out++ = static_cast<uint8_t>(offset);
+        *out++ = static_cast<uint8_t>(offset >> 8);
+
+        matchLength -= kMinMatch;
+        *token |= static_cast<uint8_t>(matchLength >= 15 ? 15 : matchLength);
+
+        if (matchLength >= 15) {
+            if (static_cast<SizeType>(outEnd - out) < matchLength / 255 + 1)
+                return false;
+
+            out = WriteLength (out, matchLength - 15);
+        }
+
+        return true;
+    };
+
+    if (size > kMatchLimit) {
+        memset (mTable, 0, sizeof (mTable));
+
+        SizeType position = 1;
+        SizeType misses = 0;
+
+        mTable[hash (Read32 (input))] = 0;
+
+        while (position + kMatchLimit < size) {
+            auto sequence = Read32 (input + position);
+            auto &slot = mTable[hash (sequence)];
+            SizeType candidate = slot;
+
+            slot = static_cast<uint16_t>(position);
+
+            if (candidate >= position
+                || position - candidate > kMaxOffset
+                || Read32 (input + candidate) != sequence) {
+                // Skip faster through data that doesn't match.
+                position += 1 + (misses++ >> 6);
+                continue;
+            }
+
+            misses = 0;
+
+            // Extend backwards, into the literals.
+            while (position > anchor && candidate > 0 && input[position - 1] == input[candidate - 1]) {
+                --position;
+                --candidate;
+            }
+
+            SizeType length = kMinMatch;
+            while (position + length < size - kLastLiterals && input[candidate + length] == input[position + length])
+                ++length;
+
+            if (! writeSequence (position - anchor, position - candidate, length))
+                return 0;
+
+            position += length;
+            anchor = position;
+
+            if (position + kMatchLimit < size)
+                mTable[hash (Read32 (input + position - 2))] = static_cast<uint16_t>(position - 2);
+        }
+    }
+
+    if (! writeSequence (size - anchor, 0, 0))
+        return 0;
+
+    return static_cast<SizeType>(out - output);
+}
+
+bool PageCompressor::Decompress(const uint8_t *input, SizeType size, uint8_t *output, SizeType outputSize)
+{
+    SizeType position = 0;
+    SizeType outputPosition = 0;
+
+    while (position < size) {
+        uint8_t token = input[position++];
+        SizeType literals = token >> 4;
+
+        if (literals == 15 && ! ReadLength (input, size, position, literals))
+            return false;
+
+        if (literals > size - position || literals > outputSize - outputPosition)
+            return false;
+
+        memcpy (output + outputPosition, input + position, literals);
+        position += literals;
+        outputPosition += literals;
+
+        // The last sequence has no match.
+        if (position == size)
+            break;
+
+        if (size - position < 2)
+            return false;
+
+        SizeType offset = input[position] | (SizeType{input[position + 1]} << 8);
+        position += 2;
+
+        if (offset == 0 || offset > outputPosition)
+            return false;
+
+        SizeType length = token & 15;
+        if (length == 15 && ! ReadLength (input, size, position, length))
+            return false;
+
+        length += kMinMatch;
+        if (length > outputSize - outputPosition)
+            return false;
+
+        // The match may overlap the output, byte by byte.
+        for (SizeType i = 0; i < length; ++i, ++outputPosition)
+            output[outputPosition] = output[outputPosition - offset];
+    }
+
+    return outputPosition == outputSize;
+}
+
+} // namespace Ziqe
+} // namespace Protocol
@@ -0,0 +1,95 @@
+/**
+ * @file PageCompressor.hpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2016 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ZIQE_PAGECOMPRESSOR_H
+#define ZIQE_PAGECOMPRESSOR_H
+
+#include "Base/Types.hpp"
+#include "Base/Vector.hpp"
+
+#include "CppCore/Types.h"
+
+namespace Ziqe {
+namespace Protocol {
+
+/**
+ * @brief A fast compressor for the pages (and page diffs) sent to peers.
+ *
+ * The output is an LZ4 block (greedy matching with a small hash table),
+ * so it runs in the kernel and in usermode without external code.
+ * Compression is decided per page: a page that doesn't get at least
+ * 1/kMinSavingsRatio smaller is sent raw, and after such a page the
+ * following ones aren't tried (twice as many every time, up to
+ * kMaxSkippedPages), so incompressible data costs almost nothing.
+ *
+ * @note Not thread safe.
+ */
+class PageCompressor
+{
+public:
+    /// How a payload is sent.
+    enum class Encoding : uint8_t {
+        Raw = 0,
+        Lz4 = 1
+    };
+
+    /// The largest payload: match offsets are 16 bit.
+    static constexpr SizeType kMaxInputSize = 0xffff;
+
+    /// Smaller payloads (short diffs) are always sent raw.
+    static constexpr SizeType kMinInputSize = 64;
+
+    static constexpr SizeType kMinSavingsRatio = 8;
+    static constexpr SizeType kMaxSkippedPages = 64;
+
+    PageCompressor();
+
+    ZQ_ALLOW_COPY_AND_MOVE (PageCompressor)
+
+    /**
+     * @return The compressed @a data, or an empty vector if it should be
+     *         sent raw.
+     */
+    Base::Vector<uint8_t> compress (const Base::Vector<uint8_t> &data);
+
+    /**
+     * @brief Decompress an LZ4 block of @a size bytes to exactly
+     *        @a outputSize bytes. Safe for blocks received from a peer.
+     * @return false if the block is malformed.
+     */
+    static bool Decompress (const uint8_t *input, SizeType size, uint8_t *output, SizeType outputSize);
+
+private:
+    static constexpr SizeType kHashBits = 10;
+
+    /// @return The compressed size, or 0 if it doesn't fit in @a capacity.
+    SizeType compressBlock (const uint8_t *input, SizeType size, uint8_t *output, SizeType capacity);
+
+    /// The last position of every hashed 4 bytes.
+    uint16_t mTable[1 << kHashBits];
+
+    /// Raw pages to send before trying again.
+    SizeType mSkipLength = 0;
+    SizeType mSkipped = 0;
+};
+
+} // namespace Ziqe
+} // namespace Protocol
+
+#endif // ZIQE_PAGECOMPRESSOR_H
@@ -23,10 +23,16 @@ namespace Ziqe {
 namespace Protocol {
 
 ThreadState::ThreadState()
+    : mRegisters{}
 {
 
 }
 
+ThreadState::ThreadState(const ZqThreadRegisters &registers)
+    : mRegisters(registers)
+{
+}
+
 void ThreadState::writeToMessage(Message &message) const
 {
 
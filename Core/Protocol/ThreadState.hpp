@@ -31,16 +31,109 @@ namespace Protocol {
 class ThreadState : public Object
 {
 public:
+    /// The registers are sent as 64 bit words.
+    typedef uint64_t WordType;
+    static constexpr SizeType kWordsCount = sizeof (ZqThreadRegisters) / sizeof (ZqRegisterType);
+
     ThreadState();
+    explicit ThreadState(const ZqThreadRegisters &registers);
 
     static ThreadState fromMessage (Message &message);
 
     virtual void writeToMessage (Message &message) const override;
 
+    const ZqThreadRegisters &getRegisters () const
+    {
+        return mRegisters;
+    }
+
+    template<class ReaderType>
+    static Base::Expected<ThreadState, Message::ParseError> ReadFrom(ReaderType &reader) {
+        if (! reader.template canReadVectorT<WordType>(kWordsCount))
+            return Base::Error (Message::ParseError::TooShort);
+
+        ThreadState state;
+        auto words = reinterpret_cast<ZqRegisterType *>(&state.mRegisters);
+
+        for (SizeType i = 0; i < kWordsCount; ++i)
+            words[i] = static_cast<ZqRegisterType>(reader.template readT<WordType>());
+
+        return {Base::move (state)};
+    }
+
+    template<class WriterType>
+    void writeToWriter (WriterType &writer) const
+    {
+        auto words = reinterpret_cast<const ZqRegisterType *>(&mRegisters);
+
+        for (SizeType i = 0; i < kWordsCount; ++i)
+            writer.writeT (static_cast<WordType>(words[i]));
+    }
+
+    SizeType writableSize () const
+    {
+        return kWordsCount * sizeof (WordType);
+    }
+
 private:
     ZqThreadRegisters mRegisters;
 };
 
+/**
+ * @brief A stopped thread's state and the pages it wrote last (MigrateThread).
+ */
+class MessageWithThreadState : public MessageWithPageAddresses {
+public:
+    MessageWithThreadState(MessageType type,
+                           HostedThreadID thread,
+                           Base::Vector<AddressType> &&pages,
+                           ThreadState &&state)
+        : MessageWithPageAddresses{type, thread, Base::move (pages)}, mState{Base::move (state)}
+    {
+    }
+
+    const ThreadState &getState () const
+    {
+        return mState;
+    }
+
+    template<class ReaderType>
+    static Base::Expected<MessageWithThreadState, Message::ParseError> ReadFrom(MessageType type,
+                                                                                ReaderType &reader) {
+        auto pages = MessageWithPageAddresses::ReadFrom (type, reader);
+        if (! pages)
+            return Base::Error (Base::move (pages.getError ()));
+
+        auto state = ThreadState::ReadFrom (reader);
+        if (! state)
+            return Base::Error (Base::move (state.getError ()));
+
+        return {MessageWithThreadState{Base::move (*pages), Base::move (*state)}};
+    }
+
+    template<class WriterType>
+    void writeToWriter (WriterType &writer) const
+    {
+        MessageWithPageAddresses::writeToWriter (writer);
+        writer.writeT (mState);
+    }
+
+    SizeType writableSize () const
+    {
+        return MessageWithPageAddresses::writableSize () + mState.writableSize ();
+    }
+
+private:
+    MessageWithThreadState(MessageWithPageAddresses &&pages, ThreadState &&state)
+        : MessageWithPageAddresses{Base::move (pages)}, mState{Base::move (state)}
+    {
+    }
+
+    ThreadState mState;
+};
+
+typedef MessageWithType<Message::Type::MigrateThread, MessageWithThreadState> MigrateThreadMessage;
+
 } // namespace Ziqe
 } // namespace Protocol
 
@@ -0,0 +1,653 @@
+/**
+ * @file DirtyTracking.cpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2017 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "CppCore/DirtyTracking.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/userfaultfd.h>
+
+// Linux 6.4, write protect also the pages that weren't faulted in yet.
+#ifndef UFFD_FEATURE_WP_UNPOPULATED
+# define UFFD_FEATURE_WP_UNPOPULATED (1 << 13)
+#endif
+
+namespace {
+
+constexpr uint64_t kPagemapSoftDirty = 1ull << 55;
+constexpr uint64_t kPagemapFilePage  = 1ull << 61;
+constexpr uint64_t kPagemapSwapped   = 1ull << 62;
+constexpr uint64_t kPagemapPresent   = 1ull << 63;
+
+constexpr size_t kPagemapBatch = 512;
+constexpr size_t kHandlerStackSize = 64 * 1024;
+constexpr size_t kMessagesBatch = 16;
+
+struct Range {
+    uintptr_t begin;
+    uintptr_t end;
+
+    // Tracked by userfaultfd, by the soft-dirty bits otherwise.
+    bool isWriteProtected;
+};
+
+/*
+ * The pages written in a single epoch, written only by the handler thread.
+ * Everything the handler writes lives in untracked mappings: a write
+ * protected page there would block the handler on itself.
+ */
+struct Epoch {
+    std::atomic<bool> closing;
+    std::atomic<bool> overflowed;
+
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> carriedCount;
+    uint64_t capacity;
+
+    size_t mappingSize;
+
+    uintptr_t *addresses;
+
+    // Pages recorded while the epoch was closing. They might have been made
+    // writable after the new epoch write protected them, so they are
+    // reported again in the next epoch.
+    uintptr_t *carried;
+};
+
+struct Tracker {
+    size_t pageSize;
+
+    int userfaultFd = -1;
+    int stopFd = -1;
+    int pagemapFd = -1;
+    int clearRefsFd = -1;
+
+    void *handlerStack = nullptr;
+    pthread_t handler;
+    bool isHandlerRunning = false;
+
+    std::atomic<Epoch *> current{nullptr};
+
+    // The epoch the handler is recording to, null while idle.
+    std::atomic<Epoch *> active{nullptr};
+
+    // The tracked ranges, sorted. Used only by ZqDirtyTrackerCollect.
+    std::vector<Range> ranges;
+};
+
+// Shared mappings are never tracked.
+void *mapUntracked (size_t size)
+{
+    void *address = ::mmap (nullptr, size,
+                            PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE,
+                            -1, 0);
+
+    return address == MAP_FAILED ? nullptr : address;
+}
+
+Epoch *createEpoch (Tracker *tracker, uint64_t capacity)
+{
+    size_t size = sizeof (Epoch) + 2 * capacity * sizeof (uintptr_t);
+
+    size = (size + tracker->pageSize - 1) & ~(tracker->pageSize - 1);
+
+    void *mapping = mapUntracked (size);
+    if (mapping == nullptr)
+        return nullptr;
+
+    auto epoch = new (mapping) Epoch;
+
+    epoch->closing.store (false);
+    epoch->overflowed.store (false);
+    epoch->count.store (0);
+    epoch->carriedCount.store (0);
+    epoch->capacity = capacity;
+    epoch->mappingSize = size;
+    epoch->addresses = reinterpret_cast<uintptr_t *>(epoch + 1);
+    epoch->carried = epoch->addresses + capacity;
+
+    return epoch;
+}
+
+void destroyEpoch (Epoch *epoch)
+{
+    if (epoch == nullptr)
+        return;
+
+    size_t size = epoch->mappingSize;
+
+    epoch->~Epoch ();
+    ::munmap (epoch, size);
+}
+
+void appendAddress (std::atomic<uint64_t> &count,
+                    uintptr_t *addresses,
+                    Epoch *epoch,
+                    uintptr_t address)
+{
+    uint64_t index = count.fetch_add (1);
+
+    if (index < epoch->capacity)
+        addresses[index] = address;
+    else
+        epoch->overflowed.store (true);
+}
+
+Epoch *getActiveEpoch (Tracker *tracker)
+{
+    Epoch *epoch;
+
+    // Publish the epoch before using it, so Collect can wait for us.
+    do {
+        epoch = tracker->current.load ();
+        tracker->active.store (epoch);
+    } while (tracker->current.load () != epoch);
+
+    return epoch;
+}
+
+bool setWriteProtection (Tracker *tracker, uintptr_t begin, uintptr_t end, bool isProtected)
+{
+    struct uffdio_writeprotect writeProtect;
+
+    writeProtect.range.start = begin;
+    writeProtect.range.len = end - begin;
+    writeProtect.mode = isProtected ? UFFDIO_WRITEPROTECT_MODE_WP : 0;
+
+    return ::ioctl (tracker->userfaultFd, UFFDIO_WRITEPROTECT, &writeProtect) == 0;
+}
+
+// File backed private mappings can't be registered.
+bool registerRange (Tracker *tracker, const Range &range)
+{
+    struct uffdio_register registration;
+
+    registration.range.start = range.begin;
+    registration.range.len = range.end - range.begin;
+    registration.mode = UFFDIO_REGISTER_MODE_WP;
+
+    return ::ioctl (tracker->userfaultFd, UFFDIO_REGISTER, &registration) == 0;
+}
+
+void onWriteFault (Tracker *tracker, uintptr_t address)
+{
+    uintptr_t page = address & ~(tracker->pageSize - 1);
+    Epoch *epoch = getActiveEpoch (tracker);
+
+    appendAddress (epoch->count, epoch->addresses, epoch, page);
+
+    // Let the writer continue.
+    setWriteProtection (tracker, page, page + tracker->pageSize, false);
+
+    // Collect sets closing before write protecting again: if we don't see
+    // it, the page will be protected after our write enable.
+    if (epoch->closing.load ())
+        appendAddress (epoch->carriedCount, epoch->carried, epoch, page);
+
+    tracker->active.store (nullptr);
+}
+
+// Runs on an untracked stack and writes only untracked memory, see Epoch.
+void *handlerThreadFunction (void *context)
+{
+    auto tracker = static_cast<Tracker *>(context);
+    struct uffd_msg messages[kMessagesBatch];
+    struct pollfd fds[2];
+
+    fds[0].fd = tracker->userfaultFd;
+    fds[0].events = POLLIN;
+    fds[1].fd = tracker->stopFd;
+    fds[1].events = POLLIN;
+
+    while (true) {
+        if (::poll (fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+
+            break;
+        }
+
+        if (fds[1].revents != 0)
+            break;
+
+        ssize_t length = ::read (tracker->userfaultFd, messages, sizeof (messages));
+        if (length <= 0)
+            continue;
+
+        for (size_t i = 0; i < length / sizeof (messages[0]); ++i) {
+            const auto &message = messages[i];
+
+            if (message.event == UFFD_EVENT_PAGEFAULT
+                && (message.arg.pagefault.flags & UFFD_PAGEFAULT_FLAG_WP))
+                onWriteFault (tracker, message.arg.pagefault.address);
+        }
+    }
+
+    return nullptr;
+}
+
+bool initializeUserfaultfd (Tracker *tracker)
+{
+    struct uffdio_api api;
+
+    tracker->userfaultFd = static_cast<int>(::syscall (SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK));
+    if (tracker->userfaultFd < 0)
+        return false;
+
+    api.api = UFFD_API;
+    api.features = UFFD_FEATURE_PAGEFAULT_FLAG_WP | UFFD_FEATURE_WP_UNPOPULATED;
+    if (::ioctl (tracker->userfaultFd, UFFDIO_API, &api) != 0)
+        return false;
+
+    tracker->stopFd = ::eventfd (0, EFD_CLOEXEC);
+    if (tracker->stopFd < 0)
+        return false;
+
+    tracker->current.store (createEpoch (tracker, 0));
+    tracker->handlerStack = mapUntracked (kHandlerStackSize);
+    if (tracker->current.load () == nullptr || tracker->handlerStack == nullptr)
+        return false;
+
+    pthread_attr_t attributes;
+    ::pthread_attr_init (&attributes);
+    ::pthread_attr_setstack (&attributes, tracker->handlerStack, kHandlerStackSize);
+
+    tracker->isHandlerRunning = ::pthread_create (&tracker->handler,
+                                                  &attributes,
+                                                  handlerThreadFunction,
+                                                  tracker) == 0;
+
+    ::pthread_attr_destroy (&attributes);
+
+    return tracker->isHandlerRunning;
+}
+
+bool clearSoftDirty (Tracker *tracker)
+{
+    return ::pwrite (tracker->clearRefsFd, "4", 1, 0) == 1;
+}
+
+// Without CONFIG_MEM_SOFT_DIRTY clear_refs accepts "4" but the bit is never set.
+bool isSoftDirtySupported (Tracker *tracker)
+{
+    volatile uint64_t probe = 0;
+    uint64_t entry;
+
+    if (! clearSoftDirty (tracker))
+        return false;
+
+    probe = 1;
+
+    off_t offset = static_cast<off_t>(reinterpret_cast<uintptr_t>(&probe) / tracker->pageSize
+                                      * sizeof (uint64_t));
+    if (::pread (tracker->pagemapFd, &entry, sizeof (entry), offset) != sizeof (entry))
+        return false;
+
+    return probe == 1 && (entry & kPagemapSoftDirty) != 0;
+}
+
+bool isTracked (uint64_t entry)
+{
+    // Private file pages that were never copied on write can't be dirty.
+    return (entry & (kPagemapPresent | kPagemapSwapped)) != 0
+            && (entry & kPagemapFilePage) == 0;
+}
+
+/*
+ * Call @a callback with every page in [begin, end) that is soft-dirty
+ * (@a flag is kPagemapSoftDirty) or that might have been written at all
+ * (@a flag is kPagemapPresent).
+ */
+ZqError reportPages (Tracker *tracker,
+                     uintptr_t begin,
+                     uintptr_t end,
+                     uint64_t flag,
+                     ZqDirtyPageCallback callback,
+                     void *context)
+{
+    uint64_t entries[kPagemapBatch];
+
+    for (uintptr_t address = begin; address < end; ) {
+        size_t count = std::min<size_t> (kPagemapBatch, (end - address) / tracker->pageSize);
+        off_t offset = static_cast<off_t>(address / tracker->pageSize * sizeof (uint64_t));
+        ssize_t length = ::pread (tracker->pagemapFd, entries, count * sizeof (uint64_t), offset);
+
+        if (length < 0)
+            return errno;
+
+        // Unmapped in the middle.
+        if (length == 0)
+            break;
+
+        count = static_cast<size_t>(length) / sizeof (uint64_t);
+        for (size_t i = 0; i < count; ++i, address += tracker->pageSize) {
+            bool isDirty = flag == kPagemapSoftDirty ? (entries[i] & kPagemapSoftDirty) != 0
+                                                      : isTracked (entries[i]);
+
+            if (isDirty)
+                callback (context, reinterpret_cast<ZqUserAddress>(address));
+        }
+    }
+
+    return ZQ_E_OK;
+}
+
+/*
+ * Read the private writable mappings from /proc/self/maps.
+ */
+ZqError readWritableRanges (std::vector<Range> &ranges)
+{
+    FILE *maps = ::fopen ("/proc/self/maps", "re");
+    char line[512];
+
+    if (maps == nullptr)
+        return errno;
+
+    ranges.clear ();
+
+    while (::fgets (line, sizeof (line), maps) != nullptr) {
+        unsigned long begin, end;
+        char permissions[5];
+
+        if (::sscanf (line, "%lx-%lx %4s", &begin, &end, permissions) != 3)
+            continue;
+
+        if (permissions[1] == 'w' && permissions[3] == 'p')
+            ranges.push_back ({begin, end, false});
+    }
+
+    ::fclose (maps);
+
+    return ZQ_E_OK;
+}
+
+/*
+ * Split @a ranges on the boundaries of @a previousRanges, so every range
+ * is either known (and keeps its backend) or new. New ranges are
+ * registered to the userfaultfd, the ones that can't be use the soft-dirty
+ * bits.
+ *
+ * A known range might be a new mapping at the same addresses, which isn't
+ * registered: ZqDirtyTrackerCollect finds it when write protecting it fails.
+ */
+void mergeRanges (Tracker *tracker,
+                  const std::vector<Range> &previousRanges,
+                  std::vector<Range> &ranges,
+                  std::vector<Range> &newRanges)
+{
+    std::vector<Range> splitRanges;
+    auto previous = previousRanges.begin ();
+
+    newRanges.clear ();
+
+    for (auto range : ranges) {
+        while (previous != previousRanges.end () && previous->end <= range.begin)
+            ++previous;
+
+        for (auto known = previous;
+             range.begin < range.end && known != previousRanges.end () && known->begin < range.end;
+             ++known) {
+            if (range.begin < known->begin) {
+                newRanges.push_back ({range.begin, known->begin, false});
+                range.begin = known->begin;
+            }
+
+            uintptr_t end = std::min (range.end, known->end);
+            splitRanges.push_back ({range.begin, end, known->isWriteProtected});
+            range.begin = end;
+        }
+
+        if (range.begin < range.end)
+            newRanges.push_back (range);
+    }
+
+    for (auto &range : newRanges) {
+        range.isWriteProtected = tracker->userfaultFd >= 0 && registerRange (tracker, range);
+        splitRanges.push_back (range);
+    }
+
+    std::sort (splitRanges.begin (), splitRanges.end (), [] (const Range &a, const Range &b) {
+        return a.begin < b.begin;
+    });
+
+    ranges.swap (splitRanges);
+}
+
+void destroyTracker (Tracker *tracker)
+{
+    // Unprotect first: the handler's exit (TLS, stack cache) writes to
+    // tracked memory.
+    if (tracker->userfaultFd >= 0) {
+        for (const auto &range : tracker->ranges) {
+            struct uffdio_range unregistration;
+
+            if (! range.isWriteProtected)
+                continue;
+
+            setWriteProtection (tracker, range.begin, range.end, false);
+
+            unregistration.start = range.begin;
+            unregistration.len = range.end - range.begin;
+            ::ioctl (tracker->userfaultFd, UFFDIO_UNREGISTER, &unregistration);
+        }
+    }
+
+    if (tracker->isHandlerRunning) {
+        uint64_t value = 1;
+
+        if (::write (tracker->stopFd, &value, sizeof (value)) == sizeof (value))
+            ::pthread_join (tracker->handler, nullptr);
+    }
+
+    for (int fd : {tracker->userfaultFd, tracker->stopFd, tracker->pagemapFd, tracker->clearRefsFd}) {
+        if (fd >= 0)
+            ::close (fd);
+    }
+
+    destroyEpoch (tracker->current.load ());
+
+    if (tracker->handlerStack != nullptr)
+        ::munmap (tracker->handlerStack, kHandlerStackSize);
+
+    tracker->~Tracker ();
+    ::munmap (tracker, sizeof (Tracker));
+}
+
+} // namespace
+
+ZqError ZQ_SYMBOL(ZqDirtyTrackerInit) (ZqDirtyTracker *tracker)
+{
+    void *mapping = mapUntracked (sizeof (Tracker));
+    if (mapping == nullptr)
+        return ZQ_E_NO_MEMORY;
+
+    auto newTracker = new (mapping) Tracker;
+
+    newTracker->pageSize = static_cast<size_t>(::sysconf (_SC_PAGESIZE));
+    newTracker->pagemapFd = ::open ("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+    newTracker->clearRefsFd = ::open ("/proc/self/clear_refs", O_WRONLY | O_CLOEXEC);
+
+    if (newTracker->clearRefsFd >= 0
+        && (newTracker->pagemapFd < 0 || ! isSoftDirtySupported (newTracker))) {
+        ::close (newTracker->clearRefsFd);
+        newTracker->clearRefsFd = -1;
+    }
+
+    if (! initializeUserfaultfd (newTracker)) {
+        // The soft-dirty bits are the only backend now.
+        if (newTracker->userfaultFd >= 0)
+            ::close (newTracker->userfaultFd);
+        if (newTracker->stopFd >= 0)
+            ::close (newTracker->stopFd);
+
+        destroyEpoch (newTracker->current.load ());
+        newTracker->current.store (nullptr);
+
+        newTracker->userfaultFd = -1;
+        newTracker->stopFd = -1;
+    }
+
+    if (newTracker->pagemapFd < 0
+        || (newTracker->userfaultFd < 0 && newTracker->clearRefsFd < 0)) {
+        destroyTracker (newTracker);
+        return ZQ_E_NOT_SUPPORTED;
+    }
+
+    tracker->_pTracker = newTracker;
+
+    // Start the first epoch: register and protect the current memory.
+    return ZQ_SYMBOL(ZqDirtyTrackerCollect) (tracker, nullptr, nullptr);
+}
+
+void *ZQ_SYMBOL(ZqDirtyTrackerAllocatePages) (size_t size)
+{
+    return mapUntracked (size);
+}
+
+void ZQ_SYMBOL(ZqDirtyTrackerDeallocatePages) (void *address, size_t size)
+{
+    ::munmap (address, size);
+}
+
+void ZQ_SYMBOL(ZqDirtyTrackerDestroy) (ZqDirtyTracker *tracker)
+{
+    destroyTracker (static_cast<Tracker *>(tracker->_pTracker));
+    tracker->_pTracker = nullptr;
+}
+
+ZqError ZQ_SYMBOL(ZqDirtyTrackerCollect) (ZqDirtyTracker *dirtyTracker,
+                                          ZqDirtyPageCallback callback,
+                                          void *context)
+{
+    auto tracker = static_cast<Tracker *>(dirtyTracker->_pTracker);
+    bool isUsingUserfaultfd = tracker->userfaultFd >= 0;
+    std::vector<Range> previousRanges{tracker->ranges};
+    std::vector<Range> newRanges;
+    Epoch *previousEpoch = tracker->current.load ();
+    Epoch *nextEpoch = nullptr;
+    ZqError result;
+
+    result = readWritableRanges (tracker->ranges);
+    if (result != ZQ_E_OK)
+        return result;
+
+    mergeRanges (tracker, previousRanges, tracker->ranges, newRanges);
+
+    if (isUsingUserfaultfd) {
+        uint64_t capacity = 0;
+
+        for (const auto &range : tracker->ranges) {
+            if (range.isWriteProtected)
+                capacity += (range.end - range.begin) / tracker->pageSize;
+        }
+
+        nextEpoch = createEpoch (tracker, capacity);
+        if (nextEpoch == nullptr)
+            return ZQ_E_NO_MEMORY;
+
+        // From here, a page that is made writable is carried to the next epoch.
+        previousEpoch->closing.store (true);
+
+        for (auto &range : tracker->ranges) {
+            if (! range.isWriteProtected
+                || setWriteProtection (tracker, range.begin, range.end, true))
+                continue;
+
+            // Unregistered (ENOENT): unmapped and mapped again since it was
+            // registered. Its writes were never seen, it is reported as new.
+            range.isWriteProtected = errno == ENOENT
+                    && registerRange (tracker, range)
+                    && setWriteProtection (tracker, range.begin, range.end, true);
+
+            newRanges.push_back (range);
+        }
+
+        tracker->current.store (nextEpoch);
+
+        while (tracker->active.load () == previousEpoch)
+            ::sched_yield ();
+
+        uint64_t carriedCount = std::min (previousEpoch->carriedCount.load (),
+                                          previousEpoch->capacity);
+        for (uint64_t i = 0; i < carriedCount; ++i)
+            appendAddress (nextEpoch->count, nextEpoch->addresses, nextEpoch, previousEpoch->carried[i]);
+    }
+
+    // Nothing to report when the first epoch starts.
+    if (callback == nullptr) {
+        if (tracker->clearRefsFd >= 0)
+            clearSoftDirty (tracker);
+
+        destroyEpoch (previousEpoch);
+        return ZQ_E_OK;
+    }
+
+    // Report the previous epoch.
+    if (isUsingUserfaultfd && ! previousEpoch->overflowed.load ()) {
+        uint64_t count = previousEpoch->count.load ();
+
+        for (uint64_t i = 0; i < count; ++i)
+            callback (context, reinterpret_cast<ZqUserAddress>(previousEpoch->addresses[i]));
+    }
+
+    for (const auto &range : tracker->ranges) {
+        bool isNew = std::any_of (newRanges.begin (), newRanges.end (), [&range] (const Range &newRange) {
+            return newRange.begin == range.begin;
+        });
+
+        if (isNew) {
+            // We don't know what have been written before the range was tracked.
+            result = reportPages (tracker, range.begin, range.end, kPagemapPresent, callback, context);
+        } else if (range.isWriteProtected) {
+            if (! previousEpoch->overflowed.load ())
+                continue;
+
+            result = reportPages (tracker, range.begin, range.end, kPagemapPresent, callback, context);
+        } else if (tracker->clearRefsFd >= 0) {
+            result = reportPages (tracker, range.begin, range.end, kPagemapSoftDirty, callback, context);
+        } else {
+            result = reportPages (tracker, range.begin, range.end, kPagemapPresent, callback, context);
+        }
+
+        if (result != ZQ_E_OK)
+            break;
+    }
+
+    if (tracker->clearRefsFd >= 0)
+        clearSoftDirty (tracker);
+
+    destroyEpoch (previousEpoch);
+
+    return result;
+}
@@ -0,0 +1,81 @@
+/**
+ * @file DirtyTracking.h
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2017 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef DIRTYTRACKING_H
+#define DIRTYTRACKING_H
+
+#include "CppCore/Macros.h"
+#include "CppCore/Types.h"
+#include "CppCore/Error.h"
+#include "CppCore/Memory.h"
+
+/**
+  @brief Track the pages the current process writes to, an epoch at a time.
+
+  Two backends are used, the first one that works:
+  - userfaultfd in write protect mode (Linux 6.4+, needs
+    vm.unprivileged_userfaultfd or CAP_SYS_PTRACE): at the start of every
+    epoch the private writable memory is write protected, and a handler
+    thread records the first write to every page and lets it continue.
+  - The soft-dirty bits of /proc/self/pagemap. Writes that race with
+    ZqDirtyTrackerCollect might be lost, so the writers should be stopped
+    while collecting.
+
+  Like the kernel tracker, only private writable mappings are tracked, and
+  mappings created after ZqDirtyTrackerInit are picked up (with all their
+  present pages reported as dirty) by the next ZqDirtyTrackerCollect.
+ */
+typedef struct {
+    // _private
+    void *_pTracker;
+} ZqDirtyTracker;
+
+typedef void (*ZqDirtyPageCallback) (void *context, ZqUserAddress address);
+
+/**
+   @brief Start tracking the current process.
+   @return ZQ_E_OK on success, ZQ_E_NOT_SUPPORTED if no backend is available.
+ */
+ZqError ZQ_SYMBOL(ZqDirtyTrackerInit) (ZqDirtyTracker *tracker);
+
+/**
+   @brief Stop tracking and remove the write protection.
+ */
+void ZQ_SYMBOL(ZqDirtyTrackerDestroy) (ZqDirtyTracker *tracker);
+
+/**
+   @brief Allocate page aligned memory that is never tracked (a shared
+          mapping), for copies of the tracked pages.
+   @return nullptr on failure.
+ */
+void *ZQ_SYMBOL(ZqDirtyTrackerAllocatePages) (size_t size);
+
+void ZQ_SYMBOL(ZqDirtyTrackerDeallocatePages) (void *address, size_t size);
+
+/**
+   @brief End the current epoch and start a new one.
+
+   @a callback is called (without any lock held) once for every page that
+   has been written since the previous call.
+ */
+ZqError ZQ_SYMBOL(ZqDirtyTrackerCollect) (ZqDirtyTracker *tracker,
+                                          ZqDirtyPageCallback callback,
+                                          void *context);
+
+#endif // DIRTYTRACKING_H
@@ -0,0 +1,245 @@
+/**
+ * @file LogBuffer.cpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2017 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "CppCore/LogBuffer.h"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+
+#include <sched.h>
+#include <time.h>
+
+namespace {
+
+// Records per ring, must be a power of two.
+constexpr uint64_t kRingSize = 1024;
+constexpr uint64_t kRingMask = kRingSize - 1;
+
+// Threads are mapped to rings by their current CPU.
+constexpr unsigned kRingsCount = 64;
+
+constexpr auto kDrainInterval = std::chrono::milliseconds (100);
+
+struct alignas(64) LogRing {
+    std::atomic<uint64_t> head{0};
+    uint64_t tail = 0;
+    std::atomic<uint64_t> dropped{0};
+
+    ZqLogRecord records[kRingSize];
+};
+
+const char *const kLevelNames[] = {"D", "I", "W", "E"};
+
+LogRing *gRings = nullptr;
+std::atomic<bool> gIsInitialized{false};
+
+FILE *gOutput = nullptr;
+std::thread gDrainThread;
+std::mutex gDrainLock;
+std::condition_variable gDrainCondition;
+bool gShouldStop = false;
+
+uint64_t currentTimestamp ()
+{
+    struct timespec now;
+
+    ::clock_gettime (CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ull + now.tv_nsec;
+}
+
+uint32_t currentCpu ()
+{
+    int cpu = ::sched_getcpu ();
+
+    return cpu < 0 ? 0 : static_cast<uint32_t>(cpu);
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+void printRecord (FILE *output, const ZqLogRecord &record)
+{
+    ::fprintf (output, "[%5llu.%06llu] %u %s %s: ",
+               static_cast<unsigned long long>(record.timestamp / 1000000000ull),
+               static_cast<unsigned long long>((record.timestamp % 1000000000ull) / 1000),
+               record.cpu,
+               kLevelNames[record.level & 3],
+               record.location);
+    ::fprintf (output, record.format,
+               record.arguments[0],
+               record.arguments[1],
+               record.arguments[2],
+               record.arguments[3]);
+    ::fputc ('\n', output);
+}
+#pragma GCC diagnostic pop
+
+// Must be called with gDrainLock held.
+void drainRing (LogRing &ring, unsigned ringIndex)
+{
+    uint64_t head = ring.head.load (std::memory_order_acquire);
+
+    // Writers have lapped us, skip what have been overwritten.
+    if (head - ring.tail > kRingSize) {
+        ring.dropped.fetch_add (head - ring.tail - kRingSize, std::memory_order_relaxed);
+        ring.tail = head - kRingSize;
+    }
+
+    while (ring.tail != head) {
+        ZqLogRecord *slot = &ring.records[ring.tail & kRingMask];
+        uint64_t sequence = __atomic_load_n (&slot->sequence, __ATOMIC_ACQUIRE);
+
+        if (sequence != ring.tail + 1) {
+            // Still being written, we'll get it on the next drain.
+            if (sequence <= ring.tail)
+                break;
+
+            ring.dropped.fetch_add (1, std::memory_order_relaxed);
+            ++ring.tail;
+            continue;
+        }
+
+        ZqLogRecord record = *slot;
+
+        // Make sure the record hasn't been overwritten while we copied it.
+        std::atomic_thread_fence (std::memory_order_acquire);
+        if (__atomic_load_n (&slot->sequence, __ATOMIC_RELAXED) != sequence) {
+            ring.dropped.fetch_add (1, std::memory_order_relaxed);
+            ++ring.tail;
+            continue;
+        }
+
+        printRecord (gOutput, record);
+        ++ring.tail;
+    }
+
+    uint64_t dropped = ring.dropped.exchange (0, std::memory_order_relaxed);
+    if (dropped != 0)
+        ::fprintf (gOutput, "[ring %u: %llu records dropped]\n",
+                   ringIndex, static_cast<unsigned long long>(dropped));
+}
+
+// Must be called with gDrainLock held.
+void drainAll ()
+{
+    for (unsigned i = 0; i < kRingsCount; ++i)
+        drainRing (gRings[i], i);
+
+    ::fflush (gOutput);
+}
+
+void drainThreadFunction ()
+{
+    std::unique_lock<std::mutex> lock{gDrainLock};
+
+    while (! gShouldStop) {
+        drainAll ();
+
+        gDrainCondition.wait_for (lock, kDrainInterval);
+    }
+}
+
+} // namespace
+
+int ZQ_SYMBOL(ZqLogBufferInit) ()
+{
+    const char *path = ::getenv ("ZQ_LOG_FILE");
+
+    gOutput = ::fopen (path != nullptr ? path : "ziqe.log", "a");
+    if (gOutput == nullptr)
+        return errno;
+
+    gRings = new (std::nothrow) LogRing[kRingsCount];
+    if (gRings == nullptr) {
+        ::fclose (gOutput);
+        return ENOMEM;
+    }
+
+    gShouldStop = false;
+    gDrainThread = std::thread{drainThreadFunction};
+
+    gIsInitialized.store (true, std::memory_order_release);
+
+    return 0;
+}
+
+void ZQ_SYMBOL(ZqLogBufferExit) ()
+{
+    if (! gIsInitialized.exchange (false))
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock{gDrainLock};
+        gShouldStop = true;
+    }
+    gDrainCondition.notify_one ();
+    gDrainThread.join ();
+
+    // Unlike the kernel, we can't wait for writers that already saw
+    // gIsInitialized: the rings are intentionally leaked.
+    drainAll ();
+    ::fclose (gOutput);
+    gOutput = nullptr;
+}
+
+void ZQ_SYMBOL(ZqLogRecordWrite) (ZqLogLevel level,
+                                  const char *location,
+                                  const char *format,
+                                  uint64_t argument0,
+                                  uint64_t argument1,
+                                  uint64_t argument2,
+                                  uint64_t argument3)
+{
+    uint32_t cpu = currentCpu ();
+
+    if (! gIsInitialized.load (std::memory_order_acquire)) {
+        ZqLogRecord record{0, currentTimestamp (), location, format,
+                           {argument0, argument1, argument2, argument3},
+                           level, cpu};
+
+        printRecord (stdout, record);
+        return;
+    }
+
+    LogRing &ring = gRings[cpu % kRingsCount];
+    uint64_t index = ring.head.fetch_add (1, std::memory_order_relaxed);
+    ZqLogRecord *record = &ring.records[index & kRingMask];
+
+    // Mark the slot as being written before touching it.
+    __atomic_store_n (&record->sequence, 0, __ATOMIC_RELAXED);
+    std::atomic_thread_fence (std::memory_order_release);
+
+    record->timestamp    = currentTimestamp ();
+    record->location     = location;
+    record->format       = format;
+    record->arguments[0] = argument0;
+    record->arguments[1] = argument1;
+    record->arguments[2] = argument2;
+    record->arguments[3] = argument3;
+    record->level        = level;
+    record->cpu          = cpu;
+
+    // Commit.
+    __atomic_store_n (&record->sequence, index + 1, __ATOMIC_RELEASE);
+}
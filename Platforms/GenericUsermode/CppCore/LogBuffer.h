@@ -0,0 +1,75 @@
+/**
+ * @file LogBuffer.h
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2017 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LOGBUFFER_H
+#define LOGBUFFER_H
+
+#include "CppCore/Macros.h"
+#include "CppCore/Types.h"
+
+#define ZQ_LOG_LEVEL_DEBUG      (0)
+#define ZQ_LOG_LEVEL_INFO       (1)
+#define ZQ_LOG_LEVEL_WARNING    (2)
+#define ZQ_LOG_LEVEL_ERROR      (3)
+
+typedef uint32_t ZqLogLevel;
+
+#define ZQ_LOG_RECORD_MAX_ARGUMENTS (4)
+
+/**
+  @brief A binary log record, see the Linux LogBuffer.h.
+ */
+typedef struct {
+    uint64_t sequence;
+    uint64_t timestamp;
+
+    const char *location;
+    const char *format;
+    uint64_t arguments[ZQ_LOG_RECORD_MAX_ARGUMENTS];
+
+    ZqLogLevel level;
+    uint32_t cpu;
+} ZqLogRecord;
+
+/**
+   @brief Allocate the per-CPU rings and start the drain thread.
+   @return 0 on success, an errno otherwise.
+
+   The records are written to the file named by the ZQ_LOG_FILE
+   environment variable ("ziqe.log" by default).
+ */
+int ZQ_SYMBOL(ZqLogBufferInit) ();
+
+/**
+   @brief Drain the remaining records and stop the drain thread.
+ */
+void ZQ_SYMBOL(ZqLogBufferExit) ();
+
+/**
+   @brief Write a record to the current CPU's ring. Lock free.
+ */
+void ZQ_SYMBOL(ZqLogRecordWrite) (ZqLogLevel level,
+                                  const char *location,
+                                  const char *format,
+                                  uint64_t argument0,
+                                  uint64_t argument1,
+                                  uint64_t argument2,
+                                  uint64_t argument3);
+
+#endif // LOGBUFFER_H
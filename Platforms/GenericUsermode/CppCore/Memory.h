@@ -29,9 +29,15 @@ typedef ZqKernelAddress ZqMapableAddress;
 typedef ZqKernelAddress ZqUserAddress;
 typedef ZqKernelAddress ZqVirtualAddress;
 
+// PROT_* flags.
+typedef int ZqMemoryProtection;
+
+#define ZQ_PAGE_SIZE (4096)
+
 
 #ifdef __cplusplus
 # include <cstdlib>
+# include <cstring>
 #else
 # include <cstdlib.h>
 #endif
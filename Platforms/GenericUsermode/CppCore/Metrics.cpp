@@ -0,0 +1,104 @@
+/**
+ * @file Metrics.cpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2017 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "CppCore/Metrics.h"
+
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+
+namespace {
+
+constexpr uint64_t kTextSize = 256 * 1024;
+constexpr auto kExportInterval = std::chrono::seconds (1);
+
+ZqMetricsFormatter gFormatter = nullptr;
+std::string gPath;
+
+std::thread gExportThread;
+std::mutex gExportLock;
+std::condition_variable gExportCondition;
+bool gShouldStop = false;
+
+// Write to a temporary file and rename, so readers never see a partial snapshot.
+void writeSnapshot ()
+{
+    std::unique_ptr<char[]> text{new char[kTextSize]};
+    uint64_t length = gFormatter (text.get (), kTextSize);
+    std::string temporaryPath = gPath + ".tmp";
+
+    FILE *file = ::fopen (temporaryPath.c_str (), "w");
+    if (file == nullptr)
+        return;
+
+    ::fwrite (text.get (), 1, length, file);
+    ::fclose (file);
+
+    ::rename (temporaryPath.c_str (), gPath.c_str ());
+}
+
+void exportThreadFunction ()
+{
+    std::unique_lock<std::mutex> lock{gExportLock};
+
+    while (! gShouldStop) {
+        gExportCondition.wait_for (lock, kExportInterval);
+
+        writeSnapshot ();
+    }
+}
+
+} // namespace
+
+int ZQ_SYMBOL(ZqMetricsExportStart) (ZqMetricsFormatter formatter)
+{
+    const char *path = ::getenv ("ZQ_METRICS_FILE");
+
+    gPath = path != nullptr ? path : "ziqe.metrics";
+    gFormatter = formatter;
+    gShouldStop = false;
+
+    try {
+        gExportThread = std::thread{exportThreadFunction};
+    } catch (const std::system_error &error) {
+        return error.code ().value ();
+    }
+
+    return 0;
+}
+
+void ZQ_SYMBOL(ZqMetricsExportStop) ()
+{
+    if (! gExportThread.joinable ())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock{gExportLock};
+        gShouldStop = true;
+    }
+    gExportCondition.notify_one ();
+    gExportThread.join ();
+}
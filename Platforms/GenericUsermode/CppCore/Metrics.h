@@ -0,0 +1,59 @@
+/**
+ * @file Metrics.h
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2017 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "CppCore/Macros.h"
+#include "CppCore/Types.h"
+
+#include <sched.h>
+#include <ctime>
+
+typedef uint64_t (*ZqMetricsFormatter) (char *buffer, uint64_t size);
+
+inline_hint uint32_t ZQ_SYMBOL(ZqMetricsCurrentCpu) ()
+{
+    int cpu = ::sched_getcpu ();
+
+    return cpu < 0 ? 0 : static_cast<uint32_t>(cpu);
+}
+
+inline_hint uint64_t ZQ_SYMBOL(ZqMetricsTimestamp) ()
+{
+    struct timespec now;
+
+    ::clock_gettime (CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ull + now.tv_nsec;
+}
+
+/**
+   @brief Start a thread that writes the metrics, every second, to the
+          file named by the ZQ_METRICS_FILE environment variable
+          ("ziqe.metrics" by default).
+   @return 0 on success, an errno otherwise.
+ */
+int ZQ_SYMBOL(ZqMetricsExportStart) (ZqMetricsFormatter formatter);
+
+/**
+   @brief Write the metrics for the last time and stop the export thread.
+ */
+void ZQ_SYMBOL(ZqMetricsExportStop) ();
+
+#endif // METRICS_H
@@ -0,0 +1,142 @@
+/**
+ * @file Memory.hpp
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2017 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MEMORY_HPP
+#define MEMORY_HPP
+
+#include "CppCore/Macros.h"
+
+#include "Base/Expected.hpp"
+#include "Base/Optional.hpp"
+
+#include "CppCore/Memory.h"
+#include "CppCore/DirtyTracking.h"
+
+#include <sys/mman.h>
+
+ZQ_BEGIN_NAMESPACE
+namespace OS {
+namespace Map {
+/**
+   @brief The usermode counterpart of the kernel's page cache: the
+          process' memory is already mapped, so a page is its own address.
+ */
+struct UserPageCache {
+    struct Page {
+        ZQ_ALLOW_MOVE (Page)
+        ZQ_DISALLOW_COPY (Page)
+
+        ZqKernelAddress getKernelAddress () const
+        {
+            return mAddress;
+        }
+
+    private:
+        friend struct UserPageCache;
+        ZQ_ALLOW_EXPECTED();
+
+        Page(ZqUserAddress address)
+            : mAddress{address}
+        {
+        }
+
+        ZqKernelAddress mAddress;
+    };
+
+    static Base::Expected<UserPageCache, Error> Create ()
+    {
+        return {UserPageCache{}};
+    }
+
+    ZQ_ALLOW_MOVE (UserPageCache)
+    ZQ_DISALLOW_COPY (UserPageCache)
+
+    Base::Expected<Page, Error> getPage (ZqUserAddress userAddress,
+                                         ZqMemoryProtection protection)
+    {
+        ZQ_UNUSED (protection);
+
+        return {Page{userAddress}};
+    }
+
+private:
+    ZQ_ALLOW_EXPECTED();
+
+    UserPageCache() = default;
+};
+} // namespace Map
+
+/**
+   @brief Write tracking of the current process, see ZqDirtyTracker.
+ */
+struct DirtyTracker {
+    static Base::Expected<DirtyTracker, Error> Create ()
+    {
+        ZqDirtyTracker tracker;
+
+        auto result = ZQ_SYMBOL(ZqDirtyTrackerInit) (&tracker);
+
+        if (result == ZQ_E_OK) {
+            return {tracker};
+        } else {
+            return {Base::Error (Base::move(result))};
+        }
+    }
+
+    ZQ_ALLOW_MOVE (DirtyTracker)
+    ZQ_DISALLOW_COPY (DirtyTracker)
+
+    ~DirtyTracker() {
+        if (mMaybeTracker)
+            ZQ_SYMBOL(ZqDirtyTrackerDestroy) (&mMaybeTracker.get ());
+    }
+
+    /**
+       @brief Start a new epoch, call @a function with the address of every
+              page written in the previous one.
+     */
+    template<class Function>
+    Error collect (Function &function)
+    {
+        return ZQ_SYMBOL(ZqDirtyTrackerCollect) (&mMaybeTracker.get (),
+                                                 &DirtyTracker::callFunction<Function>,
+                                                 &function);
+    }
+
+private:
+    ZQ_ALLOW_EXPECTED();
+
+    DirtyTracker(const ZqDirtyTracker &tracker)
+        : mMaybeTracker{tracker}
+    {
+    }
+
+    template<class Function>
+    static void callFunction (void *context, ZqUserAddress address)
+    {
+        (*static_cast<Function *>(context)) (address);
+    }
+
+    Base::Optional<ZqDirtyTracker> mMaybeTracker;
+};
+
+}
+ZQ_END_NAMESPACE
+
+#endif // MEMORY_HPP
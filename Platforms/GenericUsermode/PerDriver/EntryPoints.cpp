@@ -20,14 +20,22 @@
 #include "PerDriver/EntryPoints.hpp"
 
 #include "OS/AbstractDriverContext.hpp"
+#include "CppCore/LogBuffer.h"
+#include "Base/Metrics.hpp"
 
 int main(int argc, char *argv[]) {
     using namespace Ziqe;
 
+    int error = ZQ_SYMBOL(ZqLogBufferInit) ();
+    if (error != 0)
+        return error;
+
     auto maybeDriverContext = OS::DriverContext::Create ();
     if (! maybeDriverContext)
         return maybeDriverContext.getError ();
 
+    Base::Metrics::StartExport ();
+
     ZQ_PER_DRIVER_UNIQUE_SYMBOL(ZqOnLoad) (&maybeDriverContext.get ());
 
      while (true) {
@@ -36,5 +44,9 @@ int main(int argc, char *argv[]) {
 
     ZQ_PER_DRIVER_UNIQUE_SYMBOL(ZqOnUnload) (&maybeDriverContext.get ());
 
+    Base::Metrics::StopExport ();
+
+    ZQ_SYMBOL(ZqLogBufferExit) ();
+
     return 0;
 }
@@ -0,0 +1,130 @@
+/**
+ * @file DirtyTrackingTest
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2017 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CppCore/DirtyTracking.h"
+#include "Base/Vector.hpp"
+#include "PerDriver/EntryPoints.hpp"
+
+#include <sys/mman.h>
+
+namespace {
+
+constexpr Ziqe::SizeType kPages = 16;
+
+typedef Ziqe::Base::Vector<ZqUserAddress> Addresses;
+
+void onDirtyPage (void *context, ZqUserAddress address)
+{
+    static_cast<Addresses *>(context)->expand (1, address);
+}
+
+// Collect, and check that the written pages of [buffer, buffer + kPages)
+// are exactly @a written.
+bool collectAndCheck (ZqDirtyTracker *tracker, char *buffer, const bool (&written)[kPages])
+{
+    Addresses dirty;
+
+    if (ZQ_SYMBOL(ZqDirtyTrackerCollect) (tracker, onDirtyPage, &dirty) != ZQ_E_OK)
+        return false;
+
+    for (Ziqe::SizeType page = 0; page < kPages; ++page) {
+        auto address = reinterpret_cast<ZqUserAddress>(buffer + page * ZQ_PAGE_SIZE);
+        bool isDirty = false;
+
+        for (auto dirtyAddress : dirty)
+            isDirty = isDirty || dirtyAddress == address;
+
+        if (isDirty != written[page])
+            return false;
+    }
+
+    return true;
+}
+
+char *mapBuffer (void *address, int flags)
+{
+    void *buffer = ::mmap (address, kPages * ZQ_PAGE_SIZE,
+                           PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE | flags,
+                           -1, 0);
+
+    return buffer == MAP_FAILED ? nullptr : static_cast<char *>(buffer);
+}
+
+} // namespace
+
+ZQ_BEGIN_C_DECL void ZQ_PER_DRIVER_UNIQUE_SYMBOL(ZqOnLoad) (Ziqe::Base::RawPointer<Ziqe::OS::DriverContext>)
+{
+    ZqDirtyTracker tracker;
+    char *buffer = mapBuffer (nullptr, 0);
+
+    ZQ_ASSERT (buffer != nullptr);
+    if (buffer == nullptr || ZQ_SYMBOL(ZqDirtyTrackerInit) (&tracker) != ZQ_E_OK)
+        return;
+
+    // The buffer existed at init: only the pages written since are dirty.
+    {
+        const bool none[kPages] = {};
+        bool written[kPages] = {};
+
+        ZQ_ASSERT (collectAndCheck (&tracker, buffer, none));
+
+        buffer[3 * ZQ_PAGE_SIZE] = 1;
+        buffer[9 * ZQ_PAGE_SIZE + 17] = 1;
+        written[3] = written[9] = true;
+        ZQ_ASSERT (collectAndCheck (&tracker, buffer, written));
+
+        // Protected again by the collect: the same page is seen again.
+        buffer[3 * ZQ_PAGE_SIZE] = 2;
+        written[9] = false;
+        ZQ_ASSERT (collectAndCheck (&tracker, buffer, written));
+
+        ZQ_ASSERT (collectAndCheck (&tracker, buffer, none));
+    }
+
+    // Unmapped and mapped again at the same address between two collects:
+    // the new mapping isn't registered yet, but its writes aren't lost.
+    {
+        const bool all[kPages] = {true, true, true, true, true, true, true, true,
+                                  true, true, true, true, true, true, true, true};
+        bool written[kPages] = {};
+
+        ZQ_ASSERT (::munmap (buffer, kPages * ZQ_PAGE_SIZE) == 0);
+        ZQ_ASSERT (mapBuffer (buffer, MAP_FIXED) == buffer);
+
+        // A new mapping: its present pages are reported.
+        buffer[5 * ZQ_PAGE_SIZE] = 1;
+        ZQ_ASSERT (collectAndCheck (&tracker, buffer, all));
+
+        // And it is tracked from now on.
+        buffer[5 * ZQ_PAGE_SIZE] = 2;
+        written[5] = true;
+        ZQ_ASSERT (collectAndCheck (&tracker, buffer, written));
+    }
+
+    ZQ_SYMBOL(ZqDirtyTrackerDestroy) (&tracker);
+    ::munmap (buffer, kPages * ZQ_PAGE_SIZE);
+}
+
+void ZQ_PER_DRIVER_UNIQUE_SYMBOL(ZqOnUnload) (Ziqe::Base::RawPointer<Ziqe::OS::DriverContext>)
+{
+}
+
+ZQ_END_C_DECL
@@ -0,0 +1,56 @@
+/**
+ * @file Debugfs.c
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2017 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <linux/mutex.h>
+
+#include "CppCore/Macros.h"
+#include "CppCore/Debugfs.h"
+
+static DEFINE_MUTEX(zq_debugfs_lock);
+static struct dentry *zq_debugfs_root;
+static unsigned int zq_debugfs_users;
+
+struct dentry *ZQ_SYMBOL(ZqDebugfsGetRoot) (void)
+{
+    struct dentry *root;
+
+    mutex_lock (&zq_debugfs_lock);
+
+    if (zq_debugfs_users++ == 0)
+        zq_debugfs_root = debugfs_create_dir ("ziqe", NULL);
+
+    root = zq_debugfs_root;
+
+    mutex_unlock (&zq_debugfs_lock);
+
+    return root;
+}
+
+void ZQ_SYMBOL(ZqDebugfsPutRoot) (void)
+{
+    mutex_lock (&zq_debugfs_lock);
+
+    if (--zq_debugfs_users == 0) {
+        debugfs_remove_recursive (zq_debugfs_root);
+        zq_debugfs_root = NULL;
+    }
+
+    mutex_unlock (&zq_debugfs_lock);
+}
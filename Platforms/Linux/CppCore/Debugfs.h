@@ -0,0 +1,40 @@
+/**
+ * @file Debugfs.h
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2017 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Linux only: this header is used by the C implementation files.
+ */
+#ifndef ZIQE_API_DEBUGFS_H
+#define ZIQE_API_DEBUGFS_H
+
+#include <linux/debugfs.h>
+
+#include "CppCore/Macros.h"
+
+/**
+   @brief Get (and create on the first call) the "ziqe" debugfs directory.
+   @return The directory, or NULL/an error pointer if debugfs isn't available.
+
+   Every call should be matched with ZqDebugfsPutRoot: the directory
+   is removed (with all its files) when the last user puts it.
+ */
+struct dentry *ZQ_SYMBOL(ZqDebugfsGetRoot) (void);
+
+void ZQ_SYMBOL(ZqDebugfsPutRoot) (void);
+
+#endif /* ZIQE_API_DEBUGFS_H */
@@ -0,0 +1,642 @@
+/**
+ * @file DirtyTracking.c
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2017 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Implementation of the DirtyTracking.h ZiqeAPI for Linux.
+ *
+ * Every epoch has a sorted array of the tracked address ranges (the
+ * private writable VMAs when the epoch started) and a bitmap per CPU,
+ * a bit per page. The page_fault_user tracepoint marks the faulting page
+ * in the current CPU's bitmap of the process's current epoch.
+ *
+ * Collecting an epoch (E0) and starting the next one (E1):
+ *  1. Build E1 from the current VMAs (under the mmap lock).
+ *  2. Write protect every writable PTE. A PTE that is still writable has
+ *     been written during E0 (we write protected it when E0 started, or it
+ *     was populated by a write), so it gets marked in E0 (or, if it isn't
+ *     in E0's ranges, in E1's scan bitmap). A writable huge PMD marks all
+ *     of its pages: a write fault makes the whole huge page writable.
+ *  3. Publish E1 and wait for the probes that might still use E0.
+ *  4. Report E0's bitmaps and E1's scan bitmap.
+ * A write fault between 2 and 3 is recorded in E0, and if the page gets
+ * written again during E1 it'll be found writable by the next pass.
+ */
+
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/mmu_notifier.h>
+#include <linux/sched/mm.h>
+#include <linux/hashtable.h>
+#include <linux/mutex.h>
+#include <linux/rcupdate.h>
+#include <linux/slab.h>
+#include <linux/tracepoint.h>
+#include <linux/version.h>
+
+#include <asm/tlbflush.h>
+#ifdef __x86_64__
+# include <asm/trap_pf.h>
+# define ZQ_IS_WRITE_FAULT(error_code) ((error_code) & X86_PF_WRITE)
+#endif
+
+#include "CppCore/DirtyTracking.h"
+
+#define ZQ_DIRTY_TRACKERS_HASH_BITS (6)
+#define ZQ_PAGE_FAULT_TRACEPOINT_NAME "page_fault_user"
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 1, 0)
+# define zq_for_each_vma(mm, vma) VMA_ITERATOR (vmi, mm, 0); for_each_vma (vmi, vma)
+#else
+# define zq_for_each_vma(mm, vma) for (vma = (mm)->mmap; vma != NULL; vma = vma->vm_next)
+#endif
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+# define zq_mmu_notifier_range_init(range, vma) \
+    mmu_notifier_range_init (range, MMU_NOTIFY_PROTECTION_PAGE, 0, \
+                             (vma)->vm_mm, (vma)->vm_start, (vma)->vm_end)
+#else
+# define zq_mmu_notifier_range_init(range, vma) \
+    mmu_notifier_range_init (range, MMU_NOTIFY_PROTECTION_PAGE, 0, \
+                             vma, (vma)->vm_mm, (vma)->vm_start, (vma)->vm_end)
+#endif
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 8, 0)
+
+struct zq_dirty_range {
+    unsigned long start;
+    unsigned long end;
+    unsigned long first_bit;
+};
+
+struct zq_dirty_epoch {
+    unsigned int ranges_count;
+    struct zq_dirty_range *ranges;
+
+    unsigned long pages_count;
+
+    /* Longs per bitmap, rounded up to a cache line. */
+    unsigned long bitmap_longs;
+
+    /* nr_cpu_ids per-CPU bitmaps, followed by the scan bitmap. */
+    unsigned long *bitmaps;
+};
+
+struct zq_dirty_tracker {
+    struct hlist_node node;
+    struct mm_struct *mm;
+
+    struct zq_dirty_epoch __rcu *epoch;
+
+    /* Serializes the collects. */
+    struct mutex lock;
+};
+
+static DEFINE_HASHTABLE (zq_dirty_trackers, ZQ_DIRTY_TRACKERS_HASH_BITS);
+static DEFINE_SPINLOCK (zq_dirty_trackers_lock);
+static atomic_t zq_dirty_trackers_count = ATOMIC_INIT (0);
+
+static DEFINE_MUTEX (zq_dirty_tracepoint_lock);
+static struct tracepoint *zq_page_fault_tracepoint;
+static unsigned int zq_page_fault_tracepoint_users;
+
+static inline_hint unsigned long *zq_dirty_epoch_bitmap (struct zq_dirty_epoch *epoch,
+                                                         unsigned int index)
+{
+    return epoch->bitmaps + index * epoch->bitmap_longs;
+}
+
+static inline_hint unsigned long *zq_dirty_epoch_scan_bitmap (struct zq_dirty_epoch *epoch)
+{
+    return zq_dirty_epoch_bitmap (epoch, nr_cpu_ids);
+}
+
+/**
+   @return The bit of @a address in @a epoch, or -1 if it isn't tracked.
+ */
+static long zq_dirty_epoch_find_bit (const struct zq_dirty_epoch *epoch,
+                                     unsigned long address)
+{
+    unsigned int low = 0;
+    unsigned int high = epoch->ranges_count;
+
+    while (low < high) {
+        unsigned int middle = low + (high - low) / 2;
+        const struct zq_dirty_range *range = &epoch->ranges[middle];
+
+        if (address < range->start)
+            high = middle;
+        else if (address >= range->end)
+            low = middle + 1;
+        else
+            return range->first_bit + ((address - range->start) >> PAGE_SHIFT);
+    }
+
+    return -1;
+}
+
+static ZqBool zq_is_vma_tracked (struct vm_area_struct *vma)
+{
+    if (! (vma->vm_flags & VM_WRITE))
+        return ZQ_FALSE;
+
+    if (vma->vm_flags & (VM_SHARED | VM_IO | VM_PFNMAP | VM_MIXEDMAP | VM_HUGETLB))
+        return ZQ_FALSE;
+
+    return ZQ_TRUE;
+}
+
+static void zq_dirty_epoch_free (struct zq_dirty_epoch *epoch)
+{
+    if (epoch == NULL)
+        return;
+
+    kvfree (epoch->bitmaps);
+    kvfree (epoch->ranges);
+    kfree (epoch);
+}
+
+/**
+   @brief Create an epoch from @a mm's current VMAs.
+   @note Must be called with the mmap lock held.
+ */
+static struct zq_dirty_epoch *zq_dirty_epoch_create (struct mm_struct *mm)
+{
+    struct zq_dirty_epoch *epoch = kzalloc (sizeof (*epoch), GFP_KERNEL);
+    struct vm_area_struct *vma;
+    unsigned long longs_per_line = L1_CACHE_BYTES / sizeof (unsigned long);
+
+    if (epoch == NULL)
+        return NULL;
+
+    /* map_count is an upper bound for the ranges count. */
+    epoch->ranges = kvmalloc_array (mm->map_count, sizeof (*epoch->ranges), GFP_KERNEL);
+    if (epoch->ranges == NULL)
+        goto error;
+
+    /* VMAs are sorted, so are our ranges. */
+    zq_for_each_vma (mm, vma) {
+        struct zq_dirty_range *range;
+
+        if (! zq_is_vma_tracked (vma))
+            continue;
+
+        range = &epoch->ranges[epoch->ranges_count++];
+        range->start = vma->vm_start;
+        range->end = vma->vm_end;
+        range->first_bit = epoch->pages_count;
+
+        epoch->pages_count += (vma->vm_end - vma->vm_start) >> PAGE_SHIFT;
+    }
+
+    /* Round every bitmap up to a cache line: each CPU writes only to its own. */
+    epoch->bitmap_longs = round_up (BITS_TO_LONGS (epoch->pages_count) + 1, longs_per_line);
+    epoch->bitmaps = kvzalloc (array3_size (nr_cpu_ids + 1,
+                                            epoch->bitmap_longs,
+                                            sizeof (unsigned long)),
+                               GFP_KERNEL);
+    if (epoch->bitmaps == NULL)
+        goto error;
+
+    return epoch;
+
+error:
+    zq_dirty_epoch_free (epoch);
+    return NULL;
+}
+
+struct zq_write_protect_context {
+    struct mm_struct *mm;
+    struct zq_dirty_epoch *previous;
+    struct zq_dirty_epoch *next;
+};
+
+/**
+   @brief Mark @a address, which is writable, as written during the previous epoch.
+ */
+static void zq_write_protect_mark (struct zq_write_protect_context *context,
+                                   unsigned long address)
+{
+    long bit = context->previous ? zq_dirty_epoch_find_bit (context->previous, address) : -1;
+
+    if (bit >= 0) {
+        set_bit (bit, zq_dirty_epoch_bitmap (context->previous, smp_processor_id ()));
+    } else if (context->previous != NULL) {
+        bit = zq_dirty_epoch_find_bit (context->next, address);
+        if (bit >= 0)
+            set_bit (bit, zq_dirty_epoch_scan_bitmap (context->next));
+    }
+}
+
+static int zq_write_protect_pte (pte_t *pte, unsigned long address, void *data)
+{
+    struct zq_write_protect_context *context = data;
+    pte_t entry = ptep_get (pte);
+
+    if (! pte_present (entry) || ! pte_write (entry))
+        return 0;
+
+    zq_write_protect_mark (context, address);
+
+    ptep_set_wrprotect (context->mm, address, pte);
+    return 0;
+}
+
+/**
+   @brief Write protect a huge PMD, marking all of its pages if it is writable.
+ */
+static void zq_write_protect_huge_pmd (struct zq_write_protect_context *context,
+                                       pmd_t *pmd,
+                                       unsigned long address)
+{
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+    spinlock_t *lock = pmd_lock (context->mm, pmd);
+    unsigned long start = address & HPAGE_PMD_MASK;
+    unsigned long offset;
+
+    /* Might have been split since we looked. */
+    if (pmd_trans_huge (*pmd) && pmd_write (*pmd)) {
+        for (offset = 0; offset < HPAGE_PMD_SIZE; offset += PAGE_SIZE)
+            zq_write_protect_mark (context, start + offset);
+
+        pmdp_set_wrprotect (context->mm, start, pmd);
+    }
+
+    spin_unlock (lock);
+#else
+    ZQ_UNUSED (context);
+    ZQ_UNUSED (pmd);
+    ZQ_UNUSED (address);
+#endif
+}
+
+/**
+   @return The PMD of @a address, or NULL if there is no page table for it.
+ */
+static pmd_t *zq_find_pmd (struct mm_struct *mm, unsigned long address)
+{
+    pgd_t *pgd = pgd_offset (mm, address);
+    p4d_t *p4d;
+    pud_t *pud;
+
+    if (pgd_none (*pgd) || pgd_bad (*pgd))
+        return NULL;
+
+    p4d = p4d_offset (pgd, address);
+    if (p4d_none (*p4d) || p4d_bad (*p4d))
+        return NULL;
+
+    pud = pud_offset (p4d, address);
+    if (pud_none (*pud) || pud_bad (*pud))
+        return NULL;
+
+    return pmd_offset (pud, address);
+}
+
+/**
+   @brief Write protect [@a start, @a end) a PMD at a time.
+
+   apply_to_existing_page_range refuses huge PMDs, so they are handled here.
+   No PMD can become a huge page under the mmap read lock, apart from an
+   empty one, which would fault anyway.
+ */
+static void zq_write_protect_range (struct zq_write_protect_context *context,
+                                    unsigned long start,
+                                    unsigned long end)
+{
+    unsigned long address;
+    unsigned long next;
+
+    for (address = start; address < end; address = next) {
+        pmd_t *pmd = zq_find_pmd (context->mm, address);
+        pmd_t entry;
+
+        next = pmd_addr_end (address, end);
+        if (pmd == NULL)
+            continue;
+
+        /* A non present PMD is being migrated: its old protection is
+           restored, so the next collect will find it. */
+        entry = READ_ONCE (*pmd);
+        if (pmd_none (entry) || ! pmd_present (entry))
+            continue;
+
+        if (pmd_trans_huge (entry)) {
+            zq_write_protect_huge_pmd (context, pmd, address);
+            continue;
+        }
+
+        /* Only existing page tables: a missing page will fault anyway. */
+        apply_to_existing_page_range (context->mm,
+                                      address,
+                                      next - address,
+                                      zq_write_protect_pte,
+                                      context);
+    }
+}
+
+/**
+   @brief Write protect all of @a context->next's ranges in one pass.
+   @note Must be called with the mmap lock held.
+ */
+static void zq_write_protect_epoch (struct zq_write_protect_context *context)
+{
+    struct vm_area_struct *vma;
+
+    zq_for_each_vma (context->mm, vma) {
+        struct mmu_notifier_range range;
+
+        if (! zq_is_vma_tracked (vma))
+            continue;
+
+        /* Secondary MMUs (KVM, devices) must drop their writable mappings too. */
+        zq_mmu_notifier_range_init (&range, vma);
+        mmu_notifier_invalidate_range_start (&range);
+
+        zq_write_protect_range (context, vma->vm_start, vma->vm_end);
+        flush_tlb_range (vma, vma->vm_start, vma->vm_end);
+
+        mmu_notifier_invalidate_range_end (&range);
+    }
+}
+
+static void zq_dirty_epoch_report_bitmap (const struct zq_dirty_epoch *epoch,
+                                          unsigned long bit,
+                                          ZqDirtyPageCallback callback,
+                                          void *context)
+{
+    unsigned int low = 0;
+    unsigned int high = epoch->ranges_count;
+
+    /* Find the range of the bit. */
+    while (high - low > 1) {
+        unsigned int middle = low + (high - low) / 2;
+
+        if (epoch->ranges[middle].first_bit <= bit)
+            low = middle;
+        else
+            high = middle;
+    }
+
+    callback (context,
+              epoch->ranges[low].start + ((bit - epoch->ranges[low].first_bit) << PAGE_SHIFT));
+}
+
+/**
+   @brief Report every page that is set in @a epoch's per-CPU bitmaps
+          (or, if @a scan, in its scan bitmap), a word at a time.
+ */
+static void zq_dirty_epoch_report (struct zq_dirty_epoch *epoch,
+                                   ZqBool scan,
+                                   ZqDirtyPageCallback callback,
+                                   void *context)
+{
+    unsigned long words = BITS_TO_LONGS (epoch->pages_count);
+    unsigned long word;
+
+    for (word = 0; word < words; ++word) {
+        unsigned long value = 0;
+        unsigned int cpu;
+
+        if (scan) {
+            value = zq_dirty_epoch_scan_bitmap (epoch)[word];
+        } else {
+            for (cpu = 0; cpu < nr_cpu_ids; ++cpu)
+                value |= zq_dirty_epoch_bitmap (epoch, cpu)[word];
+        }
+
+        while (value != 0) {
+            unsigned long bit = __ffs (value);
+
+            value &= value - 1;
+            zq_dirty_epoch_report_bitmap (epoch, word * BITS_PER_LONG + bit, callback, context);
+        }
+    }
+}
+
+static void zq_page_fault_user_probe (void *data,
+                                      unsigned long address,
+                                      struct pt_regs *regs,
+                                      unsigned long error_code)
+{
+    struct zq_dirty_tracker *tracker;
+    struct mm_struct *mm = current->mm;
+
+    ZQ_UNUSED (data);
+    ZQ_UNUSED (regs);
+
+    if (likely (atomic_read (&zq_dirty_trackers_count) == 0) || ! ZQ_IS_WRITE_FAULT (error_code))
+        return;
+
+    rcu_read_lock ();
+
+    hash_for_each_possible_rcu (zq_dirty_trackers, tracker, node, (unsigned long) mm) {
+        if (tracker->mm == mm) {
+            struct zq_dirty_epoch *epoch = rcu_dereference (tracker->epoch);
+            long bit = zq_dirty_epoch_find_bit (epoch, address);
+
+            if (bit >= 0)
+                set_bit (bit, zq_dirty_epoch_bitmap (epoch, raw_smp_processor_id ()));
+
+            break;
+        }
+    }
+
+    rcu_read_unlock ();
+}
+
+static void zq_find_page_fault_tracepoint (struct tracepoint *tracepoint, void *private)
+{
+    if (strcmp (tracepoint->name, ZQ_PAGE_FAULT_TRACEPOINT_NAME) == 0)
+        *(struct tracepoint **) private = tracepoint;
+}
+
+static ZqError zq_page_fault_tracepoint_get (void)
+{
+    ZqError error = ZQ_E_OK;
+
+    mutex_lock (&zq_dirty_tracepoint_lock);
+
+    if (zq_page_fault_tracepoint_users == 0) {
+        for_each_kernel_tracepoint (zq_find_page_fault_tracepoint, &zq_page_fault_tracepoint);
+
+        if (zq_page_fault_tracepoint == NULL)
+            error = ZQ_E_NOT_SUPPORTED;
+        else
+            error = -tracepoint_probe_register (zq_page_fault_tracepoint,
+                                                zq_page_fault_user_probe,
+                                                NULL);
+    }
+
+    if (error == ZQ_E_OK)
+        ++zq_page_fault_tracepoint_users;
+
+    mutex_unlock (&zq_dirty_tracepoint_lock);
+
+    return error;
+}
+
+static void zq_page_fault_tracepoint_put (void)
+{
+    mutex_lock (&zq_dirty_tracepoint_lock);
+
+    if (--zq_page_fault_tracepoint_users == 0) {
+        tracepoint_probe_unregister (zq_page_fault_tracepoint, zq_page_fault_user_probe, NULL);
+        tracepoint_synchronize_unregister ();
+    }
+
+    mutex_unlock (&zq_dirty_tracepoint_lock);
+}
+
+ZqError ZQ_SYMBOL(ZqDirtyTrackerInit) (ZqDirtyTracker *tracker) {
+    struct zq_dirty_tracker *private_tracker;
+    struct zq_write_protect_context context;
+    ZqError error;
+
+    error = zq_page_fault_tracepoint_get ();
+    if (error != ZQ_E_OK)
+        return error;
+
+    private_tracker = kzalloc (sizeof (*private_tracker), GFP_KERNEL);
+    if (private_tracker == NULL) {
+        zq_page_fault_tracepoint_put ();
+        return ZQ_E_NO_MEMORY;
+    }
+
+    mutex_init (&private_tracker->lock);
+    private_tracker->mm = current->mm;
+    mmgrab (private_tracker->mm);
+
+    context.mm = private_tracker->mm;
+    context.previous = NULL;
+
+    mmap_read_lock (context.mm);
+
+    context.next = zq_dirty_epoch_create (context.mm);
+    if (context.next != NULL)
+        zq_write_protect_epoch (&context);
+
+    mmap_read_unlock (context.mm);
+
+    if (context.next == NULL) {
+        mmdrop (private_tracker->mm);
+        kfree (private_tracker);
+        zq_page_fault_tracepoint_put ();
+        return ZQ_E_NO_MEMORY;
+    }
+
+    RCU_INIT_POINTER (private_tracker->epoch, context.next);
+
+    spin_lock (&zq_dirty_trackers_lock);
+    hash_add_rcu (zq_dirty_trackers, &private_tracker->node, (unsigned long) private_tracker->mm);
+    spin_unlock (&zq_dirty_trackers_lock);
+
+    atomic_inc (&zq_dirty_trackers_count);
+
+    tracker->_pTracker = private_tracker;
+    return ZQ_E_OK;
+}
+
+void ZQ_SYMBOL(ZqDirtyTrackerDestroy) (ZqDirtyTracker *tracker) {
+    struct zq_dirty_tracker *private_tracker = tracker->_pTracker;
+
+    spin_lock (&zq_dirty_trackers_lock);
+    hash_del_rcu (&private_tracker->node);
+    spin_unlock (&zq_dirty_trackers_lock);
+
+    atomic_dec (&zq_dirty_trackers_count);
+
+    /* Wait for the probes that might still use this tracker. */
+    synchronize_rcu ();
+
+    zq_dirty_epoch_free (rcu_dereference_protected (private_tracker->epoch, 1));
+    mmdrop (private_tracker->mm);
+    kfree (private_tracker);
+
+    zq_page_fault_tracepoint_put ();
+
+    tracker->_pTracker = NULL;
+}
+
+ZqError ZQ_SYMBOL(ZqDirtyTrackerCollect) (ZqDirtyTracker *tracker,
+                                          ZqDirtyPageCallback callback,
+                                          void *callbackContext) {
+    struct zq_dirty_tracker *private_tracker = tracker->_pTracker;
+    struct zq_write_protect_context context;
+
+    /* The process might be exiting. */
+    if (! mmget_not_zero (private_tracker->mm))
+        return ZQ_E_INVALID_ARG;
+
+    mutex_lock (&private_tracker->lock);
+
+    context.mm = private_tracker->mm;
+    context.previous = rcu_dereference_protected (private_tracker->epoch,
+                                                  lockdep_is_held (&private_tracker->lock));
+
+    mmap_read_lock (context.mm);
+
+    context.next = zq_dirty_epoch_create (context.mm);
+    if (context.next != NULL)
+        zq_write_protect_epoch (&context);
+
+    mmap_read_unlock (context.mm);
+    mmput (context.mm);
+
+    if (context.next == NULL) {
+        mutex_unlock (&private_tracker->lock);
+        return ZQ_E_NO_MEMORY;
+    }
+
+    rcu_assign_pointer (private_tracker->epoch, context.next);
+    synchronize_rcu ();
+
+    /* Nobody writes to the previous epoch anymore. */
+    zq_dirty_epoch_report (context.previous, ZQ_FALSE, callback, callbackContext);
+    zq_dirty_epoch_report (context.next, ZQ_TRUE, callback, callbackContext);
+
+    zq_dirty_epoch_free (context.previous);
+
+    mutex_unlock (&private_tracker->lock);
+
+    return ZQ_E_OK;
+}
+
+#else /* LINUX_VERSION_CODE < 5.8 */
+
+/* apply_to_existing_page_range and ptep_get are needed. */
+
+ZqError ZQ_SYMBOL(ZqDirtyTrackerInit) (ZqDirtyTracker *tracker) {
+    ZQ_UNUSED (tracker);
+    return ZQ_E_NOT_SUPPORTED;
+}
+
+void ZQ_SYMBOL(ZqDirtyTrackerDestroy) (ZqDirtyTracker *tracker) {
+    ZQ_UNUSED (tracker);
+}
+
+ZqError ZQ_SYMBOL(ZqDirtyTrackerCollect) (ZqDirtyTracker *tracker,
+                                          ZqDirtyPageCallback callback,
+                                          void *callbackContext) {
+    ZQ_UNUSED (tracker);
+    ZQ_UNUSED (callback);
+    ZQ_UNUSED (callbackContext);
+    return ZQ_E_NOT_SUPPORTED;
+}
+
+#endif /* LINUX_VERSION_CODE >= 5.8 */
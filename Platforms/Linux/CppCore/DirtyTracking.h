@@ -0,0 +1,90 @@
+/**
+ * @file DirtyTracking.h
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2017 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * This file should be readed as a CPP file and a C file.
+ */
+#ifndef ZIQE_API_DIRTYTRACKING_H
+#define ZIQE_API_DIRTYTRACKING_H
+
+#include "CppCore/Macros.h"
+#include "CppCore/Types.h"
+#include "CppCore/Error.h"
+#include "CppCore/Memory.h"
+
+ZQ_BEGIN_C_DECL
+
+/**
+  @brief Track the pages a process writes to, an epoch at a time.
+
+  At the start of every epoch, all the private writable memory of the
+  process is write protected in a single pass. The first write to a page
+  faults, and the fault is recorded in a per-CPU bitmap (the kernel then
+  handles the fault as usual, so the following writes are free).
+
+  Shared mappings, VM_IO/VM_PFNMAP mappings and hugetlbfs are not tracked.
+ */
+typedef struct {
+    // _private
+    void *_pTracker;
+} ZqDirtyTracker;
+
+typedef void (*ZqDirtyPageCallback) (void *context, ZqUserAddress address);
+
+/**
+   @brief Start tracking the current process.
+ */
+ZqError ZQ_SYMBOL(ZqDirtyTrackerInit) (ZqDirtyTracker *tracker);
+
+/**
+   @brief Stop tracking. The memory is left write protected: every page takes
+          one more (regular) write fault.
+ */
+void ZQ_SYMBOL(ZqDirtyTrackerDestroy) (ZqDirtyTracker *tracker);
+
+/**
+   @brief Allocate memory for copies of the tracked pages. Kernel memory
+          is never tracked.
+ */
+static inline_hint void *ZQ_SYMBOL(ZqDirtyTrackerAllocatePages) (ZqSizeType size)
+{
+    return vmalloc (size);
+}
+
+static inline_hint void ZQ_SYMBOL(ZqDirtyTrackerDeallocatePages) (void *address, ZqSizeType size)
+{
+    ZQ_UNUSED (size);
+
+    vfree (address);
+}
+
+/**
+   @brief End the current epoch and start a new one.
+
+   @a callback is called (without any lock held) once for every page that
+   has been written since the previous call. A write that races with this
+   call is reported in the ending epoch or in the next one, never lost.
+ */
+ZqError ZQ_SYMBOL(ZqDirtyTrackerCollect) (ZqDirtyTracker *tracker,
+                                          ZqDirtyPageCallback callback,
+                                          void *context);
+
+ZQ_END_C_DECL
+
+#endif /* ZIQE_API_DIRTYTRACKING_H */
@@ -34,6 +34,8 @@ typedef int ZqError;
 #define ZQ_E_INVALID_ARG EINVAL
 #define ZQ_E_SIZE EMSGSIZE
 #define ZQ_E_NO_MEMORY ENOMEM
+#define ZQ_E_NOT_SUPPORTED EOPNOTSUPP
+#define ZQ_E_TIMED_OUT ETIMEDOUT
 #define ZQ_E_OK 0
 
 #ifdef __cplusplus
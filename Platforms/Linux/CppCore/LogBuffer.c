@@ -0,0 +1,368 @@
+/**
+ * @file LogBuffer.c
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2017 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Implementation of the LogBuffer.h ZiqeAPI for Linux.
+ *
+ * Every CPU has a ring of binary records. Writers reserve a slot with an
+ * atomic increment of the ring's head (so nested writers from interrupts
+ * are fine) and publish it by storing its sequence number last. The drain
+ * thread is the only reader: it formats the committed records into a text
+ * fifo that can be read from debugfs (ziqe/log).
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/percpu.h>
+#include <linux/kthread.h>
+#include <linux/kfifo.h>
+#include <linux/mutex.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+#include <linux/sched/clock.h>
+
+#include "CppCore/LogBuffer.h"
+#include "CppCore/Debugfs.h"
+
+/* Records per CPU, must be a power of two. */
+#define ZQ_LOG_RING_SIZE            (1024)
+#define ZQ_LOG_RING_MASK            (ZQ_LOG_RING_SIZE - 1)
+
+#define ZQ_LOG_TEXT_FIFO_SIZE       (1 << 17)
+#define ZQ_LOG_LINE_SIZE            (256)
+#define ZQ_LOG_DRAIN_INTERVAL_MS    (100)
+
+struct zq_log_ring {
+    /* The next index to reserve. */
+    atomic64_t head;
+
+    /* The next index to drain, used only under zq_log_drain_lock. */
+    u64 tail;
+
+    atomic64_t dropped;
+
+    ZqLogRecord records[ZQ_LOG_RING_SIZE];
+};
+
+static DEFINE_PER_CPU(struct zq_log_ring *, zq_log_rings);
+
+static DECLARE_KFIFO_PTR(zq_log_text, char);
+static DEFINE_MUTEX(zq_log_drain_lock);
+
+static struct task_struct *zq_log_drain_thread;
+static struct dentry *zq_log_debugfs_file;
+
+static ZqBool zq_log_is_initialized = ZQ_FALSE;
+
+static const char *const zq_log_level_names[] = {
+    [ZQ_LOG_LEVEL_DEBUG]    = "D",
+    [ZQ_LOG_LEVEL_INFO]     = "I",
+    [ZQ_LOG_LEVEL_WARNING]  = "W",
+    [ZQ_LOG_LEVEL_ERROR]    = "E",
+};
+
+/**
+   @brief Format @a record into @a line.
+   @return The number of bytes written (without the null terminator).
+ */
+static int zq_log_format_record (const ZqLogRecord *record,
+                                 char *line,
+                                 size_t lineSize)
+{
+    u64 seconds = record->timestamp;
+    u32 nanoseconds = do_div (seconds, NSEC_PER_SEC);
+    int length;
+
+    length = scnprintf (line, lineSize, "[%5llu.%06u] %u %s %s: ",
+                        seconds,
+                        nanoseconds / NSEC_PER_USEC,
+                        record->cpu,
+                        zq_log_level_names[record->level & 3],
+                        record->location);
+
+    length += scnprintf (line + length, lineSize - length,
+                         record->format,
+                         record->arguments[0],
+                         record->arguments[1],
+                         record->arguments[2],
+                         record->arguments[3]);
+
+    length += scnprintf (line + length, lineSize - length, "\n");
+
+    return length;
+}
+
+static void zq_log_text_write (const char *line, unsigned int length)
+{
+    /* Drop the line if the reader doesn't keep up: never block the drain. */
+    if (kfifo_avail (&zq_log_text) < length)
+        return;
+
+    kfifo_in (&zq_log_text, line, length);
+}
+
+/**
+   @brief Move all the committed records from @a ring to the text fifo.
+   @note Must be called with zq_log_drain_lock held.
+ */
+static void zq_log_drain_ring (struct zq_log_ring *ring, unsigned int cpu)
+{
+    char line[ZQ_LOG_LINE_SIZE];
+    u64 head = atomic64_read (&ring->head);
+    u64 dropped;
+
+    /* Writers have lapped us, skip what have been overwritten. */
+    if (head - ring->tail > ZQ_LOG_RING_SIZE) {
+        atomic64_add (head - ring->tail - ZQ_LOG_RING_SIZE, &ring->dropped);
+        ring->tail = head - ZQ_LOG_RING_SIZE;
+    }
+
+    while (ring->tail != head) {
+        ZqLogRecord *slot = &ring->records[ring->tail & ZQ_LOG_RING_MASK];
+        ZqLogRecord record;
+        u64 sequence = smp_load_acquire (&slot->sequence);
+
+        if (sequence != ring->tail + 1) {
+            /* Still being written, we'll get it on the next drain. */
+            if (sequence <= ring->tail)
+                break;
+
+            /* Overwritten by a newer record. */
+            atomic64_inc (&ring->dropped);
+            ++ring->tail;
+            continue;
+        }
+
+        record = *slot;
+
+        /* Make sure the record hasn't been overwritten while we copied it. */
+        smp_rmb ();
+        if (READ_ONCE (slot->sequence) != sequence) {
+            atomic64_inc (&ring->dropped);
+            ++ring->tail;
+            continue;
+        }
+
+        zq_log_text_write (line, zq_log_format_record (&record, line, sizeof (line)));
+        ++ring->tail;
+    }
+
+    dropped = atomic64_xchg (&ring->dropped, 0);
+    if (dropped != 0)
+        zq_log_text_write (line, scnprintf (line, sizeof (line),
+                                            "[cpu %u: %llu records dropped]\n",
+                                            cpu, dropped));
+}
+
+static void zq_log_drain (void)
+{
+    unsigned int cpu;
+
+    mutex_lock (&zq_log_drain_lock);
+
+    for_each_possible_cpu (cpu) {
+        zq_log_drain_ring (per_cpu (zq_log_rings, cpu), cpu);
+    }
+
+    mutex_unlock (&zq_log_drain_lock);
+}
+
+static int zq_log_drain_thread_function (void *data)
+{
+    ZQ_UNUSED (data);
+
+    while (! kthread_should_stop ()) {
+        zq_log_drain ();
+
+        schedule_timeout_interruptible (msecs_to_jiffies (ZQ_LOG_DRAIN_INTERVAL_MS));
+    }
+
+    return 0;
+}
+
+static ssize_t zq_log_debugfs_read (struct file *file,
+                                    char __user *buffer,
+                                    size_t count,
+                                    loff_t *position)
+{
+    unsigned int copied;
+    int ret;
+
+    ZQ_UNUSED (file);
+    ZQ_UNUSED (position);
+
+    /* Give the reader the newest records. */
+    zq_log_drain ();
+
+    if (mutex_lock_interruptible (&zq_log_drain_lock))
+        return -ERESTARTSYS;
+
+    ret = kfifo_to_user (&zq_log_text, buffer, count, &copied);
+
+    mutex_unlock (&zq_log_drain_lock);
+
+    return ret ? ret : copied;
+}
+
+static const struct file_operations zq_log_debugfs_fops = {
+    .owner  = THIS_MODULE,
+    .read   = zq_log_debugfs_read,
+    .llseek = noop_llseek,
+};
+
+static void zq_log_free_rings (void)
+{
+    unsigned int cpu;
+
+    for_each_possible_cpu (cpu) {
+        vfree (per_cpu (zq_log_rings, cpu));
+        per_cpu (zq_log_rings, cpu) = NULL;
+    }
+}
+
+ZqError ZQ_SYMBOL(ZqLogBufferInit) (void)
+{
+    struct dentry *root;
+    unsigned int cpu;
+    int ret;
+
+    for_each_possible_cpu (cpu) {
+        struct zq_log_ring *ring = vzalloc_node (sizeof (*ring), cpu_to_node (cpu));
+
+        if (ring == NULL) {
+            zq_log_free_rings ();
+            return ZQ_E_NO_MEMORY;
+        }
+
+        per_cpu (zq_log_rings, cpu) = ring;
+    }
+
+    /* Kernel functions return negative errnos, ZqError is positive. */
+    ret = kfifo_alloc (&zq_log_text, ZQ_LOG_TEXT_FIFO_SIZE, GFP_KERNEL);
+    if (ret != 0) {
+        zq_log_free_rings ();
+        return -ret;
+    }
+
+    zq_log_drain_thread = kthread_run (zq_log_drain_thread_function, NULL, "zq_log_drain");
+    if (IS_ERR (zq_log_drain_thread)) {
+        ret = -PTR_ERR (zq_log_drain_thread);
+
+        kfifo_free (&zq_log_text);
+        zq_log_free_rings ();
+        return ret;
+    }
+
+    /* debugfs is optional: logging works without it. */
+    root = ZQ_SYMBOL(ZqDebugfsGetRoot) ();
+    if (! IS_ERR_OR_NULL (root))
+        zq_log_debugfs_file = debugfs_create_file ("log", 0400, root, NULL, &zq_log_debugfs_fops);
+
+    /* Publish the rings to the writers. */
+    smp_store_release (&zq_log_is_initialized, ZQ_TRUE);
+
+    return ZQ_E_OK;
+}
+
+void ZQ_SYMBOL(ZqLogBufferExit) (void)
+{
+    if (! zq_log_is_initialized)
+        return;
+
+    WRITE_ONCE (zq_log_is_initialized, ZQ_FALSE);
+
+    /* Wait for writers that already saw the rings. */
+    synchronize_rcu ();
+
+    debugfs_remove (zq_log_debugfs_file);
+    ZQ_SYMBOL(ZqDebugfsPutRoot) ();
+    kthread_stop (zq_log_drain_thread);
+
+    /* Flush what is left to the kernel log: nobody would read it from debugfs now. */
+    zq_log_drain ();
+    {
+        char line[ZQ_LOG_LINE_SIZE];
+        unsigned int length;
+
+        while ((length = kfifo_out (&zq_log_text, line, sizeof (line) - 1)) != 0) {
+            line[length] = '\0';
+            printk (KERN_INFO "%s", line);
+        }
+    }
+
+    kfifo_free (&zq_log_text);
+    zq_log_free_rings ();
+}
+
+void ZQ_SYMBOL(ZqLogRecordWrite) (ZqLogLevel level,
+                                  const char *location,
+                                  const char *format,
+                                  uint64_t argument0,
+                                  uint64_t argument1,
+                                  uint64_t argument2,
+                                  uint64_t argument3)
+{
+    struct zq_log_ring *ring;
+    ZqLogRecord *record;
+    u64 index;
+
+    /* Disabling preemption is also an RCU read side section for ZqLogBufferExit. */
+    preempt_disable ();
+
+    if (unlikely (! smp_load_acquire (&zq_log_is_initialized))) {
+        ZqLogRecord synchronousRecord = {
+            .timestamp = local_clock (),
+            .location  = location,
+            .format    = format,
+            .arguments = {argument0, argument1, argument2, argument3},
+            .level     = level,
+            .cpu       = smp_processor_id (),
+        };
+        char line[ZQ_LOG_LINE_SIZE];
+
+        preempt_enable ();
+
+        zq_log_format_record (&synchronousRecord, line, sizeof (line));
+        printk (KERN_INFO "%s", line);
+        return;
+    }
+
+    ring = __this_cpu_read (zq_log_rings);
+    index = atomic64_inc_return (&ring->head) - 1;
+    record = &ring->records[index & ZQ_LOG_RING_MASK];
+
+    /* Mark the slot as being written before touching it. */
+    WRITE_ONCE (record->sequence, 0);
+    smp_wmb ();
+
+    record->timestamp    = local_clock ();
+    record->location     = location;
+    record->format       = format;
+    record->arguments[0] = argument0;
+    record->arguments[1] = argument1;
+    record->arguments[2] = argument2;
+    record->arguments[3] = argument3;
+    record->level        = level;
+    record->cpu          = smp_processor_id ();
+
+    /* Commit. */
+    smp_store_release (&record->sequence, index + 1);
+
+    preempt_enable ();
+}
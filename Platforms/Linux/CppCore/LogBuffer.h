@@ -0,0 +1,97 @@
+/**
+ * @file LogBuffer.h
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2017 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This file should be readed as a CPP file and a C file.
+ */
+#ifndef ZIQE_API_LOGBUFFER_H
+#define ZIQE_API_LOGBUFFER_H
+
+#include "CppCore/Macros.h"
+#include "CppCore/Types.h"
+#include "CppCore/Error.h"
+
+ZQ_BEGIN_C_DECL
+
+/**
+  @brief Log levels, ordered by severity.
+
+  These are plain defines (and not an enum) so ZQ_LOG_MINIMUM_LEVEL can
+  be compared by the preprocessor.
+ */
+#define ZQ_LOG_LEVEL_DEBUG      (0)
+#define ZQ_LOG_LEVEL_INFO       (1)
+#define ZQ_LOG_LEVEL_WARNING    (2)
+#define ZQ_LOG_LEVEL_ERROR      (3)
+
+typedef uint32_t ZqLogLevel;
+
+#define ZQ_LOG_RECORD_MAX_ARGUMENTS (4)
+
+/**
+  @brief A binary log record.
+
+  Records are written to a per-CPU ring without formatting, the drain
+  thread formats them later. Therefore, @a format, @a location and every
+  argument that used by a "%s" must have a static lifetime (string literals,
+  __PRETTY_FUNCTION__), and every other argument should be formatted as a
+  64 bit value ("%llu", "%llx", "%lld").
+ */
+typedef struct {
+    /* (The record's index in its ring)+1 when committed, 0 while being written. */
+    uint64_t sequence;
+    uint64_t timestamp;
+
+    const char *location;
+    const char *format;
+    uint64_t arguments[ZQ_LOG_RECORD_MAX_ARGUMENTS];
+
+    ZqLogLevel level;
+    uint32_t cpu;
+} ZqLogRecord;
+
+/**
+   @brief Allocate the per-CPU rings, start the drain thread and create
+          the debugfs file (ziqe/log).
+   @return ZQ_E_OK on success.
+
+   Until this function get called (and after ZqLogBufferExit), records are
+   formatted and printed synchronously.
+ */
+ZqError ZQ_SYMBOL(ZqLogBufferInit) (void);
+
+/**
+   @brief Drain the remaining records, stop the drain thread and free the rings.
+ */
+void ZQ_SYMBOL(ZqLogBufferExit) (void);
+
+/**
+   @brief Write a record to the current CPU's ring. Lock free, doesn't
+          sleep and can be called from any context.
+ */
+void ZQ_SYMBOL(ZqLogRecordWrite) (ZqLogLevel level,
+                                  const char *location,
+                                  const char *format,
+                                  uint64_t argument0,
+                                  uint64_t argument1,
+                                  uint64_t argument2,
+                                  uint64_t argument3);
+
+ZQ_END_C_DECL
+
+#endif /* ZIQE_API_LOGBUFFER_H */
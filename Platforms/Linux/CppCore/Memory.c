@@ -21,8 +21,15 @@
 #include <linux/kernel.h>
 #include <linux/memory.h>
 #include <linux/mm.h>
+#include <linux/mman.h>
 #include <linux/anon_inodes.h>
 #include <linux/file.h>
+#include <linux/highmem.h>
+#include <linux/hashtable.h>
+#include <linux/kref.h>
+#include <linux/mmu_notifier.h>
+#include <linux/spinlock.h>
+#include <linux/version.h>
 
 #include "asm/uaccess.h"
 
@@ -91,6 +98,29 @@ void ZQ_SYMBOL(ZqMmDeallocateUserMemory)(ZqUserAddress address, ZqSizeType lengt
     vm_munmap ((unsigned long)address, length);
 }
 
+/**
+   @brief Get the page of @a address if it can be mapped to user space.
+
+   vm_insert_page(s) refuses slab pages, so only vmalloc and page allocator
+   (e.g. __get_free_pages) memory is accepted, never kmalloc memory.
+ */
+static struct page *zq_insertable_kernel_page (const void *address)
+{
+    struct page *page;
+
+    if (is_vmalloc_addr (address))
+        return vmalloc_to_page (address);
+
+    if (! virt_addr_valid (address))
+        return NULL;
+
+    page = virt_to_page (address);
+    if (PageSlab (page))
+        return NULL;
+
+    return page;
+}
+
 static int kernel_memory_vma_fault(struct vm_area_struct *vma,
                                   struct vm_fault *vmf) {
     unsigned long byte_offset_in_kernel_memory;
@@ -104,7 +134,7 @@ static int kernel_memory_vma_fault(struct vm_area_struct *vma,
 
     /* Convert the offset in the kernel memory (=memory address)
        to a page. */
-    page = vmalloc_to_page((ZqKernelAddress*) byte_offset_in_kernel_memory);
+    page = zq_insertable_kernel_page((ZqKernelAddress) byte_offset_in_kernel_memory);
     if (! page)
         return VM_FAULT_SIGSEGV;
 
@@ -133,6 +163,39 @@ static struct file_operations kernel_memory_fops = {
     .mmap =	     kernel_memory_mmap,
 };
 
+/* A mapper's pages are installed explicitly, never on a fault. */
+static vm_fault_t zq_user_mapper_vma_fault (struct vm_fault *vmf)
+{
+    ZQ_UNUSED (vmf);
+    return VM_FAULT_SIGBUS;
+}
+
+static const struct vm_operations_struct zq_user_mapper_vm_ops = {
+    .fault = zq_user_mapper_vma_fault,
+};
+
+static int zq_user_mapper_mmap (struct file *file, struct vm_area_struct *vma)
+{
+    ZQ_UNUSED (file);
+
+    vma->vm_ops = &zq_user_mapper_vm_ops;
+
+    /* Let vm_insert_page(s) populate this vma without taking the mmap
+       lock for write. */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+    vm_flags_set (vma, VM_MIXEDMAP | VM_DONTEXPAND);
+#else
+    vma->vm_flags |= VM_MIXEDMAP | VM_DONTEXPAND;
+#endif
+
+    return 0;
+}
+
+static struct file_operations zq_user_mapper_fops = {
+    .owner = THIS_MODULE,
+    .mmap =  zq_user_mapper_mmap,
+};
+
 ZqError ZQ_SYMBOL(ZqMmMapKernelToUser)(ZqToUserMapContext *context) {
     // MAYBE: allocate it only once.
     struct file *flip = anon_inode_getfile("ZqKToU",
@@ -154,6 +217,175 @@ ZqError ZQ_SYMBOL(ZqMmMapKernelToUser)(ZqToUserMapContext *context) {
     return ZQ_E_OK;
 }
 
+void ZQ_SYMBOL(ZqMmUnmapKernelToUser)(ZqToUserMapContext *context) {
+    vm_munmap (context->destinationAddress, context->length);
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 8, 0)
+# define zq_mmap_read_lock(mm)   mmap_read_lock (mm)
+# define zq_mmap_read_unlock(mm) mmap_read_unlock (mm)
+#else
+# define zq_mmap_read_lock(mm)   down_read (&(mm)->mmap_sem)
+# define zq_mmap_read_unlock(mm) up_read (&(mm)->mmap_sem)
+#endif
+
+/* Pages per vm_insert_pages call (the page array is on the stack). */
+#define ZQ_INSERT_PAGES_BATCH (64)
+
+/**
+   @brief Insert the pages of @a kernel_addresses (or, if it is NULL, the
+          consecutive pages of @a kernel_start) to @a vma at @a address.
+
+   The destination pages must not be populated yet (-EBUSY otherwise).
+   @note Must be called with the mmap lock held (for read).
+ */
+static int zq_insert_kernel_pages (struct vm_area_struct *vma,
+                                   unsigned long address,
+                                   const ZqKernelAddress *kernel_addresses,
+                                   const char *kernel_start,
+                                   ZqSizeType count)
+{
+    struct page *pages[ZQ_INSERT_PAGES_BATCH];
+    ZqSizeType done = 0;
+
+    while (done < count) {
+        unsigned long batch = min_t (ZqSizeType, count - done, ZQ_INSERT_PAGES_BATCH);
+        unsigned long i;
+        int ret;
+
+        for (i = 0; i < batch; ++i) {
+            const void *kernel_address = kernel_addresses
+                    ? kernel_addresses[done + i]
+                    : kernel_start + (done + i) * PAGE_SIZE;
+
+            pages[i] = zq_insertable_kernel_page (kernel_address);
+            if (pages[i] == NULL)
+                return -EINVAL;
+        }
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
+        {
+            unsigned long remaining = batch;
+
+            ret = vm_insert_pages (vma, address + done * PAGE_SIZE, pages, &remaining);
+        }
+#else
+        ret = 0;
+        for (i = 0; i < batch && ret == 0; ++i)
+            ret = vm_insert_page (vma, address + (done + i) * PAGE_SIZE, pages[i]);
+#endif
+        if (ret != 0)
+            return ret;
+
+        done += batch;
+    }
+
+    return 0;
+}
+
+/**
+   @brief Find @a mapper's vma that contains [@a address, @a address + @a length).
+   @note Must be called with the mmap lock held.
+ */
+static struct vm_area_struct *zq_find_mapper_vma (ZqUserMapper *mapper,
+                                                  unsigned long address,
+                                                  ZqSizeType length)
+{
+    struct vm_area_struct *vma = find_vma (current->mm, address);
+
+    if (vma == NULL
+        || vma->vm_file != mapper->_pFile
+        || address < vma->vm_start
+        || address + length > vma->vm_end)
+        return NULL;
+
+    return vma;
+}
+
+ZqError ZQ_SYMBOL(ZqMmUserMapperInit) (ZqUserMapper *mapper) {
+    struct file *file = anon_inode_getfile ("ZqKToU",
+                                            &zq_user_mapper_fops,
+                                            NULL, /* no private data */
+                                            O_RDWR);
+
+    if (IS_ERR (file))
+        return -PTR_ERR (file);
+
+    mapper->_pFile = file;
+    return ZQ_E_OK;
+}
+
+void ZQ_SYMBOL(ZqMmUserMapperDestroy) (ZqUserMapper *mapper) {
+    /* Existing mappings hold their own reference to the file. */
+    fput (mapper->_pFile);
+    mapper->_pFile = NULL;
+}
+
+ZqError ZQ_SYMBOL(ZqMmUserMapperReserve) (ZqUserMapper *mapper, ZqToUserMapContext *context) {
+    unsigned long address = vm_mmap (mapper->_pFile,
+                                     0,
+                                     context->length,
+                                     context->protection,
+                                     MAP_SHARED,
+                                     0); /* offset */
+
+    if (IS_ERR_VALUE (address))
+        return -(long) address;
+
+    context->destinationAddress = address;
+    return ZQ_E_OK;
+}
+
+ZqError ZQ_SYMBOL(ZqMmUserMapperMap) (ZqUserMapper *mapper, ZqToUserMapContext *context) {
+    struct vm_area_struct *vma;
+    unsigned long address;
+    ZqError error;
+    int ret = -EFAULT;
+
+    error = ZQ_SYMBOL(ZqMmUserMapperReserve) (mapper, context);
+    if (error != ZQ_E_OK)
+        return error;
+
+    address = context->destinationAddress;
+
+    zq_mmap_read_lock (current->mm);
+
+    vma = zq_find_mapper_vma (mapper, address, context->length);
+    if (vma != NULL)
+        ret = zq_insert_kernel_pages (vma,
+                                      address,
+                                      NULL,
+                                      context->sourceAddress,
+                                      PAGE_ALIGN (context->length) >> PAGE_SHIFT);
+
+    zq_mmap_read_unlock (current->mm);
+
+    if (ret != 0) {
+        vm_munmap (address, context->length);
+        return -ret;
+    }
+
+    return ZQ_E_OK;
+}
+
+ZqError ZQ_SYMBOL(ZqMmUserMapperInstallPages) (ZqUserMapper *mapper,
+                                               ZqUserAddress destination,
+                                               const ZqKernelAddress *pages,
+                                               ZqSizeType count) {
+    struct vm_area_struct *vma;
+    int ret = -EFAULT;
+
+    zq_mmap_read_lock (current->mm);
+
+    vma = zq_find_mapper_vma (mapper, destination, count * PAGE_SIZE);
+    if (vma != NULL)
+        ret = zq_insert_kernel_pages (vma, destination, pages, NULL, count);
+
+    zq_mmap_read_unlock (current->mm);
+
+    return -ret;
+}
+
 void ZqMmLockUserMemoryRead()
 {
     down_read (&current->mm->mmap_sem);
@@ -244,3 +476,339 @@ void ZQ_SYMBOL(ZqMmUnmapUserToKernel) (ZqToKernelMapContext *context) {
 
     vunmap (context->destinationAddress);
 }
+
+/* The fast (lockless) pinning API, use FOLL_PIN where it exists since we
+   access the pages' content. */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 6, 0)
+# define zq_pin_user_pages_fast(start, count, write, pages) \
+    pin_user_pages_fast (start, count, (write) ? FOLL_WRITE : 0, pages)
+# define zq_unpin_user_page(page) unpin_user_page (page)
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(5, 2, 0)
+# define zq_pin_user_pages_fast(start, count, write, pages) \
+    get_user_pages_fast (start, count, (write) ? FOLL_WRITE : 0, pages)
+# define zq_unpin_user_page(page) put_page (page)
+#else
+# define zq_pin_user_pages_fast(start, count, write, pages) \
+    get_user_pages_fast (start, count, write, pages)
+# define zq_unpin_user_page(page) put_page (page)
+#endif
+
+static void zq_unpin_user_pages (struct page **pages, ZqSizeType pages_count)
+{
+    ZqSizeType i;
+
+    for (i = 0; i < pages_count; ++i)
+        zq_unpin_user_page (pages[i]);
+}
+
+ZqError ZQ_SYMBOL(ZqMmPinUserPages) (ZqPinnedUserPages *pages) {
+    int write = (pages->protection & PROT_WRITE) != 0;
+    ZqSizeType i = 0;
+
+    pages->pagesArray = kmalloc_array (pages->count, sizeof (struct page *), GFP_KERNEL);
+    if (pages->pagesArray == NULL)
+        return ZQ_E_NO_MEMORY;
+
+    while (i < pages->count) {
+        ZqUserAddress start = pages->addresses[i];
+        ZqSizeType run = 1;
+        int ret;
+
+        /* Pin a run of consecutive pages with a single call. */
+        while (i + run < pages->count
+               && run < INT_MAX
+               && pages->addresses[i + run] == start + run * PAGE_SIZE)
+            ++run;
+
+        ret = zq_pin_user_pages_fast (start, run, write, pages->pagesArray + i);
+        if (ret != run) {
+            /* Only part of these pages has been pinned, unpin everything. */
+            zq_unpin_user_pages (pages->pagesArray, i + (ret > 0 ? ret : 0));
+            kfree (pages->pagesArray);
+            pages->pagesArray = NULL;
+
+            return ZQ_E_MEM_FAULT;
+        }
+
+        i += run;
+    }
+
+    return ZQ_E_OK;
+}
+
+void ZQ_SYMBOL(ZqMmUnpinUserPages) (ZqPinnedUserPages *pages) {
+    zq_unpin_user_pages (pages->pagesArray, pages->count);
+
+    kfree (pages->pagesArray);
+    pages->pagesArray = NULL;
+}
+
+ZqKernelAddress ZQ_SYMBOL(ZqMmMapPinnedPage) (ZqPinnedUserPages *pages, ZqSizeType index) {
+    return kmap (pages->pagesArray[index]);
+}
+
+void ZQ_SYMBOL(ZqMmUnmapPinnedPage) (ZqPinnedUserPages *pages, ZqSizeType index) {
+    kunmap (pages->pagesArray[index]);
+}
+
+#define ZQ_PAGE_CACHE_HASH_BITS (10)
+
+/* The most pages a cache keeps pinned and mapped (16 MiB of 4K pages). */
+#define ZQ_PAGE_CACHE_MAX_PAGES (4096)
+
+struct zq_cached_page {
+    struct hlist_node node;
+
+    /* In the cache's LRU list, the least recently used first. */
+    struct list_head lru;
+
+    ZqUserAddress address;
+    struct page *page;
+    ZqKernelAddress kernel_address;
+    ZqBool writable;
+
+    /* One reference for the cache (while hashed) and one per user. */
+    struct kref refs;
+};
+
+struct zq_user_page_cache {
+    struct mmu_notifier notifier;
+    struct mm_struct *mm;
+
+    spinlock_t lock;
+    DECLARE_HASHTABLE (pages, ZQ_PAGE_CACHE_HASH_BITS);
+    struct list_head lru;
+    unsigned long pages_count;
+
+    /* Incremented on every invalidation, a page that has been pinned while
+       an invalidation happened might be stale and isn't cached. */
+    unsigned long invalidate_sequence;
+};
+
+static void zq_cached_page_release (struct kref *refs)
+{
+    struct zq_cached_page *entry = container_of (refs, struct zq_cached_page, refs);
+
+    kunmap (entry->page);
+    zq_unpin_user_page (entry->page);
+    kfree (entry);
+}
+
+/* Must be called with cache->lock held. */
+static void zq_user_page_cache_drop (struct zq_user_page_cache *cache,
+                                     struct zq_cached_page *entry)
+{
+    hash_del (&entry->node);
+    list_del (&entry->lru);
+    --cache->pages_count;
+
+    kref_put (&entry->refs, zq_cached_page_release);
+}
+
+/**
+   @brief Add @a entry as the most recently used page, and unpin the least
+          recently used one if the cache is full.
+   @note Must be called with cache->lock held.
+ */
+static void zq_user_page_cache_add (struct zq_user_page_cache *cache,
+                                    struct zq_cached_page *entry)
+{
+    kref_get (&entry->refs);
+    hash_add (cache->pages, &entry->node, entry->address);
+    list_add_tail (&entry->lru, &cache->lru);
+    ++cache->pages_count;
+
+    /* Pages that are still in use are released on their last put. */
+    if (cache->pages_count > ZQ_PAGE_CACHE_MAX_PAGES)
+        zq_user_page_cache_drop (cache,
+                                 list_first_entry (&cache->lru, struct zq_cached_page, lru));
+}
+
+static void zq_user_page_cache_invalidate (struct zq_user_page_cache *cache,
+                                           unsigned long start,
+                                           unsigned long end)
+{
+    struct zq_cached_page *entry;
+    struct hlist_node *temp;
+
+    spin_lock (&cache->lock);
+
+    ++cache->invalidate_sequence;
+
+    if (((end - start) >> PAGE_SHIFT) < HASH_SIZE (cache->pages)) {
+        /* A small range (the common munmap): look up every page. */
+        unsigned long address;
+
+        for (address = start & PAGE_MASK; address < end; address += PAGE_SIZE) {
+            hash_for_each_possible_safe (cache->pages, entry, temp, node, address) {
+                if (entry->address == address)
+                    zq_user_page_cache_drop (cache, entry);
+            }
+        }
+    } else {
+        int bucket;
+
+        hash_for_each_safe (cache->pages, bucket, temp, entry, node) {
+            if (entry->address >= start && entry->address < end)
+                zq_user_page_cache_drop (cache, entry);
+        }
+    }
+
+    spin_unlock (&cache->lock);
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 0, 0)
+static int zq_user_page_cache_invalidate_range_start (struct mmu_notifier *notifier,
+                                                      const struct mmu_notifier_range *range)
+{
+    zq_user_page_cache_invalidate (container_of (notifier, struct zq_user_page_cache, notifier),
+                                   range->start,
+                                   range->end);
+    return 0;
+}
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(4, 19, 0)
+static int zq_user_page_cache_invalidate_range_start (struct mmu_notifier *notifier,
+                                                      struct mm_struct *mm,
+                                                      unsigned long start,
+                                                      unsigned long end,
+                                                      bool blockable)
+{
+    zq_user_page_cache_invalidate (container_of (notifier, struct zq_user_page_cache, notifier),
+                                   start,
+                                   end);
+    return 0;
+}
+#else
+static void zq_user_page_cache_invalidate_range_start (struct mmu_notifier *notifier,
+                                                       struct mm_struct *mm,
+                                                       unsigned long start,
+                                                       unsigned long end)
+{
+    zq_user_page_cache_invalidate (container_of (notifier, struct zq_user_page_cache, notifier),
+                                   start,
+                                   end);
+}
+#endif
+
+static void zq_user_page_cache_release (struct mmu_notifier *notifier,
+                                        struct mm_struct *mm)
+{
+    zq_user_page_cache_invalidate (container_of (notifier, struct zq_user_page_cache, notifier),
+                                   0,
+                                   ULONG_MAX);
+}
+
+static const struct mmu_notifier_ops zq_user_page_cache_notifier_ops = {
+    .invalidate_range_start = zq_user_page_cache_invalidate_range_start,
+    .release                = zq_user_page_cache_release,
+};
+
+ZqError ZQ_SYMBOL(ZqMmUserPageCacheInit) (ZqUserPageCache *cache) {
+    struct zq_user_page_cache *private_cache = kzalloc (sizeof (*private_cache), GFP_KERNEL);
+    int ret;
+
+    if (private_cache == NULL)
+        return ZQ_E_NO_MEMORY;
+
+    spin_lock_init (&private_cache->lock);
+    hash_init (private_cache->pages);
+    INIT_LIST_HEAD (&private_cache->lru);
+
+    private_cache->mm = current->mm;
+    private_cache->notifier.ops = &zq_user_page_cache_notifier_ops;
+
+    ret = mmu_notifier_register (&private_cache->notifier, private_cache->mm);
+    if (ret != 0) {
+        kfree (private_cache);
+        return -ret;
+    }
+
+    cache->_pCache = private_cache;
+    return ZQ_E_OK;
+}
+
+void ZQ_SYMBOL(ZqMmUserPageCacheDestroy) (ZqUserPageCache *cache) {
+    struct zq_user_page_cache *private_cache = cache->_pCache;
+
+    mmu_notifier_unregister (&private_cache->notifier, private_cache->mm);
+
+    /* Drop the cache's references, pages that are still in use get
+       released on their last ZqMmUserPageCachePut. */
+    zq_user_page_cache_invalidate (private_cache, 0, ULONG_MAX);
+
+    kfree (private_cache);
+    cache->_pCache = NULL;
+}
+
+ZqError ZQ_SYMBOL(ZqMmUserPageCacheGet) (ZqUserPageCache *cache,
+                                         ZqUserAddress address,
+                                         ZqMemoryProtection protection,
+                                         ZqCachedUserPage *result) {
+    struct zq_user_page_cache *private_cache = cache->_pCache;
+    ZqBool write = (protection & PROT_WRITE) ? ZQ_TRUE : ZQ_FALSE;
+    struct zq_cached_page *entry;
+    struct hlist_node *temp;
+    unsigned long sequence;
+    struct page *page;
+
+    spin_lock (&private_cache->lock);
+
+    hash_for_each_possible (private_cache->pages, entry, node, address) {
+        if (entry->address == address && (entry->writable || ! write)) {
+            kref_get (&entry->refs);
+            list_move_tail (&entry->lru, &private_cache->lru);
+            spin_unlock (&private_cache->lock);
+
+            result->kernelAddress = entry->kernel_address;
+            result->_pEntry = entry;
+            return ZQ_E_OK;
+        }
+    }
+
+    sequence = private_cache->invalidate_sequence;
+
+    spin_unlock (&private_cache->lock);
+
+    /* A miss: pin and map the page outside the lock. */
+    if (zq_pin_user_pages_fast (address, 1, write, &page) != 1)
+        return ZQ_E_MEM_FAULT;
+
+    entry = kmalloc (sizeof (*entry), GFP_KERNEL);
+    if (entry == NULL) {
+        zq_unpin_user_page (page);
+        return ZQ_E_NO_MEMORY;
+    }
+
+    entry->address = address;
+    entry->page = page;
+    entry->kernel_address = kmap (page);
+    entry->writable = write;
+    kref_init (&entry->refs);
+
+    spin_lock (&private_cache->lock);
+
+    if (sequence == private_cache->invalidate_sequence) {
+        struct zq_cached_page *old_entry;
+
+        /* Replace a read only entry of the same page (or another miss'). */
+        hash_for_each_possible_safe (private_cache->pages, old_entry, temp, node, address) {
+            if (old_entry->address == address)
+                zq_user_page_cache_drop (private_cache, old_entry);
+        }
+
+        zq_user_page_cache_add (private_cache, entry);
+    }
+
+    spin_unlock (&private_cache->lock);
+
+    result->kernelAddress = entry->kernel_address;
+    result->_pEntry = entry;
+    return ZQ_E_OK;
+}
+
+void ZQ_SYMBOL(ZqMmUserPageCachePut) (ZqCachedUserPage *page) {
+    struct zq_cached_page *entry = page->_pEntry;
+
+    kref_put (&entry->refs, zq_cached_page_release);
+    page->_pEntry = NULL;
+}
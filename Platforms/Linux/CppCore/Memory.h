@@ -132,9 +132,118 @@ void ZQ_SYMBOL(ZqMmDeallocateUserMemory) (ZqUserAddress address, ZqSizeType leng
 ZqError ZQ_SYMBOL(ZqMmMapKernelToUser) (ZqToUserMapContext *context);
 void ZQ_SYMBOL(ZqMmUnmapKernelToUser) (ZqToUserMapContext *context);
 
+/**
+  @brief A persistent per-process mapping file for kernel to user mappings.
+
+  ZqMmMapKernelToUser creates a new file for every mapping and fills the
+  mapping a fault at a time, a mapper creates its file once and installs
+  all the pages of a mapping with a single call.
+ */
+typedef struct {
+    // _private
+    void *_pFile;
+} ZqUserMapper;
+
+ZqError ZQ_SYMBOL(ZqMmUserMapperInit) (ZqUserMapper *mapper);
+void ZQ_SYMBOL(ZqMmUserMapperDestroy) (ZqUserMapper *mapper);
+
+/**
+   @brief Reserve an empty mapping of @a context->length bytes in the current
+          process, for ZqMmUserMapperInstallPages. Touching a page that
+          hasn't been installed raises SIGBUS.
+ */
+ZqError ZQ_SYMBOL(ZqMmUserMapperReserve) (ZqUserMapper *mapper, ZqToUserMapContext *context);
+
+/**
+   @brief Map @a context->sourceAddress (page aligned, vmalloc or page
+          allocator memory, not kmalloc) to the current process and
+          populate the whole mapping.
+ */
+ZqError ZQ_SYMBOL(ZqMmUserMapperMap) (ZqUserMapper *mapper, ZqToUserMapContext *context);
+
+/**
+   @brief Install @a count kernel pages (e.g. received remote pages) at
+          @a destination, inside a mapping reserved by @a mapper, with a
+          single call.
+   @param pages  Page aligned kernel addresses (vmalloc or page allocator
+                 memory), a page each.
+   @return EBUSY if a page is already installed there.
+ */
+ZqError ZQ_SYMBOL(ZqMmUserMapperInstallPages) (ZqUserMapper *mapper,
+                                               ZqUserAddress destination,
+                                               const ZqKernelAddress *pages,
+                                               ZqSizeType count);
+
 ZqError ZQ_SYMBOL(ZqMmMapUserToKernel) (ZqToKernelMapContext *context);
 void ZQ_SYMBOL(ZqMmUnmapUserToKernel) (ZqToKernelMapContext *context);
 
+/**
+  @brief A batch of (possibly scattered) user pages of the current process,
+         pinned with a single call.
+ */
+typedef struct {
+    /* Page aligned user addresses, runs of consecutive pages are pinned
+       together so sorting them helps. */
+    const ZqUserAddress *addresses;
+    ZqSizeType count;
+    ZqMemoryProtection protection;
+
+    // _private
+    struct page **pagesArray;
+} ZqPinnedUserPages;
+
+/**
+   @brief Pin @a pages->count pages without taking the mm lock (get_user_pages_fast).
+   @return ZQ_E_OK if all of the pages have been pinned, otherwise no page
+           remains pinned.
+ */
+ZqError ZQ_SYMBOL(ZqMmPinUserPages) (ZqPinnedUserPages *pages);
+void ZQ_SYMBOL(ZqMmUnpinUserPages) (ZqPinnedUserPages *pages);
+
+/**
+   @brief Map a single pinned page to the kernel (kmap: no vmalloc area is
+          used and it is free without highmem).
+ */
+ZqKernelAddress ZQ_SYMBOL(ZqMmMapPinnedPage) (ZqPinnedUserPages *pages, ZqSizeType index);
+void ZQ_SYMBOL(ZqMmUnmapPinnedPage) (ZqPinnedUserPages *pages, ZqSizeType index);
+
+/**
+  @brief A cache of pinned and mapped user pages of a single process.
+
+  Entries are dropped when their user range gets invalidated (munmap,
+  migration, mm teardown) through an mmu notifier, and the least recently
+  used one is dropped when the cache is full. A page returned by
+  ZqMmUserPageCacheGet stays valid until the matching ZqMmUserPageCachePut,
+  even if it gets invalidated in the meantime.
+ */
+typedef struct {
+    // _private
+    void *_pCache;
+} ZqUserPageCache;
+
+typedef struct {
+    ZqKernelAddress kernelAddress;
+
+    // _private
+    void *_pEntry;
+} ZqCachedUserPage;
+
+/**
+   @brief Create a cache for the current process.
+ */
+ZqError ZQ_SYMBOL(ZqMmUserPageCacheInit) (ZqUserPageCache *cache);
+void ZQ_SYMBOL(ZqMmUserPageCacheDestroy) (ZqUserPageCache *cache);
+
+/**
+   @brief Get the user page at @a address (page aligned), pin and map it on
+          a miss.
+ */
+ZqError ZQ_SYMBOL(ZqMmUserPageCacheGet) (ZqUserPageCache *cache,
+                                         ZqUserAddress address,
+                                         ZqMemoryProtection protection,
+                                         ZqCachedUserPage *result);
+void ZQ_SYMBOL(ZqMmUserPageCachePut) (ZqCachedUserPage *page);
+
 /**
    @brief Lock the current process's memory for read.
  */
@@ -0,0 +1,127 @@
+/**
+ * @file Metrics.c
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2017 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Implementation of the Metrics.h ZiqeAPI for Linux.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/mutex.h>
+#include <linux/smp.h>
+#include <linux/vmalloc.h>
+#include <linux/sched/clock.h>
+
+#include "CppCore/Metrics.h"
+#include "CppCore/Debugfs.h"
+
+#define ZQ_METRICS_TEXT_SIZE (256 * 1024)
+
+struct zq_metrics_text {
+    size_t length;
+    char buffer[];
+};
+
+static ZqMetricsFormatter zq_metrics_formatter;
+
+/* The formatter uses static buffers: a single reader at a time. */
+static DEFINE_MUTEX(zq_metrics_format_lock);
+static struct dentry *zq_metrics_debugfs_file;
+
+uint32_t ZQ_SYMBOL(ZqMetricsCurrentCpu) (void)
+{
+    return raw_smp_processor_id ();
+}
+
+uint64_t ZQ_SYMBOL(ZqMetricsTimestamp) (void)
+{
+    return local_clock ();
+}
+
+/* Take a snapshot on open, so a reader gets consistent text across reads. */
+static int zq_metrics_debugfs_open (struct inode *inode, struct file *file)
+{
+    struct zq_metrics_text *text;
+
+    ZQ_UNUSED (inode);
+
+    text = vmalloc (sizeof (*text) + ZQ_METRICS_TEXT_SIZE);
+    if (text == NULL)
+        return -ENOMEM;
+
+    mutex_lock (&zq_metrics_format_lock);
+    text->length = zq_metrics_formatter (text->buffer, ZQ_METRICS_TEXT_SIZE);
+    mutex_unlock (&zq_metrics_format_lock);
+    file->private_data = text;
+
+    return 0;
+}
+
+static ssize_t zq_metrics_debugfs_read (struct file *file,
+                                        char __user *buffer,
+                                        size_t count,
+                                        loff_t *position)
+{
+    struct zq_metrics_text *text = file->private_data;
+
+    return simple_read_from_buffer (buffer, count, position, text->buffer, text->length);
+}
+
+static int zq_metrics_debugfs_release (struct inode *inode, struct file *file)
+{
+    ZQ_UNUSED (inode);
+
+    vfree (file->private_data);
+    return 0;
+}
+
+static const struct file_operations zq_metrics_debugfs_fops = {
+    .owner   = THIS_MODULE,
+    .open    = zq_metrics_debugfs_open,
+    .read    = zq_metrics_debugfs_read,
+    .release = zq_metrics_debugfs_release,
+    .llseek  = default_llseek,
+};
+
+ZqError ZQ_SYMBOL(ZqMetricsExportStart) (ZqMetricsFormatter formatter)
+{
+    struct dentry *root = ZQ_SYMBOL(ZqDebugfsGetRoot) ();
+
+    if (IS_ERR_OR_NULL (root)) {
+        ZQ_SYMBOL(ZqDebugfsPutRoot) ();
+        return ZQ_E_NOT_SUPPORTED;
+    }
+
+    zq_metrics_formatter = formatter;
+    zq_metrics_debugfs_file = debugfs_create_file ("metrics", 0400, root, NULL, &zq_metrics_debugfs_fops);
+
+    return ZQ_E_OK;
+}
+
+void ZQ_SYMBOL(ZqMetricsExportStop) (void)
+{
+    if (zq_metrics_debugfs_file == NULL)
+        return;
+
+    debugfs_remove (zq_metrics_debugfs_file);
+    zq_metrics_debugfs_file = NULL;
+
+    ZQ_SYMBOL(ZqDebugfsPutRoot) ();
+}
@@ -0,0 +1,59 @@
+/**
+ * @file Metrics.h
+ * @author Shmuel Hazan (shmuelhazan0@gmail.com)
+ *
+ * Ziqe: copyright (C) 2017 Shmuel Hazan
+ *
+ * Ziqe is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Ziqe is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This file should be readed as a CPP file and a C file.
+ */
+#ifndef ZIQE_API_METRICS_H
+#define ZIQE_API_METRICS_H
+
+#include "CppCore/Macros.h"
+#include "CppCore/Types.h"
+#include "CppCore/Error.h"
+
+ZQ_BEGIN_C_DECL
+
+/**
+   @brief Format all the metrics as text into @a buffer.
+   @return The number of bytes written.
+
+   Not reentrant: the platform calls it from a single thread at a time.
+ */
+typedef ZqSizeType (*ZqMetricsFormatter) (char *buffer, ZqSizeType size);
+
+/**
+   @brief The current CPU. Might be stale right after the call (the caller
+          isn't pinned), use it only to spread the writes.
+ */
+uint32_t ZQ_SYMBOL(ZqMetricsCurrentCpu) (void);
+
+/**
+   @brief A monotonic timestamp in nanoseconds.
+ */
+uint64_t ZQ_SYMBOL(ZqMetricsTimestamp) (void);
+
+/**
+   @brief Create the debugfs file ziqe/metrics, @a formatter is called on every open.
+ */
+ZqError ZQ_SYMBOL(ZqMetricsExportStart) (ZqMetricsFormatter formatter);
+
+void ZQ_SYMBOL(ZqMetricsExportStop) (void);
+
+ZQ_END_C_DECL
+
+#endif /* ZIQE_API_METRICS_H */
@@ -25,6 +25,13 @@
 
 #include <linux/kernel.h>
 #include <linux/kprobes.h>
+#include <linux/tracepoint.h>
+#include <linux/version.h>
+#include <linux/vmalloc.h>
+#include <linux/bitops.h>
+#include <linux/threads.h>
+#include <linux/sched.h>
+#include <linux/string.h>
 
 #include <linux/thread_info.h>
 
@@ -40,6 +47,10 @@
 #define SYSCALL_MAX_ARGS                (5)
 #define SYSCALL_INVOKE_REGS(regs)       (syscall_function(regs),(ZqRegisterType) regs->ax)
 
+/* Setting the syscall number to -1 makes the entry code skip the syscall
+ * and return regs->ax as is (the same way seccomp and ptrace do it). */
+#define SYSCALL_SKIP(regs)              (regs->orig_ax = -1)
+
 typedef void(*syscall_function_t)(struct pt_regs *regs);
 
 /* #define SYSCALL_SYMBOL  "entry_SYSCALL64_slow_path" */
@@ -50,14 +61,94 @@ typedef void(*syscall_function_t)(struct pt_regs *regs);
 #define SYSCALL_END_OFFSET 1
 #endif
 
-static ZqBool init_system_calls_hook(void);
+#define SYSCALL_TRACEPOINT_NAME "sys_enter"
+
+/*
+ * Two interception backends:
+ *  - The sys_enter tracepoint: a direct call from the syscall entry, and
+ *    the entry code re-reads the syscall number after it (so we can skip
+ *    the syscall). This is the default.
+ *  - A kprobe on SYSCALL_SYMBOL, used only when the tracepoint isn't
+ *    available: every hit is a breakpoint trap and the probe can't be
+ *    optimized since we change regs->ip.
+ */
+enum syscall_hook_backend {
+    SYSCALL_HOOK_BACKEND_NONE,
+    SYSCALL_HOOK_BACKEND_TRACEPOINT,
+    SYSCALL_HOOK_BACKEND_KPROBE,
+};
 
-ZqBool is_syscall_hook_initialized = ZQ_FALSE;
+static enum syscall_hook_backend syscall_hook_backend = SYSCALL_HOOK_BACKEND_NONE;
 ZqSystemCallHookType syscall_hook  = NULL;
 
 syscall_function_t syscall_function;
 
+/*
+ * The threads (by pid) we intercept. The hooks are called for every
+ * syscall on the system, so the common case (a thread that isn't ours)
+ * has to exit after a single load: the count is checked first so the
+ * bitmap isn't touched at all while no thread is hooked.
+ */
+static unsigned long *hooked_threads;
+static atomic_t hooked_threads_count = ATOMIC_INIT (0);
+
+static struct tracepoint *sys_enter_tracepoint;
+
+static __always_inline ZqBool is_current_thread_hooked (void)
+{
+    if (likely (atomic_read (&hooked_threads_count) == 0))
+        return ZQ_FALSE;
+
+    return test_bit (current->pid, hooked_threads) ? ZQ_TRUE : ZQ_FALSE;
+}
+
+static void syscall_sys_enter_probe (void *data, struct pt_regs *regs, long id)
+{
+    ZQ_UNUSED (data);
+    ZQ_UNUSED (id);
+
+    if (likely (! is_current_thread_hooked ()))
+        return;
+
+    // Call our hook.
+    if (syscall_hook ((ZqThreadRegisters *) regs, &SYSCALL_RESULT_REGS (regs)) == ZQ_FALSE)
+        return;
+
+    // Skip the kernel's actual syscall, the result is already in place.
+    SYSCALL_SKIP (regs);
+}
+
+static void find_sys_enter_tracepoint (struct tracepoint *tracepoint, void *private)
+{
+    if (strcmp (tracepoint->name, SYSCALL_TRACEPOINT_NAME) == 0)
+        *(struct tracepoint **) private = tracepoint;
+}
+
+static ZqBool init_tracepoint_hook (void)
+{
+    // Syscall tracepoints aren't exported to modules, look it up.
+    for_each_kernel_tracepoint (find_sys_enter_tracepoint, &sys_enter_tracepoint);
+    if (sys_enter_tracepoint == NULL)
+        return ZQ_FALSE;
+
+    if (tracepoint_probe_register (sys_enter_tracepoint, syscall_sys_enter_probe, NULL) != 0)
+        return ZQ_FALSE;
+
+    return ZQ_TRUE;
+}
+
+static void uninit_tracepoint_hook (void)
+{
+    tracepoint_probe_unregister (sys_enter_tracepoint, syscall_sys_enter_probe, NULL);
+
+    // Wait for probes that are still running.
+    tracepoint_synchronize_unregister ();
+}
+
 static int syscall_kprobe_pre_handler (struct kprobe *kprobe, struct pt_regs *regs) {
+    if (likely (! is_current_thread_hooked ()))
+        return 0;
+
     // Call our hook.
     if (syscall_hook ((ZqThreadRegisters *) regs, &SYSCALL_RESULT_REGS (regs)) == ZQ_FALSE)
     {
@@ -72,10 +163,16 @@ static int syscall_kprobe_pre_handler (struct kprobe *kprobe, struct pt_regs *re
     return 1;
 }
 
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 18, 0)
 static int kprobe_empty_break_handler (struct kprobe *p, struct pt_regs *a)
 {
     return 0;
 }
+#else
+static void kprobe_empty_post_handler (struct kprobe *p, struct pt_regs *a, unsigned long flags)
+{
+}
+#endif
 
 struct kprobe syscall_kprobe = {
     .symbol_name = SYSCALL_SYMBOL,
@@ -84,23 +181,86 @@ struct kprobe syscall_kprobe = {
 
     /* Force the kernel not to use optimization so we can
      * change the flow with regs->ip in the pre_handler.
-     * (See Documentation/kprobes.txt:266)
+     * (See Documentation/kprobes.txt:266). break_handler is gone since
+     * 4.18, a post_handler prevents the optimization there.
      */
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 18, 0)
     .break_handler = kprobe_empty_break_handler
+#else
+    .post_handler = kprobe_empty_post_handler
+#endif
 };
 
-static ZqBool init_system_calls_hook () {
+static ZqBool init_system_calls_hook (void) {
+    if (init_tracepoint_hook () == ZQ_TRUE) {
+        syscall_hook_backend = SYSCALL_HOOK_BACKEND_TRACEPOINT;
+        return ZQ_TRUE;
+    }
+
+    printk (KERN_WARNING "ziqe: no %s tracepoint, falling back to a kprobe on %s\n",
+            SYSCALL_TRACEPOINT_NAME, SYSCALL_SYMBOL);
+
     if (register_kprobe (&syscall_kprobe) < 0)
         return ZQ_FALSE;
 
+    syscall_hook_backend = SYSCALL_HOOK_BACKEND_KPROBE;
     return ZQ_TRUE;
 }
 
-void ZqInitSystemCallsHook(ZqSystemCallHookType hook) {
+ZqBool ZqInitSystemCallsHook(ZqSystemCallHookType hook) {
     syscall_hook = hook;
 
-    if (is_syscall_hook_initialized == ZQ_FALSE)
-        init_system_calls_hook ();
+    if (syscall_hook_backend != SYSCALL_HOOK_BACKEND_NONE)
+        return ZQ_TRUE;
+
+    hooked_threads = vzalloc (BITS_TO_LONGS (PID_MAX_LIMIT) * sizeof (unsigned long));
+    if (hooked_threads == NULL)
+        return ZQ_FALSE;
+
+    if (init_system_calls_hook () == ZQ_FALSE) {
+        vfree (hooked_threads);
+        hooked_threads = NULL;
+        return ZQ_FALSE;
+    }
+
+    return ZQ_TRUE;
+}
+
+void ZqUninitSystemCallsHook(void) {
+    switch (syscall_hook_backend) {
+    case SYSCALL_HOOK_BACKEND_TRACEPOINT:
+        uninit_tracepoint_hook ();
+        break;
+    case SYSCALL_HOOK_BACKEND_KPROBE:
+        unregister_kprobe (&syscall_kprobe);
+        break;
+    case SYSCALL_HOOK_BACKEND_NONE:
+        return;
+    }
+
+    syscall_hook_backend = SYSCALL_HOOK_BACKEND_NONE;
+
+    atomic_set (&hooked_threads_count, 0);
+    vfree (hooked_threads);
+    hooked_threads = NULL;
+}
+
+ZqError ZqSystemCallsHookAddThread(ZqThreadID thread) {
+    if (hooked_threads == NULL || thread >= PID_MAX_LIMIT)
+        return ZQ_E_INVALID_ARG;
+
+    if (! test_and_set_bit (thread, hooked_threads))
+        atomic_inc (&hooked_threads_count);
+
+    return ZQ_E_OK;
+}
+
+void ZqSystemCallsHookRemoveThread(ZqThreadID thread) {
+    if (hooked_threads == NULL || thread >= PID_MAX_LIMIT)
+        return;
+
+    if (test_and_clear_bit (thread, hooked_threads))
+        atomic_dec (&hooked_threads_count);
 }
 
 ZqRegisterType ZqCallSyscall(ZqThreadRegisters *regs)
@@ -23,6 +23,8 @@
 #define ZIQE_API_SYSTEMCALLS_H
 
 #include "Types.h"
+#include "Process.h"
+#include "Error.h"
 #include "CppCore/Macros.h"
 
 typedef ZqBool (* ZqSystemCallHookType) (ZqThreadRegisters *regs,
@@ -31,13 +33,24 @@ typedef ZqBool (* ZqSystemCallHookType) (ZqThreadRegisters *regs,
 ZQ_BEGIN_C_DECL
 
 /**
- * @brief ZiqeInitSystemCallsHook  Init a hook that will be called every time
- *                                 a thread with the flag WORKER is set.
- * @param hook
+ * @brief ZiqeInitSystemCallsHook  Init a hook that will be called on every
+ *                                 system call of a thread that was added with
+ *                                 ZqSystemCallsHookAddThread.
+ * @param hook  Returns ZQ_TRUE to skip the real system call (and return
+ *              @a result instead). Called from the syscall entry, must not
+ *              sleep.
+ * @return Whether the hook has been installed.
  */
-void ZqInitSystemCallsHook(ZqSystemCallHookType hook);
+ZqBool ZqInitSystemCallsHook(ZqSystemCallHookType hook);
 void ZqUninitSystemCallsHook(void);
 
+/**
+ * @brief ZqSystemCallsHookAddThread  Start intercepting @a thread's system calls.
+ * @param thread  The thread's kernel pid.
+ */
+ZqError ZqSystemCallsHookAddThread(ZqThreadID thread);
+void ZqSystemCallsHookRemoveThread(ZqThreadID thread);
+
 /**
  * @brief ZiqeCallSyscall  Blocking!!
  * @param id
@@ -26,6 +26,7 @@
 #include "Base/Optional.hpp"
 
 #include "CppCore/Memory.h"
+#include "CppCore/DirtyTracking.h"
 
 ZQ_BEGIN_NAMESPACE
 namespace OS {
@@ -182,8 +183,233 @@ private:
 
     Base::Optional<ZqToUserMapContext> mMaybeUserMapContext;
 };
+
+/**
+   @brief Kernel to user mappings of the current process through a single
+          mapping file, see ZqUserMapper.
+ */
+struct UserMapper {
+    static Base::Expected<UserMapper, Error> Create ()
+    {
+        ZqUserMapper mapper;
+
+        auto result = ZQ_SYMBOL(ZqMmUserMapperInit) (&mapper);
+
+        if (result == ZQ_E_OK) {
+            return {mapper};
+        } else {
+            return {Base::Error (Base::move(result))};
+        }
+    }
+
+    ZQ_ALLOW_MOVE (UserMapper)
+    ZQ_DISALLOW_COPY (UserMapper)
+
+    ~UserMapper() {
+        if (mMaybeMapper)
+            ZQ_SYMBOL(ZqMmUserMapperDestroy) (&mMaybeMapper.get ());
+    }
+
+    /**
+       @brief Reserve @a length bytes for installPages.
+       @return The user address of the mapping.
+     */
+    Base::Expected<ZqUserAddress, Error> reserve (SizeType length, ZqMemoryProtection protection)
+    {
+        ZqToUserMapContext context;
+        context.sourceAddress = nullptr;
+        context.length = length;
+        context.protection = protection;
+
+        auto result = ZQ_SYMBOL(ZqMmUserMapperReserve) (&mMaybeMapper.get (), &context);
+
+        if (result == ZQ_E_OK) {
+            return {context.destinationAddress};
+        } else {
+            return {Base::Error (Base::move(result))};
+        }
+    }
+
+    /**
+       @brief Map and populate @a length bytes of @a kernelAddress.
+       @return The user address of the mapping.
+     */
+    Base::Expected<ZqUserAddress, Error> map (ZqKernelAddress kernelAddress,
+                                             SizeType length,
+                                             ZqMemoryProtection protection)
+    {
+        ZqToUserMapContext context;
+        context.sourceAddress = kernelAddress;
+        context.length = length;
+        context.protection = protection;
+
+        auto result = ZQ_SYMBOL(ZqMmUserMapperMap) (&mMaybeMapper.get (), &context);
+
+        if (result == ZQ_E_OK) {
+            return {context.destinationAddress};
+        } else {
+            return {Base::Error (Base::move(result))};
+        }
+    }
+
+    /**
+       @brief Install @a count pages at @a userAddress (inside a reserved
+              mapping of this mapper, where they aren't installed yet).
+     */
+    Error installPages (ZqUserAddress userAddress, const ZqKernelAddress *pages, SizeType count)
+    {
+        return ZQ_SYMBOL(ZqMmUserMapperInstallPages) (&mMaybeMapper.get (), userAddress, pages, count);
+    }
+
+private:
+    ZQ_ALLOW_EXPECTED();
+
+    UserMapper(const ZqUserMapper &mapper)
+        : mMaybeMapper{mapper}
+    {
+    }
+
+    Base::Optional<ZqUserMapper> mMaybeMapper;
+};
+
+/**
+   @brief Pinned and mapped pages of the current process, see ZqUserPageCache.
+ */
+struct UserPageCache {
+    struct Page {
+        ZQ_ALLOW_MOVE (Page)
+        ZQ_DISALLOW_COPY (Page)
+
+        ~Page() {
+            if (mMaybePage)
+                ZQ_SYMBOL(ZqMmUserPageCachePut) (&mMaybePage.get ());
+        }
+
+        ZqKernelAddress getKernelAddress () const
+        {
+            return mMaybePage->kernelAddress;
+        }
+
+    private:
+        friend struct UserPageCache;
+        ZQ_ALLOW_EXPECTED();
+
+        Page(const ZqCachedUserPage &page)
+            : mMaybePage{page}
+        {
+        }
+
+        Base::Optional<ZqCachedUserPage> mMaybePage;
+    };
+
+    static Base::Expected<UserPageCache, Error> Create ()
+    {
+        ZqUserPageCache cache;
+
+        auto result = ZQ_SYMBOL(ZqMmUserPageCacheInit) (&cache);
+
+        if (result == ZQ_E_OK) {
+            return {cache};
+        } else {
+            return {Base::Error (Base::move(result))};
+        }
+    }
+
+    ZQ_ALLOW_MOVE (UserPageCache)
+    ZQ_DISALLOW_COPY (UserPageCache)
+
+    ~UserPageCache() {
+        if (mMaybeCache)
+            ZQ_SYMBOL(ZqMmUserPageCacheDestroy) (&mMaybeCache.get ());
+    }
+
+    /**
+       @brief Get the page at @a userAddress (page aligned), pinning and
+              mapping it only on a miss.
+     */
+    Base::Expected<Page, Error> getPage (ZqUserAddress userAddress,
+                                         ZqMemoryProtection protection)
+    {
+        ZqCachedUserPage page;
+
+        auto result = ZQ_SYMBOL(ZqMmUserPageCacheGet) (&mMaybeCache.get (),
+                                                       userAddress,
+                                                       protection,
+                                                       &page);
+
+        if (result == ZQ_E_OK) {
+            return {Page{page}};
+        } else {
+            return {Base::Error (Base::move(result))};
+        }
+    }
+
+private:
+    ZQ_ALLOW_EXPECTED();
+
+    UserPageCache(const ZqUserPageCache &cache)
+        : mMaybeCache{cache}
+    {
+    }
+
+    Base::Optional<ZqUserPageCache> mMaybeCache;
+};
 } // namespace Map
 
+/**
+   @brief Write tracking of the current process, see ZqDirtyTracker.
+ */
+struct DirtyTracker {
+    static Base::Expected<DirtyTracker, Error> Create ()
+    {
+        ZqDirtyTracker tracker;
+
+        auto result = ZQ_SYMBOL(ZqDirtyTrackerInit) (&tracker);
+
+        if (result == ZQ_E_OK) {
+            return {tracker};
+        } else {
+            return {Base::Error (Base::move(result))};
+        }
+    }
+
+    ZQ_ALLOW_MOVE (DirtyTracker)
+    ZQ_DISALLOW_COPY (DirtyTracker)
+
+    ~DirtyTracker() {
+        if (mMaybeTracker)
+            ZQ_SYMBOL(ZqDirtyTrackerDestroy) (&mMaybeTracker.get ());
+    }
+
+    /**
+       @brief Start a new epoch, call @a function with the address of every
+              page written in the previous one.
+     */
+    template<class Function>
+    Error collect (Function &function)
+    {
+        return ZQ_SYMBOL(ZqDirtyTrackerCollect) (&mMaybeTracker.get (),
+                                                 &DirtyTracker::callFunction<Function>,
+                                                 &function);
+    }
+
+private:
+    ZQ_ALLOW_EXPECTED();
+
+    DirtyTracker(const ZqDirtyTracker &tracker)
+        : mMaybeTracker{tracker}
+    {
+    }
+
+    template<class Function>
+    static void callFunction (void *context, ZqUserAddress address)
+    {
+        (*static_cast<Function *>(context)) (address);
+    }
+
+    Base::Optional<ZqDirtyTracker> mMaybeTracker;
+};
+
 }
 ZQ_END_NAMESPACE
 
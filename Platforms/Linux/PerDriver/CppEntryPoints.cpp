@@ -20,6 +20,7 @@
 
 #include "Base/Macros.hpp"
 #include "Base/SharedPointer.hpp"
+#include "Base/Metrics.hpp"
 
 #include "PerDriver/EntryPoints.hpp"
 
@@ -37,6 +38,9 @@ int ZQ_PER_DRIVER_UNIQUE_SYMBOL(CppForwardOnLoad) (void *ptr) {
     auto driverContext = new OS::DriverContext(Base::move(maybeDriverContext.get ()));
     *static_cast<OS::DriverContext**>(ptr) = driverContext;
 
+    // Metrics are optional: don't fail the load without debugfs.
+    Base::Metrics::StartExport ();
+
     ZQ_PER_DRIVER_UNIQUE_SYMBOL (ZqOnLoad) (driverContext);
 
     return 0;
@@ -50,6 +54,8 @@ void ZQ_PER_DRIVER_UNIQUE_SYMBOL(CppForwardOnUnload) (void *ptr) {
 
     ZQ_PER_DRIVER_UNIQUE_SYMBOL(ZqOnUnload) (pointer);
 
+    Base::Metrics::StopExport ();
+
     //pointer->setUserData ({});
     delete pointer;
 }
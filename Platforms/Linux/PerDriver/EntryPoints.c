@@ -22,6 +22,7 @@
 #include <linux/module.h>
 
 #include "PerDriver/Macros.h"
+#include "CppCore/LogBuffer.h"
 
 int ZQ_PER_DRIVER_UNIQUE_SYMBOL(CppForwardOnLoad) (void *ptr);
 int ZQ_PER_DRIVER_UNIQUE_SYMBOL(CppForwardOnUnload) (void *ptr);
@@ -34,13 +35,22 @@ static void *g_private_data_ptr;
 
 static int __init linux_init(void)
 {
+        ZqError error = ZQ_SYMBOL(ZqLogBufferInit) ();
+
+        /* ZqError is a positive errno, module_init expects a negative one. */
+        if (error != ZQ_E_OK)
+                return -error;
+
         ZQ_PER_DRIVER_UNIQUE_SYMBOL (CppForwardOnLoad) (&g_private_data_ptr);
+        return 0;
 }
 
 
 static void __exit linux_exit(void)
 {
         ZQ_PER_DRIVER_UNIQUE_SYMBOL(CppForwardOnUnload) (&g_private_data_ptr);
+
+        ZQ_SYMBOL(ZqLogBufferExit) ();
 }
 
 module_init(linux_init);